@@ -0,0 +1,65 @@
+#ifndef CONTAINER_H
+#define CONTAINER_H
+
+#include<stdio.h>
+#include<stdint.h>
+#include"yuv.h"
+#include"block.h"
+#include"quantization/quantization.h"
+#include"entropy/entropy.h"
+
+/* 單一檔案的container (所有數字都是big-endian)
+ *   global header : magic "VCBS" | version (1) | width (2) | height (2) | format (1) |
+ *                   block size/width/height (3) | quant type (1) | compression type (1) | entropy type (1)
+ *   frame payloads: 每張frame的bitstream (和frame_%04d_bs.bin的內容相同) 依序接起來
+ *   frame index   : 每張frame的offset (8) 和size (4)
+ *   trailer       : index offset (8) | frames個數 (4) | magic "VCBI"
+ * 讀取時先讀檔案最後的trailer，再讀index，任何一張frame都可以直接seek
+ */
+#define CONTAINER_MAGIC         "VCBS"
+#define CONTAINER_INDEX_MAGIC   "VCBI"
+#define CONTAINER_VERSION       1
+#define CONTAINER_HEADER_SIZE   16
+#define CONTAINER_INDEX_ENTRY   12
+#define CONTAINER_TRAILER_SIZE  16
+
+/* stdin/stdout使用的串流格式 (不能seek，所以沒有frame index)
+ *   stream header : magic "VCST" | 和global header相同的version/info (12) | frame rate分子 (4) | 分母 (4)
+ *   frames        : 每張frame的size (4) 後面接著bitstream，直到串流結束
+ */
+#define CONTAINER_STREAM_MAGIC        "VCST"
+#define CONTAINER_STREAM_HEADER_SIZE  24
+
+/* global header記錄的資訊，所有frames共用 */
+typedef struct {
+    int width;
+    int height;
+    YUVFormat format;
+    BlockInfo block_info;
+    QuantType quant_type;
+    CompressionType compression_type;
+    EntropyType entropy_type;
+}ContainerInfo;
+
+typedef struct {
+    FILE* fp;
+    int writing;                 // 1: container_create()建立 (寫入) 0: container_open()開啟 (讀取)
+    ContainerInfo info;
+    uint64_t* frame_offsets;     // 每張frame的payload在檔案裡的offset
+    uint32_t* frame_sizes;       // 每張frame的payload bytes
+    int frames_num;
+    int frames_capacity;
+    uint64_t write_offset;       // 寫入時，下一張frame的offset
+}VideoContainer;
+
+VideoContainer* container_create(const char* path, const ContainerInfo* info);
+int container_append_frame(VideoContainer* container, const uint8_t* data, size_t size);
+VideoContainer* container_open(const char* path);
+uint8_t* container_read_frame(VideoContainer* container, int frame_idx, size_t* size);
+int container_close(VideoContainer* container);
+int container_write_stream_header(FILE* fp, const ContainerInfo* info, int fps_num, int fps_den);
+int container_read_stream_header(FILE* fp, ContainerInfo* info, int* fps_num, int* fps_den);
+int container_write_stream_frame(FILE* fp, const uint8_t* data, size_t size);
+int container_read_stream_frame(FILE* fp, uint8_t** buffer, size_t* capacity, size_t* size);
+
+#endif /* CONTAINER_H */
@@ -0,0 +1,18 @@
+#ifndef CPU_H
+#define CPU_H
+
+/* SIMD指令集等級，SIMD_SCALAR之後數字越大代表支援的指令越多 */
+typedef enum {
+    SIMD_AUTO = 0,    // 依照CPUID自動選擇 (設定檔沒有指定時的預設值)
+    SIMD_SCALAR,      // 不使用SIMD
+    SIMD_SSE41,       // SSE4.1 (128-bit)
+    SIMD_AVX2,        // AVX2 (256-bit)
+    SIMD_AVX512       // AVX-512F + AVX-512BW (512-bit)
+}SimdLevel;
+
+SimdLevel simd_detect_level(void);
+SimdLevel simd_resolve_level(SimdLevel config_level);
+int simd_parse_level(const char* name, SimdLevel* level);
+const char* simd_level_name(SimdLevel level);
+
+#endif // CPU_H
@@ -17,13 +17,46 @@ extern const uint8_t jpeg_ac_chrominance_huffman_bits_table[];
 extern const uint8_t jpeg_ac_chrominance_huffman_hufval_table[];
 
 
+/* decode時一次peek的bits個數，codeword長度不超過它的symbol查一次表就能得到 */
+#define HUFFMAN_LOOKAHEAD_BITS  9
+#define HUFFMAN_MAX_CODE_LENGTH 16
+
+/* lookahead table的一個entry
+ *   code_length = 0  : codeword比HUFFMAN_LOOKAHEAD_BITS長，需要用maxcode/valoffset解碼
+ *   total_length > 0 : codeword + amplitude都在peek的bits裡，amplitude已經解好
+ */
+typedef struct {
+  uint8_t symbol;
+  uint8_t code_length;
+  uint8_t total_length;
+  uint16_t amplitude;
+}Huffman_Lookahead;
+
 typedef struct {
   // Huffman coding的symbol最多就是256種
   uint16_t codeword[256];
   uint8_t code_length[256];
+
+  /* decode用的tables (和JPEG規範的Annex F.2.2.3相同) */
+  int32_t maxcode[HUFFMAN_MAX_CODE_LENGTH + 2];   // 長度l的最大codeword，-1表示沒有長度l的codeword
+  int32_t valoffset[HUFFMAN_MAX_CODE_LENGTH + 1]; // 長度l的codeword加上valoffset[l]就是huffval的index
+  uint8_t huffval[256];
+  Huffman_Lookahead lookahead[1 << HUFFMAN_LOOKAHEAD_BITS];
 }Huffman_Table;
 
+/* 以JPEG DHT的方式描述一個Huffman table (header裡寫入的內容) */
+typedef struct {
+  uint8_t bits[HUFFMAN_MAX_CODE_LENGTH];  // 長度1~16的codeword各有幾個symbols
+  uint8_t hufval[256];                    // 依照codeword順序排列的symbols
+}Huffman_Spec;
+
 void huffman_create_lookup_table(const uint8_t* bits_table, const uint8_t* hufval_table, Huffman_Table* huffman_table);
+void huffman_count_dc_symbols(const JpegDcEncoded* dc_encoded, int num_blocks, uint32_t* freq);
+void huffman_count_ac_symbols(const JpegAcEncoded* ac_encoded, int num_blocks, uint32_t* freq);
+void huffman_generate_optimal_spec(const uint32_t* freq, Huffman_Spec* spec);
+int huffman_spec_symbols_num(const Huffman_Spec* spec);
+int huffman_spec_is_valid(const Huffman_Spec* spec, int max_symbol);
+uint64_t huffman_estimate_bits(const uint32_t* freq, const Huffman_Table* huffman_table);
 int huffman_encode_dc(BitWriter* bit_writer, JpegDcEncoded* dc_encoded, Huffman_Table* huffman_table);
 int huffman_decode_dc(BitReader* bit_reader, JpegDcEncoded* dc_encoded, Huffman_Table* huffman_table);
 int huffman_encode_ac(BitWriter* bit_writer, JpegAcEncoded* ac_encoded, Huffman_Table* huffman_table);
@@ -1,6 +1,7 @@
 #ifndef ENTROPY_H
 #define ENTROPY_H
 
+#include<stdio.h>
 #include"yuv.h"
 #include"quantization/quantization.h"
 
@@ -12,9 +13,37 @@ typedef enum {
     HUFFMAN = 0
 }EntropyType;
 
-void entropy_initialization(EntropyType entropy_type);
+/* entropy coded data的排列方式 */
+typedef enum {
+    SCAN_INTERLEAVED = 0,   // 一個scan，以MCU為單位交錯寫入Y/U/V blocks (預設)
+    SCAN_PER_COMPONENT      // Y/U/V各自一個scan，header記錄每個scan的offset，三個components可以平行編碼/解碼
+}ScanMode;
+
+/* restart interval最大值 (header裡使用2 bytes) */
+#define ENTROPY_RESTART_INTERVAL_MAX  65535
+
+/* entropy coding的設定 */
+typedef struct {
+    int huffman_optimize;   // encode時是否每張frame產生最佳化的Huffman tables (decode不使用)
+    int restart_interval;   // encode時每幾個MCU插入restart marker並重設DC預測，0表示不使用 (decode由header決定)
+    int threads;            // restart segments平行編碼/解碼使用的threads個數 (包含main thread)，1表示不使用multi-thread
+    int segment_index;      // encode時是否在header寫入每個restart segment的offset，decoder可以平行解碼segments (需要restart_interval > 0)
+    ScanMode scan_mode;     // encode時entropy coded data的排列方式 (decode由header決定)
+}EntropyConfig;
+
+/* entropy coding每張frame使用的記憶體 (係數、DC/AC symbols、segments的bitstream)
+   依照frame大小配置一次，同一個context (frame pool的worker、decode slot、vcodec context) 的frames重複使用
+   同時只能給一張frame使用 */
+typedef struct EntropyWorkspace EntropyWorkspace;
+
+void entropy_initialization(EntropyType entropy_type, const EntropyConfig* entropy_config);
 void entropy_destropy(EntropyType entropy_type);
-void entropy_encode(YUVFrame* frame, QuantType quant_type, CompressionType compression_type, EntropyType entropy_type, const char* out_bitstream_path);
-void entropy_decode(YUVFrame* frame, QuantType quant_type, CompressionType compression_type, EntropyType entropy_type, const char* out_bitstream_path);
+EntropyWorkspace* entropy_workspace_create(EntropyType entropy_type);
+void entropy_workspace_destroy(EntropyType entropy_type, EntropyWorkspace* workspace);
+size_t entropy_workspace_size(EntropyType entropy_type, const EntropyWorkspace* workspace);
+int entropy_encode(YUVFrame* frame, QuantParams* quant_params, CompressionType compression_type, EntropyType entropy_type, FILE* bitstream_fp,
+                   EntropyWorkspace* workspace);
+int entropy_decode(YUVFrame* frame, QuantParams* quant_params, CompressionType compression_type, EntropyType entropy_type, FILE* bitstream_fp,
+                   EntropyWorkspace* workspace);
 
 #endif /* ENTROPY_H */
\ No newline at end of file
@@ -4,14 +4,20 @@
 #include<stdint.h>
 #include"yuv.h"
 #include"entropy/entropy.h"
+#include"transform.h"
 
 
 /* 儲存zigzag scan後的係數 */
 typedef struct {
     int16_t dc;
     int16_t ac[63];
+    uint8_t eob;        // zigzag順序中最後一個非零AC係數的位置+1 (DC固定算位置0，所以AC全為0時eob=1)
 }JpegBlockCoeffs;
 
+/* zigzag_8x8的前10個位置剛好是左上角4x4 (前4條對角線)，eob不超過它時高頻係數全為0 */
+#define JPEG_EOB_DC_ONLY    1
+#define JPEG_EOB_LOW_4x4    10
+
 /* 儲存DPCM後的DC係數*/
 typedef struct {
     uint8_t size;       // 儲存dc差值需要的bit個數 (也就是儲存該係數是哪一個category，不同category需要的bits也不同)
@@ -25,13 +31,84 @@ typedef struct {
     uint16_t amplitude; // 非0係數的1's complement表示法
 }JpegAcSymbol;
 
-/* 每個block的AC編碼結果 */
+/* 一個block最多63個AC係數 + 1個EOB符號 */
+#define JPEG_AC_SYMBOLS_MAX  64
+
+/* 每個block的AC編碼結果
+   symbols只佔實際的個數，依照block順序連續存放在EntropyWorkspace的symbol buffer (不是每個block固定64個) */
 typedef struct {
-    JpegAcSymbol symbols[64];  // 最多63個AC係數 + 1個EOB符號
-    uint8_t num_symbols;       // 實際符號數量（不包含EOB）
+    JpegAcSymbol* symbols;     // 這個block的第一個symbol
+    uint8_t num_symbols;       // 符號數量 (包含ZRL和EOB)
 }JpegAcEncoded;
 
-void entropy_decode_jpeg(YUVFrame* frame, QuantType quant_type, CompressionType compression_type, EntropyType entropy_type, const char* out_bitstream_path);
-void entropy_encode_jpeg(YUVFrame* frame, QuantType quant_type, CompressionType compression_type, EntropyType entropy_type, const char* out_bitstream_path);
+/* frame裡component的順序 (JpegComponentPrepare/JpegBlocksDecoded的component參數) */
+enum {
+    JPEG_COMPONENT_Y = 0,
+    JPEG_COMPONENT_U,
+    JPEG_COMPONENT_V,
+    JPEG_COMPONENTS_NUM
+};
+
+/* 平行RLE時一個工作處理的blocks個數 (每個工作有自己的symbol buffer) */
+#define JPEG_RLE_JOB_BLOCKS  2048
+
+/* JPEG_RLE_JOB_BLOCKS個blocks的AC symbols (RLE的結果)，空間不夠時2倍成長 */
+typedef struct {
+    JpegAcSymbol* symbols;
+    size_t capacity;      // 可以存放的symbols個數
+    int failed;           // 這一張frame成長失敗 (RLE工作各自寫自己的buffer)
+}JpegSymbolBuffer;
+
+/* 一個restart segment (或component scan) 的編碼結果 */
+typedef struct {
+    uint8_t* data;        // segment的bitstream (已經做過byte stuffing，不包含segment之間的restart marker)
+    size_t size;
+    size_t capacity;      // data配置的大小
+}JpegSegment;
+
+/* entropy coding每張frame使用的記憶體，依照frame大小配置一次，之後的frames重複使用 */
+struct EntropyWorkspace {
+    int blocks_capacity[JPEG_COMPONENTS_NUM];   // blocks配置的個數
+    int encoded_capacity[JPEG_COMPONENTS_NUM];  // dc_encoded/ac_encoded配置的個數 (只有encode使用)
+    JpegBlockCoeffs* blocks[JPEG_COMPONENTS_NUM];
+    JpegDcEncoded* dc_encoded[JPEG_COMPONENTS_NUM];
+    JpegAcEncoded* ac_encoded[JPEG_COMPONENTS_NUM];
+    JpegSymbolBuffer* symbol_buffers[JPEG_COMPONENTS_NUM];  // 每JPEG_RLE_JOB_BLOCKS個blocks一個
+    JpegSegment* segments;                      // encode: 每個segment (或component scan) 的bitstream
+    int segments_capacity;
+    uint8_t* data;                              // decode: header後面的entropy coded data
+    size_t data_capacity;
+};
+
+/* entropy_encode_jpeg_coeffs()在entropy coding之前呼叫，準備好一個component的係數 (zigzag順序)
+   三個components互相獨立，交給thread pool平行處理 */
+typedef void (*JpegComponentPrepare)(void* arg, int component);
+
+/* entropy_decode_jpeg_coeffs()解碼完component的一段blocks [block_start, block_end) 後呼叫
+   平行解碼restart segments或component scans時由不同threads呼叫，每次的blocks範圍不會重疊 */
+typedef void (*JpegBlocksDecoded)(void* arg, int component, int block_start, int block_end);
+
+/* entropy_encode_jpeg_stripes()需要component的下一個block row時呼叫，將這一列blocks的係數 (zigzag順序) 寫到row_blocks
+   block rows依照順序要求，每個component只需要一列blocks的記憶體 */
+typedef void (*JpegRowPrepare)(void* arg, int component, int block_row, JpegBlockCoeffs* row_blocks);
+
+int jpeg_blocks_num(Component* comp);
+EntropyWorkspace* jpeg_workspace_create(void);
+void jpeg_workspace_destroy(EntropyWorkspace* workspace);
+int jpeg_workspace_reserve(EntropyWorkspace* workspace, YUVFrame* frame, int encode);
+size_t jpeg_workspace_size(const EntropyWorkspace* workspace);
+void zigzag_scan(int16_t* block, int b_height, int b_width, int padded_width, JpegBlockCoeffs* jpeg_block);
+int entropy_encode_jpeg_coeffs(YUVFrame* frame, EntropyWorkspace* workspace, QuantParams* quant_params, CompressionType compression_type, EntropyType entropy_type, FILE* bitstream_fp,
+                               JpegComponentPrepare prepare, void* prepare_arg);
+int entropy_encode_jpeg_stripes(YUVFrame* frame, QuantParams* quant_params, CompressionType compression_type, EntropyType entropy_type,
+                                FILE* bitstream_fp, JpegRowPrepare prepare, void* prepare_arg);
+void inverse_zigzag_scan(int16_t* block, int b_height, int b_width, int padded_width, JpegBlockCoeffs* jpeg_block);
+BlockSparsity jpeg_block_sparsity(const JpegBlockCoeffs* jpeg_block, int b_width);
+int entropy_decode_jpeg_coeffs(YUVFrame* frame, EntropyWorkspace* workspace, QuantParams* quant_params, CompressionType compression_type, EntropyType entropy_type, FILE* bitstream_fp,
+                               JpegBlocksDecoded blocks_decoded, void* blocks_decoded_arg);
+int entropy_decode_jpeg(YUVFrame* frame, QuantParams* quant_params, CompressionType compression_type, EntropyType entropy_type, FILE* bitstream_fp,
+                        EntropyWorkspace* workspace);
+int entropy_encode_jpeg(YUVFrame* frame, QuantParams* quant_params, CompressionType compression_type, EntropyType entropy_type, FILE* bitstream_fp,
+                        EntropyWorkspace* workspace);
 
 #endif /* ENTROPY_JPEG_H */
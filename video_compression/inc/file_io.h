@@ -3,20 +3,95 @@
 
 #include<stdio.h>
 #include<stdint.h>
+#include<stddef.h>
+
+/* BitWriter先把bytes存在記憶體，滿了才一次寫到檔案 (或是接到memory buffer後面) */
+#define BIT_WRITER_OUTPUT_SIZE  16384
+
+/* JPEG restart marker: 0xff 0xd0 ~ 0xff 0xd7 */
+#define JPEG_RST_MARKER_BASE    0xd0
 
 typedef struct {
-    FILE* fp;
-    uint8_t buffer;  // 儲存讀取bits的buffer，等滿8個bits再寫到檔案 (bit packing方式)
-    int bit_count;   // 計算目前buffer儲放多少bits
+    FILE* fp;         // NULL表示輸出到memory (mem/mem_size)
+    uint8_t* mem;     // memory輸出的buffer (可以使用呼叫者的buffer，由呼叫者free)
+    size_t mem_size;
+    size_t mem_capacity;
+    uint64_t buffer;  // 儲存寫入bits的accumulator (靠右對齊)，累積到32 bits以上再整批轉成bytes (bit packing方式)
+    int bit_count;    // 計算目前buffer儲放多少bits
+    int out_size;     // out裡已經有多少bytes (已經做過byte stuffing)
+    uint8_t out[BIT_WRITER_OUTPUT_SIZE];
 }BitWriter;
 
+/* 64-bit buffer一次補滿多個bytes，Huffman decode可以先peek多個bits再決定要消耗幾個bits */
+#define BIT_READER_BUFFER_BITS  64
+
 typedef struct {
-    FILE* fp;
-    uint8_t buffer;  // 從檔案讀取byte by byte，再對buffer做bit unpacking
-    int bit_left;    // 計算buffer還有多少bits未decode
+    const uint8_t* data;  // 整張frame的entropy coded data (已經讀到記憶體)
+    size_t size;          // data的bytes個數
+    size_t pos;           // 下一個要補到buffer的byte位置
+    uint64_t buffer;      // 從data讀取的bits，靠左對齊 (bit 63是下一個要decode的bit)
+    int bit_left;         // 計算buffer還有多少bits未decode
+    int pad_bits;         // data結束後補進buffer的0 bits個數，bit_left小於它代表讀超過結尾
 }BitReader;
 
 void create_bit_writer(BitWriter* bit_writer, FILE* fp);
-void create_bit_reader(BitReader* bit_reader, FILE* fp);
+void create_memory_bit_writer(BitWriter* bit_writer, uint8_t* mem, size_t mem_capacity);
+void bit_writer_drain(BitWriter* bit_writer);
+void bit_writer_flush(BitWriter* bit_writer);
+void bit_writer_emit(BitWriter* bit_writer);
+void bit_writer_write_marker(BitWriter* bit_writer, uint8_t marker);
+
+/*  function: bit_writer_put_bits()
+    Params:
+        BitWriter* bit_writer : 紀錄bitstream寫入的資訊
+        uint32_t bits         : 要寫入的bits (靠右對齊)
+        int length            : bits個數 (最多32)
+
+    Result:
+        codeword和amplitude可以合併成一次寫入，只用一次shift/or
+        每次呼叫都在Huffman encode的inner loop裡，所以放在header讓compiler inline
+ */
+static inline void bit_writer_put_bits(BitWriter* bit_writer, uint32_t bits, int length)
+{
+    if (bit_writer->bit_count > 32) {
+        bit_writer_drain(bit_writer);
+    }
+    bit_writer->buffer = (bit_writer->buffer << length) | bits;
+    bit_writer->bit_count += length;
+}
+void create_bit_reader(BitReader* bit_reader, const uint8_t* data, size_t size);
+void bit_reader_fill(BitReader* bit_reader);
+int bit_reader_restart(BitReader* bit_reader, int restart_index);
+int read_remaining_file(FILE* fp, uint8_t** buffer, size_t* capacity, size_t* size);
+
+/* BitReader的peek/consume，Huffman decoder的inner loop使用
+ *   呼叫之前先確認bit_left足夠 (不夠時呼叫bit_reader_fill)
+ */
+static inline uint32_t bit_reader_peek(const BitReader* bit_reader, int length)
+{
+    return (uint32_t)(bit_reader->buffer >> (BIT_READER_BUFFER_BITS - length));
+}
+
+static inline void bit_reader_consume(BitReader* bit_reader, int length)
+{
+    bit_reader->buffer <<= length;
+    bit_reader->bit_left -= length;
+}
+
+/* 讀取length個bits (length最多32，0會回傳0) */
+static inline uint32_t bit_reader_get_bits(BitReader* bit_reader, int length)
+{
+    if (length == 0) return 0;
+
+    uint32_t bits = bit_reader_peek(bit_reader, length);
+    bit_reader_consume(bit_reader, length);
+    return bits;
+}
+
+/* 是否已經讀超過data的結尾 (讀到補進去的0 bits) */
+static inline int bit_reader_overrun(const BitReader* bit_reader)
+{
+    return bit_reader->bit_left < bit_reader->pad_bits;
+}
 
-#endif // FILE_IO_H
\ No newline at end of file
+#endif // FILE_IO_H
@@ -0,0 +1,54 @@
+#ifndef FRAME_DECODER_H
+#define FRAME_DECODER_H
+
+#include<stdint.h>
+#include<pthread.h>
+#include"yuv.h"
+#include"transform.h"
+#include"quantization/quantization.h"
+#include"pipeline.h"
+#include"container.h"
+
+/* cache裡的一張解碼後的frame */
+typedef struct {
+    int frame_idx;               // 存放的frame，-1表示空的
+    int ready;                   // 0: 正在解碼 1: 解碼完成
+    int failed;                  // 1: 解碼失敗，等待中的threads都放開後才變回空的
+    int refs;                    // 使用中的views個數，大於0時不能被替換
+    uint64_t last_used;          // LRU使用，越大表示越晚使用
+    YUVFrame* frame;             // 第一次使用時才配置
+    QuantParams quant_params;    // 量化表/QP從這張frame的header取得
+}CachedFrame;
+
+/* 可以任意順序解碼frames的decoder
+ *   解碼後的frames放在LRU cache (大小由memory budget決定)，重複讀取同一張frame不需要再解碼
+ *   背景的prefetch thread解碼最後一次讀取的frame附近的frames
+ */
+typedef struct {
+    VideoContainer* container;
+    PipelineMode pipeline_mode;
+    TransformType transform_type;
+    CachedFrame* cache;
+    int cache_num;
+    uint64_t clock;              // 每次讀取frame加1
+    int prefetch_frames;         // 往前/往後prefetch的frames個數
+    int prefetch_center;         // 最後一次讀取的frame
+    int prefetch_pending;        // 1: prefetch_center改變了，prefetch thread要重新開始
+    int hits, misses;            // cache統計
+    EntropyWorkspace* prefetch_workspace;  // prefetch thread解碼時使用的entropy workspace
+    EntropyWorkspace* workspace;           // 在呼叫get_frame的thread解碼時使用 (其他thread正在使用時暫時配置一個)
+    int workspace_busy;                    // 1: workspace正在使用
+    int stop;
+    int prefetcher_started;
+    pthread_t prefetcher;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;         // frame解碼完成、view被release或有新的prefetch時通知
+}FrameDecoder;
+
+FrameDecoder* frame_decoder_open(const char* container_path, PipelineMode pipeline_mode, TransformType transform_type,
+                                 size_t cache_budget, int prefetch_frames);
+const YUVFrame* frame_decoder_get_frame(FrameDecoder* decoder, int frame_idx);
+void frame_decoder_release_frame(FrameDecoder* decoder, int frame_idx);
+void frame_decoder_close(FrameDecoder* decoder);
+
+#endif /* FRAME_DECODER_H */
@@ -3,16 +3,29 @@
 
 #include"yuv.h"
 #include"block.h"
+#include"transform.h"
+#include"cpu.h"
 #include"quantization/quantization.h"
 #include"entropy/entropy.h"
+#include"pipeline.h"
+#include"yuv_source.h"
 
 #define MAX_PATH_LEN (1024)
+#define MAX_FRAME_PATH_LEN (MAX_PATH_LEN + 32)  // 資料夾 (MAX_PATH_LEN) 加上frame_%04d_bs.bin
 
 typedef struct {
     int save_yuv_raw_frame;  // 是否儲存yuv raw data. 0: 不儲存 1: 儲存
     int save_idct_yuv_frame; // 是否儲存idct後的yuv frame. 0: 不儲存 1: 儲存
     int truncate_yuv_frame;  // 是否只使用前面部分的yuv data. 0: 使用全部的frames 1: 使用前面部分的frames
     int truncate_yuv_index;  // 如果有truncate，則指定從哪一張frame做truncate
+    int report_transform_accuracy; // 是否印出fast DCT和reference DCT的誤差. 0: 不印出 1: 印出
+    SimdLevel simd_level;    // 使用的SIMD指令集. AUTO: 依照CPUID選擇 (環境變數VC_SIMD_LEVEL可以覆蓋)
+    PipelineMode pipeline_mode; // MULTI_PASS: 每個stage走過整張frame FUSED: 以tile為單位做完所有stage STRIPE: 每個block row做完所有stage (只保留一列係數)
+    int entropy_threads;     // restart segments平行entropy coding/decoding使用的threads個數 (包含main thread)
+    int threads;             // 同時編碼的frames個數 (frame pool的threads個數，包含main thread)
+    int cache_mb;            // random access解碼的LRU cache大小 (MB)，只有decoder使用
+    int prefetch_frames;     // random access解碼時往前/往後prefetch的frames個數，只有decoder使用
+    InputMode input_mode;    // READ: reader thread用fread讀取 MMAP: mmap .yuv檔，raw data直接指到mapping，只有encoder使用
 }OptionInfo;
 
 typedef struct {
@@ -23,9 +36,16 @@ typedef struct {
 
 typedef struct {
     BlockInfo block_info;
+    TransformType transform_type;
     CompressionType comprss_type;
     QuantType quant_type;
+    int qp;                       // H264_QUANT的quantization parameter (0~51)，只有encoder使用
+    int quality;                  // JPEG_QUANT_STANDARD的quality (1~100)，只有encoder使用
     EntropyType entropy_type;
+    int huffman_optimize;         // 每張frame依照symbol統計產生最佳化的Huffman tables (寫到header)，只有encoder使用
+    int restart_interval;         // 每幾個MCU插入restart marker並重設DC預測 (0: 不使用)，只有encoder使用
+    int segment_index;            // header寫入restart segments的offset，讓decoder平行解碼 (0: 不寫入 1: 寫入)，只有encoder使用
+    ScanMode scan_mode;           // INTERLEAVED: MCU交錯的一個scan PER_COMPONENT: Y/U/V各自一個scan，只有encoder使用
 }CompressionInfo;
 
 /* 定義編碼需要的參數 */
@@ -33,6 +53,7 @@ typedef struct {
     char input_path[MAX_PATH_LEN];           // YUV raw data路徑. ex: ./cur_dir/videos/yuv_file_name.yuv
     char output_yuv_raw_dir[MAX_PATH_LEN];   // 儲存yuv raw data的路徑
     char output_bitstream_dir[MAX_PATH_LEN]; // 儲存entropy後的bitstream路徑
+    char output_container_path[MAX_PATH_LEN]; // 所有frames寫到一個container檔案 (空的話每張frame各自一個檔案)
     OptionInfo option_info;                  // 儲存需要開放的功能
     YUVInInfo yuv_raw_info;                  // 讀取yuv raw data需要的資訊
     CompressionInfo compress_info;           // 壓縮(quant.和entropy)yuv data需要的設定
@@ -42,6 +63,7 @@ typedef struct {
 typedef struct {
     char output_yuv_idct_dir[MAX_PATH_LEN];  // 儲存idct後的yuv data的路徑
     char input_bitstream_dir[MAX_PATH_LEN];  // Bitstream路徑. ex: ./output/bitstream/xxx.bin
+    char input_container_path[MAX_PATH_LEN]; // container檔案 (空的話從input_bitstream_dir讀取每張frame的檔案)
     OptionInfo option_info;                  // 儲存需要開放的功能
     YUVInInfo yuv_raw_info;                  // 從bitstream讀取yuv info.後，存放在這裡
     CompressionInfo compress_info;           // 壓縮(quant.和entropy)yuv data需要的設定
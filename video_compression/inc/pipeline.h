@@ -0,0 +1,24 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include<stdio.h>
+#include"yuv.h"
+#include"transform.h"
+#include"quantization/quantization.h"
+#include"entropy/entropy.h"
+
+typedef enum {
+    PIPELINE_MULTI_PASS = 0,  // 每個stage各自走過整張frame (reference)
+    PIPELINE_FUSED,           // 每塊tile在L1裡做完所有stage (encode: shift/DCT/quantization/zigzag，decode: 反向)
+    PIPELINE_STRIPE           // encode: 每個block row做完所有stage (包含Huffman) 就寫到FILE*並fflush，decode同FUSED
+}PipelineMode;
+
+/* fused pipeline一次處理的tile width (pixels)，8x8 block時tile為8x64的int16 (1KB) */
+#define FUSED_TILE_WIDTH  64
+
+int encode_frame(YUVFrame* frame, PipelineMode pipeline_mode, TransformType transform_type, QuantParams* quant_params,
+                 CompressionType compression_type, EntropyType entropy_type, FILE* bitstream_fp, EntropyWorkspace* workspace);
+int decode_frame(YUVFrame* frame, PipelineMode pipeline_mode, TransformType transform_type, QuantParams* quant_params,
+                 CompressionType compression_type, EntropyType entropy_type, FILE* bitstream_fp, EntropyWorkspace* workspace);
+
+#endif /* PIPELINE_H */
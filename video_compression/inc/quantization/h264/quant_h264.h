@@ -0,0 +1,19 @@
+#ifndef QUANT_H264_H
+#define QUANT_H264_H
+
+#include<stdint.h>
+#include"yuv.h"
+#include"block.h"
+
+#define H264_QP_MIN  0
+#define H264_QP_MAX  51
+
+extern const int32_t h264_quant_mf_table[6][3];
+extern const int32_t h264_dequant_v_table[6][3];
+
+void h264_quant_blocks(int16_t* blocks, int stride, int num_blocks, BlockSize b_size, int qp);
+void h264_dequant_blocks(int16_t* blocks, int stride, int num_blocks, BlockSize b_size, int qp);
+void h264_quant(YUVFrame* frame, int qp);
+void h264_dequant(YUVFrame* frame, int qp);
+
+#endif // QUANT_H264_H
@@ -3,11 +3,18 @@
 
 #include<stdint.h>
 #include"yuv.h"
+#include"block.h"
  
-extern const uint8_t jpeg_luminance_quant_table[64];;
+#include"quantization/quantization.h"
+ 
+extern const uint8_t jpeg_luminance_quant_table[64];
 extern const uint8_t jpeg_chrominance_quant_table[64];
 
-void jpeg_standard_quant(YUVFrame* frame);
-void jpeg_standard_dequant(YUVFrame* frame);
+void jpeg_quant_scale_tables(int quality, uint8_t* luminance_table, uint8_t* chrominance_table);
+void jpeg_quant_prepare(QuantParams* quant_params);
+void jpeg_quant_blocks(int16_t* blocks, int stride, int num_blocks, BlockSize b_size, int is_chroma, const JpegQuantPrepared* prepared);
+void jpeg_dequant_blocks(int16_t* blocks, int stride, int num_blocks, BlockSize b_size, int is_chroma, const JpegQuantPrepared* prepared);
+void jpeg_standard_quant(YUVFrame* frame, QuantParams* quant_params);
+void jpeg_standard_dequant(YUVFrame* frame, QuantParams* quant_params);
 
 #endif // QUANT_JPEG_H
\ No newline at end of file
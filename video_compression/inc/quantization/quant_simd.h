@@ -0,0 +1,47 @@
+#ifndef QUANT_SIMD_H
+#define QUANT_SIMD_H
+
+#include<stdint.h>
+#include"cpu.h"
+
+/* 量化使用reciprocal乘法取代除法
+ *   level = ((|c| + step/2) * ceil(2^QUANT_RECIP_BITS / step)) >> QUANT_RECIP_BITS
+ *   |c| + step/2 < 2^16，step <= 255，所以結果和 (|c| + step/2) / step 完全相同 (四捨五入)
+ */
+#define QUANT_RECIP_BITS  31
+
+/* JPEG Huffman table的AC係數最多只有10 bits (category 10)，量化後的level限制在[-1023, 1023] */
+#define QUANT_MAX_LEVEL   1023
+
+/* 一個8x8量化表預先算好的參數 */
+typedef struct {
+    uint32_t reciprocal[64];  // ceil(2^QUANT_RECIP_BITS / step)
+    uint32_t half[64];        // step / 2，四捨五入使用
+    int16_t step[64];         // 反量化使用的step size
+}QuantDivisors;
+
+/* quantization stage的kernels，依照SIMD等級選擇實作
+ *   quant_8x8_blocks   : 對水平相鄰的num_blocks個8x8 blocks做量化
+ *   dequant_8x8_blocks : 對水平相鄰的num_blocks個8x8 blocks做反量化
+ */
+typedef struct {
+    SimdLevel level;
+    void (*quant_8x8_blocks)(int16_t* blocks, int stride, int num_blocks, const QuantDivisors* divisors);
+    void (*dequant_8x8_blocks)(int16_t* blocks, int stride, int num_blocks, const QuantDivisors* divisors);
+}QuantDsp;
+
+void quant_dsp_init(SimdLevel level);
+const QuantDsp* quant_dsp_get(void);
+void quant_divisors_init(QuantDivisors* divisors, const uint8_t* quant_table);
+
+/* SIMD版本 (src/simd/) */
+void quant_8x8_blocks_sse41(int16_t* blocks, int stride, int num_blocks, const QuantDivisors* divisors);
+void dequant_8x8_blocks_sse41(int16_t* blocks, int stride, int num_blocks, const QuantDivisors* divisors);
+
+void quant_8x8_blocks_avx2(int16_t* blocks, int stride, int num_blocks, const QuantDivisors* divisors);
+void dequant_8x8_blocks_avx2(int16_t* blocks, int stride, int num_blocks, const QuantDivisors* divisors);
+
+void quant_8x8_blocks_avx512(int16_t* blocks, int stride, int num_blocks, const QuantDivisors* divisors);
+void dequant_8x8_blocks_avx512(int16_t* blocks, int stride, int num_blocks, const QuantDivisors* divisors);
+
+#endif // QUANT_SIMD_H
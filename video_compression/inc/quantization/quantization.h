@@ -4,14 +4,47 @@
 #include<stdint.h>
 #include"yuv.h"
 #include"block.h"
+#include"quantization/quant_simd.h"
 
 typedef enum {
     JPEG_QUANT_STANDARD=0,
     H264_QUANT
 }QuantType;
 
+#define JPEG_QUALITY_DEFAULT  50   // quality 50對應到JPEG標準量化表
 
-void quantize_frame(YUVFrame* frame, QuantType quant_type);
-void dequantize_frame(YUVFrame* frame, QuantType quant_type);
+/* JPEG_QUANT_STANDARD根據量化表預先算好的參數 (quantize_prepare()建立)
+ * 放在QuantParams裡，建立之後只會被讀取: 多個threads可以共用同一份QuantParams，
+ * 各自有不同量化表的frames (decoder) 則使用各自的QuantParams
+ */
+typedef struct {
+    int prepared;                          // 0: 還沒有建立
+    uint8_t luminance_table[64];           // 建立參數時使用的Y量化表
+    uint8_t chrominance_table[64];         // 建立參數時使用的UV量化表
+    QuantDivisors luminance_divisors;      // 8x8 block: reciprocal/step表
+    QuantDivisors chrominance_divisors;
+    int32_t luminance_quant_mf_4x4[16];    // 4x4 block: quantization的multiplication factor
+    int32_t chrominance_quant_mf_4x4[16];
+    int32_t luminance_dequant_4x4[16];     // 4x4 block: dequantization的scale
+    int32_t chrominance_dequant_4x4[16];
+}JpegQuantPrepared;
 
-#endif /* QUANTIZATION_H */
\ No newline at end of file
+/* 量化需要的參數: encoder從設定檔取得，decoder從bitstream header取得 */
+typedef struct {
+    QuantType quant_type;
+    int qp;                          // H264_QUANT使用的quantization parameter (0~51)
+    int quality;                     // JPEG_QUANT_STANDARD使用的quality (1~100)，只有encoder使用
+    uint8_t luminance_table[64];     // JPEG_QUANT_STANDARD根據quality縮放後的Y量化表
+    uint8_t chrominance_table[64];   // JPEG_QUANT_STANDARD根據quality縮放後的UV量化表
+    JpegQuantPrepared prepared;      // JPEG_QUANT_STANDARD預先算好的參數
+}QuantParams;
+
+
+void quant_params_init(QuantParams* quant_params, QuantType quant_type, int qp, int quality);
+void quantize_frame(YUVFrame* frame, QuantParams* quant_params);
+void dequantize_frame(YUVFrame* frame, QuantParams* quant_params);
+void quantize_prepare(QuantParams* quant_params);
+void quantize_blocks(int16_t* blocks, int stride, int num_blocks, BlockSize b_size, int is_chroma, QuantParams* quant_params);
+void dequantize_blocks(int16_t* blocks, int stride, int num_blocks, BlockSize b_size, int is_chroma, QuantParams* quant_params);
+
+#endif /* QUANTIZATION_H */
@@ -0,0 +1,27 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include<pthread.h>
+
+/* thread_pool_run()分配給每個thread的工作: job_index是第幾個工作 (0 ~ jobs_num-1) */
+typedef void (*ThreadPoolJob)(void* arg, int job_index);
+
+typedef struct {
+    pthread_t* workers;        // 背景的worker threads (呼叫thread_pool_run()的thread也會一起做)
+    int workers_num;
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;  // 有新的工作或是要結束時通知workers
+    pthread_cond_t done_cond;  // 所有工作都完成時通知呼叫者
+    ThreadPoolJob job;         // 目前的工作，NULL表示沒有工作
+    void* arg;
+    int jobs_num;              // 這一批有幾個工作
+    int next_job;              // 下一個還沒被拿走的工作
+    int pending_jobs;          // 還沒完成的工作個數
+    int stop;                  // 1: workers結束
+}ThreadPool;
+
+ThreadPool* thread_pool_create(int threads_num);
+void thread_pool_run(ThreadPool* pool, ThreadPoolJob job, void* arg, int jobs_num);
+void thread_pool_destroy(ThreadPool* pool);
+
+#endif /* THREAD_POOL_H */
@@ -1,10 +1,31 @@
 #ifndef TRANSFORM_H
 #define TRANSFORM_H
 
+#include<stdint.h>
 #include"yuv.h"
+#include"block.h"
 
-void shift_128(YUVFrame* frame);
-void transform_frame(YUVFrame* frame);
-void reverse_transform_frame(YUVFrame* frame);
+typedef enum {
+    DCT_REFERENCE = 0,  // double精度的DCT (逐一係數計算，作為reference)
+    DCT_INT_FAST        // 整數separable fast DCT (row/column butterfly)
+}TransformType;
 
-#endif
\ No newline at end of file
+/* block裡非零係數的分布，IDCT依此選擇kernel */
+typedef enum {
+    BLOCK_SPARSE_DC_ONLY = 0,  // 只有DC係數
+    BLOCK_SPARSE_LOW_4x4,      // 非零係數都在左上角4x4
+    BLOCK_SPARSE_FULL          // 其他
+}BlockSparsity;
+
+void shift_128(Component* component);
+void unshift_128(Component* component);
+void shift_128_tile(Component* component, int row, int col, int tile_height, int tile_width, int16_t* tile, int tile_stride);
+void unshift_128_tile(Component* component, int row, int col, int tile_height, int tile_width, const int16_t* tile, int tile_stride);
+void forward_transform_blocks(int16_t* blocks, int stride, int num_blocks, BlockSize b_size, TransformType transform_type);
+void inverse_transform_blocks(int16_t* blocks, int stride, int num_blocks, BlockSize b_size, TransformType transform_type);
+void inverse_transform_sparse_blocks(int16_t* blocks, int stride, int num_blocks, const BlockSparsity* sparsity, BlockSize b_size, TransformType transform_type);
+void transform_frame(YUVFrame* frame, TransformType transform_type);
+void reverse_transform_frame(YUVFrame* frame, TransformType transform_type);
+void transform_accuracy_report(int num_blocks);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef TRANSFORM_SIMD_H
+#define TRANSFORM_SIMD_H
+
+#include<stdint.h>
+#include"cpu.h"
+
+/* 整數fast DCT/IDCT (Loeffler-Ligtenberg-Moschytz) 使用的fixed-point參數
+ *   CONST_BITS : cosine常數的小數bits
+ *   PASS1_BITS : 第一次運算後保留的額外精度bits
+ *   常數為 round(cos_value * 2^CONST_BITS)
+ *   scalar和SIMD版本共用這些參數，才能得到完全相同的結果
+ */
+#define CONST_BITS  13
+#define PASS1_BITS  2
+
+#define FIX_0_298631336  ((int32_t)  2446)
+#define FIX_0_390180644  ((int32_t)  3196)
+#define FIX_0_541196100  ((int32_t)  4433)
+#define FIX_0_765366865  ((int32_t)  6270)
+#define FIX_0_899976223  ((int32_t)  7373)
+#define FIX_1_175875602  ((int32_t)  9633)
+#define FIX_1_501321110  ((int32_t) 12299)
+#define FIX_1_847759065  ((int32_t) 15137)
+#define FIX_1_961570560  ((int32_t) 16069)
+#define FIX_2_053119869  ((int32_t) 16819)
+#define FIX_2_562915447  ((int32_t) 20995)
+#define FIX_3_072711026  ((int32_t) 25172)
+
+/* 右移n bits並四捨五入 */
+#define DESCALE(x, n)  (((x) + ((int32_t)1 << ((n)-1))) >> (n))
+
+
+/* transform stage的kernels，依照SIMD等級選擇實作 
+ *   fdct_8x8_blocks   : 對水平相鄰的num_blocks個8x8 blocks做整數fast DCT
+ *   idct_8x8_blocks   : 對水平相鄰的num_blocks個8x8 blocks做整數fast IDCT
+ *   idct_8x8_low4x4_blocks : 同idct_8x8_blocks，但每個block的非零係數都在左上角4x4
+ *   shift_128_row     : uint8 pixel轉成int16並做-128位移
+ *   unshift_128_row   : int16做+128位移並限制在[0,255]
+ *   unshift_128_store_row : int16做+128位移並限制在[0,255]，直接寫到uint8 buffer
+ */
+typedef struct {
+    SimdLevel level;
+    void (*fdct_8x8_blocks)(int16_t* blocks, int stride, int num_blocks);
+    void (*idct_8x8_blocks)(int16_t* blocks, int stride, int num_blocks);
+    void (*idct_8x8_low4x4_blocks)(int16_t* blocks, int stride, int num_blocks);
+    void (*shift_128_row)(const uint8_t* src, int16_t* dst, int width);
+    void (*unshift_128_row)(int16_t* data, int width);
+    void (*unshift_128_store_row)(const int16_t* src, uint8_t* dst, int width);
+}TransformDsp;
+
+void transform_dsp_init(SimdLevel level);
+const TransformDsp* transform_dsp_get(void);
+
+/* scalar版本 (transform.c) */
+void fdct_int_block_8x8(int16_t* block, int padded_width);
+void idct_int_block_8x8(int16_t* block, int padded_width);
+void idct_int_block_8x8_dc(int16_t* block, int padded_width);
+void idct_int_block_8x8_low4x4(int16_t* block, int padded_width);
+
+/* SIMD版本 (src/simd/) */
+void fdct_8x8_blocks_sse41(int16_t* blocks, int stride, int num_blocks);
+void idct_8x8_blocks_sse41(int16_t* blocks, int stride, int num_blocks);
+void idct_8x8_low4x4_blocks_sse41(int16_t* blocks, int stride, int num_blocks);
+void shift_128_row_sse41(const uint8_t* src, int16_t* dst, int width);
+void unshift_128_row_sse41(int16_t* data, int width);
+void unshift_128_store_row_sse41(const int16_t* src, uint8_t* dst, int width);
+
+void fdct_8x8_blocks_avx2(int16_t* blocks, int stride, int num_blocks);
+void idct_8x8_blocks_avx2(int16_t* blocks, int stride, int num_blocks);
+void idct_8x8_low4x4_blocks_avx2(int16_t* blocks, int stride, int num_blocks);
+void shift_128_row_avx2(const uint8_t* src, int16_t* dst, int width);
+void unshift_128_row_avx2(int16_t* data, int width);
+void unshift_128_store_row_avx2(const int16_t* src, uint8_t* dst, int width);
+
+void fdct_8x8_blocks_avx512(int16_t* blocks, int stride, int num_blocks);
+void idct_8x8_blocks_avx512(int16_t* blocks, int stride, int num_blocks);
+void idct_8x8_low4x4_blocks_avx512(int16_t* blocks, int stride, int num_blocks);
+void shift_128_row_avx512(const uint8_t* src, int16_t* dst, int width);
+void unshift_128_row_avx512(int16_t* data, int width);
+void unshift_128_store_row_avx512(const int16_t* src, uint8_t* dst, int width);
+
+#endif // TRANSFORM_SIMD_H
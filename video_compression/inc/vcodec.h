@@ -0,0 +1,75 @@
+#ifndef VCODEC_H
+#define VCODEC_H
+
+#include<stdint.h>
+#include<stddef.h>
+#include"yuv.h"
+#include"block.h"
+#include"cpu.h"
+#include"transform.h"
+#include"quantization/quantization.h"
+#include"entropy/entropy.h"
+#include"pipeline.h"
+
+/* libvcodec: 不需要設定檔和檔案路徑，直接在memory裡編碼/解碼一張frame
+ *   encoder/decoder context建立時配置好frame和量化參數，之後每張frame不需要再配置，也不會開啟任何檔案
+ *   SIMD kernels和entropy coding的資源 (Huffman tables、thread pool) 是整個process共用的，
+ *   第一個建立的context決定SIMD level和entropy threads，最後一個context釋放時才會釋放
+ *   同時存在的encoders的entropy_config必須相同，設定不同的context建立時回傳NULL
+ */
+
+#define VCODEC_OK                 0
+#define VCODEC_ERROR             -1   // 參數錯誤、記憶體配置失敗或bitstream無法讀取
+#define VCODEC_BUFFER_TOO_SMALL  -2   // 呼叫者提供的output buffer不夠，bitstream_size回傳需要的bytes (bitstream指向context的pool)
+
+/* vcodec_encode_frame_stream()收到bitstream時呼叫，回傳0表示成功 (非0時停止寫出並回傳VCODEC_ERROR) */
+typedef int (*VCodecWriteCallback)(void* arg, const uint8_t* data, size_t size);
+
+/* 編碼/解碼一張frame需要的參數 (解碼時quant_type以外的量化設定由bitstream header決定) */
+typedef struct {
+    int width;
+    int height;
+    YUVFormat format;
+    BlockInfo block_info;
+    TransformType transform_type;
+    PipelineMode pipeline_mode;
+    CompressionType compression_type;
+    EntropyType entropy_type;
+    QuantType quant_type;
+    int qp;                        // H264_QUANT的quantization parameter (0~51)，只有encoder使用
+    int quality;                   // JPEG_QUANT_STANDARD的quality (1~100)，只有encoder使用
+    EntropyConfig entropy_config;  // huffman_optimize/restart_interval/segment_index/scan_mode只有encoder使用
+    SimdLevel simd_level;
+}VCodecParams;
+
+typedef struct {
+    VCodecParams params;
+    YUVFrame* frame;               // 輸入planes的stride和width相同時，raw data暫時直接指到呼叫者的planes
+    uint8_t* frame_raw[3];         // frame自己配置的y/u/v raw data
+    QuantParams quant_params;      // 所有frames共用，建立時就準備好
+    EntropyWorkspace* workspace;   // entropy coding的係數和symbols，第一張frame時配置，之後重複使用
+    uint8_t* pool;                 // 沒有提供output buffer時使用的bitstream buffer，重複使用 (不夠時變大)
+    size_t pool_capacity;
+}VCodecEncoder;
+
+typedef struct {
+    VCodecParams params;
+    YUVFrame* frame;               // 解碼結果，複製到呼叫者的planes
+    QuantParams quant_params;      // 量化表/QP從每張frame的header取得
+    EntropyWorkspace* workspace;   // entropy decoding的係數和bitstream buffer，第一張frame時配置，之後重複使用
+}VCodecDecoder;
+
+void vcodec_default_params(VCodecParams* params, int width, int height, YUVFormat format);
+
+VCodecEncoder* vcodec_encoder_create(const VCodecParams* params);
+int vcodec_encode_frame(VCodecEncoder* encoder, const uint8_t* const planes[3], const int strides[3],
+                        uint8_t* out, size_t out_capacity, const uint8_t** bitstream, size_t* bitstream_size);
+int vcodec_encode_frame_stream(VCodecEncoder* encoder, const uint8_t* const planes[3], const int strides[3],
+                               VCodecWriteCallback write, void* arg, size_t* bitstream_size);
+void vcodec_encoder_destroy(VCodecEncoder* encoder);
+
+VCodecDecoder* vcodec_decoder_create(const VCodecParams* params);
+int vcodec_decode_frame(VCodecDecoder* decoder, const uint8_t* data, size_t size, uint8_t* const planes[3], const int strides[3]);
+void vcodec_decoder_destroy(VCodecDecoder* decoder);
+
+#endif /* VCODEC_H */
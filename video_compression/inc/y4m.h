@@ -0,0 +1,27 @@
+#ifndef Y4M_H
+#define Y4M_H
+
+#include<stdio.h>
+#include<stdint.h>
+#include"yuv.h"
+
+#define Y4M_MAX_LINE  1024   // header和FRAME行的最大長度
+
+/* YUV4MPEG2 (.y4m): 一行文字header，之後每張frame是一行"FRAME"加上planar y/u/v data
+ * 只支援8-bit的C420 (jpeg/paldv/mpeg2)、C422和C444
+ */
+typedef struct {
+    int width;
+    int height;
+    YUVFormat format;
+    int fps_num;      // frame rate分子 (header沒有時是30)
+    int fps_den;      // frame rate分母 (header沒有時是1)
+}Y4MInfo;
+
+void y4m_plane_info(const Y4MInfo* info, int widths[3], int heights[3]);
+int y4m_read_header(FILE* fp, Y4MInfo* info);
+int y4m_read_frame(FILE* fp, const Y4MInfo* info, uint8_t* const planes[3]);
+int y4m_write_header(FILE* fp, const Y4MInfo* info);
+int y4m_write_frame(FILE* fp, const Y4MInfo* info, const uint8_t* const planes[3]);
+
+#endif /* Y4M_H */
@@ -37,7 +37,7 @@ void get_yuv_size_info(YUVFormat format,int width, int height, size_t* frame_siz
 YUVFrame* read_yuv_frame_data(FILE* fp, YUVFrame* frame, YUVFormat format);
 YUVVideo* read_yuv_file(const char* file, int width, int height, YUVFormat format, int truncate_yuv_frame, int truncate_yuv_index);
 void save_raw_frame_to_yuv_file(const char* file, YUVFrame* frame);
-void save_idct_frame_to_yuv_file(const char* file, YUVFrame* frame);
+void copy_padded_to_raw(YUVFrame* frame);
 void free_yuv_frame(YUVFrame* frame);
 
 #endif /* YUV_H */
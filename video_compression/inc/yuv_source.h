@@ -0,0 +1,46 @@
+#ifndef YUV_SOURCE_H
+#define YUV_SOURCE_H
+
+#include<stdio.h>
+#include<stdint.h>
+#include<pthread.h>
+#include"yuv.h"
+
+#define YUV_SOURCE_READ_AHEAD  2   // 除了正在編碼的frames以外，最多預先讀取的frames個數
+
+typedef enum {
+    INPUT_READ=0,   // reader thread用fread讀到ring裡的frames
+    INPUT_MMAP      // mmap整個.yuv檔，raw data直接指到mapping (不需要複製)
+}InputMode;
+
+/* 依序讀取.yuv檔案的frames，只保留ring裡的幾張frames (記憶體和影片長度無關)
+ *   背景的reader thread預先讀取後面的frames，frame i放在slots[i % slots_num]
+ *   slot被release後才會讀取下一張使用這個slot的frame
+ *   INPUT_MMAP時沒有reader thread，slot的raw data直接指到mapping裡的frame，只使用slot的padded data
+ */
+typedef struct {
+    FILE* fp;
+    InputMode input_mode;
+    int total_frames;          // 會讀取的frames個數
+    size_t frame_size;         // 一張frame的bytes
+    size_t y_size, u_size;     // Y/U plane的bytes (INPUT_MMAP計算plane的位置)
+    uint8_t* map;              // INPUT_MMAP: 整個.yuv檔的mapping (唯讀)
+    size_t map_size;
+    YUVFrame** slots;          // 預先配置好的frames
+    int* slot_frame;           // 每個slot目前存放的frame index，-1表示可以讀取新的frame
+    int slots_num;
+    int error;                 // 1: 讀取失敗，之後的frames都拿不到
+    int stop;                  // 1: reader thread結束
+    int reader_started;        // 1: 有建立reader thread (INPUT_MMAP不需要)
+    pthread_t reader;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;       // frame讀取完成或slot被release時通知
+}YUVSource;
+
+YUVSource* yuv_source_open(const char* file, int width, int height, YUVFormat format,
+                           int truncate_yuv_frame, int truncate_yuv_index, int alignment, int frames_in_flight, InputMode input_mode);
+YUVFrame* yuv_source_get_frame(YUVSource* source, int frame_idx);
+void yuv_source_release_frame(YUVSource* source, int frame_idx);
+void yuv_source_close(YUVSource* source);
+
+#endif /* YUV_SOURCE_H */
@@ -13,13 +13,26 @@
 #include<string.h>
 #include<sys/types.h>
 #include<sys/stat.h>
+#include<sys/resource.h>
 #include<errno.h>
 #include<ctype.h>
+#include<unistd.h>
 #include"yuv.h"
 #include"transform.h"
+#include"transform_simd.h"
+#include"cpu.h"
 #include"block.h"
 #include"quantization/quantization.h"
+#include"quantization/h264/quant_h264.h"
+#include"quantization/quant_simd.h"
 #include"entropy/entropy.h"
+#include"pipeline.h"
+#include"thread_pool.h"
+#include"yuv_source.h"
+#include"container.h"
+#include"frame_decoder.h"
+#include"vcodec.h"
+#include"y4m.h"
 #include"main.h"
 
 
@@ -96,7 +109,7 @@ void load_encode_config(AppEncodeConfig* config, const char* config_file_path)
         trim(value);
 
         if (strcmp(key, "input_path") == 0) {
-            strncpy(config->input_path, value, MAX_PATH_LEN);
+            snprintf(config->input_path, MAX_PATH_LEN, "%s", value);
         } else if (strcmp(key, "width") == 0) {
             config->yuv_raw_info.width = atoi(value);
         } else if (strcmp(key, "height") == 0) {
@@ -112,22 +125,71 @@ void load_encode_config(AppEncodeConfig* config, const char* config_file_path)
             config->compress_info.block_info.width = atoi(value);
         } else if (strcmp(key, "block_height") == 0) {
             config->compress_info.block_info.height = atoi(value);
+        } else if (strcmp(key, "transform_type") == 0) {
+            if (strcmp(value, "DCT_REFERENCE") == 0) config->compress_info.transform_type = DCT_REFERENCE;
+            else if (strcmp(value, "DCT_INT_FAST") == 0) config->compress_info.transform_type = DCT_INT_FAST;
         } else if (strcmp(key, "compress_type") == 0) {
             if (strcmp(value, "JPEG_SEQUENTIAL") == 0) config->compress_info.comprss_type = JPEG_SEQUENTIAL;
         } else if (strcmp(key, "quant_type") == 0) {
             if (strcmp(value, "JPEG_QUANT_STANDARD") == 0) config->compress_info.quant_type = JPEG_QUANT_STANDARD;
+            else if (strcmp(value, "H264_QUANT") == 0) config->compress_info.quant_type = H264_QUANT;
+        } else if (strcmp(key, "qp") == 0) {
+            config->compress_info.qp = atoi(value);
+            if (config->compress_info.qp < H264_QP_MIN || config->compress_info.qp > H264_QP_MAX) {
+                fprintf(stderr, "qp should be in [%d, %d], clip %d\n", H264_QP_MIN, H264_QP_MAX, config->compress_info.qp);
+                config->compress_info.qp = (config->compress_info.qp < H264_QP_MIN) ? H264_QP_MIN : H264_QP_MAX;
+            }
+        } else if (strcmp(key, "quality") == 0) {
+            config->compress_info.quality = atoi(value);
+            if (config->compress_info.quality < 1 || config->compress_info.quality > 100) {
+                fprintf(stderr, "quality should be in [1, 100], clip %d\n", config->compress_info.quality);
+                config->compress_info.quality = (config->compress_info.quality < 1) ? 1 : 100;
+            }
         } else if (strcmp(key, "entropy_type") == 0) {
             if (strcmp(value, "HUFFMAN") == 0) config->compress_info.entropy_type = HUFFMAN;
+        } else if (strcmp(key, "huffman_optimize") == 0) {
+            config->compress_info.huffman_optimize = atoi(value);
+        } else if (strcmp(key, "restart_interval") == 0) {
+            config->compress_info.restart_interval = atoi(value);
+            if (config->compress_info.restart_interval < 0 || config->compress_info.restart_interval > ENTROPY_RESTART_INTERVAL_MAX) {
+                fprintf(stderr, "restart_interval should be in [0, %d], clip %d\n", ENTROPY_RESTART_INTERVAL_MAX, config->compress_info.restart_interval);
+                config->compress_info.restart_interval = (config->compress_info.restart_interval < 0) ? 0 : ENTROPY_RESTART_INTERVAL_MAX;
+            }
+        } else if (strcmp(key, "segment_index") == 0) {
+            config->compress_info.segment_index = atoi(value);
+        } else if (strcmp(key, "scan_mode") == 0) {
+            if (strcmp(value, "INTERLEAVED") == 0) config->compress_info.scan_mode = SCAN_INTERLEAVED;
+            else if (strcmp(value, "PER_COMPONENT") == 0) config->compress_info.scan_mode = SCAN_PER_COMPONENT;
         } else if (strcmp(key, "output_yuv_raw_dir") == 0) {
-            strncpy(config->output_yuv_raw_dir, value, MAX_PATH_LEN);
+            snprintf(config->output_yuv_raw_dir, MAX_PATH_LEN, "%s", value);
+        } else if (strcmp(key, "output_container_path") == 0) {
+            snprintf(config->output_container_path, MAX_PATH_LEN, "%s", value);
         } else if (strcmp(key, "output_bitstream_dir") == 0) {
-            strncpy(config->output_bitstream_dir, value, MAX_PATH_LEN);
+            snprintf(config->output_bitstream_dir, MAX_PATH_LEN, "%s", value);
         } else if (strcmp(key, "save_yuv_raw_frame") == 0) {
             config->option_info.save_yuv_raw_frame = atoi(value);
         } else if (strcmp(key, "truncate_yuv_frame") == 0) {
             config->option_info.truncate_yuv_frame = atoi(value);
         } else if (strcmp(key, "truncate_yuv_index") == 0) {
             config->option_info.truncate_yuv_index = atoi(value);
+        } else if (strcmp(key, "report_transform_accuracy") == 0) {
+            config->option_info.report_transform_accuracy = atoi(value);
+        } else if (strcmp(key, "simd_level") == 0) {
+            if (simd_parse_level(value, &config->option_info.simd_level) != 0) {
+                fprintf(stderr, "Unknown simd_level: %s, use AUTO\n", value);
+                config->option_info.simd_level = SIMD_AUTO;
+            }
+        } else if (strcmp(key, "pipeline_mode") == 0) {
+            if (strcmp(value, "MULTI_PASS") == 0) config->option_info.pipeline_mode = PIPELINE_MULTI_PASS;
+            else if (strcmp(value, "FUSED") == 0) config->option_info.pipeline_mode = PIPELINE_FUSED;
+            else if (strcmp(value, "STRIPE") == 0) config->option_info.pipeline_mode = PIPELINE_STRIPE;
+        } else if (strcmp(key, "entropy_threads") == 0) {
+            config->option_info.entropy_threads = atoi(value);
+        } else if (strcmp(key, "threads") == 0) {
+            config->option_info.threads = atoi(value);
+        } else if (strcmp(key, "input_mode") == 0) {
+            if (strcmp(value, "READ") == 0) config->option_info.input_mode = INPUT_READ;
+            else if (strcmp(value, "MMAP") == 0) config->option_info.input_mode = INPUT_MMAP;
         }
     }
     fclose(fp);
@@ -189,100 +251,370 @@ void load_decode_config(AppDecodeConfig* config, const char* config_file_path)
             config->compress_info.block_info.width = atoi(value);
         } else if (strcmp(key, "block_height") == 0) {
             config->compress_info.block_info.height = atoi(value);
+        } else if (strcmp(key, "transform_type") == 0) {
+            if (strcmp(value, "DCT_REFERENCE") == 0) config->compress_info.transform_type = DCT_REFERENCE;
+            else if (strcmp(value, "DCT_INT_FAST") == 0) config->compress_info.transform_type = DCT_INT_FAST;
         } else if (strcmp(key, "compress_type") == 0) {
             if (strcmp(value, "JPEG_SEQUENTIAL") == 0) config->compress_info.comprss_type = JPEG_SEQUENTIAL;
         } else if (strcmp(key, "quant_type") == 0) {
             if (strcmp(value, "JPEG_QUANT_STANDARD") == 0) config->compress_info.quant_type = JPEG_QUANT_STANDARD;
+            else if (strcmp(value, "H264_QUANT") == 0) config->compress_info.quant_type = H264_QUANT;
         } else if (strcmp(key, "entropy_type") == 0) {
             if (strcmp(value, "HUFFMAN") == 0) config->compress_info.entropy_type = HUFFMAN;
         } else if (strcmp(key, "output_yuv_idct_dir") == 0) {
-            strncpy(config->output_yuv_idct_dir, value, MAX_PATH_LEN);
+            snprintf(config->output_yuv_idct_dir, MAX_PATH_LEN, "%s", value);
+        } else if (strcmp(key, "input_container_path") == 0) {
+            snprintf(config->input_container_path, MAX_PATH_LEN, "%s", value);
         } else if (strcmp(key, "input_bitstream_dir") == 0) {
-            strncpy(config->input_bitstream_dir, value, MAX_PATH_LEN);
+            snprintf(config->input_bitstream_dir, MAX_PATH_LEN, "%s", value);
         } else if (strcmp(key, "save_idct_yuv_frame") == 0) {
             config->option_info.save_idct_yuv_frame = atoi(value);
+        } else if (strcmp(key, "report_transform_accuracy") == 0) {
+            config->option_info.report_transform_accuracy = atoi(value);
+        } else if (strcmp(key, "simd_level") == 0) {
+            if (simd_parse_level(value, &config->option_info.simd_level) != 0) {
+                fprintf(stderr, "Unknown simd_level: %s, use AUTO\n", value);
+                config->option_info.simd_level = SIMD_AUTO;
+            }
+        } else if (strcmp(key, "pipeline_mode") == 0) {
+            if (strcmp(value, "MULTI_PASS") == 0) config->option_info.pipeline_mode = PIPELINE_MULTI_PASS;
+            else if (strcmp(value, "FUSED") == 0) config->option_info.pipeline_mode = PIPELINE_FUSED;
+            else if (strcmp(value, "STRIPE") == 0) config->option_info.pipeline_mode = PIPELINE_STRIPE;
+        } else if (strcmp(key, "entropy_threads") == 0) {
+            config->option_info.entropy_threads = atoi(value);
+        } else if (strcmp(key, "threads") == 0) {
+            config->option_info.threads = atoi(value);
+        } else if (strcmp(key, "cache_mb") == 0) {
+            config->option_info.cache_mb = atoi(value);
+        } else if (strcmp(key, "prefetch_frames") == 0) {
+            config->option_info.prefetch_frames = atoi(value);
         }
     }
     fclose(fp);
 }
 
+/*  function: report_peak_memory()
+    Params:
+        int workspaces_num     : entropy workspaces的個數 (同時編碼/解碼的frames個數)
+        size_t workspace_bytes : 所有entropy workspaces配置的bytes
+
+    Return:
+        None
+
+    Result:
+        印出entropy workspaces的大小和process的peak RSS (getrusage的ru_maxrss，Linux的單位是KB)
+ */
+void report_peak_memory(int workspaces_num, size_t workspace_bytes)
+{
+    struct rusage usage;
+
+    printf("Entropy workspaces: %d, %zu KB\n", workspaces_num, workspace_bytes / 1024);
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        printf("Peak RSS: %ld KB\n", usage.ru_maxrss);
+    }
+}
+
+/* 平行編碼frames時共用的資訊 */
+typedef struct {
+    AppEncodeConfig* appencconfig;
+    YUVSource* yuv_source;       // 背景讀取frames的source
+    QuantParams* quant_params;   // 所有frames共用 (只會讀取)
+    VideoContainer* container;   // 不是NULL時，frames依序加到container (不寫每張frame的檔案)
+    EntropyWorkspace** workspaces; // 每個worker一個entropy workspace，編碼時取一個閒置的，編碼完放回
+    int free_workspaces;         // workspaces前面free_workspaces個是閒置的
+    pthread_mutex_t mutex;
+    pthread_cond_t commit_cond;  // 有frame的bitstream commit時通知
+    int next_commit;             // 下一張要commit的frame
+}EncodeFramesJob;
+
+/*  function: encode_frame_job()
+    Params:
+        void* arg     : EncodeFramesJob*
+        int frame_idx : 第幾張frame
+
+    Return:
+        None
+
+    Result:
+        frame pool的工作，DCT forward --> Quantization forward --> Entropy encoding一張frame
+        1. 從yuv source取得frame (等reader thread讀完)，編碼完就release，讓source讀取後面的frames
+        2. bitstream先寫到暫存檔 (frame_%04d_bs.bin.tmp)，使用container時寫到memory
+        3. 等前面的frames都commit後才rename成frame_%04d_bs.bin，輸出資料夾裡一定是連續的frames
+           使用container時，依照frame順序加到container
+        係數和DC/AC symbols放在worker取得的entropy workspace，frames之間重複使用，不同workers不會共用scratch
+ */
+void encode_frame_job(void* arg, int frame_idx)
+{
+    EncodeFramesJob* job = (EncodeFramesJob*)arg;
+    AppEncodeConfig* appencconfig = job->appencconfig;
+    YUVFrame* frame = yuv_source_get_frame(job->yuv_source, frame_idx);
+    char bs_file_path[MAX_FRAME_PATH_LEN];
+    char tmp_file_path[MAX_FRAME_PATH_LEN + 8];
+    char* payload = NULL;
+    size_t payload_size = 0;
+    FILE* bs_fp = NULL;
+
+    memset(bs_file_path, 0x0, sizeof(bs_file_path));
+    snprintf(bs_file_path, sizeof(bs_file_path), "%sframe_%04d_bs.bin", appencconfig->output_bitstream_dir, frame_idx);
+    snprintf(tmp_file_path, sizeof(tmp_file_path), "%s.tmp", bs_file_path);
+
+    if (frame != NULL) {
+        /* 將讀取後的yuv raw data儲存 */
+        if (appencconfig->option_info.save_yuv_raw_frame) {
+            char raw_filename[MAX_FRAME_PATH_LEN];
+            snprintf(raw_filename, sizeof(raw_filename), "%sframe_%04d.yuv", appencconfig->output_yuv_raw_dir, frame_idx);
+            save_raw_frame_to_yuv_file(raw_filename, frame);
+        }
+
+        frame->y.block_info = appencconfig->compress_info.block_info;
+        frame->u.block_info = appencconfig->compress_info.block_info;
+        frame->v.block_info = appencconfig->compress_info.block_info;
+
+        bs_fp = (job->container != NULL) ? open_memstream(&payload, &payload_size) : fopen(tmp_file_path, "wb");
+        if (bs_fp == NULL) {
+            fprintf(stderr, "Failed to open bitstream of frame %d\n", frame_idx);
+        } else {
+            /* 同時編碼的frames不超過workers個數，一定有閒置的workspace (沒有workspaces時每張frame暫時配置) */
+            EntropyWorkspace* workspace = NULL;
+            pthread_mutex_lock(&job->mutex);
+            if (job->workspaces != NULL) workspace = job->workspaces[--job->free_workspaces];
+            pthread_mutex_unlock(&job->mutex);
+
+            if (encode_frame(frame, appencconfig->option_info.pipeline_mode, appencconfig->compress_info.transform_type, \
+                             job->quant_params, appencconfig->compress_info.comprss_type, appencconfig->compress_info.entropy_type, bs_fp, workspace) != 0) {
+                fprintf(stderr, "Failed to encode frame %d\n", frame_idx);
+            }
+            fclose(bs_fp);
+
+            pthread_mutex_lock(&job->mutex);
+            if (job->workspaces != NULL) job->workspaces[job->free_workspaces++] = workspace;
+            pthread_mutex_unlock(&job->mutex);
+        }
+        yuv_source_release_frame(job->yuv_source, frame_idx);
+    }
+
+    /* 依照frame順序commit (前面的frames一定已經被其他workers拿走，不會互相等待) */
+    pthread_mutex_lock(&job->mutex);
+    while (job->next_commit != frame_idx) {
+        pthread_cond_wait(&job->commit_cond, &job->mutex);
+    }
+    if (bs_fp != NULL) {
+        if (job->container != NULL) {
+            if (container_append_frame(job->container, (const uint8_t*)payload, payload_size) != 0) {
+                fprintf(stderr, "Failed to commit frame %d to container\n", frame_idx);
+            }
+        } else if (rename(tmp_file_path, bs_file_path) != 0) {
+            fprintf(stderr, "Failed to commit bitstream: %s\n", bs_file_path);
+        }
+    }
+    job->next_commit++;
+    pthread_cond_broadcast(&job->commit_cond);
+    pthread_mutex_unlock(&job->mutex);
+    free(payload);
+}
+
 void app_encode_process(AppEncodeConfig* appencconfig)
 {
-    YUVVideo* yuv_video;
-    char bs_file_path[MAX_PATH_LEN];
+    YUVSource* yuv_source;
+    QuantParams quant_params;
     int ret = 0;
     
-    
+    /* 建立存放bitstream和yuv raw frame的資料夾 */
+    ret =create_output_dirs(appencconfig->output_bitstream_dir, appencconfig->option_info.save_yuv_raw_frame, \
+                            appencconfig->output_yuv_raw_dir, 0, NULL);
+    if (ret != 1) {
+        /* 存放的壓縮data的資料夾建立失敗，不繼續做後續的壓縮 */
+        return;
+    }
+
     // 目前只支援YUV planar格式
-    yuv_video = read_yuv_file(appencconfig->input_path, appencconfig->yuv_raw_info.width, \
-                              appencconfig->yuv_raw_info.height, appencconfig->yuv_raw_info.format, \
-                              appencconfig->option_info.truncate_yuv_frame, appencconfig->option_info.truncate_yuv_index);
-    if (yuv_video != NULL) {
-        /* 建立存放yuv raw frame的資料夾 */
-        ret =create_output_dirs(appencconfig->output_bitstream_dir, appencconfig->option_info.save_yuv_raw_frame, \
-                                appencconfig->output_yuv_raw_dir, 0, NULL);
-        if (ret != 1) {
-            /* 存放的壓縮data的資料夾建立失敗，則釋放frame的記憶體，不繼續做後續的壓縮 */
-            for (int i = 0; i < yuv_video->total_frames; i++) {
-                if (yuv_video->frames[i] != NULL) {
-                    free_yuv_frame(yuv_video->frames[i]);
-                }
-            }
-            free(yuv_video);
-            return -1;
-        }
-        /* 將讀取後的yuv raw data儲存 */
-        if (appencconfig->option_info.save_yuv_raw_frame) {
-            char raw_filename[256];
-            for (int i = 0; i < yuv_video->total_frames; i++) {
-                sprintf(raw_filename, "%sframe_%04d.yuv", appencconfig->output_yuv_raw_dir, i);
-                save_raw_frame_to_yuv_file(raw_filename, yuv_video->frames[i]);
-            }
+    /* 為了u/v切成block後，width和height可能不足整數，因此需要做8-alignment，但是考慮到MCU的關係，直接使用64-alignment
+       frames在背景依序讀取，記憶體只有frame pool的threads個數加上read-ahead的frames */
+    yuv_source = yuv_source_open(appencconfig->input_path, appencconfig->yuv_raw_info.width, \
+                                 appencconfig->yuv_raw_info.height, appencconfig->yuv_raw_info.format, \
+                                 appencconfig->option_info.truncate_yuv_frame, appencconfig->option_info.truncate_yuv_index, \
+                                 64, appencconfig->option_info.threads, appencconfig->option_info.input_mode);
+    if (yuv_source != NULL) {
+        /* 依照CPUID和設定選擇transform和quantization的SIMD kernels */
+        transform_dsp_init(simd_resolve_level(appencconfig->option_info.simd_level));
+        quant_dsp_init(transform_dsp_get()->level);
+        printf("Transform SIMD level: %s\n", simd_level_name(transform_dsp_get()->level));
+
+        /* 印出fast DCT和reference DCT的誤差，確認可以使用fast DCT */
+        if (appencconfig->option_info.report_transform_accuracy) {
+            transform_accuracy_report(10000);
         }
 
         /* 先處理好entropy coding需要的資源 */
-        entropy_initialization(appencconfig->compress_info.entropy_type);
+        EntropyConfig entropy_config;
+        entropy_config.huffman_optimize = appencconfig->compress_info.huffman_optimize;
+        entropy_config.restart_interval = appencconfig->compress_info.restart_interval;
+        entropy_config.threads = appencconfig->option_info.entropy_threads;
+        entropy_config.segment_index = appencconfig->compress_info.segment_index;
+        entropy_config.scan_mode = appencconfig->compress_info.scan_mode;
+        entropy_initialization(appencconfig->compress_info.entropy_type, &entropy_config);
+
+        /* 量化方式、QP和quality縮放後的量化表，所有frame共用 */
+        quant_params_init(&quant_params, appencconfig->compress_info.quant_type, appencconfig->compress_info.qp, appencconfig->compress_info.quality);
+
+        /* 量化表需要的參數在workers開始前準備好，之後每張frame只會讀取 */
+        quantize_prepare(&quant_params);
+
+        /* 設定output_container_path時，所有frames寫到同一個container檔案 (global header + frames + index) */
+        VideoContainer* container = NULL;
+        if (appencconfig->output_container_path[0] != '\0') {
+            ContainerInfo container_info;
+            container_info.width = appencconfig->yuv_raw_info.width;
+            container_info.height = appencconfig->yuv_raw_info.height;
+            container_info.format = appencconfig->yuv_raw_info.format;
+            container_info.block_info = appencconfig->compress_info.block_info;
+            container_info.quant_type = appencconfig->compress_info.quant_type;
+            container_info.compression_type = appencconfig->compress_info.comprss_type;
+            container_info.entropy_type = appencconfig->compress_info.entropy_type;
+            container = container_create(appencconfig->output_container_path, &container_info);
+        }
 
-        /* 以sequential方式處理video裡的每一張frame */
-        for (int i = 0; i < yuv_video->total_frames; i++) {
-            yuv_video->frames[i]->y.block_info = appencconfig->compress_info.block_info;
-            yuv_video->frames[i]->u.block_info = appencconfig->compress_info.block_info;
-            yuv_video->frames[i]->v.block_info = appencconfig->compress_info.block_info;
+        /* 每張frame都是intra coding，互相獨立: frame pool同時編碼threads張frames，bitstream依照frame順序commit
+           每個worker一個entropy workspace，第一張frame時依照frame大小配置，之後的frames重複使用 */
+        int workers_num = (appencconfig->option_info.threads > 1) ? appencconfig->option_info.threads : 1;
+        EntropyWorkspace** workspaces = (EntropyWorkspace**)calloc(workers_num, sizeof(EntropyWorkspace*));
+        if (workspaces == NULL) {
+            perror("Failed to allocate entropy workspaces, allocate them per frame.\n");
+        }
+        for (int i = 0; workspaces != NULL && i < workers_num; i++) {
+            workspaces[i] = entropy_workspace_create(appencconfig->compress_info.entropy_type);
+        }
+        ThreadPool* frame_pool = thread_pool_create(appencconfig->option_info.threads);
+        EncodeFramesJob frames_job;
+        frames_job.appencconfig = appencconfig;
+        frames_job.yuv_source = yuv_source;
+        frames_job.quant_params = &quant_params;
+        frames_job.container = container;
+        frames_job.workspaces = workspaces;
+        frames_job.free_workspaces = workers_num;
+        frames_job.next_commit = 0;
+        pthread_mutex_init(&frames_job.mutex, NULL);
+        pthread_cond_init(&frames_job.commit_cond, NULL);
 
-            /* DCT forward */
-            transform_frame(yuv_video->frames[i]);
+        thread_pool_run(frame_pool, encode_frame_job, &frames_job, yuv_source->total_frames);
 
-            /* Quantization forward */
-            quantize_frame(yuv_video->frames[i], appencconfig->compress_info.quant_type);
+        thread_pool_destroy(frame_pool);
+        pthread_mutex_destroy(&frames_job.mutex);
+        pthread_cond_destroy(&frames_job.commit_cond);
 
-            /* Entropy encoding */
-            memset(bs_file_path, 0x0, sizeof(bs_file_path));
-            sprintf(bs_file_path, "%sframe_%04d_bs.bin", appencconfig->output_bitstream_dir, i);
-            entropy_encode(yuv_video->frames[i], appencconfig->compress_info.quant_type, appencconfig->compress_info.comprss_type, \
-                           appencconfig->compress_info.entropy_type, bs_file_path);
+        /* 在container最後寫入frame index */
+        if (container != NULL && container_close(container) != 0) {
+            fprintf(stderr, "Failed to finish container: %s\n", appencconfig->output_container_path);
         }
 
         /* 釋放entropy coding的資源 */
+        size_t workspace_bytes = 0;
+        for (int i = 0; workspaces != NULL && i < workers_num; i++) {
+            workspace_bytes += entropy_workspace_size(appencconfig->compress_info.entropy_type, workspaces[i]);
+            entropy_workspace_destroy(appencconfig->compress_info.entropy_type, workspaces[i]);
+        }
+        free(workspaces);
         entropy_destropy(appencconfig->compress_info.entropy_type);
 
-        /* 將video使用到的memory釋放 */
-        for (int i = 0; i < yuv_video->total_frames; i++) {
-            if (yuv_video->frames[i] != NULL) {
-                free_yuv_frame(yuv_video->frames[i]);
-            }
-        }
+        printf("Encoding %d frames has successfully done.\n", yuv_source->total_frames);
+        report_peak_memory(workers_num, workspace_bytes);
 
-        printf("Encoding %d frames has successfully done.\n", yuv_video->total_frames);
-        free(yuv_video);
+        /* 結束背景讀取，釋放ring裡的frames */
+        yuv_source_close(yuv_source);
     }
 }
 
 
+/* 平行解碼時ring裡的一個frame，frame_idx % slots_num的frame使用 */
+typedef struct {
+    YUVFrame* frame;
+    QuantParams quant_params;    // 量化表/QP從這張frame的header取得，每個slot各自一份
+    EntropyWorkspace* workspace; // 這個slot的frames共用的entropy workspace (同一個slot同時只有一張frame)
+}DecodeFrameSlot;
+
+/* 平行解碼frames時共用的資訊 */
+typedef struct {
+    AppDecodeConfig* appdecconfig;
+    DecodeFrameSlot* slots;      // 預先配置好的frames (slots_num張)
+    VideoContainer* container;   // 不是NULL時，從container讀取每張frame的bitstream
+    int slots_num;
+    pthread_mutex_t mutex;
+    pthread_cond_t write_cond;   // 有frame寫出時通知
+    int next_write;              // 下一張要寫出的frame
+}DecodeFramesJob;
+
+/*  function: decode_frame_job()
+    Params:
+        void* arg     : DecodeFramesJob*
+        int frame_idx : 第幾張frame
+
+    Return:
+        None
+
+    Result:
+        frame pool的工作，Entropy decoding --> de-quantization --> transform backward一張frame
+        1. 解碼到slots[frame_idx % slots_num]，slots_num不小於frame pool的threads個數
+           bitstream從frame_%04d_bs.bin讀取，使用container時依照index讀到memory
+        2. 等前面的frames都寫出後，依照frame順序儲存解碼後的yuv
+        workers依序拿frames，前面還沒寫出的frames都還在workers裡，
+        所以同一個slot的上一張frame (frame_idx - slots_num) 一定已經寫出，記憶體最多slots_num張frames
+ */
+void decode_frame_job(void* arg, int frame_idx)
+{
+    DecodeFramesJob* job = (DecodeFramesJob*)arg;
+    AppDecodeConfig* appdecconfig = job->appdecconfig;
+    DecodeFrameSlot* slot = &job->slots[frame_idx % job->slots_num];
+    char bs_file_path[MAX_FRAME_PATH_LEN];
+    char idct_filename[MAX_FRAME_PATH_LEN];
+    uint8_t* payload = NULL;
+    size_t payload_size = 0;
+    FILE* bs_fp = NULL;
+
+    if (job->container != NULL) {
+        payload = container_read_frame(job->container, frame_idx, &payload_size);
+        if (payload != NULL) bs_fp = fmemopen(payload, payload_size, "rb");
+    } else {
+        /* 設定bitstream檔案名稱 */
+        memset(bs_file_path, 0x0, sizeof(bs_file_path));
+        snprintf(bs_file_path, sizeof(bs_file_path), "%sframe_%04d_bs.bin", appdecconfig->input_bitstream_dir, frame_idx);
+        bs_fp = fopen(bs_file_path, "rb");
+    }
+    if (bs_fp == NULL) {
+        fprintf(stderr, "Failed to open bitstream of frame %d\n", frame_idx);
+    }
+
+    /* entropy decoding --> de-quantization --> transform backward，結果放在slot的frame的raw data */
+    int ret = decode_frame(slot->frame, appdecconfig->option_info.pipeline_mode, appdecconfig->compress_info.transform_type, &slot->quant_params, \
+                           appdecconfig->compress_info.comprss_type, appdecconfig->compress_info.entropy_type, bs_fp, slot->workspace);
+    if (ret != 0) {
+        fprintf(stderr, "Failed to decode frame %d\n", frame_idx);
+    }
+    if (bs_fp != NULL) fclose(bs_fp);
+    free(payload);
+
+    /* 依照frame順序寫出 (前面的frames一定已經被其他workers拿走，不會互相等待) */
+    pthread_mutex_lock(&job->mutex);
+    while (job->next_write != frame_idx) {
+        pthread_cond_wait(&job->write_cond, &job->mutex);
+    }
+    pthread_mutex_unlock(&job->mutex);
+
+    /* 將解碼後的yuv data儲存下來 (raw data在slot重複使用，完整覆寫，不需要清空；解碼失敗時是上一張frame的內容，不儲存) */
+    if (ret == 0) {
+        memset(idct_filename, 0x0, sizeof(idct_filename));
+        snprintf(idct_filename, sizeof(idct_filename), "%sframe_%04d.yuv", appdecconfig->output_yuv_idct_dir, frame_idx);
+        save_raw_frame_to_yuv_file(idct_filename, slot->frame);
+    }
+
+    pthread_mutex_lock(&job->mutex);
+    job->next_write++;
+    pthread_cond_broadcast(&job->write_cond);
+    pthread_mutex_unlock(&job->mutex);
+}
+
 int app_decode_process(AppDecodeConfig* appdecconfig)
 {
-    char bs_file_path[MAX_PATH_LEN];
-    char idct_filename[MAX_PATH_LEN];
-    YUVFrame* frame;
+    char bs_file_path[MAX_FRAME_PATH_LEN];
     FILE* fp;
     int ret;
     /* 建立存放解碼後的frame的資料夾 */
@@ -294,80 +626,423 @@ int app_decode_process(AppDecodeConfig* appdecconfig)
         return -1;
     }
 
-    int frame_idx = 0;
+    int frames_num = 0;
+
+    /* 設定input_container_path時，frame大小、format、block和壓縮設定都由container的global header決定 */
+    VideoContainer* container = NULL;
+    if (appdecconfig->input_container_path[0] != '\0') {
+        container = container_open(appdecconfig->input_container_path);
+        if (container == NULL) {
+            return -1;
+        }
+        appdecconfig->yuv_raw_info.width = container->info.width;
+        appdecconfig->yuv_raw_info.height = container->info.height;
+        appdecconfig->yuv_raw_info.format = container->info.format;
+        appdecconfig->compress_info.block_info = container->info.block_info;
+        appdecconfig->compress_info.quant_type = container->info.quant_type;
+        appdecconfig->compress_info.comprss_type = container->info.compression_type;
+        appdecconfig->compress_info.entropy_type = container->info.entropy_type;
+        frames_num = container->frames_num;
+    }
     
     int alignment = 64;  // u/v的height要align 8倍， MCU下的Y要align 16倍，取64-alignment
 
-    /* 先處理好entropy coding需要的資源 */
-    entropy_initialization(appdecconfig->compress_info.entropy_type);
+    /* 依照CPUID和設定選擇transform和quantization的SIMD kernels */
+    transform_dsp_init(simd_resolve_level(appdecconfig->option_info.simd_level));
+    quant_dsp_init(transform_dsp_get()->level);
+    printf("Transform SIMD level: %s\n", simd_level_name(transform_dsp_get()->level));
 
-    /* 根據decode設定，取得需要的記憶體空間 */
-    init_yuv_frame(&frame, appdecconfig->yuv_raw_info.format, appdecconfig->yuv_raw_info.width, appdecconfig->yuv_raw_info.height, alignment);
-    
-    /* 設定y、u、v的block資訊 */
-    frame->y.block_info = appdecconfig->compress_info.block_info;
-    frame->u.block_info = appdecconfig->compress_info.block_info;
-    frame->v.block_info = appdecconfig->compress_info.block_info;
-    
-    printf("Y w:%d h:%d pad_w:%d pad_h:%d\n", frame->y.width, frame->y.height, frame->y.padded_width, frame->y.padded_height);
-    printf("U w:%d h:%d pad_w:%d pad_h:%d\n", frame->u.width, frame->u.height, frame->u.padded_width, frame->u.padded_height);
-    printf("V w:%d h:%d pad_w:%d pad_h:%d\n", frame->v.width, frame->v.height, frame->v.padded_width, frame->v.padded_height);
+    /* 印出fast IDCT和reference IDCT的誤差，確認可以使用fast IDCT */
+    if (appdecconfig->option_info.report_transform_accuracy) {
+        transform_accuracy_report(10000);
+    }
 
+    /* 先處理好entropy coding需要的資源 (restart interval、segment index和scan mode由header決定) */
+    EntropyConfig entropy_config = {0};
+    entropy_config.threads = appdecconfig->option_info.entropy_threads;
+    entropy_initialization(appdecconfig->compress_info.entropy_type, &entropy_config);
 
-    /* 讀取以及解碼所有的bitstream檔案 */
-    while (1) {
-        /* 設定bitstream檔案名稱 */
-        memset(bs_file_path, 0x0, MAX_PATH_LEN);
-        sprintf(bs_file_path, "%sframe_%04d_bs.bin", appdecconfig->input_bitstream_dir, frame_idx);
+    /* 沒有container時，找出連續的bitstream檔案個數 */
+    while (container == NULL) {
+        memset(bs_file_path, 0x0, sizeof(bs_file_path));
+        snprintf(bs_file_path, sizeof(bs_file_path), "%sframe_%04d_bs.bin", appdecconfig->input_bitstream_dir, frames_num);
 
         fp = fopen(bs_file_path, "rb");
         if (fp == NULL) {
-            printf("Decoding %d frames has successfully done.\n", frame_idx);
             break;
         }
+        fclose(fp);
+        frames_num++;
+    }
 
-        /* entropy decoding :
-            檢查bitstream解碼出來的資訊是不是和設定檔相同
-            不相同則不會繼續解碼
-         */
-        entropy_decode(frame, appdecconfig->compress_info.quant_type, appdecconfig->compress_info.comprss_type, \
-                       appdecconfig->compress_info.entropy_type, bs_file_path);
+    /* 根據decode設定，預先配置ring裡的frames (同時解碼threads張frames) */
+    int slots_num = (appdecconfig->option_info.threads > 1) ? appdecconfig->option_info.threads : 1;
+    DecodeFrameSlot* slots = (DecodeFrameSlot*)calloc(slots_num, sizeof(DecodeFrameSlot));
+    if (slots == NULL) {
+        perror("Failed to allocate decode frames.\n");
+        entropy_destropy(appdecconfig->compress_info.entropy_type);
+        container_close(container);
+        return -1;
+    }
+    for (int i = 0; i < slots_num; i++) {
+        init_yuv_frame(&slots[i].frame, appdecconfig->yuv_raw_info.format, appdecconfig->yuv_raw_info.width, appdecconfig->yuv_raw_info.height, alignment);
 
-        /* de-quantization */
-        dequantize_frame(frame, appdecconfig->compress_info.quant_type);
+        /* 設定y、u、v的block資訊 */
+        slots[i].frame->y.block_info = appdecconfig->compress_info.block_info;
+        slots[i].frame->u.block_info = appdecconfig->compress_info.block_info;
+        slots[i].frame->v.block_info = appdecconfig->compress_info.block_info;
 
-        /* transform backward */
-        reverse_transform_frame(frame);
+        /* QP和量化表會在entropy decoding時從header取得 */
+        slots[i].quant_params.quant_type = appdecconfig->compress_info.quant_type;
+        slots[i].workspace = entropy_workspace_create(appdecconfig->compress_info.entropy_type);
+    }
+    
+    printf("Y w:%d h:%d pad_w:%d pad_h:%d\n", slots[0].frame->y.width, slots[0].frame->y.height, slots[0].frame->y.padded_width, slots[0].frame->y.padded_height);
+    printf("U w:%d h:%d pad_w:%d pad_h:%d\n", slots[0].frame->u.width, slots[0].frame->u.height, slots[0].frame->u.padded_width, slots[0].frame->u.padded_height);
+    printf("V w:%d h:%d pad_w:%d pad_h:%d\n", slots[0].frame->v.width, slots[0].frame->v.height, slots[0].frame->v.padded_width, slots[0].frame->v.padded_height);
 
-        /* 將idct後的yuv data儲存下來 */
-        memset(idct_filename, 0x0, sizeof(idct_filename));
-        sprintf(idct_filename, "%sframe_%04d.yuv", appdecconfig->output_yuv_idct_dir, frame_idx);
-        save_idct_frame_to_yuv_file(idct_filename, frame);
 
-        /* 將當下解碼後的raw data buffer清空，給下一張frame使用 */
-        memset(frame->y.raw_data, 0x0, sizeof(frame->y.width * frame->y.height));
-        memset(frame->u.raw_data, 0x0, sizeof(frame->u.width * frame->u.height));
-        memset(frame->y.raw_data, 0x0, sizeof(frame->y.width * frame->y.height));
-        memset(frame->y.padded_data, 0x0, sizeof(frame->y.padded_width * frame->y.padded_height));
-        memset(frame->u.padded_data, 0x0, sizeof(frame->u.padded_width * frame->u.padded_height));
-        memset(frame->v.padded_data, 0x0, sizeof(frame->v.padded_width * frame->v.padded_height));
+    /* 每張frame都是intra coding，互相獨立: frame pool同時解碼threads張frames，依照frame順序寫出 */
+    ThreadPool* frame_pool = thread_pool_create(slots_num);
+    DecodeFramesJob frames_job;
+    frames_job.appdecconfig = appdecconfig;
+    frames_job.slots = slots;
+    frames_job.slots_num = slots_num;
+    frames_job.container = container;
+    frames_job.next_write = 0;
+    pthread_mutex_init(&frames_job.mutex, NULL);
+    pthread_cond_init(&frames_job.write_cond, NULL);
 
-        frame_idx++;
-    }
+    thread_pool_run(frame_pool, decode_frame_job, &frames_job, frames_num);
+    printf("Decoding %d frames has successfully done.\n", frames_num);
+
+    thread_pool_destroy(frame_pool);
+    pthread_mutex_destroy(&frames_job.mutex);
+    pthread_cond_destroy(&frames_job.write_cond);
     
     /* 釋放entropy coding的資源 */
+    size_t workspace_bytes = 0;
+    for (int i = 0; i < slots_num; i++) {
+        workspace_bytes += entropy_workspace_size(appdecconfig->compress_info.entropy_type, slots[i].workspace);
+        entropy_workspace_destroy(appdecconfig->compress_info.entropy_type, slots[i].workspace);
+    }
     entropy_destropy(appdecconfig->compress_info.entropy_type);
+    report_peak_memory(slots_num, workspace_bytes);
+
+    for (int i = 0; i < slots_num; i++) {
+        free_yuv_frame(slots[i].frame);
+    }
+    free(slots);
+    container_close(container);
+    return 0;
+}
+
+/*  function: app_seek_process()
+    Params:
+        AppDecodeConfig* appdecconfig : decode設定 (需要input_container_path)
+        int frames_num                : 要解碼的frames個數
+        char* frames[]                : 依序要解碼的frame index (任意順序，可以重複)
+
+    Return:
+        0 : 成功
+        -1: container開啟失敗
+
+    Result:
+        使用FrameDecoder以任意順序解碼frames (LRU cache和prefetch)，儲存成frame_%04d.yuv，最後印出cache hit/miss
+ */
+int app_seek_process(AppDecodeConfig* appdecconfig, int frames_num, char* frames[])
+{
+    char idct_filename[MAX_FRAME_PATH_LEN];
+
+    if (appdecconfig->input_container_path[0] == '\0') {
+        fprintf(stderr, "Random access decoding needs input_container_path\n");
+        return -1;
+    }
+    if (create_output_dirs(NULL, 0, NULL, appdecconfig->option_info.save_idct_yuv_frame, appdecconfig->output_yuv_idct_dir) < 0) {
+        return -1;
+    }
+
+    /* 依照CPUID和設定選擇transform和quantization的SIMD kernels */
+    transform_dsp_init(simd_resolve_level(appdecconfig->option_info.simd_level));
+    quant_dsp_init(transform_dsp_get()->level);
+
+    /* 先處理好entropy coding需要的資源 (entropy type在container裡，目前只有HUFFMAN) */
+    EntropyConfig entropy_config = {0};
+    entropy_config.threads = appdecconfig->option_info.entropy_threads;
+    entropy_initialization(appdecconfig->compress_info.entropy_type, &entropy_config);
+
+    int cache_mb = (appdecconfig->option_info.cache_mb > 0) ? appdecconfig->option_info.cache_mb : 64;
+    FrameDecoder* decoder = frame_decoder_open(appdecconfig->input_container_path, appdecconfig->option_info.pipeline_mode,
+                                               appdecconfig->compress_info.transform_type, (size_t)cache_mb << 20,
+                                               appdecconfig->option_info.prefetch_frames);
+    if (decoder == NULL) {
+        entropy_destropy(appdecconfig->compress_info.entropy_type);
+        return -1;
+    }
+    printf("Frames: %d   cache frames: %d   prefetch: %d\n", decoder->container->frames_num, decoder->cache_num, decoder->prefetch_frames);
+
+    for (int i = 0; i < frames_num; i++) {
+        int frame_idx = atoi(frames[i]);
+        const YUVFrame* frame = frame_decoder_get_frame(decoder, frame_idx);
+        if (frame == NULL) {
+            fprintf(stderr, "Failed to decode frame %d\n", frame_idx);
+            continue;
+        }
+        if (appdecconfig->option_info.save_idct_yuv_frame) {
+            snprintf(idct_filename, sizeof(idct_filename), "%sframe_%04d.yuv", appdecconfig->output_yuv_idct_dir, frame_idx);
+            save_raw_frame_to_yuv_file(idct_filename, (YUVFrame*)frame);
+        }
+        frame_decoder_release_frame(decoder, frame_idx);
+    }
+    printf("Cache hits: %d   misses: %d\n", decoder->hits, decoder->misses);
 
-    free_yuv_frame(frame);
+    frame_decoder_close(decoder);
+    entropy_destropy(appdecconfig->compress_info.entropy_type);
     return 0;
 }
 
+/*  function: stream_stdout()
+    Return:
+        NULL : 複製stdout失敗
+        FILE* : 寫到原本stdout的串流
+
+    Result:
+        串流模式時stdout是bitstream/Y4M資料，把fd 1改成stderr，之後printf的訊息不會混到資料裡
+ */
+FILE* stream_stdout(void)
+{
+    fflush(stdout);
+    int fd = dup(STDOUT_FILENO);
+    if (fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        perror("Failed to redirect stdout");
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    FILE* fp = fdopen(fd, "wb");
+    if (fp == NULL) {
+        perror("Failed to open output stream");
+        close(fd);
+    }
+    return fp;
+}
+
+/*  function: stream_codec_params()
+    Params:
+        VCodecParams* params                : 串流使用的編碼/解碼參數 (已經是預設值)
+        const OptionInfo* option_info       : 設定檔的控制選項
+        const CompressionInfo* compress_info : 設定檔的壓縮設定
+
+    Result:
+        有指定設定檔時，用設定檔的block/transform/量化/entropy/pipeline/SIMD設定取代預設值
+        frame大小和format一定由串流的header決定
+ */
+void stream_codec_params(VCodecParams* params, const OptionInfo* option_info, const CompressionInfo* compress_info)
+{
+    params->block_info = compress_info->block_info;
+    params->transform_type = compress_info->transform_type;
+    params->compression_type = compress_info->comprss_type;
+    params->entropy_type = compress_info->entropy_type;
+    params->quant_type = compress_info->quant_type;
+    params->qp = compress_info->qp;
+    params->quality = compress_info->quality;
+    params->entropy_config.huffman_optimize = compress_info->huffman_optimize;
+    params->entropy_config.restart_interval = compress_info->restart_interval;
+    params->entropy_config.segment_index = compress_info->segment_index;
+    params->entropy_config.scan_mode = compress_info->scan_mode;
+    params->entropy_config.threads = option_info->entropy_threads;
+    params->pipeline_mode = option_info->pipeline_mode;
+    params->simd_level = option_info->simd_level;
+}
+
+/*  function: app_encode_stream()
+    Params:
+        AppEncodeConfig* appencconfig : encode設定 (use_config為0時不使用)
+        int use_config                : 1: 有指定設定檔 0: 使用vcodec_default_params()的預設值
+
+    Return:
+        0 : 成功
+        -1: Y4M header錯誤、記憶體配置失敗或寫入失敗
+
+    Result:
+        從stdin讀取Y4M (frame大小和format由header決定)，每讀到一張frame就編碼並寫到stdout
+        stdout是stream header加上每張frame的size和bitstream，記憶體只有一張frame和bitstream pool，和影片長度無關
+ */
+int app_encode_stream(AppEncodeConfig* appencconfig, int use_config)
+{
+    Y4MInfo y4m_info;
+    VCodecParams params;
+    ContainerInfo stream_info;
+    uint8_t* planes[3] = {NULL, NULL, NULL};
+    int widths[3], heights[3];
+    int frames_num = 0;
+    int ret = -1;
+
+    FILE* out_fp = stream_stdout();
+    if (out_fp == NULL) {
+        return -1;
+    }
+    if (y4m_read_header(stdin, &y4m_info) != 0) {
+        fclose(out_fp);
+        return -1;
+    }
+    printf("Y4M input: %dx%d format:%d fps:%d/%d\n", y4m_info.width, y4m_info.height, y4m_info.format, y4m_info.fps_num, y4m_info.fps_den);
+
+    vcodec_default_params(&params, y4m_info.width, y4m_info.height, y4m_info.format);
+    if (use_config) {
+        stream_codec_params(&params, &appencconfig->option_info, &appencconfig->compress_info);
+    }
+    VCodecEncoder* encoder = vcodec_encoder_create(&params);
+    if (encoder == NULL) {
+        fclose(out_fp);
+        return -1;
+    }
+
+    y4m_plane_info(&y4m_info, widths, heights);
+    for (int c = 0; c < 3; c++) {
+        planes[c] = (uint8_t*)malloc((size_t)widths[c] * heights[c]);
+        if (planes[c] == NULL) {
+            perror("Allocate Y4M frame failed");
+            goto done;
+        }
+    }
+
+    stream_info.width = params.width;
+    stream_info.height = params.height;
+    stream_info.format = params.format;
+    stream_info.block_info = params.block_info;
+    stream_info.quant_type = params.quant_type;
+    stream_info.compression_type = params.compression_type;
+    stream_info.entropy_type = params.entropy_type;
+    if (container_write_stream_header(out_fp, &stream_info, y4m_info.fps_num, y4m_info.fps_den) != 0) {
+        goto done;
+    }
+
+    /* 每張frame讀進來就編碼、寫出 (planes的stride就是width，encoder不需要複製) */
+    int read_ret;
+    while ((read_ret = y4m_read_frame(stdin, &y4m_info, planes)) == 1) {
+        const uint8_t* bitstream;
+        size_t bitstream_size;
+        if (vcodec_encode_frame(encoder, (const uint8_t* const*)planes, widths, NULL, 0, &bitstream, &bitstream_size) != VCODEC_OK ||
+            container_write_stream_frame(out_fp, bitstream, bitstream_size) != 0) {
+            fprintf(stderr, "Failed to encode frame %d\n", frames_num);
+            goto done;
+        }
+        frames_num++;
+    }
+    if (read_ret == 0) {
+        printf("Encoding %d frames has successfully done.\n", frames_num);
+        report_peak_memory(1, entropy_workspace_size(params.entropy_type, encoder->workspace));
+        ret = 0;
+    }
+
+done:
+    for (int c = 0; c < 3; c++) {
+        free(planes[c]);
+    }
+    vcodec_encoder_destroy(encoder);
+    if (fclose(out_fp) != 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+/*  function: app_decode_stream()
+    Params:
+        AppDecodeConfig* appdecconfig : decode設定 (use_config為0時不使用)
+        int use_config                : 1: 有指定設定檔 0: 使用vcodec_default_params()的預設值
+
+    Return:
+        0 : 成功
+        -1: stream header錯誤、記憶體配置失敗或寫入失敗
+
+    Result:
+        從stdin讀取app_encode_stream()的輸出，每讀到一張frame就解碼並以Y4M寫到stdout
+        frame大小、format、block和壓縮設定由stream header決定，記憶體只有一張frame和bitstream buffer
+ */
+int app_decode_stream(AppDecodeConfig* appdecconfig, int use_config)
+{
+    ContainerInfo stream_info;
+    Y4MInfo y4m_info;
+    VCodecParams params;
+    uint8_t* planes[3] = {NULL, NULL, NULL};
+    int widths[3], heights[3];
+    uint8_t* payload = NULL;
+    size_t payload_capacity = 0, payload_size;
+    int frames_num = 0;
+    int ret = -1;
+
+    FILE* out_fp = stream_stdout();
+    if (out_fp == NULL) {
+        return -1;
+    }
+    if (container_read_stream_header(stdin, &stream_info, &y4m_info.fps_num, &y4m_info.fps_den) != 0) {
+        fclose(out_fp);
+        return -1;
+    }
+    y4m_info.width = stream_info.width;
+    y4m_info.height = stream_info.height;
+    y4m_info.format = stream_info.format;
+
+    vcodec_default_params(&params, stream_info.width, stream_info.height, stream_info.format);
+    if (use_config) {
+        stream_codec_params(&params, &appdecconfig->option_info, &appdecconfig->compress_info);
+    }
+    params.block_info = stream_info.block_info;
+    params.quant_type = stream_info.quant_type;
+    params.compression_type = stream_info.compression_type;
+    params.entropy_type = stream_info.entropy_type;
+    VCodecDecoder* decoder = vcodec_decoder_create(&params);
+    if (decoder == NULL) {
+        fclose(out_fp);
+        return -1;
+    }
+
+    y4m_plane_info(&y4m_info, widths, heights);
+    for (int c = 0; c < 3; c++) {
+        planes[c] = (uint8_t*)malloc((size_t)widths[c] * heights[c]);
+        if (planes[c] == NULL) {
+            perror("Allocate Y4M frame failed");
+            goto done;
+        }
+    }
+    if (y4m_write_header(out_fp, &y4m_info) != 0) {
+        goto done;
+    }
+
+    /* 每張frame讀進來就解碼、寫出 */
+    int read_ret;
+    while ((read_ret = container_read_stream_frame(stdin, &payload, &payload_capacity, &payload_size)) == 1) {
+        if (vcodec_decode_frame(decoder, payload, payload_size, planes, widths) != VCODEC_OK ||
+            y4m_write_frame(out_fp, &y4m_info, (const uint8_t* const*)planes) != 0) {
+            fprintf(stderr, "Failed to decode frame %d\n", frames_num);
+            goto done;
+        }
+        frames_num++;
+    }
+    if (read_ret == 0) {
+        printf("Decoding %d frames has successfully done.\n", frames_num);
+        ret = 0;
+    }
+
+done:
+    for (int c = 0; c < 3; c++) {
+        free(planes[c]);
+    }
+    free(payload);
+    vcodec_decoder_destroy(decoder);
+    if (fclose(out_fp) != 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
 int main(int argc, char* argv[])
 {
-    YUVVideo* yuv_video;
     int ret = 0;
     char config_file_path[MAX_PATH_LEN];
     AppEncodeConfig appencconfig = {0};
+    appencconfig.compress_info.quality = JPEG_QUALITY_DEFAULT;
+    appencconfig.compress_info.huffman_optimize = 1;
     AppDecodeConfig appdecconfig = {0};
 
     if (argc == 1) {
@@ -375,18 +1050,31 @@ int main(int argc, char* argv[])
         return -1;
     }
 
-    if (strcmp(argv[1], "enc") == 0) {
-        strncpy(config_file_path, argv[2], MAX_PATH_LEN);
+    if (strcmp(argv[1], "enc") == 0 && argc > 2 && strcmp(argv[2], "-") == 0) {
+        /* ./main enc - [encode_config_file_path] : stdin的Y4M編碼到stdout */
+        if (argc > 3) load_encode_config(&appencconfig, argv[3]);
+        ret = app_encode_stream(&appencconfig, argc > 3);
+    } else if (strcmp(argv[1], "dec") == 0 && argc > 2 && strcmp(argv[2], "-") == 0) {
+        /* ./main dec - [decode_config_file_path] : stdin的bitstream解碼成Y4M寫到stdout */
+        if (argc > 3) load_decode_config(&appdecconfig, argv[3]);
+        ret = app_decode_stream(&appdecconfig, argc > 3);
+    } else if (strcmp(argv[1], "enc") == 0) {
+        snprintf(config_file_path, MAX_PATH_LEN, "%s", argv[2]);
         trim(config_file_path);
         load_encode_config(&appencconfig, config_file_path);
         app_encode_process(&appencconfig);
     } else if (strcmp(argv[1], "dec") == 0) {
-        strncpy(config_file_path, argv[2], MAX_PATH_LEN);
+        snprintf(config_file_path, MAX_PATH_LEN, "%s", argv[2]);
         trim(config_file_path);
         load_decode_config(&appdecconfig, config_file_path);
         ret = app_decode_process(&appdecconfig);
+    } else if (strcmp(argv[1], "seek") == 0 && argc > 3) {
+        snprintf(config_file_path, MAX_PATH_LEN, "%s", argv[2]);
+        trim(config_file_path);
+        load_decode_config(&appdecconfig, config_file_path);
+        ret = app_seek_process(&appdecconfig, argc - 3, &argv[3]);
     } else {
-        perror("Please input \"enc\" or \"dec\" as the sencond argument.\n");
+        perror("Please input \"enc\", \"dec\" or \"seek\" as the sencond argument.\n");
         return -1;
     }
     return ret;
@@ -0,0 +1,417 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include"container.h"
+
+
+/* big-endian整數 */
+static void container_put_be(uint8_t* buf, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        buf[i] = (value >> (8 * (bytes - 1 - i))) & 0xff;
+    }
+}
+
+static uint64_t container_get_be(const uint8_t* buf, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value = (value << 8) | buf[i];
+    }
+    return value;
+}
+
+/* global header: magic (4) | version (1) | ContainerInfo (11) */
+static void container_pack_header(uint8_t* header, const char* magic, const ContainerInfo* info)
+{
+    memcpy(header, magic, 4);
+    header[4] = CONTAINER_VERSION;
+    container_put_be(header + 5, info->width, 2);
+    container_put_be(header + 7, info->height, 2);
+    header[9] = info->format & 0xff;
+    header[10] = info->block_info.b_size & 0xff;
+    header[11] = info->block_info.width & 0xff;
+    header[12] = info->block_info.height & 0xff;
+    header[13] = info->quant_type & 0xff;
+    header[14] = info->compression_type & 0xff;
+    header[15] = info->entropy_type & 0xff;
+}
+
+static void container_unpack_header(const uint8_t* header, ContainerInfo* info)
+{
+    info->width = (int)container_get_be(header + 5, 2);
+    info->height = (int)container_get_be(header + 7, 2);
+    info->format = header[9];
+    info->block_info.b_size = header[10];
+    info->block_info.width = header[11];
+    info->block_info.height = header[12];
+    info->quant_type = header[13];
+    info->compression_type = header[14];
+    info->entropy_type = header[15];
+}
+
+/*  function: container_create()
+    Params:
+        const char* path          : container檔案的路徑
+        const ContainerInfo* info : 寫到global header的資訊
+
+    Return:
+        NULL : 檔案開啟失敗或記憶體配置失敗
+        VideoContainer* : 寫入用的container
+
+    Result:
+        寫入global header，之後用container_append_frame()依序加入frames，
+        container_close()時在最後寫入frame index和trailer
+ */
+VideoContainer* container_create(const char* path, const ContainerInfo* info)
+{
+    uint8_t header[CONTAINER_HEADER_SIZE];
+
+    VideoContainer* container = (VideoContainer*)calloc(1, sizeof(VideoContainer));
+    if (container == NULL) {
+        perror("Allocate VideoContainer failed");
+        return NULL;
+    }
+    container->fp = fopen(path, "wb");
+    if (container->fp == NULL) {
+        fprintf(stderr, "Failed to open file: %s\n", path);
+        free(container);
+        return NULL;
+    }
+    container->writing = 1;
+    container->info = *info;
+
+    container_pack_header(header, CONTAINER_MAGIC, info);
+    if (fwrite(header, 1, CONTAINER_HEADER_SIZE, container->fp) != CONTAINER_HEADER_SIZE) {
+        perror("Write container header failed");
+        fclose(container->fp);
+        free(container);
+        return NULL;
+    }
+    container->write_offset = CONTAINER_HEADER_SIZE;
+    return container;
+}
+
+/*  function: container_append_frame()
+    Params:
+        VideoContainer* container : container_create()建立的container
+        const uint8_t* data       : 一張frame的bitstream
+        size_t size               : bitstream的bytes
+
+    Return:
+        0 : 成功
+        -1: 寫檔失敗或記憶體配置失敗
+
+    Result:
+        frame接在前一張frame後面 (依照frame順序呼叫)，offset和size記在index裡
+ */
+int container_append_frame(VideoContainer* container, const uint8_t* data, size_t size)
+{
+    if (container->frames_num == container->frames_capacity) {
+        int capacity = (container->frames_capacity > 0) ? container->frames_capacity * 2 : 64;
+        uint64_t* offsets = (uint64_t*)realloc(container->frame_offsets, sizeof(uint64_t) * capacity);
+        if (offsets == NULL) {
+            perror("Allocate container index failed");
+            return -1;
+        }
+        container->frame_offsets = offsets;
+        uint32_t* sizes = (uint32_t*)realloc(container->frame_sizes, sizeof(uint32_t) * capacity);
+        if (sizes == NULL) {
+            perror("Allocate container index failed");
+            return -1;
+        }
+        container->frame_sizes = sizes;
+        container->frames_capacity = capacity;
+    }
+
+    if (fwrite(data, 1, size, container->fp) != size) {
+        perror("Write container frame failed");
+        return -1;
+    }
+    container->frame_offsets[container->frames_num] = container->write_offset;
+    container->frame_sizes[container->frames_num] = (uint32_t)size;
+    container->frames_num++;
+    container->write_offset += size;
+    return 0;
+}
+
+/*  function: container_open()
+    Params:
+        const char* path : container檔案的路徑
+
+    Return:
+        NULL : 不是container檔案、檔案損毀或記憶體配置失敗
+        VideoContainer* : 讀取用的container (info和frame index已經讀好)
+
+    Result:
+        1. 讀取global header
+        2. 讀取檔案最後的trailer，找到frame index並讀取每張frame的offset/size
+ */
+VideoContainer* container_open(const char* path)
+{
+    uint8_t header[CONTAINER_HEADER_SIZE];
+    uint8_t trailer[CONTAINER_TRAILER_SIZE];
+    uint8_t* index = NULL;
+
+    VideoContainer* container = (VideoContainer*)calloc(1, sizeof(VideoContainer));
+    if (container == NULL) {
+        perror("Allocate VideoContainer failed");
+        return NULL;
+    }
+    container->fp = fopen(path, "rb");
+    if (container->fp == NULL) {
+        fprintf(stderr, "Failed to open file: %s\n", path);
+        free(container);
+        return NULL;
+    }
+
+    if (fread(header, 1, CONTAINER_HEADER_SIZE, container->fp) != CONTAINER_HEADER_SIZE ||
+        memcmp(header, CONTAINER_MAGIC, 4) != 0 || header[4] != CONTAINER_VERSION ||
+        fseek(container->fp, -CONTAINER_TRAILER_SIZE, SEEK_END) != 0 ||
+        fread(trailer, 1, CONTAINER_TRAILER_SIZE, container->fp) != CONTAINER_TRAILER_SIZE ||
+        memcmp(trailer + 12, CONTAINER_INDEX_MAGIC, 4) != 0) {
+        fprintf(stderr, "Invalid container: %s\n", path);
+        container_close(container);
+        return NULL;
+    }
+    container_unpack_header(header, &container->info);
+    /* trailer: frame index的offset和frames個數 */
+    uint64_t index_offset = container_get_be(trailer, 8);
+    int frames_num = (int)container_get_be(trailer + 8, 4);
+    long file_size = ftell(container->fp);
+    if (frames_num < 0 || index_offset < CONTAINER_HEADER_SIZE ||
+        index_offset + (uint64_t)frames_num * CONTAINER_INDEX_ENTRY + CONTAINER_TRAILER_SIZE != (uint64_t)file_size) {
+        fprintf(stderr, "Invalid container index: %s\n", path);
+        container_close(container);
+        return NULL;
+    }
+
+    container->frame_offsets = (uint64_t*)malloc(sizeof(uint64_t) * (frames_num > 0 ? frames_num : 1));
+    container->frame_sizes = (uint32_t*)malloc(sizeof(uint32_t) * (frames_num > 0 ? frames_num : 1));
+    index = (uint8_t*)malloc((size_t)CONTAINER_INDEX_ENTRY * (frames_num > 0 ? frames_num : 1));
+    if (container->frame_offsets == NULL || container->frame_sizes == NULL || index == NULL ||
+        fseek(container->fp, (long)index_offset, SEEK_SET) != 0 ||
+        fread(index, CONTAINER_INDEX_ENTRY, frames_num, container->fp) != (size_t)frames_num) {
+        fprintf(stderr, "Failed to read container index: %s\n", path);
+        free(index);
+        container_close(container);
+        return NULL;
+    }
+
+    for (int i = 0; i < frames_num; i++) {
+        container->frame_offsets[i] = container_get_be(index + i * CONTAINER_INDEX_ENTRY, 8);
+        container->frame_sizes[i] = (uint32_t)container_get_be(index + i * CONTAINER_INDEX_ENTRY + 8, 4);
+        if (container->frame_offsets[i] < CONTAINER_HEADER_SIZE || container->frame_offsets[i] + container->frame_sizes[i] > index_offset) {
+            fprintf(stderr, "Invalid container index: %s\n", path);
+            free(index);
+            container_close(container);
+            return NULL;
+        }
+    }
+    free(index);
+    container->frames_num = frames_num;
+    container->frames_capacity = frames_num;
+    return container;
+}
+
+/*  function: container_read_frame()
+    Params:
+        VideoContainer* container : container_open()開啟的container
+        int frame_idx             : 第幾張frame
+        size_t* size              : 回傳bitstream的bytes
+
+    Return:
+        NULL : frame_idx超出範圍或讀取失敗
+        uint8_t* : 一張frame的bitstream (由呼叫者free)
+
+    Result:
+        使用pread直接讀取index記錄的位置，不會改變檔案位置，多個threads可以同時讀取不同frames
+ */
+uint8_t* container_read_frame(VideoContainer* container, int frame_idx, size_t* size)
+{
+    if (frame_idx < 0 || frame_idx >= container->frames_num) {
+        return NULL;
+    }
+
+    *size = container->frame_sizes[frame_idx];
+    uint8_t* data = (uint8_t*)malloc(*size > 0 ? *size : 1);
+    if (data == NULL) {
+        perror("Allocate container frame failed");
+        return NULL;
+    }
+
+    size_t done = 0;
+    while (done < *size) {
+        ssize_t ret = pread(fileno(container->fp), data + done, *size - done, (off_t)(container->frame_offsets[frame_idx] + done));
+        if (ret <= 0) {
+            fprintf(stderr, "Failed to read frame %d from container\n", frame_idx);
+            free(data);
+            return NULL;
+        }
+        done += (size_t)ret;
+    }
+    return data;
+}
+
+/*  function: container_close()
+    Params:
+        VideoContainer* container : container_create()或container_open()的container
+
+    Return:
+        0 : 成功
+        -1: 寫入frame index或trailer失敗
+
+    Result:
+        寫入用的container在最後加上frame index和trailer，然後關檔並釋放記憶體
+ */
+int container_close(VideoContainer* container)
+{
+    int ret = 0;
+
+    if (container == NULL) return 0;
+
+    if (container->writing) {
+        uint8_t entry[CONTAINER_INDEX_ENTRY];
+        uint8_t trailer[CONTAINER_TRAILER_SIZE];
+
+        for (int i = 0; i < container->frames_num && ret == 0; i++) {
+            container_put_be(entry, container->frame_offsets[i], 8);
+            container_put_be(entry + 8, container->frame_sizes[i], 4);
+            if (fwrite(entry, 1, CONTAINER_INDEX_ENTRY, container->fp) != CONTAINER_INDEX_ENTRY) ret = -1;
+        }
+        container_put_be(trailer, container->write_offset, 8);
+        container_put_be(trailer + 8, (uint64_t)container->frames_num, 4);
+        memcpy(trailer + 12, CONTAINER_INDEX_MAGIC, 4);
+        if (ret != 0 || fwrite(trailer, 1, CONTAINER_TRAILER_SIZE, container->fp) != CONTAINER_TRAILER_SIZE) {
+            perror("Write container index failed");
+            ret = -1;
+        }
+    }
+
+    if (container->fp != NULL && fclose(container->fp) != 0) {
+        ret = -1;
+    }
+    free(container->frame_offsets);
+    free(container->frame_sizes);
+    free(container);
+    return ret;
+}
+
+/*  function: container_write_stream_header()
+    Params:
+        FILE* fp                  : 輸出的串流 (例如stdout，不需要可以seek)
+        const ContainerInfo* info : 寫到stream header的資訊
+        int fps_num               : frame rate的分子
+        int fps_den               : frame rate的分母
+
+    Return:
+        0 : 成功
+        -1: 寫入失敗
+ */
+int container_write_stream_header(FILE* fp, const ContainerInfo* info, int fps_num, int fps_den)
+{
+    uint8_t header[CONTAINER_STREAM_HEADER_SIZE];
+
+    container_pack_header(header, CONTAINER_STREAM_MAGIC, info);
+    container_put_be(header + CONTAINER_HEADER_SIZE, (uint32_t)fps_num, 4);
+    container_put_be(header + CONTAINER_HEADER_SIZE + 4, (uint32_t)fps_den, 4);
+    if (fwrite(header, 1, CONTAINER_STREAM_HEADER_SIZE, fp) != CONTAINER_STREAM_HEADER_SIZE) {
+        perror("Write stream header failed");
+        return -1;
+    }
+    return 0;
+}
+
+/*  function: container_read_stream_header()
+    Params:
+        FILE* fp            : 輸入的串流 (例如stdin)
+        ContainerInfo* info : 回傳stream header的資訊
+        int* fps_num        : 回傳frame rate的分子
+        int* fps_den        : 回傳frame rate的分母
+
+    Return:
+        0 : 成功
+        -1: 讀取失敗或不是stream header
+ */
+int container_read_stream_header(FILE* fp, ContainerInfo* info, int* fps_num, int* fps_den)
+{
+    uint8_t header[CONTAINER_STREAM_HEADER_SIZE];
+
+    if (fread(header, 1, CONTAINER_STREAM_HEADER_SIZE, fp) != CONTAINER_STREAM_HEADER_SIZE ||
+        memcmp(header, CONTAINER_STREAM_MAGIC, 4) != 0 || header[4] != CONTAINER_VERSION) {
+        fprintf(stderr, "Invalid stream header\n");
+        return -1;
+    }
+    container_unpack_header(header, info);
+    *fps_num = (int)container_get_be(header + CONTAINER_HEADER_SIZE, 4);
+    *fps_den = (int)container_get_be(header + CONTAINER_HEADER_SIZE + 4, 4);
+    return 0;
+}
+
+/*  function: container_write_stream_frame()
+    Params:
+        FILE* fp            : 輸出的串流
+        const uint8_t* data : 一張frame的bitstream
+        size_t size         : bitstream的bytes
+
+    Return:
+        0 : 成功
+        -1: 寫入失敗
+
+    Result:
+        frame的size (4 bytes) 後面接著bitstream，寫完就flush，下游可以馬上讀到這張frame
+ */
+int container_write_stream_frame(FILE* fp, const uint8_t* data, size_t size)
+{
+    uint8_t frame_size[4];
+
+    container_put_be(frame_size, (uint64_t)size, 4);
+    if (fwrite(frame_size, 1, 4, fp) != 4 || fwrite(data, 1, size, fp) != size || fflush(fp) != 0) {
+        perror("Write stream frame failed");
+        return -1;
+    }
+    return 0;
+}
+
+/*  function: container_read_stream_frame()
+    Params:
+        FILE* fp          : 輸入的串流
+        uint8_t** buffer  : 存放bitstream的buffer，不夠時realloc (所有frames重複使用)
+        size_t* capacity  : buffer的bytes
+        size_t* size      : 回傳這張frame的bytes
+
+    Return:
+        1 : 讀到一張frame
+        0 : 串流結束
+        -1: 讀取失敗、frame不完整或記憶體配置失敗
+ */
+int container_read_stream_frame(FILE* fp, uint8_t** buffer, size_t* capacity, size_t* size)
+{
+    uint8_t frame_size[4];
+
+    size_t n = fread(frame_size, 1, 4, fp);
+    if (n == 0 && feof(fp)) {
+        return 0;
+    }
+    if (n != 4) {
+        fprintf(stderr, "Truncated stream frame\n");
+        return -1;
+    }
+
+    *size = (size_t)container_get_be(frame_size, 4);
+    if (*size > *capacity) {
+        uint8_t* data = (uint8_t*)realloc(*buffer, *size);
+        if (data == NULL) {
+            perror("Allocate stream frame failed");
+            return -1;
+        }
+        *buffer = data;
+        *capacity = *size;
+    }
+    if (fread(*buffer, 1, *size, fp) != *size) {
+        fprintf(stderr, "Truncated stream frame\n");
+        return -1;
+    }
+    return 1;
+}
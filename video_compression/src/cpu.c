@@ -0,0 +1,92 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include"cpu.h"
+
+/* 環境變數: 強制使用某個SIMD等級，優先權高於設定檔. ex: VC_SIMD_LEVEL=SSE41 */
+#define SIMD_LEVEL_ENV "VC_SIMD_LEVEL"
+
+
+/*  function: simd_detect_level()
+    Return:
+        CPU (和OS) 支援的最高SIMD等級
+
+    Result:
+        使用CPUID檢查 SSE4.1 / AVX2 / AVX-512F+BW
+ */
+SimdLevel simd_detect_level(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) return SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return SIMD_SSE41;
+#endif
+    return SIMD_SCALAR;
+}
+
+
+/*  function: simd_parse_level()
+    Params:
+        const char* name : 設定檔或環境變數的字串 (AUTO/SCALAR/SSE41/AVX2/AVX512)
+        SimdLevel* level : 解析後的SIMD等級
+
+    Return:
+        0 : 解析成功
+        -1 : 不認得的字串
+ */
+int simd_parse_level(const char* name, SimdLevel* level)
+{
+    if (strcmp(name, "AUTO") == 0) *level = SIMD_AUTO;
+    else if (strcmp(name, "SCALAR") == 0) *level = SIMD_SCALAR;
+    else if (strcmp(name, "SSE41") == 0) *level = SIMD_SSE41;
+    else if (strcmp(name, "AVX2") == 0) *level = SIMD_AVX2;
+    else if (strcmp(name, "AVX512") == 0) *level = SIMD_AVX512;
+    else return -1;
+    return 0;
+}
+
+const char* simd_level_name(SimdLevel level)
+{
+    switch (level) {
+        case SIMD_SCALAR: return "SCALAR";
+        case SIMD_SSE41:  return "SSE41";
+        case SIMD_AVX2:   return "AVX2";
+        case SIMD_AVX512: return "AVX512";
+        default:          return "AUTO";
+    }
+}
+
+
+/*  function: simd_resolve_level()
+    Params:
+        SimdLevel config_level : 設定檔指定的SIMD等級 (SIMD_AUTO表示不指定)
+
+    Return:
+        實際要使用的SIMD等級
+
+    Result:
+        1. 環境變數VC_SIMD_LEVEL優先，其次是設定檔，都沒有指定則使用CPUID的結果
+        2. 指定的等級超過CPU支援的等級時，降回CPU支援的最高等級
+ */
+SimdLevel simd_resolve_level(SimdLevel config_level)
+{
+    SimdLevel detected = simd_detect_level();
+    SimdLevel level = config_level;
+    const char* env = getenv(SIMD_LEVEL_ENV);
+
+    if (env != NULL && env[0] != '\0') {
+        if (simd_parse_level(env, &level) != 0) {
+            fprintf(stderr, "Unknown %s=%s, ignored\n", SIMD_LEVEL_ENV, env);
+            level = config_level;
+        }
+    }
+
+    if (level == SIMD_AUTO) return detected;
+
+    if (level > detected) {
+        fprintf(stderr, "SIMD level %s is not supported by this CPU, use %s\n", simd_level_name(level), simd_level_name(detected));
+        return detected;
+    }
+    return level;
+}
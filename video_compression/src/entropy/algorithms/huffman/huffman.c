@@ -1,94 +1,391 @@
 #include<stdio.h>
 #include<stdlib.h>
 #include<stdint.h>
+#include<string.h>
 #include"entropy/algorithms/huffman.h"
 #include"file_io.h"
 
-/* 建立Huffman tree上面每個symbol對應的code word */
+/*  function: huffman_create_lookup_table()
+    Params:
+        const uint8_t* bits_table    : 每種codeword長度 (1~16) 有幾個symbols
+        const uint8_t* hufval_table  : 依照codeword順序排列的symbols
+        Huffman_Table* huffman_table : 儲存建立好的tables
+
+    Return:
+        得到encode和decode用的Huffman tables
+
+    Result:
+        1. encode: 每個symbol對應的codeword和長度
+        2. decode: maxcode/valoffset (可以解任何長度的codeword)
+        3. decode: HUFFMAN_LOOKAHEAD_BITS bits的lookahead table，短的codeword查一次表就能得到symbol，
+           codeword加上amplitude的長度也在範圍內時，amplitude也一起解好
+ */
 void huffman_create_lookup_table(const uint8_t* bits_table, const uint8_t* hufval_table, Huffman_Table* huffman_table)
 {
     uint16_t codeword = 0;
     int hufval_index = 0;
 
-    for (int bit_len = 1; bit_len <= 16; bit_len++) {
+    memset(huffman_table->code_length, 0, sizeof(huffman_table->code_length));
+    memset(huffman_table->lookahead, 0, sizeof(huffman_table->lookahead));
+
+    for (int bit_len = 1; bit_len <= HUFFMAN_MAX_CODE_LENGTH; bit_len++) {
         uint8_t symbol_nums = bits_table[bit_len-1];
 
+        if (symbol_nums == 0) {
+            huffman_table->maxcode[bit_len] = -1;
+        } else {
+            huffman_table->valoffset[bit_len] = hufval_index - codeword;
+        }
+
         for (int i = 0; i < symbol_nums; i++) {
             uint8_t symbol = hufval_table[hufval_index];
             huffman_table->codeword[symbol] = codeword;
             huffman_table->code_length[symbol] = bit_len;
+            huffman_table->huffval[hufval_index] = symbol;
+
+            /* 長度不超過lookahead bits的codeword，後面接任何bits都對應到同一個symbol */
+            if (bit_len <= HUFFMAN_LOOKAHEAD_BITS) {
+                int free_bits = HUFFMAN_LOOKAHEAD_BITS - bit_len;
+                int amp_len = symbol & 0x0f;  // DC的symbol就是size，AC的symbol低4 bits是size
+
+                for (int rest = 0; rest < (1 << free_bits); rest++) {
+                    Huffman_Lookahead* entry = &huffman_table->lookahead[(codeword << free_bits) | rest];
+                    entry->symbol = symbol;
+                    entry->code_length = bit_len;
+
+                    if (amp_len <= free_bits) {
+                        entry->total_length = bit_len + amp_len;
+                        entry->amplitude = (uint16_t)((rest >> (free_bits - amp_len)) & ((1 << amp_len) - 1));
+                    }
+                }
+            }
+
             codeword++;
             hufval_index++;
         }
+
+        if (symbol_nums != 0) {
+            huffman_table->maxcode[bit_len] = codeword - 1;
+        }
         // 新增一個bit長度
         codeword <<= 1;
     }
+
+    /* sentinel: 保證slow path在長度超過16之前會停下來 */
+    huffman_table->maxcode[HUFFMAN_MAX_CODE_LENGTH + 1] = 0x7fffffff;
 }
 
-int huffman_decode_dc(BitReader* bit_reader, JpegDcEncoded* dc_encoded, Huffman_Table* huffman_table)
+/*  function: huffman_count_dc_symbols()
+    Params:
+        const JpegDcEncoded* dc_encoded : DPCM後的DC係數
+        int num_blocks                  : block個數
+        uint32_t* freq                  : 256個symbols的出現次數 (累加，不會先清0)
+
+    Return:
+        None
+
+    Result:
+        DC的symbol就是size
+ */
+void huffman_count_dc_symbols(const JpegDcEncoded* dc_encoded, int num_blocks, uint32_t* freq)
 {
-    uint16_t codeword = 0, amplitude = 0;
-    int bit_len = 0;
-    uint8_t bit;
-    const int max_symbols_num = 16;  // DC 最多16種symbols
-    int found_symbol = 0;
-
-    // Decode DC codeword
-    while (!found_symbol) {
-        // 讀取bit by bit
-        if (bit_reader->bit_left == 0) {
-            int data = fgetc(bit_reader->fp);
-
-            /* 不應該出現底下情況 */
-            if (data == EOF) {
-                perror("[Error] Unexpected End of File!");
-                return -1;
-            }
+    for (int i = 0; i < num_blocks; i++) {
+        freq[dc_encoded[i].size]++;
+    }
+}
 
-            bit_reader->buffer = (uint8_t)data;
-            bit_reader->bit_left = 8;
+/*  function: huffman_count_ac_symbols()
+    Params:
+        const JpegAcEncoded* ac_encoded : RLE後的AC symbols (包含ZRL和EOB)
+        int num_blocks                  : block個數
+        uint32_t* freq                  : 256個symbols的出現次數 (累加，不會先清0)
 
-            /* byte stuffing情況: 0xff 0x00 */
-            if (bit_reader->buffer == 0xff) {
-                // 丟掉0x00
-                fgetc(bit_reader->fp);
-            }
+    Return:
+        None
+
+    Result:
+        AC的symbol是(run_length << 4 | size)
+ */
+void huffman_count_ac_symbols(const JpegAcEncoded* ac_encoded, int num_blocks, uint32_t* freq)
+{
+    for (int i = 0; i < num_blocks; i++) {
+        const JpegAcSymbol* symbols = ac_encoded[i].symbols;
+        for (int j = 0; j < ac_encoded[i].num_symbols; j++) {
+            freq[symbols[j].run_length << 4 | symbols[j].size]++;
         }
+    }
+}
 
-        bit = (bit_reader->buffer >> (bit_reader->bit_left-1)) & 0x01;
-        codeword = (codeword << 1) | bit;
-        bit_len++;
-        bit_reader->bit_left--;
-
-        // 匹配目前的codeword有沒有在huffman table裡
-        for (int i = 0; i < max_symbols_num; i++) {
-            if (huffman_table->codeword[i] == codeword && huffman_table->code_length[i] == bit_len) {
-                found_symbol = 1; // 找到DC係數的codeword長度
-                dc_encoded->size = i;  // amplitude的bit長度 (不是codeword本身的長度)
-                break;
+/*  function: huffman_generate_optimal_spec()
+    Params:
+        const uint32_t* freq : 256個symbols的出現次數
+        Huffman_Spec* spec   : 儲存產生的bits/hufval
+
+    Return:
+        None
+
+    Result:
+        依照JPEG規範Annex K.2產生codeword長度不超過16的Huffman table
+        1. 加入一個出現1次的保留symbol，保證不會有全部是1的codeword
+        2. 每次合併出現次數最少的兩個節點，得到每個symbol的codeword長度
+        3. 長度超過16的codeword，往上移到較短的長度 (Figure K.3)
+        4. 移除保留symbol的codeword
+        沒有出現的symbol不會有codeword
+ */
+void huffman_generate_optimal_spec(const uint32_t* freq, Huffman_Spec* spec)
+{
+    /* 257個symbols的樹最深是256層 */
+    uint8_t bits[258];
+    uint16_t codesize[257];
+    int16_t others[257];
+    uint64_t count[257];
+
+    memset(bits, 0, sizeof(bits));
+    memset(codesize, 0, sizeof(codesize));
+    for (int i = 0; i < 256; i++) {
+        count[i] = freq[i];
+        others[i] = -1;
+    }
+    count[256] = 1;
+    others[256] = -1;
+
+    for (;;) {
+        /* 找出現次數最少的c1，次數相同時選index較大的 (讓保留symbol拿到最長的codeword) */
+        int c1 = -1, c2 = -1;
+        uint64_t v = UINT64_MAX;
+        for (int i = 0; i <= 256; i++) {
+            if (count[i] != 0 && count[i] <= v) {
+                v = count[i];
+                c1 = i;
             }
         }
+        /* 第二少的c2 */
+        v = UINT64_MAX;
+        for (int i = 0; i <= 256; i++) {
+            if (count[i] != 0 && count[i] <= v && i != c1) {
+                v = count[i];
+                c2 = i;
+            }
+        }
+        if (c2 < 0) break;
+
+        /* 合併c1和c2，兩棵樹裡的所有symbols長度都加1 */
+        count[c1] += count[c2];
+        count[c2] = 0;
+
+        codesize[c1]++;
+        while (others[c1] >= 0) {
+            c1 = others[c1];
+            codesize[c1]++;
+        }
+        others[c1] = c2;
+
+        codesize[c2]++;
+        while (others[c2] >= 0) {
+            c2 = others[c2];
+            codesize[c2]++;
+        }
     }
 
-    // Decode DC amplitude
-    for (int i = 0; i < dc_encoded->size; i++) {
-        if (bit_reader->bit_left == 0) {
-            bit_reader->buffer = (uint8_t)fgetc(bit_reader->fp);
-            bit_reader->bit_left = 8;
-            
-            /* byte stuffing情況: 0xff 0x00 */
-            if (bit_reader->buffer == 0xff) {
-                // 丟掉0x00
-                fgetc(bit_reader->fp);
+    for (int i = 0; i <= 256; i++) {
+        if (codesize[i] != 0) {
+            bits[codesize[i]]++;
+        }
+    }
+
+    /* 長度i的兩個codeword移到長度i-1，再把長度j的一個codeword拆成兩個長度j+1的 */
+    for (int i = 257; i > HUFFMAN_MAX_CODE_LENGTH; i--) {
+        while (bits[i] > 0) {
+            int j = i - 2;
+            while (bits[j] == 0) j--;
+
+            bits[i] -= 2;
+            bits[i-1]++;
+            bits[j+1] += 2;
+            bits[j]--;
+        }
+    }
+
+    /* 移除保留symbol (一定在最長的長度) */
+    int longest = HUFFMAN_MAX_CODE_LENGTH;
+    while (longest > 0 && bits[longest] == 0) longest--;
+    if (longest > 0) bits[longest]--;
+
+    memcpy(spec->bits, &bits[1], HUFFMAN_MAX_CODE_LENGTH);
+
+    /* symbols依照原本的codeword長度排序，長度相同時依照symbol大小 */
+    int hufval_index = 0;
+    for (int len = 1; len <= 256; len++) {
+        for (int i = 0; i < 256; i++) {
+            if (codesize[i] == len) {
+                spec->hufval[hufval_index++] = (uint8_t)i;
             }
         }
+    }
+}
+
+/*  function: huffman_spec_symbols_num()
+    Params:
+        const Huffman_Spec* spec : Huffman table的bits/hufval
+
+    Return:
+        table裡的symbol個數 (hufval的長度)
+ */
+int huffman_spec_symbols_num(const Huffman_Spec* spec)
+{
+    int symbols_num = 0;
+    for (int i = 0; i < HUFFMAN_MAX_CODE_LENGTH; i++) {
+        symbols_num += spec->bits[i];
+    }
+    return symbols_num;
+}
+
+/*  function: huffman_spec_is_valid()
+    Params:
+        const Huffman_Spec* spec : 從bitstream讀出的bits/hufval
+        int max_symbol           : symbol的最大值 (DC是size，不會超過15)
+
+    Return:
+        1: 可以用來建立Huffman_Table
+        0: symbol個數超過256、codeword超出長度可以表示的範圍、或symbol不合法
+           codeword不能全部是1 (JPEG Annex K.2)，所以每個長度的codeword個數都要小於2^bit_len，
+           也保證長度16的codeword放得進huffman_create_lookup_table()的16-bit codeword
+ */
+int huffman_spec_is_valid(const Huffman_Spec* spec, int max_symbol)
+{
+    int symbols_num = huffman_spec_symbols_num(spec);
+    uint32_t codeword = 0;
+
+    if (symbols_num == 0 || symbols_num > 256) {
+        return 0;
+    }
+
+    for (int bit_len = 1; bit_len <= HUFFMAN_MAX_CODE_LENGTH; bit_len++) {
+        codeword += spec->bits[bit_len-1];
+        if (codeword >= (1u << bit_len)) {
+            return 0;
+        }
+        codeword <<= 1;
+    }
+
+    for (int i = 0; i < symbols_num; i++) {
+        if (spec->hufval[i] > max_symbol) {
+            return 0;
+        }
+    }
 
-        bit = (bit_reader->buffer >> (bit_reader->bit_left-1)) & 0x01;
-        amplitude = (amplitude << 1) | bit;
-        bit_reader->bit_left--;
+    return 1;
+}
+
+/*  function: huffman_estimate_bits()
+    Params:
+        const uint32_t* freq                : 256個symbols的出現次數
+        const Huffman_Table* huffman_table  : 用來編碼的table
+
+    Return:
+        所有codeword加起來的bits個數 (不包含amplitude)
+        有出現的symbol在table裡沒有codeword時回傳UINT64_MAX
+ */
+uint64_t huffman_estimate_bits(const uint32_t* freq, const Huffman_Table* huffman_table)
+{
+    uint64_t total_bits = 0;
+
+    for (int i = 0; i < 256; i++) {
+        if (freq[i] == 0) continue;
+        if (huffman_table->code_length[i] == 0) return UINT64_MAX;
+        total_bits += (uint64_t)freq[i] * huffman_table->code_length[i];
+    }
+
+    return total_bits;
+}
+
+/*  function: huffman_decode_symbol()
+    Params:
+        BitReader* bit_reader        : 紀錄bitstream讀取的情況
+        Huffman_Table* huffman_table : decode用的tables
+        uint16_t* amplitude          : 如果amplitude也從lookahead table解出來，存放amplitude
+        int* amplitude_done          : 1: amplitude已經解好 0: 需要另外讀取size個bits
+
+    Return:
+        解出來的symbol，-1表示bitstream裡沒有對應的codeword
+
+    Result:
+        1. 先peek HUFFMAN_LOOKAHEAD_BITS bits查lookahead table
+        2. 查不到 (較長的codeword) 才逐一增加長度和maxcode比較
+        buffer在進來之前至少要有32個bits (codeword 16 bits + amplitude 16 bits)
+ */
+static inline int huffman_decode_symbol(BitReader* bit_reader, Huffman_Table* huffman_table, uint16_t* amplitude, int* amplitude_done)
+{
+    uint32_t peek = bit_reader_peek(bit_reader, HUFFMAN_LOOKAHEAD_BITS);
+    const Huffman_Lookahead* entry = &huffman_table->lookahead[peek];
+
+    if (entry->total_length != 0) {
+        bit_reader_consume(bit_reader, entry->total_length);
+        *amplitude = entry->amplitude;
+        *amplitude_done = 1;
+        return entry->symbol;
+    }
+
+    *amplitude_done = 0;
+    if (entry->code_length != 0) {
+        bit_reader_consume(bit_reader, entry->code_length);
+        return entry->symbol;
+    }
+
+    /* 比lookahead bits長的codeword */
+    int bit_len = HUFFMAN_LOOKAHEAD_BITS + 1;
+    int32_t codeword = (int32_t)bit_reader_peek(bit_reader, bit_len);
+    while (codeword > huffman_table->maxcode[bit_len]) {
+        bit_len++;
+        codeword = (int32_t)bit_reader_peek(bit_reader, bit_len);
+    }
+
+    if (bit_len > HUFFMAN_MAX_CODE_LENGTH) {
+        fprintf(stderr, "[Error] Invalid Huffman codeword!\n");
+        return -1;
+    }
+
+    bit_reader_consume(bit_reader, bit_len);
+    return huffman_table->huffval[codeword + huffman_table->valoffset[bit_len]];
+}
+
+/*  function: huffman_decode_dc()
+    Params:
+        BitReader* bit_reader        : 紀錄bitstream讀取的情況
+        JpegDcEncoded* dc_encoded    : 存放解碼後的(size, amplitude)
+        Huffman_Table* huffman_table : decode用的tables
+
+    Return:
+        0 : 成功
+        -1: codeword不合法或是讀超過檔案結尾
+
+    Result:
+        解碼size (codeword) 後，再讀取size個bits的amplitude
+ */
+int huffman_decode_dc(BitReader* bit_reader, JpegDcEncoded* dc_encoded, Huffman_Table* huffman_table)
+{
+    uint16_t amplitude = 0;
+    int amplitude_done;
+
+    if (bit_reader->bit_left < 32) {
+        bit_reader_fill(bit_reader);
+    }
+
+    int symbol = huffman_decode_symbol(bit_reader, huffman_table, &amplitude, &amplitude_done);
+    if (symbol < 0) return -1;
+
+    dc_encoded->size = symbol;  // amplitude的bit長度 (不是codeword本身的長度)
+    if (!amplitude_done) {
+        amplitude = (uint16_t)bit_reader_get_bits(bit_reader, dc_encoded->size);
     }
     dc_encoded->amplitude = amplitude;
 
+    /* 不應該出現底下情況 */
+    if (bit_reader_overrun(bit_reader)) {
+        fprintf(stderr, "[Error] Unexpected End of File!\n");
+        return -1;
+    }
+
     return 0;
 }
 
@@ -109,152 +406,77 @@ int huffman_encode_dc(BitWriter* bit_writer, JpegDcEncoded* dc_encoded, Huffman_
 {
     /* Huffman coding將DPCM編碼後的DC係數得到的size (也就是category)當作symbol，寫入它的codeword */
     uint8_t symbol = dc_encoded->size;
-    uint16_t codeword = huffman_table->codeword[symbol];
+    uint32_t codeword = huffman_table->codeword[symbol];
     uint8_t code_len = huffman_table->code_length[symbol]; // codeword編碼需要的bits個數，由Huffman table定義好，只需要做mapping
-    int16_t amplitude = dc_encoded->amplitude;
+    uint32_t amplitude = dc_encoded->amplitude & ((1u << dc_encoded->size) - 1);
     uint8_t amp_len = dc_encoded->size;
 
-    /* 將codeword轉成bitstream，寫入檔案
-       使用MSB->LSB順序讀取codeword
-     */
-    for (int offset = code_len-1; offset >= 0; offset--) {
-        // 讀取codeword的bit
-        uint8_t bit = (codeword >> offset) & 0x01;
-
-        /* 寫入bit到buffer */
-        bit_writer->buffer <<= 1;
-        bit_writer->buffer |= bit;
-        bit_writer->bit_count++;
-
-        /* 讀到8個bits時，將一個byte的資料寫入檔案*/
-        if (bit_writer->bit_count == 8) {
-            fputc(bit_writer->buffer, bit_writer->fp);
-
-            /* byte stuffing: 避開JPEG檔案裡的marker */
-            if (bit_writer->buffer == 0xff) {
-                fputc(0x00, bit_writer->fp);
-            }
-            
-            /* 清空buffer */
-            bit_writer->buffer = 0;
-            bit_writer->bit_count = 0;
-        }
-    }
-
-    /* 將ampltitude轉成bitstream，寫入檔案 
-       使用MSB->LSB順序讀取ampltitude
-     */
-    for (int offset = amp_len-1; offset >= 0; offset--) {
-        // 讀取ampltitude的bit
-        uint8_t bit = (amplitude >> offset) & 0x01;
-
-        /* 寫入bit到buffer */
-        bit_writer->buffer <<= 1;
-        bit_writer->buffer |= bit;
-        bit_writer->bit_count++;
-
-        /* 讀到8個bits時，將一個byte的資料寫入檔案*/
-        if (bit_writer->bit_count == 8) {
-            fputc(bit_writer->buffer, bit_writer->fp);
-
-            /* byte stuffing: 避開JPEG檔案裡的marker */
-            if (bit_writer->buffer == 0xff) {
-                fputc(0x00, bit_writer->fp);
-            }
-
-            bit_writer->buffer = 0;
-            bit_writer->bit_count = 0;
-        }
-    }
-
+    /* codeword後面接著amplitude (MSB->LSB順序)，合併成一次寫入 */
+    bit_writer_put_bits(bit_writer, (codeword << amp_len) | amplitude, code_len + amp_len);
 
     return 0;
 }
 
+/*  function: huffman_decode_ac()
+    Params:
+        BitReader* bit_reader        : 紀錄bitstream讀取的情況
+        JpegAcEncoded* ac_encoded    : 存放一個block解碼後的((run_length, size), amplitude)
+        Huffman_Table* huffman_table : decode用的tables
+
+    Return:
+        0 : 成功
+        -1: codeword不合法、symbol個數超過block大小、或是讀超過檔案結尾
+
+    Result:
+        一直解碼直到EOB
+ */
 int huffman_decode_ac(BitReader* bit_reader, JpegAcEncoded* ac_encoded, Huffman_Table* huffman_table)
 {
     int ac_index = 0;
     int found_eob = 0;
 
     while (!found_eob) {
-        uint16_t codeword = 0, amplitude = 0;
-        int bit_len = 0;
-        uint8_t bit;
-        const int max_symbols_num = 256;  // AC 最多256種symbols
-        int found_symbol = 0;
-
-        // Decode AC codeword
-        while (!found_symbol) {
-            if (bit_reader->bit_left == 0) {
-                int data = fgetc(bit_reader->fp);
-
-                /* 不應該出現底下情況 */
-                if (data == EOF) {
-                    perror("[Error] Unexpected End of File!");
-                    return -1;
-                
-                }
+        uint16_t amplitude = 0;
+        int amplitude_done;
 
-                bit_reader->buffer = (uint8_t)data;
-                bit_reader->bit_left = 8;
-
-                /* byte stuffing情況: 0xff 0x00 */
-                if (bit_reader->buffer == 0xff) {
-                    // 丟掉0x00
-                    fgetc(bit_reader->fp);
-                }
-            }
+        /* 一個block最多63個AC係數 + EOB */
+        if (ac_index >= 64) {
+            fprintf(stderr, "[Error] Too many AC symbols in a block!\n");
+            return -1;
+        }
 
-            bit = (bit_reader->buffer >> (bit_reader->bit_left-1)) & 0x01;
-            codeword = (codeword << 1) | bit;
-            bit_len++;
-            bit_reader->bit_left--;
-
-            // 匹配目前的codeword有沒有在huffman table裡
-            for (int i = 0; i < max_symbols_num; i++) {
-                if (huffman_table->codeword[i] == codeword && huffman_table->code_length[i] == bit_len) {
-                    ac_encoded->symbols[ac_index].run_length = (i >> 4) & 0x0f;
-                    ac_encoded->symbols[ac_index].size = i & 0x0f;
-                    found_symbol = 1; // 找到AC係數的codeword長度
-                    break;
-                }
-            }
+        if (bit_reader->bit_left < 32) {
+            bit_reader_fill(bit_reader);
         }
 
+        int symbol = huffman_decode_symbol(bit_reader, huffman_table, &amplitude, &amplitude_done);
+        if (symbol < 0) return -1;
 
-        if (ac_encoded->symbols[ac_index].run_length == 0 && ac_encoded->symbols[ac_index].size == 0) {
-            /* 檢查是不是EOB */
-            found_eob = 1; // 找到EOB符號
-            ac_encoded->symbols[ac_index].amplitude = 0;
-            ac_index++;
-        } else if (ac_encoded->symbols[ac_index].run_length == 15 && ac_encoded->symbols[ac_index].size == 0) {
-            /* 檢查是不是ZRL*/
-            ac_encoded->symbols[ac_index].amplitude = 0;
-            ac_index++;
-        } else {
-            // Decode AC amplitude
-            for (int i = 0; i < ac_encoded->symbols[ac_index].size; i++) {
-                if (bit_reader->bit_left == 0) {
-                    bit_reader->buffer = (uint8_t)fgetc(bit_reader->fp);
-                    bit_reader->bit_left = 8;
-
-                    /* byte stuffing情況: 0xff 0x00 */
-                    if (bit_reader->buffer == 0xff) {
-                        // 丟掉0x00
-                        fgetc(bit_reader->fp);
-                    }
-                }
+        JpegAcSymbol* ac_symbol = &ac_encoded->symbols[ac_index];
+        ac_symbol->run_length = (symbol >> 4) & 0x0f;
+        ac_symbol->size = symbol & 0x0f;
 
-                bit = (bit_reader->buffer >> (bit_reader->bit_left-1)) & 0x01;
-                amplitude = (amplitude << 1) | bit;
-                bit_reader->bit_left--;
-            }
-            ac_encoded->symbols[ac_index].amplitude = amplitude;
-            ac_index++;
+        if (!amplitude_done) {
+            /* EOB和ZRL的size是0，amplitude也會是0 */
+            amplitude = (uint16_t)bit_reader_get_bits(bit_reader, ac_symbol->size);
+        }
+        ac_symbol->amplitude = amplitude;
+        ac_index++;
+
+        /* 檢查是不是EOB */
+        if (symbol == 0x00) {
+            found_eob = 1;
         }
     }
 
     ac_encoded->num_symbols = ac_index;
+
+    /* 不應該出現底下情況 */
+    if (bit_reader_overrun(bit_reader)) {
+        fprintf(stderr, "[Error] Unexpected End of File!\n");
+        return -1;
+    }
+
     return 0;
 }
 
@@ -277,66 +499,14 @@ int huffman_encode_ac(BitWriter* bit_writer, JpegAcEncoded* ac_encoded, Huffman_
     for (int i = 0; i < ac_encoded->num_symbols; i++) {
         /* Huffman coding將RLE encode後的(run length, size)組成一個byte當作symbol */
         uint8_t symbol = (ac_encoded->symbols[i].run_length << 4 | ac_encoded->symbols[i].size);
-        uint16_t codeword = huffman_table->codeword[symbol];
+        uint32_t codeword = huffman_table->codeword[symbol];
         uint8_t code_len = huffman_table->code_length[symbol];
-        uint16_t amplitude = ac_encoded->symbols[i].amplitude;
         uint8_t amp_len = ac_encoded->symbols[i].size;
+        uint32_t amplitude = ac_encoded->symbols[i].amplitude & ((1u << amp_len) - 1);
 
-        
-        /* 將codeword轉成bitstream，寫入檔案
-           使用MSB->LSB順序讀取codeword
-         */
-        for (int offset = code_len-1; offset >= 0; offset--) {
-            // 讀取codeword的bit
-            uint8_t bit = (codeword >> offset) & 0x01;
-
-            /* 寫入bit到buffer */
-            bit_writer->buffer <<= 1;
-            bit_writer->buffer |= bit;
-            bit_writer->bit_count++;
-
-            /* 讀到8個bits時，將一個byte的資料寫入檔案*/
-            if (bit_writer->bit_count == 8) {
-                fputc(bit_writer->buffer, bit_writer->fp);
-
-                /* byte stuffing: 避開JPEG檔案裡的marker */
-                if (bit_writer->buffer == 0xff) {
-                    fputc(0x00, bit_writer->fp);
-                }
-
-                bit_writer->buffer = 0;
-                bit_writer->bit_count = 0;
-            }
-        }
-
-
-        /* 將ampltitude轉成bitstream，寫入檔案 
-           使用MSB->LSB順序讀取ampltitude
-         */
-        for (int offset = amp_len-1; offset >= 0; offset--) {
-            // 讀取ampltitude的bit
-            uint8_t bit = (amplitude >> offset) & 0x01;
-
-            /* 寫入bit到buffer */
-            bit_writer->buffer <<= 1;
-            bit_writer->buffer |= bit;
-            bit_writer->bit_count++;
-
-            /* 讀到8個bits時，將一個byte的資料寫入檔案*/
-            if (bit_writer->bit_count == 8) {
-                fputc(bit_writer->buffer, bit_writer->fp);
-
-                /* byte stuffing: 避開JPEG檔案裡的marker */
-                if (bit_writer->buffer == 0xff) {
-                    fputc(0x00, bit_writer->fp);
-                }
-
-                bit_writer->buffer = 0;
-                bit_writer->bit_count = 0;
-            }
-        }
+        /* codeword後面接著amplitude (MSB->LSB順序)，合併成一次寫入 */
+        bit_writer_put_bits(bit_writer, (codeword << amp_len) | amplitude, code_len + amp_len);
     }
 
     return 0;
-
-}
\ No newline at end of file
+}
@@ -4,24 +4,32 @@
 #include"yuv.h"
 #include"entropy/entropy.h"
 #include"entropy/algorithms/huffman.h"
+#include"thread_pool.h"
 
 Huffman_Table* jpeg_y_dc_huffman_table, * jpeg_y_ac_huffman_table;
 Huffman_Table* jpeg_uv_dc_huffman_table, * jpeg_uv_ac_huffman_table;
+EntropyConfig jpeg_entropy_config;     // huffman_optimize/restart_interval/threads
+ThreadPool* jpeg_entropy_thread_pool;  // restart segments平行編碼使用，threads <= 1時是NULL
 
 
 /*  function: entropy_initialization()
     Params:
-        EntropyType entropy_type         : entropy的方式
+        EntropyType entropy_type            : entropy的方式
+        const EntropyConfig* entropy_config : Huffman tables最佳化、restart interval和threads的設定
 
     Return:
-        得到entropy coding需要的資源. 例如: Huffman coding的tables
+        得到entropy coding需要的資源. 例如: Huffman coding的tables、thread pool
 
     Result:
+        標準的Annex K tables一定會建立 (最佳化沒有比較小時使用)
  */
-void entropy_initialization(EntropyType entropy_type)
+void entropy_initialization(EntropyType entropy_type, const EntropyConfig* entropy_config)
 {
     if (entropy_type == HUFFMAN) {
-        printf("Initialize Huffman tables\n");
+        jpeg_entropy_config = *entropy_config;
+        jpeg_entropy_thread_pool = thread_pool_create(entropy_config->threads);
+
+        fprintf(stderr, "Initialize Huffman tables\n");  // libvcodec和串流模式的stdout是呼叫者的資料
         jpeg_y_dc_huffman_table = (Huffman_Table*)malloc(sizeof(Huffman_Table));
         jpeg_y_ac_huffman_table = (Huffman_Table*)malloc(sizeof(Huffman_Table));
         jpeg_uv_dc_huffman_table = (Huffman_Table*)malloc(sizeof(Huffman_Table));
@@ -52,13 +60,15 @@ void entropy_initialization(EntropyType entropy_type)
         EntropyType entropy_type         : entropy的方式
 
     Return:
-        將entropy取得的資源釋放. 例如: 將Huffman coding tables釋放
+        將entropy取得的資源釋放. 例如: 將Huffman coding tables和thread pool釋放
 
     Result:
  */
 void entropy_destropy(EntropyType entropy_type)
 {
     if (entropy_type == HUFFMAN) {
+        thread_pool_destroy(jpeg_entropy_thread_pool);
+        jpeg_entropy_thread_pool = NULL;
         free(jpeg_y_dc_huffman_table);
         free(jpeg_y_ac_huffman_table);
         free(jpeg_uv_dc_huffman_table);
@@ -66,24 +76,77 @@ void entropy_destropy(EntropyType entropy_type)
     }
 }
 
+/*  function: entropy_workspace_create()
+    Params:
+        EntropyType entropy_type : entropy的方式
+
+    Return:
+        空的workspace，失敗時回傳NULL
+
+    Result:
+        第一張frame編碼/解碼時才依照frame大小配置記憶體
+ */
+EntropyWorkspace* entropy_workspace_create(EntropyType entropy_type)
+{
+    if (entropy_type == HUFFMAN) {
+        return jpeg_workspace_create();
+    }
+    return NULL;
+}
+
+/*  function: entropy_workspace_destroy()
+    Params:
+        EntropyType entropy_type    : entropy的方式
+        EntropyWorkspace* workspace : entropy_workspace_create()得到的workspace (可以是NULL)
+
+    Return:
+        將workspace配置的記憶體釋放
+ */
+void entropy_workspace_destroy(EntropyType entropy_type, EntropyWorkspace* workspace)
+{
+    if (entropy_type == HUFFMAN) {
+        jpeg_workspace_destroy(workspace);
+    }
+}
+
+/*  function: entropy_workspace_size()
+    Params:
+        EntropyType entropy_type          : entropy的方式
+        const EntropyWorkspace* workspace : workspace
+
+    Return:
+        workspace目前配置的bytes個數
+ */
+size_t entropy_workspace_size(EntropyType entropy_type, const EntropyWorkspace* workspace)
+{
+    if (entropy_type == HUFFMAN) {
+        return jpeg_workspace_size(workspace);
+    }
+    return 0;
+}
+
 /*  function: entropy_encode()
     Params:
         YUVFrame* frame                  : yuv raw data frame
         CompressionType compression_type : 壓縮的方式
-        const char* out_bitstream_path   : 儲存bitstream的path
+        FILE* bitstream_fp               : 寫入bitstream的檔案 (由呼叫者開啟/關閉)
+        EntropyWorkspace* workspace      : 這張frame使用的workspace
 
     Return:
-        對frame的padded data做完壓縮，再將bitstream儲存起來
+        0 : 成功 (對frame的padded data做完壓縮，再將bitstream儲存起來)
+        -1: 沒有支援的壓縮方式或記憶體配置失敗 (bitstream不完整)
 
     Result:
         1. 依照壓縮的方式對frame的padded y/u/v data各自做壓縮
         2. 依照壓縮的方式將bitstream儲存
  */
-void entropy_encode(YUVFrame* frame, QuantType quant_type, CompressionType compression_type, EntropyType entropy_type, const char* out_bitstream_path)
+int entropy_encode(YUVFrame* frame, QuantParams* quant_params, CompressionType compression_type, EntropyType entropy_type, FILE* bitstream_fp,
+                   EntropyWorkspace* workspace)
 {
     if (compression_type == JPEG_SEQUENTIAL) {
-        entropy_encode_jpeg(frame, quant_type, compression_type, entropy_type, out_bitstream_path);
+        return entropy_encode_jpeg(frame, quant_params, compression_type, entropy_type, bitstream_fp, workspace);
     }
+    return -1;
 }
 
 
@@ -91,18 +154,22 @@ void entropy_encode(YUVFrame* frame, QuantType quant_type, CompressionType compr
     Params:
         YUVFrame* frame                  : yuv raw data frame
         CompressionType compression_type : 壓縮的方式
-        const char* out_bitstream_path   : 讀取bitstream的path
+        FILE* bitstream_fp               : 讀取bitstream的檔案 (由呼叫者開啟/關閉)
+        EntropyWorkspace* workspace      : 這張frame使用的workspace
 
     Return:
-        將bitstream檔案內容讀取出來，再將DC/AC係數擺放到正確的位置
+        0 : 解碼成功
+        -1: 沒有支援的壓縮方式、header和設定不同、或是bitstream損毀
 
     Result:
         1. 解碼後的DC/AC係數
         2. reverse zigzag scan的結果
  */
-void entropy_decode(YUVFrame* frame, QuantType quant_type, CompressionType compression_type, EntropyType entropy_type, const char* out_bitstream_path)
+int entropy_decode(YUVFrame* frame, QuantParams* quant_params, CompressionType compression_type, EntropyType entropy_type, FILE* bitstream_fp,
+                   EntropyWorkspace* workspace)
 {
     if (compression_type == JPEG_SEQUENTIAL) {
-        entropy_decode_jpeg(frame, quant_type, compression_type, entropy_type, out_bitstream_path);
+        return entropy_decode_jpeg(frame, quant_params, compression_type, entropy_type, bitstream_fp, workspace);
     }
+    return -1;
 }
\ No newline at end of file
@@ -1,11 +1,32 @@
 #include<stdio.h>
 #include<stdlib.h>
 #include<stdint.h>
+#include<string.h>
 #include"yuv.h"
 #include"entropy/jpeg/entropy_jpeg.h"
 #include"entropy/entropy.h"
 #include"entropy/algorithms/huffman.h"
+#include"quantization/quantization.h"
+#include"quantization/h264/quant_h264.h"
 #include"file_io.h"
+#include"thread_pool.h"
+
+/* Huffman tables在header裡的順序 */
+enum {
+    JPEG_HUFFMAN_Y_DC = 0,
+    JPEG_HUFFMAN_Y_AC,
+    JPEG_HUFFMAN_UV_DC,
+    JPEG_HUFFMAN_UV_AC,
+    JPEG_HUFFMAN_TABLES_NUM
+};
+
+/* 一張frame使用的Huffman tables (標準的Annex K tables或這張frame最佳化的tables) */
+typedef struct {
+    int optimized;                                       // 1: 使用specs建立的tables，header裡會有specs
+    Huffman_Spec specs[JPEG_HUFFMAN_TABLES_NUM];         // 依照JPEG_HUFFMAN_*順序的bits/hufval
+    Huffman_Table tables[JPEG_HUFFMAN_TABLES_NUM];       // 由specs建立的tables
+    Huffman_Table* y_dc, * y_ac, * uv_dc, * uv_ac;       // encode/decode實際使用的tables
+}JpegHuffmanTables;
 
 // 8x8 Zig-zag掃描順序: 對應到block的位置
 const uint8_t zigzag_8x8[64] = {
@@ -19,6 +40,14 @@ const uint8_t zigzag_8x8[64] = {
     53, 60, 61, 54, 47, 55, 62, 63
 };
 
+// 4x4 Zig-zag掃描順序: 對應到block的位置
+const uint8_t zigzag_4x4[16] = {
+     0,  1,  4,  8,
+     5,  2,  3,  6,
+     9, 12, 13, 10,
+     7, 11, 14, 15
+};
+
 
 /*  function: zigzag_scan()
     Params:
@@ -32,23 +61,36 @@ const uint8_t zigzag_8x8[64] = {
         將scan順序的資料擺放在DC/AC裡
 
     Result:
-        得到scan後的資料順序
+        得到scan後的資料順序 (8x8 block使用zigzag_8x8，4x4 block使用zigzag_4x4)
  */
 void zigzag_scan(int16_t* block, int b_height, int b_width, int padded_width, JpegBlockCoeffs* jpeg_block)
 {
+    const uint8_t* zigzag = (b_width == 4) ? zigzag_4x4 : zigzag_8x8;
+    int num_coeffs = b_width * b_height;
+
+    int last = 0;
+
     // DC係數
     jpeg_block->dc = block[0];
 
     // AC係數
-    for (int i = 1; i < 64; i++) {
-        int index = zigzag_8x8[i];
+    for (int i = 1; i < num_coeffs; i++) {
+        int index = zigzag[i];
 
         /* 轉換座標 */
-        int row = index / 8;
-        int col = index % 8;
+        int row = index / b_width;
+        int col = index % b_width;
         int offset = row * padded_width + col;
         jpeg_block->ac[i-1] = block[offset];
+        if (block[offset] != 0) last = i;
+    }
+
+    /* 4x4 block沒有用到的AC係數補0，RLE會將它們編碼成EOB */
+    for (int i = num_coeffs; i < 64; i++) {
+        jpeg_block->ac[i-1] = 0;
     }
+
+    jpeg_block->eob = (uint8_t)(last + 1);
 }
 
 
@@ -86,6 +128,7 @@ void zigzag_component(Component* comp, JpegBlockCoeffs* blocks)
     Params:
         JpegBlockCoeffs* blocks    : 儲存component做完zigzag scan後的DC/AC
         int num_blocks             : 該component有多少塊block
+        int restart_blocks         : 每幾個blocks重設DC預測 (restart segment的開頭)，0表示不重設
 
     Return:
         得到DPCM encoding後的DC係數
@@ -93,12 +136,15 @@ void zigzag_component(Component* comp, JpegBlockCoeffs* blocks)
     Result:
         DPCM encoding是將current block的DC係數減掉上一個block的DC係數，最後將差值儲存
  */
-void differential_pulse_code_modulation(JpegBlockCoeffs* blocks, int num_blocks)
+void differential_pulse_code_modulation(JpegBlockCoeffs* blocks, int num_blocks, int restart_blocks)
 {
     int16_t prev_dc = 0;  // 第一個block的前一個DC係數為0
 
     /* DPCM encoding: 當下block的DC - 上一個block的DC */
     for (int i = 0; i < num_blocks; i++) {
+        if (restart_blocks > 0 && i % restart_blocks == 0) {
+            prev_dc = 0;
+        }
         int16_t current_dc = blocks[i].dc;
         blocks[i].dc = current_dc - prev_dc;
         prev_dc = current_dc;
@@ -155,53 +201,75 @@ int16_t get_amplitude(int16_t coeff, uint8_t size)
     Params:
         JpegBlockCoeffs* blocks    : 儲存component做完zigzag scan後的DC/AC
         int num_blocks             : 該component有多少塊block
-        JpegDcEncoded** dc_encoded : 儲存每個block將DC係數encode後的結果
+        int restart_blocks         : 每幾個blocks重設DC預測，0表示不重設
+        JpegDcEncoded* dc_encoded  : 儲存每個block將DC係數encode後的結果 (workspace配置好num_blocks個)
 
     Return:
         得到DPCM encoding後的DC係數
 
     Result:
  */
-void jpeg_encode_dc(JpegBlockCoeffs* blocks, int num_blocks, JpegDcEncoded** dc_encoded)
+void jpeg_encode_dc(JpegBlockCoeffs* blocks, int num_blocks, int restart_blocks, JpegDcEncoded* dc_encoded)
 {
     /* DPCM encoding */
-    differential_pulse_code_modulation(blocks, num_blocks);
-
-    /* 根據block個數配置記憶體，儲存每塊block的DC係數在encode後的結果 */
-    *dc_encoded = (JpegDcEncoded*)malloc(sizeof(JpegDcEncoded) * num_blocks);
-
-    if (*dc_encoded == NULL) {
-        /* 記憶體配置失敗，則回傳，不繼續做encode */
-        perror("Failed to allocate memory for JPEG DC encoded data");
-        return;
-    }
+    differential_pulse_code_modulation(blocks, num_blocks, restart_blocks);
 
     /*  Encode DC 差值係數
         JPEG不直接對DC差值做編碼，而是另外處理後，得到size(或是)category、ampltitude再對他們編碼
      */
     for (int i = 0; i < num_blocks; i++) {
-        (*dc_encoded)[i].size = get_size(blocks[i].dc);
-        (*dc_encoded)[i].amplitude = get_amplitude(blocks[i].dc, (*dc_encoded)[i].size);
+        dc_encoded[i].size = get_size(blocks[i].dc);
+        dc_encoded[i].amplitude = get_amplitude(blocks[i].dc, dc_encoded[i].size);
     }
 }
 
 void inverse_zigzag_scan(int16_t* block, int b_height, int b_width, int padded_width, JpegBlockCoeffs* jpeg_block)
 {
+    const uint8_t* zigzag = (b_width == 4) ? zigzag_4x4 : zigzag_8x8;
+    int num_coeffs = b_width * b_height;
+
+    int eob = (jpeg_block->eob < num_coeffs) ? jpeg_block->eob : num_coeffs;
+
+    /* eob之後的係數都是0，先整塊清0，只需要寫到eob為止 */
+    for (int row = 0; row < b_height; row++) {
+        memset(block + row * padded_width, 0, sizeof(int16_t) * b_width);
+    }
+
     // DC係數
     block[0] = jpeg_block->dc;
 
     // AC係數
-    for (int i = 1; i < 64; i++) {
-        int index = zigzag_8x8[i];
+    for (int i = 1; i < eob; i++) {
+        int index = zigzag[i];
 
         /* 轉換座標 */
-        int row = index / 8;
-        int col = index % 8;
+        int row = index / b_width;
+        int col = index % b_width;
         int offset = row * padded_width + col;
         block[offset] = jpeg_block->ac[i-1];
     }
 }
 
+/*  function: jpeg_block_sparsity()
+    Params:
+        const JpegBlockCoeffs* jpeg_block : entropy decoding後的一個block
+        int b_width                       : block width
+
+    Return:
+        block裡非零係數的分布
+
+    Result:
+        由eob判斷: 只有DC、非零係數都在左上角4x4、或是一般的block
+        4x4 block一律回傳BLOCK_SPARSE_FULL
+ */
+BlockSparsity jpeg_block_sparsity(const JpegBlockCoeffs* jpeg_block, int b_width)
+{
+    if (b_width != 8) return BLOCK_SPARSE_FULL;
+    if (jpeg_block->eob <= JPEG_EOB_DC_ONLY) return BLOCK_SPARSE_DC_ONLY;
+    if (jpeg_block->eob <= JPEG_EOB_LOW_4x4) return BLOCK_SPARSE_LOW_4x4;
+    return BLOCK_SPARSE_FULL;
+}
+
 void inverse_zigzag_component(Component* comp, JpegBlockCoeffs* blocks)
 {
     int blocks_per_row = comp->padded_width / comp->block_info.width;
@@ -216,11 +284,14 @@ void inverse_zigzag_component(Component* comp, JpegBlockCoeffs* blocks)
     }
 }
 
-void differential_pulse_code_demodulation(JpegBlockCoeffs* blocks, int num_blocks)
+void differential_pulse_code_demodulation(JpegBlockCoeffs* blocks, int num_blocks, int restart_blocks)
 {
     int16_t prev_dc = 0;  // 第一個block的前一個DC係數為0
 
     for (int i = 0; i < num_blocks; i++) {
+        if (restart_blocks > 0 && i % restart_blocks == 0) {
+            prev_dc = 0;
+        }
         int16_t current_dc = blocks[i].dc;
         blocks[i].dc = current_dc + prev_dc;
         prev_dc = blocks[i].dc;
@@ -240,21 +311,11 @@ int16_t decode_amplitude(uint8_t size, int16_t amplitude)
     }
 }
 
-void jpeg_decode_dc(JpegBlockCoeffs* blocks, int num_blocks, JpegDcEncoded* dc_encoded)
-{
-    for (int i = 0; i < num_blocks; i++) {
-        blocks[i].dc = decode_amplitude(dc_encoded[i].size, dc_encoded[i].amplitude);
-    }
-
-    // DPCM decoding
-    differential_pulse_code_demodulation(blocks, num_blocks);
-}
-
 
 /*  function: run_length_encoding()
     Params:
         JpegBlockCoeffs* blocks    : 儲存component做完zigzag scan後的DC/AC
-        JpegAcEncoded** ac_encoded : 儲存每個block將AC係數encode後的結果
+        JpegAcEncoded* ac_encoded  : 儲存block將AC係數encode後的結果 (symbols指到的空間至少JPEG_AC_SYMBOLS_MAX個)
 
     Return:
         得到run length encoding後的結果
@@ -271,13 +332,7 @@ void run_length_encoding(JpegBlockCoeffs* block, JpegAcEncoded* ac_encoded)
     ac_encoded->num_symbols = 0;
     
     /* 避免block裡的係數都是0的情況，找到最後一個非零係數的位置 */
-    int last_nonzero = -1;
-    for (int i = 62; i >= 0; i--) {
-        if (block->ac[i] != 0) {
-            last_nonzero = i;
-            break;
-        }
-    }
+    int last_nonzero = block->eob - 2;
 
     /* 如果所有AC係數都是0，只輸出EOB (run_length, size)(amplitude) = (0,0)(0) */
     if (last_nonzero == -1) {
@@ -320,30 +375,112 @@ void run_length_encoding(JpegBlockCoeffs* block, JpegAcEncoded* ac_encoded)
 }
 
 
-/*  function: jpeg_encode_ac()
+/* symbol buffer第一次配置時的大小 (之後2倍成長) */
+#define JPEG_SYMBOL_BUFFER_MIN  4096
+
+typedef struct {
+    JpegBlockCoeffs* blocks;
+    JpegAcEncoded* ac_encoded;
+    JpegSymbolBuffer* symbol_buffers;
+    int num_blocks;
+}JpegRleJob;
+
+/*  function: jpeg_symbol_buffer_reserve()
     Params:
-        JpegBlockCoeffs* blocks    : 儲存component做完zigzag scan後的DC/AC
-        int num_blocks             : 該component有多少塊block
-        JpegAcEncoded** ac_encoded : 儲存每個block將AC係數encode後的結果
+        JpegSymbolBuffer* buffer : RLE工作的symbol buffer
+        size_t symbols_num       : 需要的symbols個數
 
     Return:
-        得到run length encoding後的結果
+        0 : 成功
+        -1: 記憶體配置失敗 (原本的symbols保留)
 
     Result:
+        不夠時2倍成長，buffer留給之後的frames，所以只有前幾張frames會配置記憶體
  */
-void jpeg_encode_ac(JpegBlockCoeffs* blocks, int num_blocks, JpegAcEncoded** ac_encoded)
+static int jpeg_symbol_buffer_reserve(JpegSymbolBuffer* buffer, size_t symbols_num)
 {
-    /* 根據block個數配置記憶體，儲存每塊block的AC係數在encode後的結果 */
-    *ac_encoded = (JpegAcEncoded*)malloc(sizeof(JpegAcEncoded) * num_blocks);
-    if (*ac_encoded == NULL) {
-        /* 記憶體配置失敗，則回傳，不繼續做encode */
-        perror("Failed to allocate memory for JPEG AC encoded data");
-        return;
+    if (symbols_num <= buffer->capacity) {
+        return 0;
     }
 
-    for (int i = 0; i < num_blocks; i++) {
-        run_length_encoding(&blocks[i], &(*ac_encoded)[i]);
+    size_t capacity = (buffer->capacity > 0) ? buffer->capacity : JPEG_SYMBOL_BUFFER_MIN;
+    while (capacity < symbols_num) {
+        capacity *= 2;
     }
+    JpegAcSymbol* symbols = (JpegAcSymbol*)realloc(buffer->symbols, sizeof(JpegAcSymbol) * capacity);
+    if (symbols == NULL) {
+        return -1;
+    }
+    buffer->symbols = symbols;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+/*  function: jpeg_rle_job()
+    Params:
+        void* arg     : JpegRleJob*
+        int job_index : 處理第job_index * JPEG_RLE_JOB_BLOCKS個block開始的blocks
+
+    Result:
+        thread pool的工作，對一段blocks做run length encoding
+        symbols依照block順序連續寫到symbol_buffers[job_index]，每個block只佔實際的symbols個數
+        buffer成長時位置會改變，所以最後才設定每個block的symbols指標
+ */
+void jpeg_rle_job(void* arg, int job_index)
+{
+    JpegRleJob* rle_job = (JpegRleJob*)arg;
+    JpegSymbolBuffer* buffer = &rle_job->symbol_buffers[job_index];
+    int start = job_index * JPEG_RLE_JOB_BLOCKS;
+    int end = (start + JPEG_RLE_JOB_BLOCKS < rle_job->num_blocks) ? start + JPEG_RLE_JOB_BLOCKS : rle_job->num_blocks;
+    size_t used = 0;
+
+    buffer->failed = 0;
+    for (int i = start; i < end; i++) {
+        /* 一個block最多JPEG_AC_SYMBOLS_MAX個symbols */
+        if (jpeg_symbol_buffer_reserve(buffer, used + JPEG_AC_SYMBOLS_MAX) != 0) {
+            perror("Failed to allocate memory for JPEG AC symbols");
+            buffer->failed = 1;
+            return;
+        }
+        rle_job->ac_encoded[i].symbols = buffer->symbols + used;
+        run_length_encoding(&rle_job->blocks[i], &rle_job->ac_encoded[i]);
+        used += rle_job->ac_encoded[i].num_symbols;
+    }
+
+    JpegAcSymbol* symbols = buffer->symbols;
+    for (int i = start; i < end; i++) {
+        rle_job->ac_encoded[i].symbols = symbols;
+        symbols += rle_job->ac_encoded[i].num_symbols;
+    }
+}
+
+/*  function: jpeg_encode_ac()
+    Params:
+        JpegBlockCoeffs* blocks          : 儲存component做完zigzag scan後的DC/AC
+        int num_blocks                   : 該component有多少塊block
+        JpegAcEncoded* ac_encoded        : 儲存每個block將AC係數encode後的結果 (workspace配置好num_blocks個)
+        JpegSymbolBuffer* symbol_buffers : 存放symbols的buffers (每JPEG_RLE_JOB_BLOCKS個blocks一個)
+
+    Return:
+        0 : 成功
+        -1: symbols的記憶體配置失敗
+
+    Result:
+        得到run length encoding後的結果
+ */
+int jpeg_encode_ac(JpegBlockCoeffs* blocks, int num_blocks, JpegAcEncoded* ac_encoded, JpegSymbolBuffer* symbol_buffers)
+{
+    extern ThreadPool* jpeg_entropy_thread_pool;
+    int jobs_num = (num_blocks + JPEG_RLE_JOB_BLOCKS - 1) / JPEG_RLE_JOB_BLOCKS;
+
+    /* 每個block的RLE互相獨立，切成JPEG_RLE_JOB_BLOCKS個blocks為一個工作平行處理 */
+    JpegRleJob rle_job = {blocks, ac_encoded, symbol_buffers, num_blocks};
+    thread_pool_run(jpeg_entropy_thread_pool, jpeg_rle_job, &rle_job, jobs_num);
+
+    for (int i = 0; i < jobs_num; i++) {
+        if (symbol_buffers[i].failed) return -1;
+    }
+    return 0;
 }
 
 
@@ -356,6 +493,7 @@ void jpeg_encode_ac(JpegBlockCoeffs* blocks, int num_blocks, JpegAcEncoded** ac_
         得到reverse run length encoding後的結果
 
     Result:
+        同時記錄block的eob (最後一個非零係數在zigzag順序的位置+1)
  */
 void reverse_run_length_encoding(JpegBlockCoeffs* block, JpegAcEncoded* ac_encoded)
 {
@@ -365,6 +503,7 @@ void reverse_run_length_encoding(JpegBlockCoeffs* block, JpegAcEncoded* ac_encod
     }
 
     int ac_index = 0;
+    int last = 0;
 
     for (int i = 0; i < ac_encoded->num_symbols; i++) {
         JpegAcSymbol symbol = ac_encoded->symbols[i];
@@ -389,27 +528,152 @@ void reverse_run_length_encoding(JpegBlockCoeffs* block, JpegAcEncoded* ac_encod
         if (ac_index < 63) {
             block->ac[ac_index] = decode_amplitude(symbol.size, symbol.amplitude);
             ac_index++;
+            last = ac_index;
         }
     }
+
+    /* 記錄最後一個非零係數的位置，讓IDCT可以選擇對應的kernel */
+    block->eob = (uint8_t)(last + 1);
 }
 
 
-/*  function: jpeg_decode_ac()
+/*  function: jpeg_use_standard_huffman_tables()
     Params:
-        JpegBlockCoeffs* blocks    : 儲存component做完zigzag scan後的DC/AC
-        int num_blocks             : frame裡的block個數
-        JpegAcEncoded** ac_encoded : 儲存每個block將AC係數encode後的結果
+        JpegHuffmanTables* huffman_tables : 存放這張frame使用的tables
 
     Return:
-        得到解碼AC係數後的結果
+        None
 
     Result:
+        使用entropy_initialization()建立的Annex K tables
  */
-void jpeg_decode_ac(JpegBlockCoeffs* blocks, int num_blocks, JpegAcEncoded* ac_encoded)
+void jpeg_use_standard_huffman_tables(JpegHuffmanTables* huffman_tables)
 {
-    for (int i = 0; i < num_blocks; i++) {
-        reverse_run_length_encoding(&blocks[i], &ac_encoded[i]);
+    extern Huffman_Table* jpeg_y_dc_huffman_table, * jpeg_y_ac_huffman_table;
+    extern Huffman_Table* jpeg_uv_dc_huffman_table, * jpeg_uv_ac_huffman_table;
+
+    huffman_tables->optimized = 0;
+    huffman_tables->y_dc = jpeg_y_dc_huffman_table;
+    huffman_tables->y_ac = jpeg_y_ac_huffman_table;
+    huffman_tables->uv_dc = jpeg_uv_dc_huffman_table;
+    huffman_tables->uv_ac = jpeg_uv_ac_huffman_table;
+}
+
+/*  function: jpeg_use_spec_huffman_tables()
+    Params:
+        JpegHuffmanTables* huffman_tables : tables已經由specs建立好
+
+    Return:
+        None
+
+    Result:
+        使用huffman_tables->tables (header裡會寫入specs)
+ */
+void jpeg_use_spec_huffman_tables(JpegHuffmanTables* huffman_tables)
+{
+    huffman_tables->optimized = 1;
+    huffman_tables->y_dc = &huffman_tables->tables[JPEG_HUFFMAN_Y_DC];
+    huffman_tables->y_ac = &huffman_tables->tables[JPEG_HUFFMAN_Y_AC];
+    huffman_tables->uv_dc = &huffman_tables->tables[JPEG_HUFFMAN_UV_DC];
+    huffman_tables->uv_ac = &huffman_tables->tables[JPEG_HUFFMAN_UV_AC];
+}
+
+/*  function: jpeg_select_huffman_tables()
+    Params:
+        JpegHuffmanTables* huffman_tables : 存放這張frame使用的tables
+        JpegDcEncoded* y_dc_encoded       : Y component DPCM後的DC
+        JpegAcEncoded* y_ac_encoded       : Y component RLE後的AC
+        int y_blocks_num                  : Y component的block個數
+        JpegDcEncoded* u_dc_encoded       : U component DPCM後的DC
+        JpegAcEncoded* u_ac_encoded       : U component RLE後的AC
+        int u_blocks_num                  : U component的block個數
+        JpegDcEncoded* v_dc_encoded       : V component DPCM後的DC
+        JpegAcEncoded* v_ac_encoded       : V component RLE後的AC
+        int v_blocks_num                  : V component的block個數
+
+    Return:
+        None
+
+    Result:
+        1. 沒有開啟huffman_optimize時使用標準tables
+        2. 統計Y DC/Y AC/UV DC/UV AC的symbol個數，產生長度不超過16的最佳化tables
+        3. 最佳化tables的codeword bits加上寫到header的bytes比標準tables少時才使用
+ */
+void jpeg_select_huffman_tables(JpegHuffmanTables* huffman_tables,
+                                JpegDcEncoded* y_dc_encoded, JpegAcEncoded* y_ac_encoded, int y_blocks_num,
+                                JpegDcEncoded* u_dc_encoded, JpegAcEncoded* u_ac_encoded, int u_blocks_num,
+                                JpegDcEncoded* v_dc_encoded, JpegAcEncoded* v_ac_encoded, int v_blocks_num)
+{
+    extern EntropyConfig jpeg_entropy_config;
+
+    jpeg_use_standard_huffman_tables(huffman_tables);
+    if (!jpeg_entropy_config.huffman_optimize) {
+        return;
+    }
+
+    /* 統計每個table的symbols出現次數 (amplitude的bits和table無關，不需要統計) */
+    uint32_t freq[JPEG_HUFFMAN_TABLES_NUM][256];
+    memset(freq, 0, sizeof(freq));
+    huffman_count_dc_symbols(y_dc_encoded, y_blocks_num, freq[JPEG_HUFFMAN_Y_DC]);
+    huffman_count_ac_symbols(y_ac_encoded, y_blocks_num, freq[JPEG_HUFFMAN_Y_AC]);
+    huffman_count_dc_symbols(u_dc_encoded, u_blocks_num, freq[JPEG_HUFFMAN_UV_DC]);
+    huffman_count_dc_symbols(v_dc_encoded, v_blocks_num, freq[JPEG_HUFFMAN_UV_DC]);
+    huffman_count_ac_symbols(u_ac_encoded, u_blocks_num, freq[JPEG_HUFFMAN_UV_AC]);
+    huffman_count_ac_symbols(v_ac_encoded, v_blocks_num, freq[JPEG_HUFFMAN_UV_AC]);
+
+    Huffman_Table* standard_tables[JPEG_HUFFMAN_TABLES_NUM] = {
+        huffman_tables->y_dc, huffman_tables->y_ac, huffman_tables->uv_dc, huffman_tables->uv_ac
+    };
+    uint64_t standard_bits = 0;
+    uint64_t optimized_bits = 0;
+
+    for (int i = 0; i < JPEG_HUFFMAN_TABLES_NUM; i++) {
+        huffman_generate_optimal_spec(freq[i], &huffman_tables->specs[i]);
+        huffman_create_lookup_table(huffman_tables->specs[i].bits, huffman_tables->specs[i].hufval, &huffman_tables->tables[i]);
+
+        uint64_t bits = huffman_estimate_bits(freq[i], standard_tables[i]);
+        standard_bits = (bits == UINT64_MAX || standard_bits == UINT64_MAX) ? UINT64_MAX : standard_bits + bits;
+
+        /* header裡每個table需要16 bytes的bits和hufval */
+        optimized_bits += huffman_estimate_bits(freq[i], &huffman_tables->tables[i]);
+        optimized_bits += (uint64_t)(HUFFMAN_MAX_CODE_LENGTH + huffman_spec_symbols_num(&huffman_tables->specs[i])) * 8;
+    }
+
+    if (optimized_bits < standard_bits) {
+        jpeg_use_spec_huffman_tables(huffman_tables);
+    }
+}
+
+/* header裡restart interval後面的layout (1 byte) */
+#define JPEG_LAYOUT_INTERLEAVED      0   // MCU交錯的一個scan
+#define JPEG_LAYOUT_SEGMENT_INDEX    1   // MCU交錯的一個scan，後面接著segments個數(4 bytes)和每個segment的offset(各4 bytes)
+#define JPEG_LAYOUT_COMPONENT_SCANS  2   // Y/U/V各自一個scan，後面接著每個scan的offset(各4 bytes)
+
+/* entropy coded data的排列方式 (寫在header) */
+typedef struct {
+    int restart_interval;        // 每幾個MCU有一個restart marker，0表示沒有 (component scans時是每幾個blocks)
+    int component_scans;         // 0: MCU交錯的一個scan 1: Y/U/V各自一個scan
+    uint32_t* segment_offsets;   // 每個restart segment在entropy coded data裡的offset，NULL表示沒有segment index
+    int segments_num;
+    uint32_t scan_offsets[JPEG_COMPONENTS_NUM];  // component scans時每個scan在entropy coded data裡的offset
+}JpegScanLayout;
+
+/* 4 bytes的big-endian整數 */
+void jpeg_write_u32(FILE* fp, uint32_t value)
+{
+    fputc((value >> 24) & 0xff, fp);
+    fputc((value >> 16) & 0xff, fp);
+    fputc((value >> 8) & 0xff, fp);
+    fputc(value & 0xff, fp);
+}
+
+uint32_t jpeg_read_u32(FILE* fp)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value = (value << 8) | (uint8_t)fgetc(fp);
     }
+    return value;
 }
 
 /*  function: jpeg_encode_header()
@@ -417,8 +681,12 @@ void jpeg_decode_ac(JpegBlockCoeffs* blocks, int num_blocks, JpegAcEncoded* ac_e
         將解碼需要的資訊寫到header裡
 
     Result:
+        使用最佳化的Huffman tables時，bits/hufval也會寫到header
+        layout有segment_offsets時寫入segment index: 每個restart segment在entropy coded data裡的byte offset
+        component scans時寫入每個scan的byte offset
  */
-void jpeg_encode_header(FILE* fp, YUVFrame* frame, QuantType quant_type, CompressionType compression_type, EntropyType entropy_type)
+void jpeg_encode_header(FILE* fp, YUVFrame* frame, QuantParams* quant_params, CompressionType compression_type, EntropyType entropy_type,
+                        JpegHuffmanTables* huffman_tables, const JpegScanLayout* layout)
 {
     /* YUV inforamtion */
     // yuv raw data width (2 bytes)
@@ -444,11 +712,44 @@ void jpeg_encode_header(FILE* fp, YUVFrame* frame, QuantType quant_type, Compres
     fputc(frame->v.block_info.width & 0xff, fp);
     fputc(frame->v.block_info.height & 0xff, fp);
     // quantization type
-    fputc(quant_type & 0xff, fp);
+    fputc(quant_params->quant_type & 0xff, fp);
+    // quantization parameter (1 byte, H264_QUANT使用)
+    fputc(quant_params->qp & 0xff, fp);
+    // JPEG_QUANT_STANDARD : quality縮放後的Y/UV量化表 (各64 bytes)
+    if (quant_params->quant_type == JPEG_QUANT_STANDARD) {
+        fwrite(quant_params->luminance_table, 1, 64, fp);
+        fwrite(quant_params->chrominance_table, 1, 64, fp);
+    }
     // compression type
     fputc(compression_type & 0xff, fp);
     // entropy type
     fputc(entropy_type & 0xff, fp);
+    // Huffman tables (1 byte, 0: 標準tables 1: 後面接著Y DC/Y AC/UV DC/UV AC的bits(16 bytes)和hufval)
+    fputc(huffman_tables->optimized & 0xff, fp);
+    if (huffman_tables->optimized) {
+        for (int i = 0; i < JPEG_HUFFMAN_TABLES_NUM; i++) {
+            fwrite(huffman_tables->specs[i].bits, 1, HUFFMAN_MAX_CODE_LENGTH, fp);
+            fwrite(huffman_tables->specs[i].hufval, 1, huffman_spec_symbols_num(&huffman_tables->specs[i]), fp);
+        }
+    }
+    // restart interval (2 bytes, 每幾個MCU有一個restart marker，0表示沒有)
+    fputc((layout->restart_interval >> 8) & 0xff, fp);
+    fputc(layout->restart_interval & 0xff, fp);
+    // layout (1 byte) 和segment index或scan offsets
+    if (layout->component_scans) {
+        fputc(JPEG_LAYOUT_COMPONENT_SCANS, fp);
+        for (int i = 0; i < JPEG_COMPONENTS_NUM; i++) {
+            jpeg_write_u32(fp, layout->scan_offsets[i]);
+        }
+    } else if (layout->segment_offsets != NULL) {
+        fputc(JPEG_LAYOUT_SEGMENT_INDEX, fp);
+        jpeg_write_u32(fp, (uint32_t)layout->segments_num);
+        for (int i = 0; i < layout->segments_num; i++) {
+            jpeg_write_u32(fp, layout->segment_offsets[i]);
+        }
+    } else {
+        fputc(JPEG_LAYOUT_INTERLEAVED, fp);
+    }
 }
 
 
@@ -457,8 +758,14 @@ void jpeg_encode_header(FILE* fp, YUVFrame* frame, QuantType quant_type, Compres
         解碼出需要的設定資訊
 
     Result:
+        quant_params->qp會更新成header裡的QP
+        JPEG_QUANT_STANDARD會取得header裡的量化表
+        huffman_tables會是標準tables或header裡的tables
+        layout是header裡的restart interval和entropy coded data的排列方式
+        有segment index時layout->segment_offsets是每個segment的offset (由呼叫者free)，沒有時是NULL
  */
-int jpeg_decode_header(FILE* fp, YUVFrame* frame, QuantType quant_type, CompressionType compression_type, EntropyType entropy_type)
+int jpeg_decode_header(FILE* fp, YUVFrame* frame, QuantParams* quant_params, CompressionType compression_type, EntropyType entropy_type,
+                       JpegHuffmanTables* huffman_tables, JpegScanLayout* layout)
 {
     /* YUV inforamtion */
     int frame_w, frame_h;
@@ -483,6 +790,7 @@ int jpeg_decode_header(FILE* fp, YUVFrame* frame, QuantType quant_type, Compress
     BlockInfo u_block_info;
     BlockInfo v_block_info;
     QuantType q_type;
+    int qp;
     CompressionType cmpr_type;
     EntropyType en_type;
     // Y : block size / block width / block height (各都1 byte)
@@ -499,10 +807,61 @@ int jpeg_decode_header(FILE* fp, YUVFrame* frame, QuantType quant_type, Compress
     v_block_info.height = fgetc(fp);
     // quantization type
     q_type = (uint8_t)fgetc(fp);
+    // quantization parameter
+    qp = (uint8_t)fgetc(fp);
+    /* H264反量化的shift是QP/6，超出範圍的QP表示bitstream損毀 */
+    if (qp > H264_QP_MAX) {
+        fprintf(stderr, "[Error] QP in header is out of range: %d\n", qp);
+        return -1;
+    }
+    // JPEG_QUANT_STANDARD : Y/UV量化表
+    if (q_type == JPEG_QUANT_STANDARD) {
+        if (fread(quant_params->luminance_table, 1, 64, fp) != 64 ||
+            fread(quant_params->chrominance_table, 1, 64, fp) != 64) {
+            perror("Failed to read quantization tables from header.\n");
+            return -1;
+        }
+        /* step為0時無法反量化 (reciprocal會除以0)，bitstream損毀 */
+        for (int i = 0; i < 64; i++) {
+            if (quant_params->luminance_table[i] == 0 || quant_params->chrominance_table[i] == 0) {
+                fprintf(stderr, "[Error] Quantization table in header has a zero step!\n");
+                return -1;
+            }
+        }
+    }
     // compression type
     cmpr_type = (uint8_t)fgetc(fp);
     // entropy type
     en_type = (uint8_t)fgetc(fp);
+    // Huffman tables
+    int huffman_optimized = fgetc(fp);
+    if (huffman_optimized == 1) {
+        for (int i = 0; i < JPEG_HUFFMAN_TABLES_NUM; i++) {
+            Huffman_Spec* spec = &huffman_tables->specs[i];
+            int max_symbol = (i == JPEG_HUFFMAN_Y_DC || i == JPEG_HUFFMAN_UV_DC) ? 15 : 255;
+
+            if (fread(spec->bits, 1, HUFFMAN_MAX_CODE_LENGTH, fp) != HUFFMAN_MAX_CODE_LENGTH) {
+                perror("Failed to read Huffman tables from header.\n");
+                return -1;
+            }
+            int symbols_num = huffman_spec_symbols_num(spec);
+            if (symbols_num > 256 || (int)fread(spec->hufval, 1, symbols_num, fp) != symbols_num || !huffman_spec_is_valid(spec, max_symbol)) {
+                perror("Huffman tables in header are invalid.\n");
+                return -1;
+            }
+            huffman_create_lookup_table(spec->bits, spec->hufval, &huffman_tables->tables[i]);
+        }
+        jpeg_use_spec_huffman_tables(huffman_tables);
+    } else if (huffman_optimized == 0) {
+        jpeg_use_standard_huffman_tables(huffman_tables);
+    } else {
+        perror("Huffman tables in header are invalid.\n");
+        return -1;
+    }
+    // restart interval
+    memset(layout, 0, sizeof(JpegScanLayout));
+    layout->restart_interval = ((uint8_t)fgetc(fp)) << 8;
+    layout->restart_interval |= (uint8_t)fgetc(fp);
 
     if (y_block_info.b_size != frame->y.block_info.b_size || y_block_info.width != frame->y.block_info.width || y_block_info.height != frame->y.block_info.height) {
         perror("Y block information is not set correctly.\n");
@@ -526,12 +885,15 @@ int jpeg_decode_header(FILE* fp, YUVFrame* frame, QuantType quant_type, Compress
         return -1;
     }
 
-    if (q_type != quant_type) {
+    if (q_type != quant_params->quant_type) {
         perror("Quantization type is not set correctly.\n");
         fprintf(stderr, "Decoded quantization type=%d\n", q_type);
         return -1;
     }
 
+    /* QP由encoder決定，decoder使用header裡的QP做反量化 */
+    quant_params->qp = qp;
+
     if (cmpr_type != compression_type) {
         perror("Compression type is not set correctly.\n");
         fprintf(stderr, "Decoded compression type=%d\n", cmpr_type);
@@ -544,216 +906,791 @@ int jpeg_decode_header(FILE* fp, YUVFrame* frame, QuantType quant_type, Compress
         return -1;
     }
 
+    /* layout (restart interval後面) */
+    int layout_type = fgetc(fp);
+    if (layout_type == JPEG_LAYOUT_SEGMENT_INDEX) {
+        uint32_t index_num = jpeg_read_u32(fp);
+        /* 每個segment至少有1個MCU */
+        if (layout->restart_interval == 0 || index_num == 0 || index_num > (uint32_t)(frame->y.padded_width / frame->y.block_info.width) * (frame->y.padded_height / frame->y.block_info.height)) {
+            perror("Segment index is invalid.\n");
+            return -1;
+        }
+        layout->segment_offsets = (uint32_t*)malloc(sizeof(uint32_t) * index_num);
+        if (layout->segment_offsets == NULL) {
+            perror("Failed to allocate memory for segment index.");
+            return -1;
+        }
+        for (uint32_t i = 0; i < index_num; i++) {
+            layout->segment_offsets[i] = jpeg_read_u32(fp);
+        }
+        layout->segments_num = (int)index_num;
+    } else if (layout_type == JPEG_LAYOUT_COMPONENT_SCANS) {
+        layout->component_scans = 1;
+        for (int i = 0; i < JPEG_COMPONENTS_NUM; i++) {
+            layout->scan_offsets[i] = jpeg_read_u32(fp);
+        }
+    } else if (layout_type != JPEG_LAYOUT_INTERLEAVED) {
+        perror("Entropy coded data layout is invalid.\n");
+        return -1;
+    }
+
     // 表示decode出來的資訊和設定的都相同
     return 0;
 }
 
-void entropy_decode_jpeg(YUVFrame* frame, QuantType quant_type, CompressionType compression_type, EntropyType entropy_type, const char* out_bitstream_path)
+/*  function: entropy_decode_jpeg()
+    Params:
+        YUVFrame* frame                  : 存放解碼結果的frame (係數放在padded data)
+        QuantParams* quant_params        : 量化的方式 (QP和量化表從header取得)
+        CompressionType compression_type : 壓縮的方式
+        EntropyType entropy_type         : entropy coding的方式
+        FILE* bitstream_fp               : 讀取bitstream的檔案 (由呼叫者開啟/關閉)
+        EntropyWorkspace* workspace      : 這張frame使用的workspace (存放係數)
+
+    Return:
+        0 : 解碼成功
+        -1: 記憶體配置失敗、header和設定不同、或是bitstream損毀 (padded data不會被更新)
+
+    Result:
+        1. 使用entropy_decode_jpeg_coeffs()解碼出每個block的係數 (zigzag順序)
+        2. reverse zigzag scan後放到padded data
+ */
+int entropy_decode_jpeg(YUVFrame* frame, QuantParams* quant_params, CompressionType compression_type, EntropyType entropy_type, FILE* bitstream_fp,
+                        EntropyWorkspace* workspace)
 {
-    int ret;
-    FILE* fp;
-    fp = fopen(out_bitstream_path, "rb");
-    if (!fp) {
-        fprintf(stderr, "Failed to open file: %s\n", out_bitstream_path);
-        return;
+    if (jpeg_workspace_reserve(workspace, frame, 0) != 0) {
+        return -1;
     }
 
-    ret = jpeg_decode_header(fp, frame, quant_type, compression_type, entropy_type);
-
-    /* Header解碼失敗 */
-    if (ret != 0) {
-        fclose(fp);
-        return;
+    if (entropy_decode_jpeg_coeffs(frame, workspace, quant_params, compression_type, entropy_type, bitstream_fp, NULL, NULL) != 0) {
+        return -1;
     }
+    inverse_zigzag_component(&frame->y, workspace->blocks[JPEG_COMPONENT_Y]);
+    inverse_zigzag_component(&frame->u, workspace->blocks[JPEG_COMPONENT_U]);
+    inverse_zigzag_component(&frame->v, workspace->blocks[JPEG_COMPONENT_V]);
+    return 0;
+}
 
-    /* 統計每張frame有多少個block，再配置每個block裡的DC和AC需要儲存的資訊所需要的記憶體空間 */
-    int y_blocks_num = (frame->y.padded_height / frame->y.block_info.height) * (frame->y.padded_width / frame->y.block_info.width);
-    int u_blocks_num = (frame->u.padded_height / frame->u.block_info.height) * (frame->u.padded_width / frame->u.block_info.width);
-    int v_blocks_num = (frame->v.padded_height / frame->v.block_info.height) * (frame->v.padded_width / frame->v.block_info.width);
-    JpegBlockCoeffs* jpeg_y_blocks = (JpegBlockCoeffs*)malloc(sizeof(JpegBlockCoeffs) * y_blocks_num);
-    JpegBlockCoeffs* jpeg_u_blocks = (JpegBlockCoeffs*)malloc(sizeof(JpegBlockCoeffs) * u_blocks_num);
-    JpegBlockCoeffs* jpeg_v_blocks = (JpegBlockCoeffs*)malloc(sizeof(JpegBlockCoeffs) * v_blocks_num);
-    JpegDcEncoded* jpeg_y_dc_encoded, *jpeg_u_dc_encoded, *jpeg_v_dc_encoded;
-    JpegAcEncoded* jpeg_y_ac_encoded, *jpeg_u_ac_encoded, *jpeg_v_ac_encoded;
-
-    if (jpeg_y_blocks == NULL || jpeg_u_blocks == NULL || jpeg_v_blocks == NULL) {
-        /* 有任何一個component配置記憶體失敗，則不會繼續做壓縮 */
-        perror("Failed to allocate memory for JPEG blocks of component(s) in a frame.");
-        if (jpeg_y_blocks != NULL) free(jpeg_y_blocks);
-        if (jpeg_u_blocks != NULL) free(jpeg_u_blocks);
-        if (jpeg_v_blocks != NULL) free(jpeg_v_blocks);
-        return;
+/* entropy decode時需要的資訊 (serial、平行解碼segments和component scans共用) */
+typedef struct {
+    JpegBlockCoeffs* blocks[JPEG_COMPONENTS_NUM];
+    int blocks_num[JPEG_COMPONENTS_NUM];
+    JpegHuffmanTables* huffman_tables;
+    int minimum_coded_unit;            // MCU個數
+    int mcu_y_nums;                    // 一個MCU裡的Y blocks個數
+    const JpegScanLayout* layout;      // restart interval、segment index和scan offsets
+    const uint8_t* data;               // header後面的entropy coded data
+    size_t data_size;
+    int* status;                       // 每個segment (或scan) 的解碼結果 (0: 成功 -1: 失敗)
+    JpegBlocksDecoded blocks_decoded;  // 一段blocks解碼完成後呼叫，可以是NULL
+    void* blocks_decoded_arg;
+}JpegDecodeJob;
+
+/*  function: jpeg_huffman_decode_block()
+    Params:
+        BitReader* bit_reader   : 紀錄bitstream讀取的情況
+        JpegBlockCoeffs* block  : 存放解碼後的係數 (DC是DPCM的差值)
+        Huffman_Table* dc_table : DC使用的Huffman table
+        Huffman_Table* ac_table : AC使用的Huffman table
+
+    Return:
+        0 : 成功
+        -1: bitstream損毀
+
+    Result:
+        AC symbols只暫存在stack，解碼完馬上做reverse RLE寫到block，不需要整張frame的JpegDcEncoded/JpegAcEncoded
+ */
+static int jpeg_huffman_decode_block(BitReader* bit_reader, JpegBlockCoeffs* block, Huffman_Table* dc_table, Huffman_Table* ac_table)
+{
+    JpegDcEncoded dc_encoded;
+    JpegAcSymbol symbols[JPEG_AC_SYMBOLS_MAX];
+    JpegAcEncoded ac_encoded = {symbols, 0};
+
+    if (huffman_decode_dc(bit_reader, &dc_encoded, dc_table) != 0 ||
+        huffman_decode_ac(bit_reader, &ac_encoded, ac_table) != 0) {
+        return -1;
     }
 
-    jpeg_y_dc_encoded = (JpegDcEncoded*)malloc(sizeof(JpegDcEncoded) * y_blocks_num);
-    jpeg_y_ac_encoded = (JpegAcEncoded*)malloc(sizeof(JpegAcEncoded) * y_blocks_num);
-    if (jpeg_y_dc_encoded == NULL || jpeg_y_ac_encoded == NULL) {
-        /* 儲存Y的DC/AC配置記憶體失敗，則不會繼續做壓縮 */
-        perror("Failed to allocate memory for DC/AC of Y component in a block.");
-        free(jpeg_y_blocks);
-        free(jpeg_u_blocks);
-        free(jpeg_v_blocks);
-        if (jpeg_y_dc_encoded != NULL) free(jpeg_y_dc_encoded);
-        if (jpeg_y_ac_encoded != NULL) free(jpeg_y_ac_encoded);
-        return;
+    block->dc = decode_amplitude(dc_encoded.size, dc_encoded.amplitude);
+    reverse_run_length_encoding(block, &ac_encoded);
+    return 0;
+}
+
+/*  function: jpeg_huffman_decode_mcus()
+    Params:
+        BitReader* bit_reader : 從mcu_start的第一個bit開始讀取
+        JpegDecodeJob* job    : 存放解碼結果的arrays和Huffman tables
+        int mcu_start         : 第一個MCU
+        int mcu_end           : 最後一個MCU + 1
+        int restart_interval  : 每幾個MCU跳過一個restart marker (0表示這段MCUs裡沒有marker)
+
+    Return:
+        0 : 成功
+        -1: bitstream損毀 (任何一個block解碼失敗就停止，不需要繼續解後面的blocks)
+
+    Result:
+        Huffman decode得到MCU交錯的每個block的DPCM DC差值和AC係數
+ */
+int jpeg_huffman_decode_mcus(BitReader* bit_reader, JpegDecodeJob* job, int mcu_start, int mcu_end, int restart_interval)
+{
+    Huffman_Table* y_dc_table = job->huffman_tables->y_dc, * y_ac_table = job->huffman_tables->y_ac;
+    Huffman_Table* uv_dc_table = job->huffman_tables->uv_dc, * uv_ac_table = job->huffman_tables->uv_ac;
+    JpegBlockCoeffs* y_blocks = job->blocks[JPEG_COMPONENT_Y], * u_blocks = job->blocks[JPEG_COMPONENT_U], * v_blocks = job->blocks[JPEG_COMPONENT_V];
+    int mcu_y_nums = job->mcu_y_nums;
+
+    for (int i = mcu_start; i < mcu_end; i++) {
+        /* 每個restart segment的開頭: 跳過上一個segment後面的restart marker */
+        if (restart_interval > 0 && i > mcu_start && i % restart_interval == 0) {
+            if (bit_reader_restart(bit_reader, i / restart_interval - 1) != 0) {
+                fprintf(stderr, "[Error] Missing restart marker before MCU %d!\n", i);
+                return -1;
+            }
+        }
+
+        int y_block_idx = i * mcu_y_nums;
+        for (int j = 0; j < mcu_y_nums; j++) {
+            // huffman decode dc/ac of y_block[y_block_idx+j]
+            if (jpeg_huffman_decode_block(bit_reader, &y_blocks[y_block_idx+j], y_dc_table, y_ac_table) != 0) {
+                return -1;
+            }
+        }
+
+        // huffman decode dc/ac of u_block[i] and v_block[i]
+        if (jpeg_huffman_decode_block(bit_reader, &u_blocks[i], uv_dc_table, uv_ac_table) != 0 ||
+            jpeg_huffman_decode_block(bit_reader, &v_blocks[i], uv_dc_table, uv_ac_table) != 0) {
+            return -1;
+        }
     }
 
-    jpeg_u_dc_encoded = (JpegDcEncoded*)malloc(sizeof(JpegDcEncoded) * u_blocks_num);
-    jpeg_u_ac_encoded = (JpegAcEncoded*)malloc(sizeof(JpegAcEncoded) * u_blocks_num);
-    if (jpeg_u_dc_encoded == NULL || jpeg_u_ac_encoded == NULL) {
-        /* 儲存U的DC/AC配置記憶體失敗，則不會繼續做壓縮 */
-        perror("Failed to allocate memory for DC/AC of U component in a block.");
-        free(jpeg_y_blocks);
-        free(jpeg_u_blocks);
-        free(jpeg_v_blocks);
-        free(jpeg_y_dc_encoded);
-        free(jpeg_y_ac_encoded);
-        if (jpeg_u_dc_encoded != NULL) free(jpeg_u_dc_encoded);
-        if (jpeg_u_ac_encoded != NULL) free(jpeg_u_ac_encoded);
-        return;
+    return 0;
+}
+
+/*  function: jpeg_decode_component_blocks()
+    Params:
+        JpegDecodeJob* job : 存放解碼結果的arrays
+        int component      : JPEG_COMPONENT_Y/U/V
+        int block_start    : 第一個block (必須是restart segment的開頭)
+        int block_end      : 最後一個block + 1
+        int restart_blocks : 每幾個blocks重設DC預測 (0表示不重設)
+
+    Return:
+        None
+
+    Result:
+        1. reverse DPCM得到component一段blocks的DC係數 (AC在Huffman decode時已經做完reverse RLE)
+        2. 呼叫blocks_decoded，讓pipeline接著做反量化和IDCT
+ */
+void jpeg_decode_component_blocks(JpegDecodeJob* job, int component, int block_start, int block_end, int restart_blocks)
+{
+    // DPCM decoding (restart segment的開頭重設DC預測)
+    differential_pulse_code_demodulation(job->blocks[component] + block_start, block_end - block_start, restart_blocks);
+
+    if (job->blocks_decoded != NULL) {
+        job->blocks_decoded(job->blocks_decoded_arg, component, block_start, block_end);
     }
+}
 
-    jpeg_v_dc_encoded = (JpegDcEncoded*)malloc(sizeof(JpegDcEncoded) * v_blocks_num);
-    jpeg_v_ac_encoded = (JpegAcEncoded*)malloc(sizeof(JpegAcEncoded) * v_blocks_num);
-    if (jpeg_v_dc_encoded == NULL || jpeg_v_ac_encoded == NULL) {
-        /* 儲存V的DC/AC配置記憶體失敗，則不會繼續做壓縮 */
-        perror("Failed to allocate memory for DC/AC of V component in a block.");
-        free(jpeg_y_blocks);
-        free(jpeg_u_blocks);
-        free(jpeg_v_blocks);
-        free(jpeg_y_dc_encoded);
-        free(jpeg_y_ac_encoded);
-        free(jpeg_u_dc_encoded);
-        free(jpeg_u_ac_encoded);
-        if (jpeg_v_dc_encoded != NULL) free(jpeg_v_dc_encoded);
-        if (jpeg_v_ac_encoded != NULL) free(jpeg_v_ac_encoded);
-        return;
+/*  function: jpeg_decode_mcu_blocks()
+    Params:
+        JpegDecodeJob* job : 存放解碼結果的arrays
+        int mcu_start      : 第一個MCU (必須是restart segment的開頭)
+        int mcu_end        : 最後一個MCU + 1
+
+    Return:
+        None
+
+    Result:
+        對MCUs包含的Y/U/V blocks做reverse DPCM (restart segment的開頭重設DC預測)
+ */
+void jpeg_decode_mcu_blocks(JpegDecodeJob* job, int mcu_start, int mcu_end)
+{
+    int restart_interval = job->layout->restart_interval;
+
+    jpeg_decode_component_blocks(job, JPEG_COMPONENT_Y, mcu_start * job->mcu_y_nums, mcu_end * job->mcu_y_nums, restart_interval * job->mcu_y_nums);
+    jpeg_decode_component_blocks(job, JPEG_COMPONENT_U, mcu_start, mcu_end, restart_interval);
+    jpeg_decode_component_blocks(job, JPEG_COMPONENT_V, mcu_start, mcu_end, restart_interval);
+}
+
+/*  function: jpeg_decode_segment_job()
+    Params:
+        void* arg     : JpegDecodeJob*
+        int job_index : 第幾個restart segment
+
+    Result:
+        thread pool的工作，從segment index的offset開始解碼一個segment，
+        結果寫在segment自己的blocks範圍，不會和其他segments重疊
+ */
+void jpeg_decode_segment_job(void* arg, int job_index)
+{
+    JpegDecodeJob* job = (JpegDecodeJob*)arg;
+    int restart_interval = job->layout->restart_interval;
+    int mcu_start = job_index * restart_interval;
+    int mcu_end = (mcu_start + restart_interval < job->minimum_coded_unit) ? mcu_start + restart_interval : job->minimum_coded_unit;
+    size_t start = job->layout->segment_offsets[job_index];
+    size_t end = (job_index + 1 < job->layout->segments_num) ? job->layout->segment_offsets[job_index + 1] : job->data_size;
+
+    /* segment的資料到下一個segment的restart marker為止 (BitReader遇到marker會停下來) */
+    BitReader bit_reader;
+    create_bit_reader(&bit_reader, job->data + start, end - start);
+
+    job->status[job_index] = jpeg_huffman_decode_mcus(&bit_reader, job, mcu_start, mcu_end, 0);
+    if (job->status[job_index] == 0) {
+        jpeg_decode_mcu_blocks(job, mcu_start, mcu_end);
     }
+}
 
+/*  function: jpeg_decode_scan_job()
+    Params:
+        void* arg     : JpegDecodeJob*
+        int component : 第幾個component的scan (JPEG_COMPONENT_Y/U/V)
 
-    /* 取得計算好的Huffman tables */
-    extern Huffman_Table* jpeg_y_dc_huffman_table, * jpeg_y_ac_huffman_table;
-    extern Huffman_Table* jpeg_uv_dc_huffman_table, * jpeg_uv_ac_huffman_table;
+    Result:
+        thread pool的工作，從scan offset開始解碼一個component的所有blocks
+        component scan裡每restart_interval個blocks有一個restart marker
+ */
+void jpeg_decode_scan_job(void* arg, int component)
+{
+    JpegDecodeJob* job = (JpegDecodeJob*)arg;
+    int restart_interval = job->layout->restart_interval;
+    Huffman_Table* dc_table = (component == JPEG_COMPONENT_Y) ? job->huffman_tables->y_dc : job->huffman_tables->uv_dc;
+    Huffman_Table* ac_table = (component == JPEG_COMPONENT_Y) ? job->huffman_tables->y_ac : job->huffman_tables->uv_ac;
+    size_t start = job->layout->scan_offsets[component];
+    size_t end = (component + 1 < JPEG_COMPONENTS_NUM) ? job->layout->scan_offsets[component + 1] : job->data_size;
+    /* 和MCU交錯時相同，只有MCUs包含的blocks */
+    int scan_blocks_num = (component == JPEG_COMPONENT_Y) ? job->minimum_coded_unit * job->mcu_y_nums : job->minimum_coded_unit;
 
     BitReader bit_reader;
-    int minimum_coded_unit;
-    int mcu_y_nums;
-    int y_block_idx = 0, u_block_idx = 0, v_block_idx = 0;  // 紀錄要讀出的y/u/v block在當下frame的第幾個block
+    create_bit_reader(&bit_reader, job->data + start, end - start);
+
+    job->status[component] = 0;
+    for (int i = 0; i < scan_blocks_num; i++) {
+        if (restart_interval > 0 && i > 0 && i % restart_interval == 0) {
+            if (bit_reader_restart(&bit_reader, i / restart_interval - 1) != 0) {
+                fprintf(stderr, "[Error] Missing restart marker before block %d of component %d!\n", i, component);
+                job->status[component] = -1;
+                return;
+            }
+        }
+
+        if (jpeg_huffman_decode_block(&bit_reader, &job->blocks[component][i], dc_table, ac_table) != 0) {
+            job->status[component] = -1;
+            return;
+        }
+    }
+
+    jpeg_decode_component_blocks(job, component, 0, scan_blocks_num, restart_interval);
+}
+
+/*  function: entropy_decode_jpeg_coeffs()
+    Params:
+        YUVFrame* frame                  : frame的大小、format和block資訊
+        EntropyWorkspace* workspace      : 已經用jpeg_workspace_reserve()準備好，每個block解碼後的係數 (zigzag順序) 放在workspace->blocks
+        QuantParams* quant_params        : 量化的方式 (QP和量化表從header取得)
+        CompressionType compression_type : 壓縮的方式
+        EntropyType entropy_type         : entropy coding的方式
+        FILE* bitstream_fp               : 讀取bitstream的檔案 (由呼叫者開啟/關閉)
+        JpegBlocksDecoded blocks_decoded : 一段blocks解碼完成後呼叫 (NULL表示不需要)
+        void* blocks_decoded_arg         : 傳給blocks_decoded的參數
+
+    Return:
+        0 : 解碼成功
+        -1: 沒有檔案、header和設定不同、記憶體配置失敗、或是bitstream損毀
 
-    create_bit_reader(&bit_reader, fp);
+    Result:
+        Huffman decode、reverse DPCM/RLE後的DC/AC係數
+        multi-pass和fused pipeline共用
+        1. header取得量化表後先呼叫quantize_prepare()，blocks_decoded可以直接反量化
+        2. component scans時，Y/U/V三個scans交給thread pool平行解碼
+        3. 有segment index時，每個restart segment交給thread pool平行解碼
+        4. 都沒有時依序解碼整張frame
+        segment (或scan) 解碼完就在同一個thread呼叫blocks_decoded (blocks範圍不會重疊)
+ */
+int entropy_decode_jpeg_coeffs(YUVFrame* frame, EntropyWorkspace* workspace, QuantParams* quant_params, CompressionType compression_type, EntropyType entropy_type, FILE* bitstream_fp,
+                               JpegBlocksDecoded blocks_decoded, void* blocks_decoded_arg)
+{
+    extern ThreadPool* jpeg_entropy_thread_pool;
+
+    int ret;
+    JpegHuffmanTables huffman_tables;
+    JpegScanLayout layout;
+    if (!bitstream_fp) {
+        return -1;
+    }
+
+    ret = jpeg_decode_header(bitstream_fp, frame, quant_params, compression_type, entropy_type, &huffman_tables, &layout);
+
+    /* Header解碼失敗 */
+    if (ret != 0) {
+        return -1;
+    }
+
+    /* header後面的entropy coded data一次讀到workspace的buffer，之後不需要再讀檔 */
+    size_t data_size;
+    if (read_remaining_file(bitstream_fp, &workspace->data, &workspace->data_capacity, &data_size) != 0) {
+        perror("Failed to read bitstream.\n");
+        free(layout.segment_offsets);
+        return -1;
+    }
+
+    /* 量化表從header取得後，每張frame準備一次 */
+    quantize_prepare(quant_params);
+
+    JpegDecodeJob job;
+    memset(&job, 0, sizeof(job));
+    job.blocks[JPEG_COMPONENT_Y] = workspace->blocks[JPEG_COMPONENT_Y];
+    job.blocks[JPEG_COMPONENT_U] = workspace->blocks[JPEG_COMPONENT_U];
+    job.blocks[JPEG_COMPONENT_V] = workspace->blocks[JPEG_COMPONENT_V];
+    job.blocks_num[JPEG_COMPONENT_Y] = jpeg_blocks_num(&frame->y);
+    job.blocks_num[JPEG_COMPONENT_U] = jpeg_blocks_num(&frame->u);
+    job.blocks_num[JPEG_COMPONENT_V] = jpeg_blocks_num(&frame->v);
+    job.huffman_tables = &huffman_tables;
+    job.layout = &layout;
+    job.data = workspace->data;
+    job.data_size = data_size;
+    job.blocks_decoded = blocks_decoded;
+    job.blocks_decoded_arg = blocks_decoded_arg;
 
     /* 根據YUV format，計算出每個compoent寫入的情況 */
+    int y_blocks_num = job.blocks_num[JPEG_COMPONENT_Y];
     if (frame->format == YUV444) {
-        minimum_coded_unit = y_blocks_num;
-        mcu_y_nums = 1;
+        job.minimum_coded_unit = y_blocks_num;
+        job.mcu_y_nums = 1;
     } else if (frame->format == YUV422) {
-        minimum_coded_unit = y_blocks_num / 2;
-        mcu_y_nums = 2;
+        job.minimum_coded_unit = y_blocks_num / 2;
+        job.mcu_y_nums = 2;
     } else if (frame->format == YUV420) {
-        minimum_coded_unit = y_blocks_num / 4;
-        mcu_y_nums = 4;
+        job.minimum_coded_unit = y_blocks_num / 4;
+        job.mcu_y_nums = 4;
     }
 
-    for (int i = 0; i < minimum_coded_unit; i++) {
-        for (int j = 0; j < mcu_y_nums; j++) {
-            // huffman decode dc of y_block[y_block_idx+j]
-            huffman_decode_dc(&bit_reader, &jpeg_y_dc_encoded[y_block_idx+j], jpeg_y_dc_huffman_table);
+    if (ret == 0 && layout.component_scans) {
+        /* scan offsets要遞增且在data裡面 */
+        if (layout.scan_offsets[0] != 0 || layout.scan_offsets[1] < layout.scan_offsets[0] ||
+            layout.scan_offsets[2] < layout.scan_offsets[1] || layout.scan_offsets[2] > data_size) {
+            fprintf(stderr, "[Error] Invalid component scan offsets!\n");
+            ret = -1;
+        } else {
+            int status[JPEG_COMPONENTS_NUM];
+            job.status = status;
+            thread_pool_run(jpeg_entropy_thread_pool, jpeg_decode_scan_job, &job, JPEG_COMPONENTS_NUM);
+            for (int i = 0; i < JPEG_COMPONENTS_NUM; i++) {
+                if (status[i] != 0) ret = -1;
+            }
+        }
+    } else if (ret == 0 && layout.segment_offsets != NULL) {
+        /* segment index: 個數要和restart segments相同，offsets要遞增且在data裡面 */
+        int restart_interval = layout.restart_interval;
+        int expected_segments = (job.minimum_coded_unit + restart_interval - 1) / restart_interval;
+        if (layout.segments_num != expected_segments || layout.segment_offsets[0] != 0) {
+            ret = -1;
+        }
+        for (int i = 1; i < layout.segments_num && ret == 0; i++) {
+            if (layout.segment_offsets[i] <= layout.segment_offsets[i-1] || layout.segment_offsets[i] > data_size) {
+                ret = -1;
+            }
+        }
 
-            // huffman decode ac of y_block[y_block_idx+j]
-            huffman_decode_ac(&bit_reader, &jpeg_y_ac_encoded[y_block_idx+j], jpeg_y_ac_huffman_table);
+        job.status = (int*)malloc(sizeof(int) * layout.segments_num);
+        if (ret != 0 || job.status == NULL) {
+            fprintf(stderr, "[Error] Invalid segment index!\n");
+            ret = -1;
+        } else {
+            thread_pool_run(jpeg_entropy_thread_pool, jpeg_decode_segment_job, &job, layout.segments_num);
+            for (int i = 0; i < layout.segments_num; i++) {
+                if (job.status[i] != 0) ret = -1;
+            }
         }
+        free(job.status);
+    } else if (ret == 0) {
+        /* 沒有segment index: 從頭依序解碼，遇到restart marker時跳過 */
+        BitReader bit_reader;
+        create_bit_reader(&bit_reader, workspace->data, data_size);
+
+        ret = jpeg_huffman_decode_mcus(&bit_reader, &job, 0, job.minimum_coded_unit, layout.restart_interval);
+        if (ret == 0) {
+            jpeg_decode_mcu_blocks(&job, 0, job.minimum_coded_unit);
+        }
+    }
 
-        // huffman decode dc of u_block[u_block_idx]
-        huffman_decode_dc(&bit_reader, &jpeg_u_dc_encoded[u_block_idx], jpeg_uv_dc_huffman_table);
+    /* bitstream損毀 */
+    if (ret != 0) {
+        fprintf(stderr, "Failed to decode bitstream.\n");
+    }
+
+    // data和係數留在workspace給下一張frame使用
+    free(layout.segment_offsets);
 
-        // huffman decode ac of u_block[u_block_idx]
-        huffman_decode_ac(&bit_reader, &jpeg_u_ac_encoded[u_block_idx], jpeg_uv_ac_huffman_table);
+    return ret;
+}
 
-        // huffman decode dc of v_block[v_block_idx]
-        huffman_decode_dc(&bit_reader, &jpeg_v_dc_encoded[v_block_idx], jpeg_uv_dc_huffman_table);
+/*  function: jpeg_blocks_num()
+    Params:
+        Component* comp : frame的y/u/v其中一個component
 
-        // huffman decode ac of v_block[v_block_idx]
-        huffman_decode_ac(&bit_reader, &jpeg_v_ac_encoded[v_block_idx], jpeg_uv_ac_huffman_table);
+    Return:
+        component有多少個block
+ */
+int jpeg_blocks_num(Component* comp)
+{
+    return (comp->padded_height / comp->block_info.height) * (comp->padded_width / comp->block_info.width);
+}
 
+/*  function: jpeg_workspace_create()
+    Params:
+        None
 
-        y_block_idx += mcu_y_nums;
-        u_block_idx++;
-        v_block_idx++;
+    Return:
+        空的workspace (第一次jpeg_workspace_reserve()時才依照frame大小配置)，失敗時回傳NULL
+ */
+EntropyWorkspace* jpeg_workspace_create(void)
+{
+    EntropyWorkspace* workspace = (EntropyWorkspace*)calloc(1, sizeof(EntropyWorkspace));
+    if (workspace == NULL) {
+        perror("Failed to allocate entropy workspace");
     }
+    return workspace;
+}
 
-    fclose(fp);
+/*  function: jpeg_workspace_free_encoded()
+    Params:
+        EntropyWorkspace* workspace : workspace
+        int component               : JPEG_COMPONENT_Y/U/V
 
-    // Decode DC係數
-    jpeg_decode_dc(jpeg_y_blocks, y_blocks_num, jpeg_y_dc_encoded);
-    jpeg_decode_dc(jpeg_u_blocks, u_blocks_num, jpeg_u_dc_encoded);
-    jpeg_decode_dc(jpeg_v_blocks, v_blocks_num, jpeg_v_dc_encoded);
+    Return:
+        釋放component的DC/AC編碼結果和symbol buffers
+ */
+static void jpeg_workspace_free_encoded(EntropyWorkspace* workspace, int component)
+{
+    int buffers_num = (workspace->encoded_capacity[component] + JPEG_RLE_JOB_BLOCKS - 1) / JPEG_RLE_JOB_BLOCKS;
 
-    // Decode AC係數
-    jpeg_decode_ac(jpeg_y_blocks, y_blocks_num, jpeg_y_ac_encoded);
-    jpeg_decode_ac(jpeg_u_blocks, u_blocks_num, jpeg_u_ac_encoded);
-    jpeg_decode_ac(jpeg_v_blocks, v_blocks_num, jpeg_v_ac_encoded);
+    if (workspace->symbol_buffers[component] != NULL) {
+        for (int i = 0; i < buffers_num; i++) {
+            free(workspace->symbol_buffers[component][i].symbols);
+        }
+    }
+    free(workspace->symbol_buffers[component]);
+    free(workspace->dc_encoded[component]);
+    free(workspace->ac_encoded[component]);
+    workspace->symbol_buffers[component] = NULL;
+    workspace->dc_encoded[component] = NULL;
+    workspace->ac_encoded[component] = NULL;
+    workspace->encoded_capacity[component] = 0;
+}
 
-    inverse_zigzag_component(&frame->y, jpeg_y_blocks);
-    inverse_zigzag_component(&frame->u, jpeg_u_blocks);
-    inverse_zigzag_component(&frame->v, jpeg_v_blocks);
+/*  function: jpeg_workspace_destroy()
+    Params:
+        EntropyWorkspace* workspace : jpeg_workspace_create()得到的workspace (可以是NULL)
 
-    // 將儲存係數的記憶體釋放
-    free(jpeg_y_dc_encoded);
-    free(jpeg_u_dc_encoded);
-    free(jpeg_v_dc_encoded);
-    free(jpeg_y_ac_encoded);
-    free(jpeg_u_ac_encoded);
-    free(jpeg_v_ac_encoded);
-    free(jpeg_y_blocks);
-    free(jpeg_u_blocks);
-    free(jpeg_v_blocks);
+    Return:
+        將workspace配置的記憶體釋放
+ */
+void jpeg_workspace_destroy(EntropyWorkspace* workspace)
+{
+    if (workspace == NULL) {
+        return;
+    }
+
+    for (int c = 0; c < JPEG_COMPONENTS_NUM; c++) {
+        free(workspace->blocks[c]);
+        jpeg_workspace_free_encoded(workspace, c);
+    }
+    for (int i = 0; i < workspace->segments_capacity; i++) {
+        free(workspace->segments[i].data);
+    }
+    free(workspace->segments);
+    free(workspace->data);
+    free(workspace);
 }
 
-void entropy_encode_jpeg(YUVFrame* frame, QuantType quant_type, CompressionType compression_type, EntropyType entropy_type, const char* out_bitstream_path)
+/*  function: jpeg_workspace_reserve()
+    Params:
+        EntropyWorkspace* workspace : 這張frame使用的workspace
+        YUVFrame* frame             : frame的大小、format和block資訊
+        int encode                  : 1: 編碼 (需要DC/AC編碼結果和symbol buffers) 0: 解碼 (只需要係數)
+
+    Return:
+        0 : 成功
+        -1: 記憶體配置失敗
+
+    Result:
+        依照frame的blocks個數配置，已經夠大時不做任何事，所以同樣大小的frames只有第一張會配置記憶體
+        AC symbols不是每個block固定64個，而是由RLE工作依照實際個數寫到symbol buffers
+ */
+int jpeg_workspace_reserve(EntropyWorkspace* workspace, YUVFrame* frame, int encode)
 {
-    /* 取得計算好的Huffman tables */
-    extern Huffman_Table* jpeg_y_dc_huffman_table, * jpeg_y_ac_huffman_table;
-    extern Huffman_Table* jpeg_uv_dc_huffman_table, * jpeg_uv_ac_huffman_table;
+    Component* comps[JPEG_COMPONENTS_NUM] = {&frame->y, &frame->u, &frame->v};
 
+    if (workspace == NULL) {
+        return -1;
+    }
 
-    /* 統計每張frame有多少個block，再配置每個block裡的DC和AC需要儲存的資訊所需要的記憶體空間 */
-    int y_blocks_num = (frame->y.padded_height / frame->y.block_info.height) * (frame->y.padded_width / frame->y.block_info.width);
-    int u_blocks_num = (frame->u.padded_height / frame->u.block_info.height) * (frame->u.padded_width / frame->u.block_info.width);
-    int v_blocks_num = (frame->v.padded_height / frame->v.block_info.height) * (frame->v.padded_width / frame->v.block_info.width);
-    JpegBlockCoeffs* jpeg_y_blocks = (JpegBlockCoeffs*)malloc(sizeof(JpegBlockCoeffs) * y_blocks_num);
-    JpegBlockCoeffs* jpeg_u_blocks = (JpegBlockCoeffs*)malloc(sizeof(JpegBlockCoeffs) * u_blocks_num);
-    JpegBlockCoeffs* jpeg_v_blocks = (JpegBlockCoeffs*)malloc(sizeof(JpegBlockCoeffs) * v_blocks_num);
-    JpegDcEncoded* jpeg_y_dc_encoded, *jpeg_u_dc_encoded, *jpeg_v_dc_encoded;
-    JpegAcEncoded* jpeg_y_ac_encoded, *jpeg_u_ac_encoded, *jpeg_v_ac_encoded;
-
-    if (jpeg_y_blocks == NULL || jpeg_u_blocks == NULL || jpeg_v_blocks == NULL) {
-        /* 有任何一個component配置記憶體失敗，則不會繼續做壓縮 */
-        perror("Failed to allocate memory for JPEG blocks of component(s) in a frame.");
-        if (jpeg_y_blocks != NULL )free(jpeg_y_blocks);
-        if (jpeg_u_blocks != NULL) free(jpeg_u_blocks);
-        if (jpeg_v_blocks != NULL) free(jpeg_v_blocks);
-        return;
+    for (int c = 0; c < JPEG_COMPONENTS_NUM; c++) {
+        int blocks_num = jpeg_blocks_num(comps[c]);
+
+        if (workspace->blocks_capacity[c] < blocks_num) {
+            free(workspace->blocks[c]);
+            workspace->blocks[c] = (JpegBlockCoeffs*)malloc(sizeof(JpegBlockCoeffs) * blocks_num);
+            workspace->blocks_capacity[c] = (workspace->blocks[c] != NULL) ? blocks_num : 0;
+            if (workspace->blocks[c] == NULL) {
+                perror("Failed to allocate memory for JPEG blocks of component(s) in a frame.");
+                return -1;
+            }
+        }
+
+        if (encode && workspace->encoded_capacity[c] < blocks_num) {
+            int buffers_num = (blocks_num + JPEG_RLE_JOB_BLOCKS - 1) / JPEG_RLE_JOB_BLOCKS;
+
+            jpeg_workspace_free_encoded(workspace, c);
+            workspace->dc_encoded[c] = (JpegDcEncoded*)malloc(sizeof(JpegDcEncoded) * blocks_num);
+            workspace->ac_encoded[c] = (JpegAcEncoded*)malloc(sizeof(JpegAcEncoded) * blocks_num);
+            workspace->symbol_buffers[c] = (JpegSymbolBuffer*)calloc(buffers_num, sizeof(JpegSymbolBuffer));
+            if (workspace->dc_encoded[c] == NULL || workspace->ac_encoded[c] == NULL || workspace->symbol_buffers[c] == NULL) {
+                perror("Failed to allocate memory for DC/AC of components in a frame.");
+                jpeg_workspace_free_encoded(workspace, c);
+                return -1;
+            }
+            workspace->encoded_capacity[c] = blocks_num;
+        }
+    }
+
+    return 0;
+}
+
+/*  function: jpeg_workspace_reserve_segments()
+    Params:
+        EntropyWorkspace* workspace : 這張frame使用的workspace
+        int segments_num            : restart segments (或component scans) 的個數
+
+    Return:
+        0 : 成功
+        -1: 記憶體配置失敗
+
+    Result:
+        新增的segments從空的buffer開始，已經有的segments保留上一張frame的buffer
+ */
+static int jpeg_workspace_reserve_segments(EntropyWorkspace* workspace, int segments_num)
+{
+    if (segments_num <= workspace->segments_capacity) {
+        return 0;
+    }
+
+    JpegSegment* segments = (JpegSegment*)realloc(workspace->segments, sizeof(JpegSegment) * segments_num);
+    if (segments == NULL) {
+        perror("Failed to allocate memory for restart segments.");
+        return -1;
+    }
+    memset(segments + workspace->segments_capacity, 0, sizeof(JpegSegment) * (segments_num - workspace->segments_capacity));
+    workspace->segments = segments;
+    workspace->segments_capacity = segments_num;
+    return 0;
+}
+
+/*  function: jpeg_workspace_size()
+    Params:
+        const EntropyWorkspace* workspace : workspace
+
+    Return:
+        workspace目前配置的bytes個數 (包含symbol buffers和segments的bitstream)
+ */
+size_t jpeg_workspace_size(const EntropyWorkspace* workspace)
+{
+    size_t size = 0;
+
+    if (workspace == NULL) {
+        return 0;
+    }
+
+    for (int c = 0; c < JPEG_COMPONENTS_NUM; c++) {
+        int buffers_num = (workspace->encoded_capacity[c] + JPEG_RLE_JOB_BLOCKS - 1) / JPEG_RLE_JOB_BLOCKS;
+
+        size += sizeof(JpegBlockCoeffs) * workspace->blocks_capacity[c];
+        size += (sizeof(JpegDcEncoded) + sizeof(JpegAcEncoded)) * workspace->encoded_capacity[c];
+        size += sizeof(JpegSymbolBuffer) * buffers_num;
+        for (int i = 0; i < buffers_num; i++) {
+            size += sizeof(JpegAcSymbol) * workspace->symbol_buffers[c][i].capacity;
+        }
+    }
+    for (int i = 0; i < workspace->segments_capacity; i++) {
+        size += sizeof(JpegSegment) + workspace->segments[i].capacity;
+    }
+    return size + workspace->data_capacity;
+}
+
+/*  function: entropy_encode_jpeg()
+    Params:
+        YUVFrame* frame                  : 已經做完DCT和量化的frame (係數在padded data)
+        QuantParams* quant_params        : 量化的方式和參數 (寫到header)
+        CompressionType compression_type : 壓縮的方式
+        EntropyType entropy_type         : entropy coding的方式
+        FILE* bitstream_fp               : 寫入bitstream的檔案 (由呼叫者開啟/關閉)
+        EntropyWorkspace* workspace      : 這張frame使用的workspace (存放係數和編碼結果)
+
+    Return:
+        0 : 成功
+        -1: 記憶體配置失敗
+
+    Result:
+        1. 對padded data做zigzag scan
+        2. 將zigzag scan後的係數交給entropy_encode_jpeg_coeffs()編碼寫檔
+ */
+int entropy_encode_jpeg(YUVFrame* frame, QuantParams* quant_params, CompressionType compression_type, EntropyType entropy_type, FILE* bitstream_fp,
+                        EntropyWorkspace* workspace)
+{
+    /* 依照每張frame有多少個block，準備好每個block裡的DC和AC需要儲存的資訊所需要的記憶體空間 */
+    if (jpeg_workspace_reserve(workspace, frame, 1) != 0) {
+        return -1;
     }
 
-    
     /* 對frame的每個component做zigzag scan，再將結果儲存 */
-    zigzag_component(&frame->y, jpeg_y_blocks);
-    zigzag_component(&frame->u, jpeg_u_blocks);
-    zigzag_component(&frame->v, jpeg_v_blocks);
+    zigzag_component(&frame->y, workspace->blocks[JPEG_COMPONENT_Y]);
+    zigzag_component(&frame->u, workspace->blocks[JPEG_COMPONENT_U]);
+    zigzag_component(&frame->v, workspace->blocks[JPEG_COMPONENT_V]);
 
-    /* 對frame的每個component做DC係數DPCM encoding */
-    jpeg_encode_dc(jpeg_y_blocks, y_blocks_num, &jpeg_y_dc_encoded);
-    jpeg_encode_dc(jpeg_u_blocks, u_blocks_num, &jpeg_u_dc_encoded);
-    jpeg_encode_dc(jpeg_v_blocks, v_blocks_num, &jpeg_v_dc_encoded);
+    return entropy_encode_jpeg_coeffs(frame, workspace, quant_params, compression_type, entropy_type, bitstream_fp, NULL, NULL);
+}
 
-    /* 對frame的每個component做AC係數run length encoding */
-    jpeg_encode_ac(jpeg_y_blocks, y_blocks_num, &jpeg_y_ac_encoded);
-    jpeg_encode_ac(jpeg_u_blocks, u_blocks_num, &jpeg_u_ac_encoded);
-    jpeg_encode_ac(jpeg_v_blocks, v_blocks_num, &jpeg_v_ac_encoded);
+/* 平行編碼restart segments或component scans時共用的資訊 */
+typedef struct {
+    JpegDcEncoded* dc_encoded[JPEG_COMPONENTS_NUM];
+    JpegAcEncoded* ac_encoded[JPEG_COMPONENTS_NUM];
+    int scan_blocks_num[JPEG_COMPONENTS_NUM];  // component scan的blocks個數 (和MCU交錯時相同，不包含MCUs以外的padding blocks)
+    JpegHuffmanTables* huffman_tables;
+    int minimum_coded_unit;  // MCU個數
+    int mcu_y_nums;          // 一個MCU裡的Y blocks個數
+    int segment_mcus;        // 一個segment的MCU個數
+    int restart_interval;    // component scan裡每幾個blocks有一個restart marker
+    JpegSegment* segments;   // 每個segment (或component scan) 的編碼結果
+}JpegSegmentJob;
+
+/*  function: jpeg_huffman_segment_job()
+    Params:
+        void* arg     : JpegSegmentJob*
+        int job_index : 第幾個restart segment
+
+    Result:
+        thread pool的工作，將一個segment的MCUs用Huffman編碼到segment自己的buffer (上一張frame留下的buffer從頭覆寫)
+        每個segment從byte開頭開始，最後不滿1個byte的部分補1，所以可以直接依序接起來
+ */
+void jpeg_huffman_segment_job(void* arg, int job_index)
+{
+    JpegSegmentJob* job = (JpegSegmentJob*)arg;
+    JpegHuffmanTables* huffman_tables = job->huffman_tables;
+    JpegDcEncoded* y_dc_encoded = job->dc_encoded[JPEG_COMPONENT_Y], * u_dc_encoded = job->dc_encoded[JPEG_COMPONENT_U], * v_dc_encoded = job->dc_encoded[JPEG_COMPONENT_V];
+    JpegAcEncoded* y_ac_encoded = job->ac_encoded[JPEG_COMPONENT_Y], * u_ac_encoded = job->ac_encoded[JPEG_COMPONENT_U], * v_ac_encoded = job->ac_encoded[JPEG_COMPONENT_V];
+    int mcu_start = job_index * job->segment_mcus;
+    int mcu_end = (mcu_start + job->segment_mcus < job->minimum_coded_unit) ? mcu_start + job->segment_mcus : job->minimum_coded_unit;
+    int mcu_y_nums = job->mcu_y_nums;
 
+    BitWriter bit_writer;
+    create_memory_bit_writer(&bit_writer, job->segments[job_index].data, job->segments[job_index].capacity);
 
-    /*  將編碼後的DC/AC係數變成bitstream，寫入檔案 
-        在entropy coding時，需要根據YUV format處理YUV data (以interleave方式)
+    for (int i = mcu_start; i < mcu_end; i++) {
+        /* 先寫入Y component的blocks (dc再來ac)，寫入mcu_y_nums個blocks 
+           接著寫入U component的blocks (dc再來ac)，寫入1個block
+           最後寫入V compoents的blocks (dc再來ac)，寫入1個block
+         */
+        int y_block_idx = i * mcu_y_nums;
+        for (int j = 0; j < mcu_y_nums; j++) {
+            huffman_encode_dc(&bit_writer, &y_dc_encoded[y_block_idx+j], huffman_tables->y_dc);
+            huffman_encode_ac(&bit_writer, &y_ac_encoded[y_block_idx+j], huffman_tables->y_ac);
+        }
+        huffman_encode_dc(&bit_writer, &u_dc_encoded[i], huffman_tables->uv_dc);
+        huffman_encode_ac(&bit_writer, &u_ac_encoded[i], huffman_tables->uv_ac);
+        huffman_encode_dc(&bit_writer, &v_dc_encoded[i], huffman_tables->uv_dc);
+        huffman_encode_ac(&bit_writer, &v_ac_encoded[i], huffman_tables->uv_ac);
+    }
+
+    /* Flush: 處理剩下沒寫入的bits (補齊1個byte) */
+    bit_writer_flush(&bit_writer);
+
+    job->segments[job_index].data = bit_writer.mem;
+    job->segments[job_index].size = bit_writer.mem_size;
+    job->segments[job_index].capacity = bit_writer.mem_capacity;
+}
+
+/*  function: jpeg_huffman_scan_job()
+    Params:
+        void* arg     : JpegSegmentJob*
+        int component : 第幾個component的scan (JPEG_COMPONENT_Y/U/V)
+
+    Result:
+        thread pool的工作，將一個component的所有blocks用Huffman編碼到scan自己的buffer
+        每restart_interval個blocks插入一個restart marker (每個scan從0xd0開始)
+ */
+void jpeg_huffman_scan_job(void* arg, int component)
+{
+    JpegSegmentJob* job = (JpegSegmentJob*)arg;
+    Huffman_Table* dc_table = (component == JPEG_COMPONENT_Y) ? job->huffman_tables->y_dc : job->huffman_tables->uv_dc;
+    Huffman_Table* ac_table = (component == JPEG_COMPONENT_Y) ? job->huffman_tables->y_ac : job->huffman_tables->uv_ac;
+    int restart_interval = job->restart_interval;
+
+    BitWriter bit_writer;
+    create_memory_bit_writer(&bit_writer, job->segments[component].data, job->segments[component].capacity);
+
+    for (int i = 0; i < job->scan_blocks_num[component]; i++) {
+        if (restart_interval > 0 && i > 0 && i % restart_interval == 0) {
+            bit_writer_write_marker(&bit_writer, JPEG_RST_MARKER_BASE + ((i / restart_interval - 1) & 7));
+        }
+        huffman_encode_dc(&bit_writer, &job->dc_encoded[component][i], dc_table);
+        huffman_encode_ac(&bit_writer, &job->ac_encoded[component][i], ac_table);
+    }
+
+    /* Flush: 處理剩下沒寫入的bits (補齊1個byte) */
+    bit_writer_flush(&bit_writer);
+
+    job->segments[component].data = bit_writer.mem;
+    job->segments[component].size = bit_writer.mem_size;
+    job->segments[component].capacity = bit_writer.mem_capacity;
+}
+
+/*  function: entropy_encode_jpeg_coeffs()
+    Params:
+        YUVFrame* frame                  : frame的大小、format和block資訊
+        EntropyWorkspace* workspace      : 已經用jpeg_workspace_reserve()準備好，workspace->blocks是zigzag scan後的係數
+                                           (prepare不是NULL時由prepare寫入，DPCM會改寫DC)
+        QuantParams* quant_params        : 量化的方式和參數 (寫到header)
+        CompressionType compression_type : 壓縮的方式
+        EntropyType entropy_type         : entropy coding的方式
+        FILE* bitstream_fp               : 寫入bitstream的檔案 (由呼叫者開啟/關閉)
+        JpegComponentPrepare prepare     : 準備一個component的係數 (NULL表示jpeg_*_blocks已經準備好)
+        void* prepare_arg                : 傳給prepare的參數
+
+    Return:
+        0 : 成功
+        -1: 記憶體配置失敗 (不會寫入任何bitstream)
+
+    Result:
+        DPCM、RLE、Huffman encode後寫入bitstream檔案
+        multi-pass和fused pipeline共用
+        1. prepare交給thread pool，Y/U/V三個components平行做DCT、量化和zigzag scan
+        2. 設定restart_interval時，每restart_interval個MCUs是一個segment (DC預測在segment開頭重設)
+        3. RLE和每個segment的Huffman encode交給thread pool平行處理，segments依照順序寫檔，
+           中間插入restart marker，所以bitstream和threads個數無關
+        4. SCAN_PER_COMPONENT時Y/U/V各自一個scan (restart_interval是每幾個blocks)，三個scans平行編碼
+        DC/AC symbols和segments的bitstream都放在workspace，不需要每張frame配置記憶體
+ */
+int entropy_encode_jpeg_coeffs(YUVFrame* frame, EntropyWorkspace* workspace, QuantParams* quant_params, CompressionType compression_type, EntropyType entropy_type, FILE* bitstream_fp,
+                               JpegComponentPrepare prepare, void* prepare_arg)
+{
+    extern EntropyConfig jpeg_entropy_config;
+    extern ThreadPool* jpeg_entropy_thread_pool;
+
+    int y_blocks_num = jpeg_blocks_num(&frame->y);
+    int u_blocks_num = jpeg_blocks_num(&frame->u);
+    int v_blocks_num = jpeg_blocks_num(&frame->v);
+    int restart_interval = jpeg_entropy_config.restart_interval;
+    int component_scans = (jpeg_entropy_config.scan_mode == SCAN_PER_COMPONENT);
+    JpegBlockCoeffs* jpeg_y_blocks = workspace->blocks[JPEG_COMPONENT_Y];
+    JpegBlockCoeffs* jpeg_u_blocks = workspace->blocks[JPEG_COMPONENT_U];
+    JpegBlockCoeffs* jpeg_v_blocks = workspace->blocks[JPEG_COMPONENT_V];
+    JpegDcEncoded* jpeg_y_dc_encoded = workspace->dc_encoded[JPEG_COMPONENT_Y];
+    JpegDcEncoded* jpeg_u_dc_encoded = workspace->dc_encoded[JPEG_COMPONENT_U];
+    JpegDcEncoded* jpeg_v_dc_encoded = workspace->dc_encoded[JPEG_COMPONENT_V];
+    JpegAcEncoded* jpeg_y_ac_encoded = workspace->ac_encoded[JPEG_COMPONENT_Y];
+    JpegAcEncoded* jpeg_u_ac_encoded = workspace->ac_encoded[JPEG_COMPONENT_U];
+    JpegAcEncoded* jpeg_v_ac_encoded = workspace->ac_encoded[JPEG_COMPONENT_V];
+
+    /*  在entropy coding時，需要根據YUV format處理YUV data (以interleave方式)
         1. 以block為單位來處理
         2. 在一個block裡，編碼以及寫入Y的DC和AC，再來處理U的DC和AC，最後才處理V的DC和AC
 
@@ -761,22 +1698,6 @@ void entropy_encode_jpeg(YUVFrame* frame, QuantType quant_type, CompressionType
      */
     int minimum_coded_unit;
     int mcu_y_nums;
-    int y_block_idx = 0, u_block_idx = 0, v_block_idx = 0;  // 紀錄要寫入的y/u/v block在當下frame的第幾個block
-
-    /* 準備將整張frame編碼後的係數寫到檔案 */
-    BitWriter bit_writer;
-    FILE* fp = fopen(out_bitstream_path, "wb");
-    if (!fp) {
-        fprintf(stderr, "Failed to open file: %s\n", out_bitstream_path);
-        return;
-    }
-
-    /* 將frame的width/height/YUV format/quantization type/ compression type/ entropy type 寫到header */
-    jpeg_encode_header(fp, frame, quant_type, compression_type, entropy_type);
-    
-
-    /* 建立一個bit writer，紀錄整張frame的bitstream寫入情況 */
-    create_bit_writer(&bit_writer, fp);
 
     /* 根據YUV format，計算出每個compoent寫入的情況 */
     if (frame->format == YUV444) {
@@ -788,68 +1709,222 @@ void entropy_encode_jpeg(YUVFrame* frame, QuantType quant_type, CompressionType
     } else if (frame->format == YUV420) {
         minimum_coded_unit = y_blocks_num / 4;
         mcu_y_nums = 4;
+    } else {
+        fprintf(stderr, "[Error] Unsupported YUV format for entropy coding: %d\n", frame->format);
+        return -1;
     }
 
-    for (int i = 0; i < minimum_coded_unit; i++) {
-        /* 先寫入Y component的blocks (dc再來ac)，寫入mcu_y_nums個blocks 
-           接著寫入U component的blocks (dc再來ac)，寫入1個block
-           最後寫入V compoents的blocks (dc再來ac)，寫入1個block
-         */
-        for (int j = 0; j < mcu_y_nums; j++) {
-            // huffman encode dc of y_block[y_block_idx + j]
-            huffman_encode_dc(&bit_writer, &jpeg_y_dc_encoded[y_block_idx+j], jpeg_y_dc_huffman_table);
+    /* Y/U/V三個components互相獨立，平行準備係數 */
+    if (prepare != NULL) {
+        thread_pool_run(jpeg_entropy_thread_pool, prepare, prepare_arg, JPEG_COMPONENTS_NUM);
+    }
+
+    /* 對frame的每個component做DC係數DPCM encoding (restart segment的開頭重設DC預測) */
+    jpeg_encode_dc(jpeg_y_blocks, y_blocks_num, component_scans ? restart_interval : restart_interval * mcu_y_nums, jpeg_y_dc_encoded);
+    jpeg_encode_dc(jpeg_u_blocks, u_blocks_num, restart_interval, jpeg_u_dc_encoded);
+    jpeg_encode_dc(jpeg_v_blocks, v_blocks_num, restart_interval, jpeg_v_dc_encoded);
 
-            // huffman encode ac of y_block[y_block_idx+j]
-            huffman_encode_ac(&bit_writer, &jpeg_y_ac_encoded[y_block_idx+j], jpeg_y_ac_huffman_table);
+    /* 對frame的每個component做AC係數run length encoding (symbols放在workspace的symbol buffers) */
+    if (jpeg_encode_ac(jpeg_y_blocks, y_blocks_num, jpeg_y_ac_encoded, workspace->symbol_buffers[JPEG_COMPONENT_Y]) != 0 ||
+        jpeg_encode_ac(jpeg_u_blocks, u_blocks_num, jpeg_u_ac_encoded, workspace->symbol_buffers[JPEG_COMPONENT_U]) != 0 ||
+        jpeg_encode_ac(jpeg_v_blocks, v_blocks_num, jpeg_v_ac_encoded, workspace->symbol_buffers[JPEG_COMPONENT_V]) != 0) {
+        /* 記憶體配置失敗，則不會繼續做壓縮 */
+        return -1;
+    }
+
+    /* 依照這張frame的symbols統計選擇Huffman tables */
+    JpegHuffmanTables huffman_tables;
+    jpeg_select_huffman_tables(&huffman_tables, jpeg_y_dc_encoded, jpeg_y_ac_encoded, y_blocks_num,
+                               jpeg_u_dc_encoded, jpeg_u_ac_encoded, u_blocks_num, jpeg_v_dc_encoded, jpeg_v_ac_encoded, v_blocks_num);
+
+    /* 沒有restart interval時整張frame是一個segment，component scans時每個component是一個segment */
+    int segment_mcus = (restart_interval > 0) ? restart_interval : minimum_coded_unit;
+    int segments_num = component_scans ? JPEG_COMPONENTS_NUM : (segment_mcus > 0) ? (minimum_coded_unit + segment_mcus - 1) / segment_mcus : 0;
+    JpegSegment* segments = (jpeg_workspace_reserve_segments(workspace, segments_num) == 0) ? workspace->segments : NULL;
+    JpegScanLayout layout;
+    memset(&layout, 0, sizeof(layout));
+    layout.restart_interval = restart_interval;
+    layout.component_scans = component_scans;
+
+    if (segments == NULL) {
+        perror("Failed to allocate memory for restart segments.");
+        return -1;
+    } else {
+        /* 每個segment (或scan) 各自編碼到自己的buffer，header的offsets需要先知道每個segment的大小 */
+        JpegSegmentJob segment_job = {
+            {jpeg_y_dc_encoded, jpeg_u_dc_encoded, jpeg_v_dc_encoded},
+            {jpeg_y_ac_encoded, jpeg_u_ac_encoded, jpeg_v_ac_encoded},
+            {minimum_coded_unit * mcu_y_nums, minimum_coded_unit, minimum_coded_unit},
+            &huffman_tables, minimum_coded_unit, mcu_y_nums, segment_mcus, restart_interval, segments
+        };
+
+        if (component_scans) {
+            thread_pool_run(jpeg_entropy_thread_pool, jpeg_huffman_scan_job, &segment_job, JPEG_COMPONENTS_NUM);
+            for (int i = 1; i < JPEG_COMPONENTS_NUM; i++) {
+                layout.scan_offsets[i] = layout.scan_offsets[i-1] + (uint32_t)segments[i-1].size;
+            }
+        } else {
+            thread_pool_run(jpeg_entropy_thread_pool, jpeg_huffman_segment_job, &segment_job, segments_num);
+
+            /* segment index: 每個segment在entropy coded data裡的offset (包含前面的restart markers) */
+            if (jpeg_entropy_config.segment_index && restart_interval > 0) {
+                layout.segment_offsets = (uint32_t*)malloc(sizeof(uint32_t) * segments_num);
+                if (layout.segment_offsets == NULL) {
+                    perror("Failed to allocate memory for segment index, write bitstream without index.");
+                } else {
+                    layout.segments_num = segments_num;
+                    layout.segment_offsets[0] = 0;
+                    for (int i = 1; i < segments_num; i++) {
+                        layout.segment_offsets[i] = layout.segment_offsets[i-1] + (uint32_t)segments[i-1].size + 2;
+                    }
+                }
+            }
         }
-        // huffman encode dc of u_block[u_block_idx]
-        huffman_encode_dc(&bit_writer, &jpeg_u_dc_encoded[u_block_idx], jpeg_uv_dc_huffman_table);
+    }
 
-        // huffman encode ac of u_block[u_block_idx]
-        huffman_encode_ac(&bit_writer, &jpeg_u_ac_encoded[u_block_idx], jpeg_uv_ac_huffman_table);
-        
-        // huffman encode dc of v_block[v_block_idx]
-        huffman_encode_dc(&bit_writer, &jpeg_v_dc_encoded[v_block_idx], jpeg_uv_dc_huffman_table);
+    /* 準備將整張frame編碼後的係數寫到檔案 */
+    FILE* fp = bitstream_fp;
+    if (fp != NULL) {
+        /* 將frame的width/height/YUV format/quantization type/ compression type/ entropy type/ Huffman tables/ restart interval/ layout 寫到header */
+        jpeg_encode_header(fp, frame, quant_params, compression_type, entropy_type, &huffman_tables, &layout);
+
+        /* 依照順序寫入segments，MCU交錯時segments之間插入restart marker (0xff 0xd0~0xd7)，component scans直接接起來 */
+        for (int i = 0; i < segments_num; i++) {
+            if (i > 0 && !component_scans) {
+                fputc(0xff, fp);
+                fputc(JPEG_RST_MARKER_BASE + ((i - 1) & 7), fp);
+            }
+            fwrite(segments[i].data, 1, segments[i].size, fp);
+        }
+    }
+
+    /* segments的buffers留在workspace給下一張frame使用 */
+    free(layout.segment_offsets);
+    return 0;
+}
+
+/*  function: jpeg_encode_stripe_block()
+    Params:
+        BitWriter* bit_writer   : 寫入bitstream的bit writer
+        JpegBlockCoeffs* block  : 一個block的係數 (zigzag順序)
+        int16_t* prev_dc        : component上一個block的DC (DPCM使用，會更新成這個block的DC)
+        Huffman_Table* dc_table : DC使用的Huffman table
+        Huffman_Table* ac_table : AC使用的Huffman table
+
+    Result:
+        對一個block做DPCM、RLE後直接Huffman encode，不需要整張frame的JpegDcEncoded/JpegAcEncoded
+ */
+static void jpeg_encode_stripe_block(BitWriter* bit_writer, JpegBlockCoeffs* block, int16_t* prev_dc,
+                                     Huffman_Table* dc_table, Huffman_Table* ac_table)
+{
+    JpegDcEncoded dc_encoded;
+    JpegAcSymbol symbols[JPEG_AC_SYMBOLS_MAX];
+    JpegAcEncoded ac_encoded = {symbols, 0};
+
+    int16_t diff = block->dc - *prev_dc;
+    *prev_dc = block->dc;
+    dc_encoded.size = get_size(diff);
+    dc_encoded.amplitude = get_amplitude(diff, dc_encoded.size);
+    run_length_encoding(block, &ac_encoded);
+
+    huffman_encode_dc(bit_writer, &dc_encoded, dc_table);
+    huffman_encode_ac(bit_writer, &ac_encoded, ac_table);
+}
+
+/*  function: entropy_encode_jpeg_stripes()
+    Params:
+        YUVFrame* frame                  : frame的大小、format和block資訊
+        QuantParams* quant_params        : 量化的方式和參數 (寫到header)
+        CompressionType compression_type : 壓縮的方式
+        EntropyType entropy_type         : entropy coding的方式
+        FILE* bitstream_fp               : 寫入bitstream的檔案 (由呼叫者開啟/關閉)
+        JpegRowPrepare prepare           : 準備component一個block row的係數
+        void* prepare_arg                : 傳給prepare的參數
 
-        // huffman encode ac of v_block[v_block_idx]
-        huffman_encode_ac(&bit_writer, &jpeg_v_ac_encoded[v_block_idx], jpeg_uv_ac_huffman_table);
+    Return:
+        0 : 成功
+        -1: 記憶體配置失敗 (不會寫入任何bitstream)
 
-        /* 更新compoents的block在frame裡的index */
-        y_block_idx += mcu_y_nums;
-        u_block_idx++;
-        v_block_idx++;
+    Result:
+        stripe編碼: 依照MCU順序，需要下一個block row時才呼叫prepare，每個block直接做DPCM、RLE和Huffman encode
+        1. header在第一個MCU之前寫入，所以使用標準Huffman tables、沒有segment index、MCU交錯的一個scan
+           (huffman_optimize、segment_index和scan_mode不使用)，restart_interval和一般編碼相同
+        2. 每個Y block row編碼完就把bitstream寫出並fflush (bitstream_fp是串流時下游馬上收到這一列)
+        3. 每個component只有一列blocks的係數，不需要整張frame的係數和編碼結果
+        bitstream和FUSED/MULTI_PASS在huffman_optimize: 0、segment_index: 0、scan_mode: INTERLEAVED時完全相同
+ */
+int entropy_encode_jpeg_stripes(YUVFrame* frame, QuantParams* quant_params, CompressionType compression_type, EntropyType entropy_type,
+                                FILE* bitstream_fp, JpegRowPrepare prepare, void* prepare_arg)
+{
+    extern EntropyConfig jpeg_entropy_config;
+
+    Component* comps[JPEG_COMPONENTS_NUM] = {&frame->y, &frame->u, &frame->v};
+    JpegBlockCoeffs* rows[JPEG_COMPONENTS_NUM] = {NULL, NULL, NULL};
+    int blocks_per_row[JPEG_COMPONENTS_NUM];
+    int current_row[JPEG_COMPONENTS_NUM] = {-1, -1, -1};
+    int16_t prev_dc[JPEG_COMPONENTS_NUM] = {0, 0, 0};
+    int restart_interval = jpeg_entropy_config.restart_interval;
+    int mcu_y_nums = (frame->format == YUV420) ? 4 : (frame->format == YUV422) ? 2 : 1;
+    int minimum_coded_unit = jpeg_blocks_num(&frame->y) / mcu_y_nums;
+
+    for (int c = 0; c < JPEG_COMPONENTS_NUM; c++) {
+        blocks_per_row[c] = comps[c]->padded_width / comps[c]->block_info.width;
+        rows[c] = (JpegBlockCoeffs*)malloc(sizeof(JpegBlockCoeffs) * blocks_per_row[c]);
+        if (rows[c] == NULL) {
+            perror("Failed to allocate memory for JPEG block rows.");
+            for (int i = 0; i < c; i++) free(rows[i]);
+            return -1;
+        }
     }
 
-    /* 一張frame裡的Y/U/V的所有block都變成bitstream也有寫到檔案
-       最後處理還留在buffer裡的bits
-       Flush: 處理剩下沒寫入的bits，補齊1個byte的資料
-     */
-    if (bit_writer.bit_count > 0) {
-        /* 向右對齊 */
-        bit_writer.buffer <<= (8-bit_writer.bit_count);
+    /* header在所有係數之前: 標準tables，MCU交錯的一個scan */
+    JpegHuffmanTables huffman_tables;
+    jpeg_use_standard_huffman_tables(&huffman_tables);
+    JpegScanLayout layout;
+    memset(&layout, 0, sizeof(layout));
+    layout.restart_interval = restart_interval;
+    jpeg_encode_header(bitstream_fp, frame, quant_params, compression_type, entropy_type, &huffman_tables, &layout);
 
-        /* 右邊bits補1 */
-        bit_writer.buffer |= ((1 << (8-bit_writer.bit_count)) - 1);
+    BitWriter bit_writer;
+    create_bit_writer(&bit_writer, bitstream_fp);
 
-        fputc(bit_writer.buffer, bit_writer.fp);
+    for (int i = 0; i < minimum_coded_unit; i++) {
+        /* restart segment的開頭: 補齊byte後寫入restart marker，重設DC預測 */
+        if (restart_interval > 0 && i % restart_interval == 0) {
+            if (i > 0) {
+                bit_writer_write_marker(&bit_writer, JPEG_RST_MARKER_BASE + ((i / restart_interval - 1) & 7));
+            }
+            prev_dc[JPEG_COMPONENT_Y] = prev_dc[JPEG_COMPONENT_U] = prev_dc[JPEG_COMPONENT_V] = 0;
+        }
 
-        /* byte stuffing: 避開JPEG檔案裡的marker */
-        if (bit_writer.buffer == 0xff) {
-            fputc(0x00, bit_writer.fp);
+        /* MCU: mcu_y_nums個Y blocks，接著1個U block和1個V block */
+        for (int c = 0; c < JPEG_COMPONENTS_NUM; c++) {
+            int count = (c == JPEG_COMPONENT_Y) ? mcu_y_nums : 1;
+            int first = (c == JPEG_COMPONENT_Y) ? i * mcu_y_nums : i;
+            Huffman_Table* dc_table = (c == JPEG_COMPONENT_Y) ? huffman_tables.y_dc : huffman_tables.uv_dc;
+            Huffman_Table* ac_table = (c == JPEG_COMPONENT_Y) ? huffman_tables.y_ac : huffman_tables.uv_ac;
+
+            for (int j = 0; j < count; j++) {
+                int block_idx = first + j;
+                int row = block_idx / blocks_per_row[c];
+                if (row != current_row[c]) {
+                    /* 前一個Y block row已經編碼完，寫出這一列的bitstream */
+                    if (c == JPEG_COMPONENT_Y && current_row[c] >= 0) {
+                        bit_writer_emit(&bit_writer);
+                    }
+                    prepare(prepare_arg, c, row, rows[c]);
+                    current_row[c] = row;
+                }
+                jpeg_encode_stripe_block(&bit_writer, &rows[c][block_idx % blocks_per_row[c]], &prev_dc[c], dc_table, ac_table);
+            }
         }
     }
 
-    /* 一張frame的DC/AC係數壓縮寫檔後，關檔 */
-    fclose(fp);
+    /* Flush: 處理剩下沒寫入的bits (補齊1個byte) */
+    bit_writer_flush(&bit_writer);
 
-    /* 將儲存係數的記憶體釋放 */
-    free(jpeg_y_dc_encoded);
-    free(jpeg_u_dc_encoded);
-    free(jpeg_v_dc_encoded);
-    free(jpeg_y_ac_encoded);
-    free(jpeg_u_ac_encoded);
-    free(jpeg_v_ac_encoded);
-    free(jpeg_y_blocks);
-    free(jpeg_u_blocks);
-    free(jpeg_v_blocks);
-}
\ No newline at end of file
+    for (int c = 0; c < JPEG_COMPONENTS_NUM; c++) {
+        free(rows[c]);
+    }
+    return 0;
+}
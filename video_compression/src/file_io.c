@@ -1,6 +1,7 @@
 #include<stdio.h>
 #include<stdlib.h>
 #include<stdint.h>
+#include<string.h>
 #include"file_io.h"
 
 
@@ -17,13 +18,346 @@
 void create_bit_writer(BitWriter* bit_writer, FILE* fp)
 {
     bit_writer->fp = fp;
+    bit_writer->mem = NULL;
+    bit_writer->mem_size = 0;
+    bit_writer->mem_capacity = 0;
     bit_writer->buffer = 0;
     bit_writer->bit_count = 0;
+    bit_writer->out_size = 0;
 }
 
-void create_bit_reader(BitReader* bit_reader, FILE* fp)
+/*  function: create_memory_bit_writer()
+    Params:
+        BitWriter* bit_writer : 紀錄bistream寫入的資訊
+        uint8_t* mem          : 上一次使用的buffer (可以是NULL)，從開頭覆寫
+        size_t mem_capacity   : mem的大小
+
+    Return:
+        得到輸出到memory的bit writer
+
+    Result:
+        flush之後bitstream在bit_writer->mem (共bit_writer->mem_size bytes)，空間不夠時會realloc，由呼叫者free
+        restart segment各自編碼到自己的buffer時使用，buffer可以留給下一張frame
+ */
+void create_memory_bit_writer(BitWriter* bit_writer, uint8_t* mem, size_t mem_capacity)
 {
-    bit_reader->fp = fp;
+    create_bit_writer(bit_writer, NULL);
+    bit_writer->mem = mem;
+    bit_writer->mem_capacity = mem_capacity;
+}
+
+/*  function: bit_writer_output()
+    Params:
+        BitWriter* bit_writer : 紀錄bitstream寫入的資訊
+
+    Result:
+        將out裡的bytes寫到檔案，或是接到memory buffer後面 (空間不夠時2倍成長)
+ */
+static void bit_writer_output(BitWriter* bit_writer)
+{
+    if (bit_writer->fp != NULL) {
+        fwrite(bit_writer->out, 1, bit_writer->out_size, bit_writer->fp);
+    } else if (bit_writer->out_size > 0) {
+        if (bit_writer->mem_size + bit_writer->out_size > bit_writer->mem_capacity) {
+            size_t capacity = (bit_writer->mem_capacity == 0) ? BIT_WRITER_OUTPUT_SIZE : bit_writer->mem_capacity;
+            while (capacity < bit_writer->mem_size + bit_writer->out_size) {
+                capacity *= 2;
+            }
+            uint8_t* mem = (uint8_t*)realloc(bit_writer->mem, capacity);
+            if (mem == NULL) {
+                perror("Failed to allocate memory for bitstream buffer");
+                bit_writer->out_size = 0;
+                return;
+            }
+            bit_writer->mem = mem;
+            bit_writer->mem_capacity = capacity;
+        }
+        memcpy(bit_writer->mem + bit_writer->mem_size, bit_writer->out, bit_writer->out_size);
+        bit_writer->mem_size += bit_writer->out_size;
+    }
+    bit_writer->out_size = 0;
+}
+
+/*  function: bit_writer_put_byte()
+    Params:
+        BitWriter* bit_writer : 紀錄bitstream寫入的資訊
+        uint8_t byte          : 要寫入的byte
+
+    Result:
+        寫入一個byte到out，byte stuffing: 0xff後面補0x00，避開JPEG檔案裡的marker
+ */
+static void bit_writer_put_byte(BitWriter* bit_writer, uint8_t byte)
+{
+    bit_writer->out[bit_writer->out_size++] = byte;
+    if (byte == 0xff) {
+        bit_writer->out[bit_writer->out_size++] = 0x00;
+    }
+}
+
+/*  function: bit_writer_drain()
+    Params:
+        BitWriter* bit_writer : 紀錄bitstream寫入的資訊
+
+    Return:
+        None
+
+    Result:
+        1. 將accumulator最前面的32 bits轉成4個bytes放到out
+           4個bytes都不是0xff時 (大部分情況) 直接整批寫入，不需要逐一檢查byte stuffing
+        2. out快滿時一次寫到檔案 (或memory buffer)
+ */
+void bit_writer_drain(BitWriter* bit_writer)
+{
+    /* 4個bytes加上stuffing最多8個bytes */
+    if (bit_writer->out_size + 8 > BIT_WRITER_OUTPUT_SIZE) {
+        bit_writer_output(bit_writer);
+    }
+
+    bit_writer->bit_count -= 32;
+    uint32_t word = (uint32_t)(bit_writer->buffer >> bit_writer->bit_count);
+    uint32_t inverted = ~word;
+
+    /* inverted有byte是0，表示word有byte是0xff */
+    if (((inverted - 0x01010101u) & ~inverted & 0x80808080u) == 0) {
+        uint8_t* out = bit_writer->out + bit_writer->out_size;
+        out[0] = (uint8_t)(word >> 24);
+        out[1] = (uint8_t)(word >> 16);
+        out[2] = (uint8_t)(word >> 8);
+        out[3] = (uint8_t)word;
+        bit_writer->out_size += 4;
+    } else {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            bit_writer_put_byte(bit_writer, (uint8_t)(word >> shift));
+        }
+    }
+}
+
+/*  function: bit_writer_flush()
+    Params:
+        BitWriter* bit_writer : 紀錄bitstream寫入的資訊
+
+    Return:
+        None
+
+    Result:
+        一張frame (或一個restart segment) 的bitstream結束時呼叫
+        1. 處理還留在accumulator的bits，最後不滿1個byte的部分向左對齊，右邊bits補1
+        2. 將out裡的所有bytes寫到檔案 (或memory buffer)
+ */
+void bit_writer_flush(BitWriter* bit_writer)
+{
+    if (bit_writer->bit_count >= 32) {
+        bit_writer_drain(bit_writer);
+    }
+
+    /* 剩下最多31 bits，補1之後最多4個bytes (加上stuffing最多8個bytes) */
+    if (bit_writer->out_size + 8 > BIT_WRITER_OUTPUT_SIZE) {
+        bit_writer_output(bit_writer);
+    }
+
+    int pad_bits = (8 - (bit_writer->bit_count & 7)) & 7;
+    bit_writer->buffer = (bit_writer->buffer << pad_bits) | ((1u << pad_bits) - 1);
+    bit_writer->bit_count += pad_bits;
+
+    while (bit_writer->bit_count > 0) {
+        bit_writer->bit_count -= 8;
+        bit_writer_put_byte(bit_writer, (uint8_t)(bit_writer->buffer >> bit_writer->bit_count));
+    }
+
+    bit_writer_output(bit_writer);
+    bit_writer->buffer = 0;
+}
+
+/*  function: bit_writer_emit()
+    Params:
+        BitWriter* bit_writer : 紀錄bitstream寫入的資訊 (輸出到檔案)
+
+    Return:
+        None
+
+    Result:
+        不等out滿，把已經轉成bytes的部分馬上寫到檔案並fflush (還在accumulator裡不滿32 bits的部分留到之後)
+        stripe模式每個block row編碼完呼叫，下游可以馬上讀到這一列的bitstream
+ */
+void bit_writer_emit(BitWriter* bit_writer)
+{
+    bit_writer_output(bit_writer);
+    if (bit_writer->fp != NULL) {
+        fflush(bit_writer->fp);
+    }
+}
+
+/*  function: bit_writer_write_marker()
+    Params:
+        BitWriter* bit_writer : 紀錄bitstream寫入的資訊
+        uint8_t marker        : marker的第二個byte (例如restart marker 0xd0~0xd7)
+
+    Return:
+        None
+
+    Result:
+        先flush前面的bits (補齊1個byte)，再寫入0xff marker (不做byte stuffing)
+        一個component scan裡的restart segments依序寫在同一個bit writer時使用
+ */
+void bit_writer_write_marker(BitWriter* bit_writer, uint8_t marker)
+{
+    bit_writer_flush(bit_writer);
+    bit_writer->out[bit_writer->out_size++] = 0xff;
+    bit_writer->out[bit_writer->out_size++] = marker;
+}
+
+/*  function: create_bit_reader()
+    Params:
+        BitReader* bit_reader : 紀錄bitstream讀取的資訊
+        const uint8_t* data   : entropy coded data (整張frame一次讀到記憶體，或是mmap)
+        size_t size           : data的bytes個數
+
+    Return:
+        得到 bit reader，用來讀取整張frame的bitstream
+
+    Result:
+ */
+void create_bit_reader(BitReader* bit_reader, const uint8_t* data, size_t size)
+{
+    bit_reader->data = data;
+    bit_reader->size = size;
+    bit_reader->pos = 0;
+    bit_reader->buffer = 0;
+    bit_reader->bit_left = 0;
+    bit_reader->pad_bits = 0;
+}
+
+/*  function: bit_reader_fill()
+    Params:
+        BitReader* bit_reader : 紀錄bitstream讀取的資訊
+
+    Return:
+        None
+
+    Result:
+        從data讀取bytes補到buffer，直到buffer至少有57個bits
+        1. 後面還有8個bytes時一次讀入，要補的bytes裡沒有0xff (大部分情況) 直接整批放到buffer
+        2. 有0xff時逐一byte處理byte stuffing情況: 0xff 0x00，丟掉0x00
+        3. data結束或遇到restart marker後補0，並記錄補了多少bits (由decoder判斷是否讀超過結尾)
+ */
+void bit_reader_fill(BitReader* bit_reader)
+{
+    int num_bytes = (BIT_READER_BUFFER_BITS - bit_reader->bit_left) >> 3;
+
+    if (bit_reader->pos + 8 <= bit_reader->size) {
+        const uint8_t* p = bit_reader->data + bit_reader->pos;
+        uint64_t word = ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) | ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+                        ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) | ((uint64_t)p[6] << 8) | (uint64_t)p[7];
+
+        /* 只看要補的num_bytes個bytes，inverted有byte是0表示word有byte是0xff */
+        uint64_t inverted = ~word | (num_bytes == 8 ? 0 : (~0ull >> (num_bytes * 8)));
+        if (((inverted - 0x0101010101010101ull) & ~inverted & 0x8080808080808080ull) == 0) {
+            if (num_bytes == 8) {
+                bit_reader->buffer = word;
+            } else {
+                bit_reader->buffer |= (word >> (64 - num_bytes * 8)) << (BIT_READER_BUFFER_BITS - num_bytes * 8 - bit_reader->bit_left);
+            }
+            bit_reader->bit_left += num_bytes * 8;
+            bit_reader->pos += num_bytes;
+            return;
+        }
+    }
+
+    while (bit_reader->bit_left <= BIT_READER_BUFFER_BITS - 8) {
+        uint64_t data = 0;
+        int is_data = 0;
+
+        if (bit_reader->pos < bit_reader->size) {
+            data = bit_reader->data[bit_reader->pos];
+            if (data != 0xff) {
+                bit_reader->pos++;
+                is_data = 1;
+            } else if (bit_reader->pos + 1 < bit_reader->size && bit_reader->data[bit_reader->pos + 1] == 0x00) {
+                // 丟掉0x00
+                bit_reader->pos += 2;
+                is_data = 1;
+            }
+            /* 0xff後面不是0x00: restart marker，停在marker前面，由bit_reader_restart()跳過 */
+        }
+
+        if (!is_data) {
+            data = 0;
+            bit_reader->pad_bits += 8;
+        }
+
+        bit_reader->buffer |= data << (BIT_READER_BUFFER_BITS - 8 - bit_reader->bit_left);
+        bit_reader->bit_left += 8;
+    }
+}
+
+/*  function: bit_reader_restart()
+    Params:
+        BitReader* bit_reader : 紀錄bitstream讀取的資訊
+        int restart_index     : 第幾個restart marker (marker是0xff 0xd0+(restart_index%8))
+
+    Return:
+        0 : 跳過marker，下一個segment從頭開始讀
+        -1: 目前的位置不是預期的restart marker
+
+    Result:
+        丟掉buffer裡剩下的bits (上一個segment最後補的1)，segment都是從byte開頭開始
+ */
+int bit_reader_restart(BitReader* bit_reader, int restart_index)
+{
+    if (bit_reader->pos + 1 >= bit_reader->size || bit_reader->data[bit_reader->pos] != 0xff ||
+        bit_reader->data[bit_reader->pos + 1] != JPEG_RST_MARKER_BASE + (restart_index & 7)) {
+        return -1;
+    }
+
+    bit_reader->pos += 2;
     bit_reader->buffer = 0;
     bit_reader->bit_left = 0;
+    bit_reader->pad_bits = 0;
+    return 0;
+}
+
+/*  function: read_remaining_file()
+    Params:
+        FILE* fp          : 檔案位置 (從目前位置開始讀)
+        uint8_t** buffer  : 存放資料的buffer (可以是NULL)，不夠大時重新配置 (由呼叫者free)
+        size_t* capacity  : buffer的大小
+        size_t* size      : 讀到的bytes個數
+
+    Return:
+        0 : 成功
+        -1: 檔案無法seek、記憶體配置失敗或讀取失敗
+
+    Result:
+        用一次fread讀取檔案剩下的所有資料，buffer可以給下一張frame重複使用
+ */
+int read_remaining_file(FILE* fp, uint8_t** buffer, size_t* capacity, size_t* size)
+{
+    long start = ftell(fp);
+    if (start < 0 || fseek(fp, 0, SEEK_END) != 0) {
+        return -1;
+    }
+    long end = ftell(fp);
+    if (end < start || fseek(fp, start, SEEK_SET) != 0) {
+        return -1;
+    }
+
+    *size = (size_t)(end - start);
+
+    /* 空的資料也配置一個byte，回傳的buffer一定不是NULL */
+    if (*buffer == NULL || *capacity < *size) {
+        uint8_t* data = (uint8_t*)malloc(*size > 0 ? *size : 1);
+        if (data == NULL) {
+            perror("Failed to allocate memory for bitstream");
+            return -1;
+        }
+        free(*buffer);
+        *buffer = data;
+        *capacity = (*size > 0) ? *size : 1;
+    }
+
+    if (fread(*buffer, 1, *size, fp) != *size) {
+        return -1;
+    }
+
+    return 0;
 }
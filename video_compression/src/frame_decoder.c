@@ -0,0 +1,394 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include"frame_decoder.h"
+
+
+/*  function: frame_decoder_find()
+    Params:
+        FrameDecoder* decoder : decoder (呼叫前已經lock mutex)
+        int frame_idx         : 第幾張frame
+
+    Return:
+        cache裡存放這張frame的位置 (可能還在解碼)，NULL表示不在cache裡
+        解碼失敗的位置不算在cache裡 (下次讀取會重新解碼)
+ */
+static CachedFrame* frame_decoder_find(FrameDecoder* decoder, int frame_idx)
+{
+    for (int i = 0; i < decoder->cache_num; i++) {
+        if (decoder->cache[i].frame_idx == frame_idx && !decoder->cache[i].failed) {
+            return &decoder->cache[i];
+        }
+    }
+    return NULL;
+}
+
+/*  function: frame_decoder_victim()
+    Params:
+        FrameDecoder* decoder : decoder (呼叫前已經lock mutex)
+        int keep_start        : [keep_start, keep_end]範圍內的frames不替換 (prefetch使用)
+        int keep_end
+
+    Return:
+        可以存放新frame的位置: 空的位置優先，否則是最久沒有使用的frame
+        NULL表示所有frames都在使用中或正在解碼 (包含解碼失敗但還有threads在等待的位置)
+ */
+static CachedFrame* frame_decoder_victim(FrameDecoder* decoder, int keep_start, int keep_end)
+{
+    CachedFrame* victim = NULL;
+
+    for (int i = 0; i < decoder->cache_num; i++) {
+        CachedFrame* entry = &decoder->cache[i];
+        if (entry->refs > 0 || !entry->ready) continue;
+        if (entry->frame_idx < 0) {
+            return entry;
+        }
+        if (entry->frame_idx >= keep_start && entry->frame_idx <= keep_end) continue;
+        if (victim == NULL || entry->last_used < victim->last_used) {
+            victim = entry;
+        }
+    }
+    return victim;
+}
+
+/*  function: frame_decoder_clear_failed()
+    Params:
+        FrameDecoder* decoder : decoder (呼叫前已經lock mutex)
+        CachedFrame* entry    : 解碼失敗的位置 (呼叫前已經放開自己的reference)
+
+    Result:
+        所有等待這張frame的threads都放開reference後，位置才變回空的，可以被替換
+ */
+static void frame_decoder_clear_failed(FrameDecoder* decoder, CachedFrame* entry)
+{
+    if (entry->refs == 0) {
+        entry->frame_idx = -1;
+        entry->failed = 0;
+        pthread_cond_broadcast(&decoder->cond);
+    }
+}
+
+/*  function: frame_decoder_decode()
+    Params:
+        FrameDecoder* decoder : decoder
+        CachedFrame* entry    : 已經標記成正在解碼的位置 (其他threads不會使用)
+        EntropyWorkspace* workspace : 這個thread使用的entropy workspace (NULL表示暫時配置一個)
+
+    Return:
+        0 : 成功
+        -1: 讀取bitstream失敗、記憶體配置失敗或解碼失敗 (header和container不同、bitstream損毀)
+
+    Result:
+        不需要lock: 從container讀取entry->frame_idx的bitstream，解碼到entry自己的frame和QuantParams
+ */
+static int frame_decoder_decode(FrameDecoder* decoder, CachedFrame* entry, EntropyWorkspace* workspace)
+{
+    const ContainerInfo* info = &decoder->container->info;
+    size_t payload_size;
+
+    if (entry->frame == NULL) {
+        if (init_yuv_frame(&entry->frame, info->format, info->width, info->height, 64) == NULL) {
+            entry->frame = NULL;
+            return -1;
+        }
+        entry->frame->y.block_info = info->block_info;
+        entry->frame->u.block_info = info->block_info;
+        entry->frame->v.block_info = info->block_info;
+        entry->quant_params.quant_type = info->quant_type;
+    }
+
+    uint8_t* payload = container_read_frame(decoder->container, entry->frame_idx, &payload_size);
+    if (payload == NULL) {
+        return -1;
+    }
+    FILE* bs_fp = fmemopen(payload, payload_size, "rb");
+    if (bs_fp == NULL) {
+        perror("Failed to open frame bitstream");
+        free(payload);
+        return -1;
+    }
+
+    int ret = decode_frame(entry->frame, decoder->pipeline_mode, decoder->transform_type, &entry->quant_params,
+                           info->compression_type, info->entropy_type, bs_fp, workspace);
+
+    fclose(bs_fp);
+    free(payload);
+    return ret;
+}
+
+/*  function: frame_decoder_prefetch()
+    Params:
+        void* arg : FrameDecoder*
+
+    Result:
+        背景的prefetch thread: 每次有新的frame被讀取，依照距離由近到遠 (同距離先往後) 解碼附近還不在cache裡的frames
+        prefetch範圍內的frames不會被替換；讀取的frame改變時，重新從新的位置開始
+ */
+static void* frame_decoder_prefetch(void* arg)
+{
+    FrameDecoder* decoder = (FrameDecoder*)arg;
+
+    pthread_mutex_lock(&decoder->mutex);
+    while (!decoder->stop) {
+        if (!decoder->prefetch_pending) {
+            pthread_cond_wait(&decoder->cond, &decoder->mutex);
+            continue;
+        }
+        decoder->prefetch_pending = 0;
+
+        int center = decoder->prefetch_center;
+        int keep_start = center - decoder->prefetch_frames;
+        int keep_end = center + decoder->prefetch_frames;
+
+        for (int i = 0; i < decoder->prefetch_frames * 2; i++) {
+            int frame_idx = center + ((i % 2 == 0) ? (i / 2 + 1) : -(i / 2 + 1));
+            if (decoder->prefetch_pending || decoder->stop) break;
+            if (frame_idx < 0 || frame_idx >= decoder->container->frames_num) continue;
+            if (frame_decoder_find(decoder, frame_idx) != NULL) continue;
+
+            CachedFrame* entry = frame_decoder_victim(decoder, keep_start, keep_end);
+            if (entry == NULL) break;
+            entry->frame_idx = frame_idx;
+            entry->ready = 0;
+            entry->failed = 0;
+            entry->refs = 0;
+            entry->last_used = decoder->clock;
+            pthread_mutex_unlock(&decoder->mutex);
+
+            int ret = frame_decoder_decode(decoder, entry, decoder->prefetch_workspace);
+
+            pthread_mutex_lock(&decoder->mutex);
+            entry->ready = 1;
+            if (ret != 0) {
+                /* prefetch thread沒有reference: 沒有threads等待時直接變回空的 */
+                entry->failed = 1;
+                frame_decoder_clear_failed(decoder, entry);
+            }
+            pthread_cond_broadcast(&decoder->cond);
+        }
+    }
+    pthread_mutex_unlock(&decoder->mutex);
+    return NULL;
+}
+
+/*  function: frame_decoder_open()
+    Params:
+        const char* container_path : container檔案的路徑
+        PipelineMode pipeline_mode : MULTI_PASS或FUSED
+        TransformType transform_type : 使用的IDCT
+        size_t cache_budget        : cache可以使用的bytes (至少放得下一張frame)
+        int prefetch_frames        : 往前/往後prefetch的frames個數 (0: 不prefetch)
+
+    Return:
+        NULL : container開啟失敗或記憶體配置失敗
+        FrameDecoder* : 可以用frame_decoder_get_frame()以任意順序讀取frames
+
+    Result:
+        cache的frames個數 = cache_budget / 一張frame使用的記憶體 (raw data + padded data)
+        呼叫前需要先初始化transform/quantization的SIMD kernels和entropy coding (和app_decode_process()相同)
+ */
+FrameDecoder* frame_decoder_open(const char* container_path, PipelineMode pipeline_mode, TransformType transform_type,
+                                 size_t cache_budget, int prefetch_frames)
+{
+    FrameDecoder* decoder = (FrameDecoder*)calloc(1, sizeof(FrameDecoder));
+    if (decoder == NULL) {
+        perror("Allocate FrameDecoder failed");
+        return NULL;
+    }
+    decoder->container = container_open(container_path);
+    if (decoder->container == NULL) {
+        free(decoder);
+        return NULL;
+    }
+    decoder->pipeline_mode = pipeline_mode;
+    decoder->transform_type = transform_type;
+    decoder->prefetch_frames = (prefetch_frames > 0) ? prefetch_frames : 0;
+
+    /* 先配置一張frame，計算一張frame使用的記憶體 */
+    const ContainerInfo* info = &decoder->container->info;
+    YUVFrame* probe;
+    if (init_yuv_frame(&probe, info->format, info->width, info->height, 64) == NULL) {
+        container_close(decoder->container);
+        free(decoder);
+        return NULL;
+    }
+    size_t frame_bytes = sizeof(YUVFrame);
+    Component* comps[3] = {&probe->y, &probe->u, &probe->v};
+    for (int c = 0; c < 3; c++) {
+        frame_bytes += (size_t)comps[c]->width * comps[c]->height;
+        frame_bytes += sizeof(int16_t) * comps[c]->padded_width * comps[c]->padded_height;
+    }
+    decoder->cache_num = (int)(cache_budget / frame_bytes);
+    if (decoder->cache_num < 1) decoder->cache_num = 1;
+    if (decoder->cache_num > decoder->container->frames_num && decoder->container->frames_num > 0) {
+        decoder->cache_num = decoder->container->frames_num;
+    }
+
+    decoder->cache = (CachedFrame*)calloc(decoder->cache_num, sizeof(CachedFrame));
+    if (decoder->cache == NULL) {
+        perror("Allocate frame cache failed");
+        free_yuv_frame(probe);
+        container_close(decoder->container);
+        free(decoder);
+        return NULL;
+    }
+    for (int i = 0; i < decoder->cache_num; i++) {
+        decoder->cache[i].frame_idx = -1;
+        decoder->cache[i].ready = 1;
+    }
+    /* 第一個位置直接使用算大小的frame */
+    decoder->cache[0].frame = probe;
+    decoder->cache[0].frame->y.block_info = info->block_info;
+    decoder->cache[0].frame->u.block_info = info->block_info;
+    decoder->cache[0].frame->v.block_info = info->block_info;
+    decoder->cache[0].quant_params.quant_type = info->quant_type;
+
+    /* prefetch thread和呼叫的thread各自一個entropy workspace (配置失敗時每張frame暫時配置) */
+    decoder->prefetch_workspace = entropy_workspace_create(info->entropy_type);
+    decoder->workspace = entropy_workspace_create(info->entropy_type);
+
+    pthread_mutex_init(&decoder->mutex, NULL);
+    pthread_cond_init(&decoder->cond, NULL);
+    if (decoder->prefetch_frames > 0 && decoder->cache_num > 1) {
+        if (pthread_create(&decoder->prefetcher, NULL, frame_decoder_prefetch, decoder) != 0) {
+            perror("Failed to create prefetch thread, decode without prefetch");
+        } else {
+            decoder->prefetcher_started = 1;
+        }
+    }
+    return decoder;
+}
+
+/*  function: frame_decoder_get_frame()
+    Params:
+        FrameDecoder* decoder : frame_decoder_open()建立的decoder
+        int frame_idx         : 第幾張frame (任意順序)
+
+    Return:
+        NULL : frame_idx超出範圍或解碼失敗
+        const YUVFrame* : 解碼後的frame (raw data是8-bit的y/u/v)，用完後呼叫frame_decoder_release_frame()
+
+    Result:
+        1. cache hit: 直接回傳 (prefetch thread正在解碼時等它完成)
+        2. cache miss: 替換最久沒有使用的frame，在呼叫的thread解碼
+        3. 通知prefetch thread解碼這張frame附近的frames
+        回傳的frame在release前不會被替換
+ */
+const YUVFrame* frame_decoder_get_frame(FrameDecoder* decoder, int frame_idx)
+{
+    CachedFrame* entry;
+    CachedFrame* victim = NULL;
+    int ret = 0;
+
+    if (frame_idx < 0 || frame_idx >= decoder->container->frames_num) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&decoder->mutex);
+    decoder->clock++;
+    /* 等待空位時其他thread可能已經開始解碼這張frame，每次醒來都重新找一次 */
+    entry = frame_decoder_find(decoder, frame_idx);
+    while (entry == NULL && (victim = frame_decoder_victim(decoder, -1, -1)) == NULL) {
+        pthread_cond_wait(&decoder->cond, &decoder->mutex);
+        entry = frame_decoder_find(decoder, frame_idx);
+    }
+    if (entry != NULL) {
+        entry->refs++;
+        while (!entry->ready) {
+            pthread_cond_wait(&decoder->cond, &decoder->mutex);
+        }
+        if (entry->failed) {
+            /* 解碼失敗: 只放開自己的reference */
+            entry->refs--;
+            frame_decoder_clear_failed(decoder, entry);
+            ret = -1;
+        } else {
+            decoder->hits++;
+        }
+    } else {
+        decoder->misses++;
+        entry = victim;
+        entry->frame_idx = frame_idx;
+        entry->ready = 0;
+        entry->failed = 0;
+        entry->refs = 1;
+        EntropyWorkspace* workspace = decoder->workspace_busy ? NULL : decoder->workspace;
+        decoder->workspace_busy = 1;
+        pthread_mutex_unlock(&decoder->mutex);
+
+        ret = frame_decoder_decode(decoder, entry, workspace);
+
+        pthread_mutex_lock(&decoder->mutex);
+        if (workspace == decoder->workspace) decoder->workspace_busy = 0;
+        entry->ready = 1;
+        if (ret != 0) {
+            /* 其他等待這張frame的threads還有reference，只放開自己的 */
+            entry->failed = 1;
+            entry->refs--;
+            frame_decoder_clear_failed(decoder, entry);
+        }
+        pthread_cond_broadcast(&decoder->cond);
+    }
+    if (ret == 0) {
+        entry->last_used = decoder->clock;
+    }
+
+    decoder->prefetch_center = frame_idx;
+    decoder->prefetch_pending = 1;
+    pthread_cond_broadcast(&decoder->cond);
+    pthread_mutex_unlock(&decoder->mutex);
+
+    return (ret == 0) ? entry->frame : NULL;
+}
+
+/*  function: frame_decoder_release_frame()
+    Params:
+        FrameDecoder* decoder : frame_decoder_open()建立的decoder
+        int frame_idx         : frame_decoder_get_frame()取得的frame
+
+    Result:
+        frame留在cache裡，沒有使用中的views時可以被替換
+ */
+void frame_decoder_release_frame(FrameDecoder* decoder, int frame_idx)
+{
+    pthread_mutex_lock(&decoder->mutex);
+    CachedFrame* entry = frame_decoder_find(decoder, frame_idx);
+    if (entry != NULL && entry->refs > 0) {
+        entry->refs--;
+        pthread_cond_broadcast(&decoder->cond);
+    }
+    pthread_mutex_unlock(&decoder->mutex);
+}
+
+/*  function: frame_decoder_close()
+    Params:
+        FrameDecoder* decoder : frame_decoder_open()建立的decoder
+
+    Result:
+        結束prefetch thread，釋放cache裡的frames、entropy workspaces和container
+ */
+void frame_decoder_close(FrameDecoder* decoder)
+{
+    if (decoder == NULL) return;
+
+    pthread_mutex_lock(&decoder->mutex);
+    decoder->stop = 1;
+    pthread_cond_broadcast(&decoder->cond);
+    pthread_mutex_unlock(&decoder->mutex);
+    if (decoder->prefetcher_started) {
+        pthread_join(decoder->prefetcher, NULL);
+    }
+
+    for (int i = 0; i < decoder->cache_num; i++) {
+        if (decoder->cache[i].frame != NULL) {
+            free_yuv_frame(decoder->cache[i].frame);
+        }
+    }
+    free(decoder->cache);
+    entropy_workspace_destroy(decoder->container->info.entropy_type, decoder->prefetch_workspace);
+    entropy_workspace_destroy(decoder->container->info.entropy_type, decoder->workspace);
+    container_close(decoder->container);
+    pthread_mutex_destroy(&decoder->mutex);
+    pthread_cond_destroy(&decoder->cond);
+    free(decoder);
+}
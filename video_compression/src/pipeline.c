@@ -0,0 +1,399 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include"yuv.h"
+#include"block.h"
+#include"transform.h"
+#include"quantization/quantization.h"
+#include"entropy/entropy.h"
+#include"entropy/jpeg/entropy_jpeg.h"
+#include"pipeline.h"
+
+
+/*  function: fused_forward_block_row()
+    Params:
+        Component* comp              : frame的y/u/v其中一個component
+        int is_chroma                : 0: Y component 1: U/V component
+        TransformType transform_type : 8x8 block使用reference或是整數fast DCT
+        QuantParams* quant_params    : 量化的方式和參數
+        int block_row                : 第幾個block row
+        JpegBlockCoeffs* row_blocks  : 儲存這個block row每個block做完zigzag scan後的DC/AC
+
+    Return:
+        得到一個block row每個block的量化係數 (zigzag順序)
+
+    Result:
+        1. 從raw data讀取一塊tile (一個block row裡水平相鄰的幾個blocks)，做128-shift
+        2. 對tile做DCT、量化
+        3. 直接以zigzag順序寫到JpegBlockCoeffs
+        tile只有1KB，所有stage都在L1裡完成，不需要經過整張frame的padded data
+ */
+void fused_forward_block_row(Component* comp, int is_chroma, TransformType transform_type, QuantParams* quant_params,
+                             int block_row, JpegBlockCoeffs* row_blocks)
+{
+    int16_t tile[8 * FUSED_TILE_WIDTH] __attribute__((aligned(64)));
+    int b_width = comp->block_info.width;
+    int b_height = comp->block_info.height;
+    int row = block_row * b_height;
+
+    for (int col = 0; col < comp->padded_width; col += FUSED_TILE_WIDTH) {
+        int tile_width = comp->padded_width - col;
+        if (tile_width > FUSED_TILE_WIDTH) tile_width = FUSED_TILE_WIDTH;
+        int num_blocks = tile_width / b_width;
+
+        shift_128_tile(comp, row, col, b_height, tile_width, tile, FUSED_TILE_WIDTH);
+        forward_transform_blocks(tile, FUSED_TILE_WIDTH, num_blocks, comp->block_info.b_size, transform_type);
+        quantize_blocks(tile, FUSED_TILE_WIDTH, num_blocks, comp->block_info.b_size, is_chroma, quant_params);
+
+        for (int i = 0; i < num_blocks; i++) {
+            zigzag_scan(tile + i * b_width, b_height, b_width, FUSED_TILE_WIDTH, &row_blocks[col / b_width + i]);
+        }
+    }
+}
+
+/*  function: fused_forward_component()
+    Params:
+        Component* comp              : frame的y/u/v其中一個component
+        int is_chroma                : 0: Y component 1: U/V component
+        TransformType transform_type : 8x8 block使用reference或是整數fast DCT
+        QuantParams* quant_params    : 量化的方式和參數
+        JpegBlockCoeffs* blocks      : 儲存component每個block做完zigzag scan後的DC/AC
+
+    Return:
+        得到component每個block的量化係數 (zigzag順序)
+
+    Result:
+        每個block row各自做fused forward
+ */
+void fused_forward_component(Component* comp, int is_chroma, TransformType transform_type, QuantParams* quant_params, JpegBlockCoeffs* blocks)
+{
+    int blocks_per_row = comp->padded_width / comp->block_info.width;
+    int block_rows = comp->padded_height / comp->block_info.height;
+
+    for (int block_row = 0; block_row < block_rows; block_row++) {
+        fused_forward_block_row(comp, is_chroma, transform_type, quant_params, block_row, blocks + block_row * blocks_per_row);
+    }
+}
+
+/* fused pipeline對一個component做forward/inverse需要的資訊 */
+typedef struct {
+    YUVFrame* frame;
+    TransformType transform_type;
+    QuantParams* quant_params;
+    JpegBlockCoeffs* blocks[JPEG_COMPONENTS_NUM];
+}FusedComponentArgs;
+
+/*  function: fused_component()
+    Params:
+        YUVFrame* frame : frame
+        int component   : JPEG_COMPONENT_Y/U/V
+
+    Return:
+        frame裡對應的component
+ */
+Component* fused_component(YUVFrame* frame, int component)
+{
+    if (component == JPEG_COMPONENT_Y) return &frame->y;
+    if (component == JPEG_COMPONENT_U) return &frame->u;
+    return &frame->v;
+}
+
+/*  function: fused_forward_prepare()
+    Params:
+        void* arg     : FusedComponentArgs*
+        int component : JPEG_COMPONENT_Y/U/V
+
+    Result:
+        entropy_encode_jpeg_coeffs()的JpegComponentPrepare，Y/U/V在不同threads各自做fused forward
+ */
+void fused_forward_prepare(void* arg, int component)
+{
+    FusedComponentArgs* args = (FusedComponentArgs*)arg;
+
+    fused_forward_component(fused_component(args->frame, component), component != JPEG_COMPONENT_Y, args->transform_type,
+                            args->quant_params, args->blocks[component]);
+}
+
+/*  function: encode_frame_fused()
+    Params:
+        同encode_frame() (workspace不會是NULL)
+
+    Return:
+        0 : 成功
+        -1: 記憶體配置失敗
+
+    Result:
+        對y/u/v各自做fused forward (交給entropy coding的thread pool平行處理)，得到zigzag順序的量化係數後做entropy coding
+ */
+int encode_frame_fused(YUVFrame* frame, TransformType transform_type, QuantParams* quant_params,
+                       CompressionType compression_type, EntropyType entropy_type, FILE* bitstream_fp, EntropyWorkspace* workspace)
+{
+    /* 係數放在workspace (有任何一個component配置記憶體失敗，則不會繼續做壓縮) */
+    if (jpeg_workspace_reserve(workspace, frame, 1) != 0) {
+        return -1;
+    }
+
+    /* 量化表需要的參數每張frame只準備一次 */
+    quantize_prepare(quant_params);
+
+    FusedComponentArgs args = { frame, transform_type, quant_params,
+                                {workspace->blocks[JPEG_COMPONENT_Y], workspace->blocks[JPEG_COMPONENT_U], workspace->blocks[JPEG_COMPONENT_V]} };
+    return entropy_encode_jpeg_coeffs(frame, workspace, quant_params, compression_type, entropy_type, bitstream_fp,
+                                      fused_forward_prepare, &args);
+}
+
+/*  function: stripe_forward_row()
+    Params:
+        void* arg                   : FusedComponentArgs* (只使用frame/transform_type/quant_params)
+        int component               : JPEG_COMPONENT_Y/U/V
+        int block_row               : 第幾個block row
+        JpegBlockCoeffs* row_blocks : 儲存這個block row的係數
+
+    Result:
+        entropy_encode_jpeg_stripes()的JpegRowPrepare，需要下一個block row時才做fused forward
+ */
+void stripe_forward_row(void* arg, int component, int block_row, JpegBlockCoeffs* row_blocks)
+{
+    FusedComponentArgs* args = (FusedComponentArgs*)arg;
+
+    fused_forward_block_row(fused_component(args->frame, component), component != JPEG_COMPONENT_Y, args->transform_type,
+                            args->quant_params, block_row, row_blocks);
+}
+
+/*  function: encode_frame_stripes()
+    Params:
+        同encode_frame()
+
+    Return:
+        0 : 成功
+        -1: 記憶體配置失敗
+
+    Result:
+        以block row為單位做完shift/DCT/量化/zigzag/DPCM/RLE/Huffman，每個Y block row編碼完就寫出
+        記憶體只有每個component一列blocks的係數 (1080p時約60KB)，不需要整張frame的係數
+ */
+int encode_frame_stripes(YUVFrame* frame, TransformType transform_type, QuantParams* quant_params,
+                         CompressionType compression_type, EntropyType entropy_type, FILE* bitstream_fp)
+{
+    /* 量化表需要的參數每張frame只準備一次 */
+    quantize_prepare(quant_params);
+
+    FusedComponentArgs args = { frame, transform_type, quant_params, {NULL, NULL, NULL} };
+    return entropy_encode_jpeg_stripes(frame, quant_params, compression_type, entropy_type, bitstream_fp, stripe_forward_row, &args);
+}
+
+/*  function: encode_frame()
+    Params:
+        YUVFrame* frame                  : yuv raw data frame
+        PipelineMode pipeline_mode       : multi-pass或fused
+        TransformType transform_type     : 使用reference或是整數fast DCT
+        QuantParams* quant_params        : 量化的方式和參數
+        CompressionType compression_type : 壓縮的方式
+        EntropyType entropy_type         : entropy coding的方式
+        FILE* bitstream_fp               : 寫入bitstream的檔案 (由呼叫者開啟/關閉)
+        EntropyWorkspace* workspace      : 呼叫者的entropy workspace，同一個context的frames重複使用 (NULL表示這張frame暫時配置一個)
+
+    Return:
+        0 : 成功
+        -1: 記憶體配置失敗或沒有支援的壓縮方式 (bitstream不能使用)
+
+    Result:
+        1. PIPELINE_MULTI_PASS : DCT forward --> quantization --> entropy encoding，每個stage走過整張frame
+        2. PIPELINE_FUSED      : 以tile為單位做完DCT、quantization和zigzag scan，再做entropy encoding
+        3. PIPELINE_STRIPE     : 以block row為單位做完所有stage (包含Huffman encode) 就寫出，使用標準Huffman tables
+        前兩種方式的bitstream完全相同
+ */
+int encode_frame(YUVFrame* frame, PipelineMode pipeline_mode, TransformType transform_type, QuantParams* quant_params,
+                 CompressionType compression_type, EntropyType entropy_type, FILE* bitstream_fp, EntropyWorkspace* workspace)
+{
+    int ret;
+
+    /* stripe只需要一列blocks的係數，不使用workspace */
+    if (pipeline_mode == PIPELINE_STRIPE && compression_type == JPEG_SEQUENTIAL) {
+        return encode_frame_stripes(frame, transform_type, quant_params, compression_type, entropy_type, bitstream_fp);
+    }
+
+    EntropyWorkspace* frame_workspace = (workspace != NULL) ? workspace : entropy_workspace_create(entropy_type);
+    if (frame_workspace == NULL) {
+        return -1;
+    }
+
+    if (pipeline_mode == PIPELINE_FUSED && compression_type == JPEG_SEQUENTIAL) {
+        ret = encode_frame_fused(frame, transform_type, quant_params, compression_type, entropy_type, bitstream_fp, frame_workspace);
+    } else {
+        /* DCT forward */
+        transform_frame(frame, transform_type);
+
+        /* Quantization forward */
+        quantize_frame(frame, quant_params);
+
+        /* Entropy encoding */
+        ret = entropy_encode(frame, quant_params, compression_type, entropy_type, bitstream_fp, frame_workspace);
+    }
+
+    if (workspace == NULL) {
+        entropy_workspace_destroy(entropy_type, frame_workspace);
+    }
+    return ret;
+}
+
+
+/*  function: fused_inverse_component()
+    Params:
+        Component* comp              : frame的y/u/v其中一個component
+        int is_chroma                : 0: Y component 1: U/V component
+        TransformType transform_type : 8x8 block使用reference或是整數fast IDCT
+        QuantParams* quant_params    : 量化的方式和參數
+        JpegBlockCoeffs* blocks      : component每個block解碼後的DC/AC (zigzag順序)
+        int block_start              : 第一個要重建的block (raster順序)
+        int block_end                : 最後一個要重建的block + 1
+
+    Return:
+        將重建的pixels寫到component的raw data (uint8)
+
+    Result:
+        1. 對一塊tile的每個block做reverse zigzag scan，並由eob得到block的sparsity
+        2. 對tile做反量化、IDCT (DC-only和低頻blocks使用較小的kernel)
+        3. +128位移、限制在[0,255]，直接寫到raw data
+        tile只有1KB，不需要經過整張frame的padded data
+        blocks範圍可以從block row中間開始 (restart segment解碼完就可以重建)，不同範圍寫到不重疊的pixels
+ */
+void fused_inverse_component(Component* comp, int is_chroma, TransformType transform_type, QuantParams* quant_params, JpegBlockCoeffs* blocks,
+                             int block_start, int block_end)
+{
+    int16_t tile[8 * FUSED_TILE_WIDTH] __attribute__((aligned(64)));
+    BlockSparsity sparsity[FUSED_TILE_WIDTH / 4];
+    int b_width = comp->block_info.width;
+    int b_height = comp->block_info.height;
+    int blocks_per_row = comp->padded_width / b_width;
+    int visible_block_cols = (comp->width + b_width - 1) / b_width;
+    int visible_block_rows = (comp->height + b_height - 1) / b_height;
+    int tile_blocks = FUSED_TILE_WIDTH / b_width;
+
+    /* padding的blocks不會被輸出，不需要重建 */
+    for (int block_row = block_start / blocks_per_row; block_row < visible_block_rows; block_row++) {
+        int row_start = block_row * blocks_per_row;
+        if (row_start >= block_end) break;
+
+        int col_start = (block_start > row_start) ? block_start - row_start : 0;
+        int col_end = (block_end - row_start < visible_block_cols) ? block_end - row_start : visible_block_cols;
+        JpegBlockCoeffs* row_blocks = blocks + row_start;
+
+        for (int block_col = col_start; block_col < col_end; block_col += tile_blocks) {
+            int num_blocks = (col_end - block_col < tile_blocks) ? col_end - block_col : tile_blocks;
+
+            for (int i = 0; i < num_blocks; i++) {
+                JpegBlockCoeffs* jpeg_block = &row_blocks[block_col + i];
+                inverse_zigzag_scan(tile + i * b_width, b_height, b_width, FUSED_TILE_WIDTH, jpeg_block);
+                sparsity[i] = jpeg_block_sparsity(jpeg_block, b_width);
+            }
+            dequantize_blocks(tile, FUSED_TILE_WIDTH, num_blocks, comp->block_info.b_size, is_chroma, quant_params);
+            inverse_transform_sparse_blocks(tile, FUSED_TILE_WIDTH, num_blocks, sparsity, comp->block_info.b_size, transform_type);
+            unshift_128_tile(comp, block_row * b_height, block_col * b_width, b_height, num_blocks * b_width, tile, FUSED_TILE_WIDTH);
+        }
+    }
+}
+
+/*  function: fused_inverse_blocks()
+    Params:
+        void* arg       : FusedComponentArgs*
+        int component   : JPEG_COMPONENT_Y/U/V
+        int block_start : 第一個解碼完成的block
+        int block_end   : 最後一個解碼完成的block + 1
+
+    Result:
+        entropy_decode_jpeg_coeffs()的JpegBlocksDecoded，restart segment (或component scan) 解碼完後
+        在同一個thread做fused inverse，係數還在cache裡
+ */
+void fused_inverse_blocks(void* arg, int component, int block_start, int block_end)
+{
+    FusedComponentArgs* args = (FusedComponentArgs*)arg;
+
+    fused_inverse_component(fused_component(args->frame, component), component != JPEG_COMPONENT_Y, args->transform_type,
+                            args->quant_params, args->blocks[component], block_start, block_end);
+}
+
+/*  function: decode_frame_fused()
+    Params:
+        同decode_frame() (workspace不會是NULL)
+
+    Return:
+        0 : 解碼成功
+        -1: 記憶體配置失敗、header和設定不同、或是bitstream損毀
+
+    Result:
+        entropy decoding每解碼完一段blocks (整張frame、一個restart segment或一個component scan)，就做fused inverse
+ */
+int decode_frame_fused(YUVFrame* frame, TransformType transform_type, QuantParams* quant_params,
+                       CompressionType compression_type, EntropyType entropy_type, FILE* bitstream_fp, EntropyWorkspace* workspace)
+{
+    /* 係數放在workspace (有任何一個component配置記憶體失敗，則不會繼續做解碼) */
+    if (jpeg_workspace_reserve(workspace, frame, 0) != 0) {
+        return -1;
+    }
+
+    /* 量化表從header取得後由entropy_decode_jpeg_coeffs()準備，再呼叫fused_inverse_blocks() */
+    FusedComponentArgs args = { frame, transform_type, quant_params,
+                                {workspace->blocks[JPEG_COMPONENT_Y], workspace->blocks[JPEG_COMPONENT_U], workspace->blocks[JPEG_COMPONENT_V]} };
+    return entropy_decode_jpeg_coeffs(frame, workspace, quant_params, compression_type, entropy_type, bitstream_fp,
+                                      fused_inverse_blocks, &args);
+}
+
+/*  function: decode_frame()
+    Params:
+        YUVFrame* frame                  : 存放解碼結果的frame
+        PipelineMode pipeline_mode       : multi-pass或fused
+        TransformType transform_type     : 使用reference或是整數fast IDCT
+        QuantParams* quant_params        : 量化的方式 (QP和量化表從header取得)
+        CompressionType compression_type : 壓縮的方式
+        EntropyType entropy_type         : entropy coding的方式
+        FILE* bitstream_fp               : 讀取bitstream的檔案 (由呼叫者開啟/關閉)
+        EntropyWorkspace* workspace      : 呼叫者的entropy workspace，同一個context的frames重複使用 (NULL表示這張frame暫時配置一個)
+
+    Return:
+        0 : 解碼成功
+        -1: 記憶體配置失敗、header和設定不同、或是bitstream損毀 (raw data的內容不能使用)
+
+    Result:
+        解碼後的8-bit pixels放在frame的raw data (可以重複使用，不需要每張frame配置記憶體)
+        1. PIPELINE_MULTI_PASS : entropy decoding --> de-quantization --> IDCT --> unshift，每個stage走過整張frame
+        2. PIPELINE_FUSED      : 以tile為單位做完reverse zigzag、de-quantization、IDCT、unshift，直接寫到raw data
+           (PIPELINE_STRIPE的bitstream是一般的格式，解碼和FUSED相同)
+        兩種方式的結果完全相同
+ */
+int decode_frame(YUVFrame* frame, PipelineMode pipeline_mode, TransformType transform_type, QuantParams* quant_params,
+                 CompressionType compression_type, EntropyType entropy_type, FILE* bitstream_fp, EntropyWorkspace* workspace)
+{
+    EntropyWorkspace* frame_workspace = (workspace != NULL) ? workspace : entropy_workspace_create(entropy_type);
+    int ret;
+
+    if (frame_workspace == NULL) {
+        return -1;
+    }
+
+    if ((pipeline_mode == PIPELINE_FUSED || pipeline_mode == PIPELINE_STRIPE) && compression_type == JPEG_SEQUENTIAL) {
+        ret = decode_frame_fused(frame, transform_type, quant_params, compression_type, entropy_type, bitstream_fp, frame_workspace);
+    } else {
+        /* entropy decoding :
+            檢查bitstream解碼出來的資訊是不是和設定檔相同
+            不相同則不會繼續解碼
+         */
+        ret = entropy_decode(frame, quant_params, compression_type, entropy_type, bitstream_fp, frame_workspace);
+
+        if (ret == 0) {
+            /* de-quantization */
+            dequantize_frame(frame, quant_params);
+
+            /* transform backward */
+            reverse_transform_frame(frame, transform_type);
+
+            /* 將padded data轉回8-bit raw data */
+            copy_padded_to_raw(frame);
+        }
+    }
+
+    if (workspace == NULL) {
+        entropy_workspace_destroy(entropy_type, frame_workspace);
+    }
+    return ret;
+}
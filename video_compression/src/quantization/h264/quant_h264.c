@@ -0,0 +1,227 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include"quantization/h264/quant_h264.h"
+#include"yuv.h"
+#include"block.h"
+
+/* 4x4 block的quantization參數 (H.264 intra): qbits = 15 + QP/6，rounding offset f = 2^qbits / 3 */
+#define H264_QBITS_4x4    15
+
+/* 8x8 block是正規化(orthonormal)的DCT，只需要除以Qstep
+ *   Qstep(QP) = base(QP%6) * 2^(QP/6)，base = {0.625, 0.6875, 0.8125, 0.875, 1.0, 1.125}
+ *   quant  : MF = round(2^16 / base)
+ *   dequant: base * 16 = {10, 11, 13, 14, 16, 18} (剛好等於4x4 dequant表的第0類)
+ */
+#define H264_QBITS_8x8    16
+static const int32_t h264_quant_mf_8x8[6] = {104858, 95325, 80660, 74898, 65536, 58254};
+
+/* JPEG Huffman table的AC係數最多只有10 bits (category 10)，DC差值最多11 bits
+ * 所以量化後的level限制在[-1023, 1023]，避免QP很小的時候超出Huffman table的範圍
+ */
+#define H264_MAX_LEVEL    1023
+
+
+/*  function: h264_coeff_class()
+    Params:
+        int row : 係數在4x4 block的row
+        int col : 係數在4x4 block的col
+
+    Return:
+        係數位置對應到MF/V表的哪一個類別
+ */
+static inline int h264_coeff_class(int row, int col)
+{
+    if ((row % 2 == 0) && (col % 2 == 0)) return 0;
+    if ((row % 2 == 1) && (col % 2 == 1)) return 1;
+    return 2;
+}
+
+static inline int32_t h264_clip_level(int32_t level)
+{
+    return (level > H264_MAX_LEVEL) ? H264_MAX_LEVEL : level;
+}
+
+
+/*  function: h264_block_quant_4x4()
+    Params:
+        int16_t* block   : frame在core transform後的padded data裡的一塊4x4 block
+        int padded_width : padded data的width
+        int qp           : quantization parameter
+
+    Return:
+        對4x4 block做H.264 quantization的結果
+
+    Result:
+        level = sign(W) * ((|W| * MF(QP%6, pos) + f) >> (15 + QP/6))，只使用整數乘法和shift
+ */
+void h264_block_quant_4x4(int16_t* block, int padded_width, int qp)
+{
+    const int32_t* mf = h264_quant_mf_table[qp % 6];
+    int qbits = H264_QBITS_4x4 + qp / 6;
+    int32_t f = (1 << qbits) / 3;
+
+    for (int row = 0; row < 4; row++) {
+        for (int col = 0; col < 4; col++) {
+            int32_t coeff = block[row * padded_width + col];
+            int32_t level = h264_clip_level((abs(coeff) * mf[h264_coeff_class(row, col)] + f) >> qbits);
+            block[row * padded_width + col] = (int16_t)((coeff < 0) ? -level : level);
+        }
+    }
+}
+
+/*  function: h264_block_dequant_4x4()
+    Params:
+        int16_t* block   : 一塊4x4 block的量化係數
+        int padded_width : padded data的width
+        int qp           : quantization parameter
+
+    Return:
+        反量化後的係數: W' = level * V(QP%6, pos) * 2^(QP/6) (level可能是負數，不使用<<)
+        (V已經包含idct_block_4x4()最後除以64需要的scale)
+ */
+void h264_block_dequant_4x4(int16_t* block, int padded_width, int qp)
+{
+    const int32_t* v = h264_dequant_v_table[qp % 6];
+    int shift = qp / 6;
+
+    for (int row = 0; row < 4; row++) {
+        for (int col = 0; col < 4; col++) {
+            int32_t level = block[row * padded_width + col];
+            block[row * padded_width + col] = (int16_t)(level * v[h264_coeff_class(row, col)] * (1 << shift));
+        }
+    }
+}
+
+/*  function: h264_block_quant_8x8()
+    Params:
+        int16_t* block   : frame在DCT後的padded data裡的一塊8x8 block
+        int padded_width : padded data的width
+        int qp           : quantization parameter
+
+    Return:
+        對8x8 block做flat Qstep的quantization結果
+
+    Result:
+        level = sign(c) * ((|c| * MF(QP%6) + f) >> (16 + QP/6))
+ */
+void h264_block_quant_8x8(int16_t* block, int padded_width, int qp)
+{
+    int32_t mf = h264_quant_mf_8x8[qp % 6];
+    int qbits = H264_QBITS_8x8 + qp / 6;
+    int32_t f = (1 << qbits) / 3;
+
+    for (int row = 0; row < 8; row++) {
+        for (int col = 0; col < 8; col++) {
+            int32_t coeff = block[row * padded_width + col];
+            int32_t level = h264_clip_level((abs(coeff) * mf + f) >> qbits);
+            block[row * padded_width + col] = (int16_t)((coeff < 0) ? -level : level);
+        }
+    }
+}
+
+/*  function: h264_block_dequant_8x8()
+    Params:
+        int16_t* block   : 一塊8x8 block的量化係數
+        int padded_width : padded data的width
+        int qp           : quantization parameter
+
+    Return:
+        反量化後的係數: c' = (level * 16*base(QP%6) * 2^(QP/6) + 8) >> 4
+ */
+void h264_block_dequant_8x8(int16_t* block, int padded_width, int qp)
+{
+    int32_t v = h264_dequant_v_table[qp % 6][0];
+    int shift = qp / 6;
+
+    for (int row = 0; row < 8; row++) {
+        for (int col = 0; col < 8; col++) {
+            int32_t level = block[row * padded_width + col];
+            block[row * padded_width + col] = (int16_t)(((level * v * (1 << shift)) + 8) >> 4);
+        }
+    }
+}
+
+/*  function: h264_quant_blocks()
+    Params:
+        int16_t* blocks  : 水平相鄰的num_blocks個blocks (transform後的係數)
+        int stride       : blocks所在buffer的width
+        int num_blocks   : block個數
+        BlockSize b_size : 4x4或8x8 block
+        int qp           : quantization parameter
+
+    Return:
+        對每個block做H.264 quantization的結果
+ */
+void h264_quant_blocks(int16_t* blocks, int stride, int num_blocks, BlockSize b_size, int qp)
+{
+    for (int i = 0; i < num_blocks; i++) {
+        if (b_size == BLOCK_4x4) {
+            h264_block_quant_4x4(blocks + i * 4, stride, qp);
+        } else {
+            h264_block_quant_8x8(blocks + i * 8, stride, qp);
+        }
+    }
+}
+
+void h264_dequant_blocks(int16_t* blocks, int stride, int num_blocks, BlockSize b_size, int qp)
+{
+    for (int i = 0; i < num_blocks; i++) {
+        if (b_size == BLOCK_4x4) {
+            h264_block_dequant_4x4(blocks + i * 4, stride, qp);
+        } else {
+            h264_block_dequant_8x8(blocks + i * 8, stride, qp);
+        }
+    }
+}
+
+/*  function: h264_component_quant()
+    Params:
+        Component* comp : y/u/v其中一個component
+        int qp          : quantization parameter
+
+    Return:
+        對component的每個block做H.264 quantization的結果
+ */
+void h264_component_quant(Component* comp, int qp)
+{
+    for (int row = 0; row < comp->padded_height; row += comp->block_info.height) {
+        h264_quant_blocks(comp->padded_data + row * comp->padded_width, comp->padded_width,
+                          comp->padded_width / comp->block_info.width, comp->block_info.b_size, qp);
+    }
+}
+
+void h264_component_dequant(Component* comp, int qp)
+{
+    for (int row = 0; row < comp->padded_height; row += comp->block_info.height) {
+        h264_dequant_blocks(comp->padded_data + row * comp->padded_width, comp->padded_width,
+                            comp->padded_width / comp->block_info.width, comp->block_info.b_size, qp);
+    }
+}
+
+/*  function: h264_quant()
+    Params:
+        YUVFrame* frame : yuv raw data frame
+        int qp          : quantization parameter (0~51)，每增加6，Qstep變成2倍
+
+    Return:
+        對padded data做H.264 quantization的結果
+
+    Result:
+        1. 4x4 block使用H.264的MF表 (包含core transform的scale)
+        2. 8x8 block使用flat Qstep (DCT已經正規化)
+        3. y/u/v使用相同的QP
+ */
+void h264_quant(YUVFrame* frame, int qp)
+{
+    h264_component_quant(&frame->y, qp);
+    h264_component_quant(&frame->u, qp);
+    h264_component_quant(&frame->v, qp);
+}
+
+void h264_dequant(YUVFrame* frame, int qp)
+{
+    h264_component_dequant(&frame->y, qp);
+    h264_component_dequant(&frame->u, qp);
+    h264_component_dequant(&frame->v, qp);
+}
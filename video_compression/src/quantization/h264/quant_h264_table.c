@@ -0,0 +1,33 @@
+#include<stdint.h>
+
+/* 統一將table放在這裡，避免使用static浪費記憶體空間 
+ * 如果單獨放在.h，這樣需要在前面加上static，這樣會讓所有include .h的地方都放置一份
+ */
+
+/* H.264 4x4 quantization/dequantization表 (來源: H.264/AVC標準, Richardson "The H.264 Advanced Video Compression Standard")
+ *  row: QP % 6
+ *  col: 係數位置的類別
+ *       0 : (0,0) (0,2) (2,0) (2,2)
+ *       1 : (1,1) (1,3) (3,1) (3,3)
+ *       2 : 其他位置
+ */
+
+// Multiplication factor (MF) : 包含core transform的scale和Qstep，MF = scale * 2^(15+QP/6) / Qstep
+const int32_t h264_quant_mf_table[6][3] = {
+    {13107, 5243, 8066},
+    {11916, 4660, 7490},
+    {10082, 4194, 6554},
+    { 9362, 3647, 5825},
+    { 8192, 3355, 5243},
+    { 7282, 2893, 4559}
+};
+
+// Dequantization scale (V) : V = scale * Qstep * 64 (QP/6的部分用左移)
+const int32_t h264_dequant_v_table[6][3] = {
+    {10, 16, 13},
+    {11, 18, 14},
+    {13, 20, 16},
+    {14, 23, 18},
+    {16, 25, 20},
+    {18, 29, 23}
+};
@@ -2,116 +2,259 @@
 #include<stdlib.h>
 #include<math.h>
 #include<stdint.h>
+#include<string.h>
 #include"quantization/jpeg/quant_jpeg.h"
+#include"quantization/quant_simd.h"
 #include"yuv.h"
+#include"block.h"
 
+/* 4x4 block的quantization/dequantization fixed-point參數 */
+#define QUANT_4x4_BITS    18  // quantization multiplication factor的小數bits
+#define DEQUANT_4x4_BITS  6   // dequantization scale的小數bits
 
-/*  function: jpeg_standard_block_luminance_quant()
+/* H.264 4x4 core transform沒有normalize，每個位置需要補上的scale (a=1/2, b=sqrt(2/5))
+ *   forward: 偶數row/偶數col = a^2，奇數row/奇數col = b^2/4，其他 = ab/2
+ *   inverse: 偶數row/偶數col = a^2，奇數row/奇數col = b^2，  其他 = ab
+ *   inverse還要再乘64，配合idct_block_4x4()最後的除以64
+ */
+
+
+/*  function: jpeg_quant_scale_tables()
     Params:
-        int16_t* block   : frame在DCT後的padded data裡的一塊block
-        int b_height     : block height
-        int b_width      : block width
-        int padded_width : padded data的width
+        int quality                 : 1~100，數字越大畫質越好 (50為JPEG標準量化表)
+        uint8_t* luminance_table    : 縮放後的Y量化表
+        uint8_t* chrominance_table  : 縮放後的UV量化表
 
     Return:
-        對Y padded data做jpeg standard quantization的結果
+        None
 
     Result:
-        對frame的Y padded buffer的blocks各自做jpeg standard quantization的結果
+        和libjpeg相同的縮放方式:
+           quality < 50 : scale = 5000 / quality
+           quality >= 50: scale = 200 - 2 * quality
+           step = (base * scale + 50) / 100，限制在[1,255] (baseline JPEG只允許8-bit量化表)
  */
-void jpeg_standard_block_luminance_quant(int16_t* block, int b_height, int b_width, int padded_width)
+void jpeg_quant_scale_tables(int quality, uint8_t* luminance_table, uint8_t* chrominance_table)
 {
-    /* 使用Y的quantization table對block的係數做量化 */
-    for (int row = 0; row < b_height; row++) {
-        for (int col = 0; col < b_width; col++) {
-            /* 標準JPEG量化方式: DCT_coef./step_size */
-            block[row * padded_width + col] = (int16_t)round(block[row * padded_width + col] / jpeg_luminance_quant_table[row * b_width + col]);
-        }
+    int scale;
+
+    if (quality <= 0) quality = 1;
+    if (quality > 100) quality = 100;
+    scale = (quality < 50) ? (5000 / quality) : (200 - quality * 2);
+
+    for (int i = 0; i < 64; i++) {
+        long y_step = ((long)jpeg_luminance_quant_table[i] * scale + 50) / 100;
+        long uv_step = ((long)jpeg_chrominance_quant_table[i] * scale + 50) / 100;
+
+        if (y_step < 1) y_step = 1;
+        else if (y_step > 255) y_step = 255;
+        if (uv_step < 1) uv_step = 1;
+        else if (uv_step > 255) uv_step = 255;
+
+        luminance_table[i] = (uint8_t)y_step;
+        chrominance_table[i] = (uint8_t)uv_step;
     }
 }
 
-void jpeg_standard_block_chrominance_quant(int16_t* block, int b_height, int b_width, int padded_width)
+
+/*  function: jpeg_quant_prepare()
+    Params:
+        QuantParams* quant_params : 使用的Y/UV量化表
+
+    Return:
+        None
+
+    Result:
+        1. 8x8 block: 建立每個step size的reciprocal，量化變成乘法和shift
+        2. 4x4 block: 4-point DCT的第k個頻率約等於8-point DCT的第2k個頻率，因此取8x8量化表的偶數row/col
+           根據4x4量化表和core transform的scale，建立quantization的multiplication factor (MF)
+           MF = round(forward_scale * 2^QUANT_4x4_BITS / step_size)
+           dequantization的scale: round(inverse_scale * 64 * 2^DEQUANT_4x4_BITS) * step_size
+        3. 結果存在quant_params->prepared，量化表和上次相同時不需要重新計算
+           (沒有共用的static狀態，不同的QuantParams可以在不同threads同時使用)
+ */
+void jpeg_quant_prepare(QuantParams* quant_params)
 {
-    /* 使用UV的quantization table對block的係數做量化 */
-    for (int row = 0; row < b_height; row++) {
-        for (int col = 0; col < b_width; col++) {
-            /* 標準JPEG量化方式: DCT_coef./step_size */
-            block[row * padded_width + col] = (int16_t)round(block[row * padded_width + col] / jpeg_chrominance_quant_table[row * b_width + col]);
+    const double a = 0.5;
+    const double b = sqrt(2.0 / 5.0);
+    JpegQuantPrepared* prepared = &quant_params->prepared;
+
+    if (prepared->prepared &&
+        memcmp(prepared->luminance_table, quant_params->luminance_table, 64) == 0 &&
+        memcmp(prepared->chrominance_table, quant_params->chrominance_table, 64) == 0) {
+        return;
+    }
+    memcpy(prepared->luminance_table, quant_params->luminance_table, 64);
+    memcpy(prepared->chrominance_table, quant_params->chrominance_table, 64);
+
+    quant_divisors_init(&prepared->luminance_divisors, prepared->luminance_table);
+    quant_divisors_init(&prepared->chrominance_divisors, prepared->chrominance_table);
+
+    for (int row = 0; row < 4; row++) {
+        for (int col = 0; col < 4; col++) {
+            int pos = row * 4 + col;
+            int y_step = prepared->luminance_table[(row * 2) * 8 + col * 2];
+            int uv_step = prepared->chrominance_table[(row * 2) * 8 + col * 2];
+            double forward_scale, inverse_scale;
+
+            if ((row % 2 == 0) && (col % 2 == 0)) {
+                forward_scale = a * a;
+                inverse_scale = a * a;
+            } else if ((row % 2 == 1) && (col % 2 == 1)) {
+                forward_scale = b * b / 4.0;
+                inverse_scale = b * b;
+            } else {
+                forward_scale = a * b / 2.0;
+                inverse_scale = a * b;
+            }
+
+            prepared->luminance_quant_mf_4x4[pos] = (int32_t)round(forward_scale * (1 << QUANT_4x4_BITS) / y_step);
+            prepared->chrominance_quant_mf_4x4[pos] = (int32_t)round(forward_scale * (1 << QUANT_4x4_BITS) / uv_step);
+            prepared->luminance_dequant_4x4[pos] = (int32_t)round(inverse_scale * 64 * (1 << DEQUANT_4x4_BITS)) * y_step;
+            prepared->chrominance_dequant_4x4[pos] = (int32_t)round(inverse_scale * 64 * (1 << DEQUANT_4x4_BITS)) * uv_step;
         }
     }
+    prepared->prepared = 1;
 }
 
-/*  function: jpeg_standard_quant()
+/*  function: jpeg_block_quant_4x4()
     Params:
-        YUVFrame* frame : yuv raw data frame
+        int16_t* block    : frame在core transform後的padded data裡的一塊4x4 block
+        int padded_width  : padded data的width
+        const int32_t* mf : 每個位置的multiplication factor
 
     Return:
-        對padded data做jpeg standard quantization的結果
+        對4x4 block做quantization的結果
 
     Result:
-        對frame的padded buffer的blocks各自做jpeg standard quantization的結果
+        level = sign(W) * ((|W| * MF + 2^(QUANT_4x4_BITS-1)) >> QUANT_4x4_BITS)，只使用整數運算
  */
-void jpeg_standard_quant(YUVFrame* frame)
+void jpeg_block_quant_4x4(int16_t* block, int padded_width, const int32_t* mf)
 {
-    // Y component
-    for (int row = 0; row < frame->y.padded_height; row += frame->y.block_info.height) {
-        for (int col = 0; col < frame->y.padded_width; col += frame->y.block_info.width) {
-            jpeg_standard_block_luminance_quant(frame->y.padded_data + (row * frame->y.padded_width + col), frame->y.block_info.height, frame->y.block_info.width, frame->y.padded_width);
-        }
-    }
-    // U component
-    for (int row = 0; row < frame->u.padded_height; row += frame->u.block_info.height) {
-        for (int col = 0; col < frame->u.padded_width; col += frame->u.block_info.width) {
-            jpeg_standard_block_chrominance_quant(frame->u.padded_data + (row * frame->u.padded_width + col), frame->u.block_info.height, frame->u.block_info.width, frame->u.padded_width);
-        }
-    }
-    // V component
-    for (int row = 0; row < frame->v.padded_height; row += frame->v.block_info.height) {
-        for (int col = 0; col < frame->v.padded_width; col += frame->v.block_info.width) {
-            jpeg_standard_block_chrominance_quant(frame->v.padded_data + (row * frame->v.padded_width + col), frame->v.block_info.height, frame->v.block_info.width, frame->v.padded_width);
+    for (int row = 0; row < 4; row++) {
+        for (int col = 0; col < 4; col++) {
+            int32_t coeff = block[row * padded_width + col];
+            int32_t level = (abs(coeff) * mf[row * 4 + col] + (1 << (QUANT_4x4_BITS-1))) >> QUANT_4x4_BITS;
+            if (level > QUANT_MAX_LEVEL) level = QUANT_MAX_LEVEL;
+            block[row * padded_width + col] = (int16_t)((coeff < 0) ? -level : level);
         }
     }
 }
 
-void jpeg_standard_block_luminance_dequant(int16_t* block, int b_height, int b_width, int padded_width)
+/*  function: jpeg_block_dequant_4x4()
+    Params:
+        int16_t* block         : 一塊4x4 block的量化係數
+        int padded_width       : padded data的width
+        const int32_t* dequant : 每個位置的dequantization scale
+
+    Return:
+        反量化後的係數 (已經乘上idct_block_4x4()需要的scale)
+ */
+void jpeg_block_dequant_4x4(int16_t* block, int padded_width, const int32_t* dequant)
 {
-    /* 標準JPEG反量化方式: DCT_coef. * step_size */
-    for (int row = 0; row < b_height; row++) {
-        for (int col = 0; col < b_width; col++) {
-            block[row * padded_width + col] *= jpeg_luminance_quant_table[row * b_width + col];
+    for (int row = 0; row < 4; row++) {
+        for (int col = 0; col < 4; col++) {
+            int32_t level = block[row * padded_width + col];
+            block[row * padded_width + col] = (int16_t)((level * dequant[row * 4 + col] + (1 << (DEQUANT_4x4_BITS-1))) >> DEQUANT_4x4_BITS);
         }
     }
 }
 
-void jpeg_standard_block_chrominance_dequant(int16_t* block, int b_height, int b_width, int padded_width)
+
+/*  function: jpeg_quant_blocks()
+    Params:
+        int16_t* blocks  : 水平相鄰的num_blocks個blocks (DCT後的係數)
+        int stride       : blocks所在buffer的width
+        int num_blocks   : block個數
+        BlockSize b_size : 4x4或8x8 block
+        int is_chroma    : 0: 使用Y量化表 1: 使用UV量化表
+        const JpegQuantPrepared* prepared : jpeg_quant_prepare()建立的參數 (只會讀取)
+
+    Return:
+        對每個block做jpeg standard quantization的結果
+
+    Result:
+        8x8 block: 使用SIMD的reciprocal乘法和shift
+        4x4 block: 使用4x4量化表，並補上core transform的scale
+        需要先呼叫jpeg_quant_prepare()
+ */
+void jpeg_quant_blocks(int16_t* blocks, int stride, int num_blocks, BlockSize b_size, int is_chroma, const JpegQuantPrepared* prepared)
 {
-    /* 標準JPEG反量化方式: DCT_coef. * step_size */
-    for (int row = 0; row < b_height; row++) {
-        for (int col = 0; col < b_width; col++) {
-            block[row * padded_width + col] *= jpeg_chrominance_quant_table[row * b_width + col];
+    if (b_size == BLOCK_4x4) {
+        const int32_t* mf = is_chroma ? prepared->chrominance_quant_mf_4x4 : prepared->luminance_quant_mf_4x4;
+        for (int i = 0; i < num_blocks; i++) {
+            jpeg_block_quant_4x4(blocks + i * 4, stride, mf);
         }
+    } else {
+        quant_dsp_get()->quant_8x8_blocks(blocks, stride, num_blocks, is_chroma ? &prepared->chrominance_divisors : &prepared->luminance_divisors);
     }
 }
 
-void jpeg_standard_dequant(YUVFrame* frame)
+void jpeg_dequant_blocks(int16_t* blocks, int stride, int num_blocks, BlockSize b_size, int is_chroma, const JpegQuantPrepared* prepared)
 {
-    // Y component
-    for (int row = 0; row < frame->y.padded_height; row += frame->y.block_info.height) {
-        for (int col = 0; col < frame->y.padded_width; col += frame->y.block_info.width) {
-            jpeg_standard_block_luminance_dequant(frame->y.padded_data + (row * frame->y.padded_width + col), frame->y.block_info.height, frame->y.block_info.width, frame->y.padded_width);
+    if (b_size == BLOCK_4x4) {
+        const int32_t* dequant = is_chroma ? prepared->chrominance_dequant_4x4 : prepared->luminance_dequant_4x4;
+        for (int i = 0; i < num_blocks; i++) {
+            jpeg_block_dequant_4x4(blocks + i * 4, stride, dequant);
         }
+    } else {
+        quant_dsp_get()->dequant_8x8_blocks(blocks, stride, num_blocks, is_chroma ? &prepared->chrominance_divisors : &prepared->luminance_divisors);
     }
-    // U component
-    for (int row = 0; row < frame->u.padded_height; row += frame->u.block_info.height) {
-        for (int col = 0; col < frame->u.padded_width; col += frame->u.block_info.width) {
-            jpeg_standard_block_chrominance_dequant(frame->u.padded_data + (row * frame->u.padded_width + col), frame->u.block_info.height, frame->u.block_info.width, frame->u.padded_width);
-        }
+}
+
+/*  function: jpeg_component_quant()
+    Params:
+        Component* comp : y/u/v其中一個component
+        int is_chroma   : 0: 使用Y量化表 1: 使用UV量化表
+        const JpegQuantPrepared* prepared : jpeg_quant_prepare()建立的參數
+
+    Return:
+        對component的padded data做jpeg standard quantization的結果
+
+    Result:
+        一次處理一整排 (block row) 的blocks
+ */
+void jpeg_component_quant(Component* comp, int is_chroma, const JpegQuantPrepared* prepared)
+{
+    for (int row = 0; row < comp->padded_height; row += comp->block_info.height) {
+        jpeg_quant_blocks(comp->padded_data + row * comp->padded_width, comp->padded_width,
+                          comp->padded_width / comp->block_info.width, comp->block_info.b_size, is_chroma, prepared);
     }
-    // V component
-    for (int row = 0; row < frame->v.padded_height; row += frame->v.block_info.height) {
-        for (int col = 0; col < frame->v.padded_width; col += frame->v.block_info.width) {
-            jpeg_standard_block_chrominance_dequant(frame->v.padded_data + (row * frame->v.padded_width + col), frame->v.block_info.height, frame->v.block_info.width, frame->v.padded_width);
-        }
+}
+
+void jpeg_component_dequant(Component* comp, int is_chroma, const JpegQuantPrepared* prepared)
+{
+    for (int row = 0; row < comp->padded_height; row += comp->block_info.height) {
+        jpeg_dequant_blocks(comp->padded_data + row * comp->padded_width, comp->padded_width,
+                            comp->padded_width / comp->block_info.width, comp->block_info.b_size, is_chroma, prepared);
     }
 }
 
+/*  function: jpeg_standard_quant()
+    Params:
+        YUVFrame* frame           : yuv raw data frame
+        QuantParams* quant_params : 使用的Y/UV量化表
+
+    Return:
+        對padded data做jpeg standard quantization的結果
+
+    Result:
+        level = round(DCT_coef. / step_size)，Y使用luminance量化表，U/V使用chrominance量化表
+ */
+void jpeg_standard_quant(YUVFrame* frame, QuantParams* quant_params)
+{
+    jpeg_quant_prepare(quant_params);
+
+    jpeg_component_quant(&frame->y, 0, &quant_params->prepared);
+    jpeg_component_quant(&frame->u, 1, &quant_params->prepared);
+    jpeg_component_quant(&frame->v, 1, &quant_params->prepared);
+}
+
+void jpeg_standard_dequant(YUVFrame* frame, QuantParams* quant_params)
+{
+    jpeg_quant_prepare(quant_params);
+
+    jpeg_component_dequant(&frame->y, 0, &quant_params->prepared);
+    jpeg_component_dequant(&frame->u, 1, &quant_params->prepared);
+    jpeg_component_dequant(&frame->v, 1, &quant_params->prepared);
+}
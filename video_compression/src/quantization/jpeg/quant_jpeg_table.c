@@ -27,3 +27,4 @@ const uint8_t jpeg_chrominance_quant_table[64] = {
     99, 99, 99, 99, 99, 99, 99, 99,
     99, 99, 99, 99, 99, 99, 99, 99
 };
+
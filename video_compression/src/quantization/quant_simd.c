@@ -0,0 +1,110 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include"cpu.h"
+#include"quantization/quant_simd.h"
+
+static QuantDsp quant_dsp;
+static int quant_dsp_initialized = 0;
+
+
+/*  function: quant_divisors_init()
+    Params:
+        QuantDivisors* divisors    : 存放預先算好的參數
+        const uint8_t* quant_table : 8x8量化表
+
+    Return:
+        None
+
+    Result:
+        對每個step size算出reciprocal、四捨五入的offset，量化時只需要乘法和shift
+ */
+void quant_divisors_init(QuantDivisors* divisors, const uint8_t* quant_table)
+{
+    for (int i = 0; i < 64; i++) {
+        uint32_t step = quant_table[i];
+        divisors->reciprocal[i] = (uint32_t)((((uint64_t)1 << QUANT_RECIP_BITS) + step - 1) / step);
+        divisors->half[i] = step >> 1;
+        divisors->step[i] = (int16_t)step;
+    }
+}
+
+void quant_8x8_blocks_scalar(int16_t* blocks, int stride, int num_blocks, const QuantDivisors* divisors)
+{
+    for (int i = 0; i < num_blocks; i++) {
+        int16_t* block = blocks + i * 8;
+        for (int row = 0; row < 8; row++) {
+            for (int col = 0; col < 8; col++) {
+                int pos = row * 8 + col;
+                int32_t coeff = block[row * stride + col];
+                uint32_t level = (uint32_t)(((uint64_t)(abs(coeff) + divisors->half[pos]) * divisors->reciprocal[pos]) >> QUANT_RECIP_BITS);
+
+                if (level > QUANT_MAX_LEVEL) level = QUANT_MAX_LEVEL;
+                block[row * stride + col] = (int16_t)((coeff < 0) ? -(int32_t)level : (int32_t)level);
+            }
+        }
+    }
+}
+
+void dequant_8x8_blocks_scalar(int16_t* blocks, int stride, int num_blocks, const QuantDivisors* divisors)
+{
+    for (int i = 0; i < num_blocks; i++) {
+        int16_t* block = blocks + i * 8;
+        for (int row = 0; row < 8; row++) {
+            for (int col = 0; col < 8; col++) {
+                block[row * stride + col] = (int16_t)(block[row * stride + col] * divisors->step[row * 8 + col]);
+            }
+        }
+    }
+}
+
+
+/*  function: quant_dsp_init()
+    Params:
+        SimdLevel level : 要使用的SIMD等級 (已經確認CPU支援)
+
+    Return:
+        None
+
+    Result:
+        根據SIMD等級設定quantization stage使用的kernels
+        所有SIMD版本和scalar版本的結果完全相同 (bit-exact)
+ */
+void quant_dsp_init(SimdLevel level)
+{
+    quant_dsp.level = SIMD_SCALAR;
+    quant_dsp.quant_8x8_blocks = quant_8x8_blocks_scalar;
+    quant_dsp.dequant_8x8_blocks = dequant_8x8_blocks_scalar;
+
+#if defined(__x86_64__) || defined(__i386__)
+    if (level == SIMD_SSE41) {
+        quant_dsp.level = SIMD_SSE41;
+        quant_dsp.quant_8x8_blocks = quant_8x8_blocks_sse41;
+        quant_dsp.dequant_8x8_blocks = dequant_8x8_blocks_sse41;
+    } else if (level == SIMD_AVX2) {
+        quant_dsp.level = SIMD_AVX2;
+        quant_dsp.quant_8x8_blocks = quant_8x8_blocks_avx2;
+        quant_dsp.dequant_8x8_blocks = dequant_8x8_blocks_avx2;
+    } else if (level == SIMD_AVX512) {
+        quant_dsp.level = SIMD_AVX512;
+        quant_dsp.quant_8x8_blocks = quant_8x8_blocks_avx512;
+        quant_dsp.dequant_8x8_blocks = dequant_8x8_blocks_avx512;
+    }
+#endif
+
+    quant_dsp_initialized = 1;
+}
+
+
+/*  function: quant_dsp_get()
+    Return:
+        目前使用的quantization kernels
+        如果還沒有初始化，則依照CPUID (和VC_SIMD_LEVEL環境變數) 自動選擇
+ */
+const QuantDsp* quant_dsp_get(void)
+{
+    if (!quant_dsp_initialized) {
+        quant_dsp_init(simd_resolve_level(SIMD_AUTO));
+    }
+    return &quant_dsp;
+}
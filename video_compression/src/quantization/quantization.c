@@ -4,32 +4,114 @@
 #include<stdint.h>
 #include"quantization/quantization.h"
 #include"quantization/jpeg/quant_jpeg.h"
+#include"quantization/h264/quant_h264.h"
 #include"yuv.h"
 #include"block.h"
 
 
-/*  function: quantize_frame()
+/*  function: quant_params_init()
     Params:
-        YUVFrame* frame      : yuv raw data frame
-        QuantType quant_type : 使用量化的方式
+        QuantParams* quant_params : 存放量化需要的參數
+        QuantType quant_type      : 使用量化的方式
+        int qp                    : H264_QUANT的quantization parameter
+        int quality               : JPEG_QUANT_STANDARD的quality (1~100)
 
     Return:
-        對padded data做DCT forward結果
+        None
 
     Result:
-        1. 對frame的padded buffer做128-shift (不是對raw data的buffer做shift)
-        2. 對shift結果做DCT
+        encoder使用: JPEG_QUANT_STANDARD會根據quality縮放量化表 (只在開始時做一次)
  */
-void quantize_frame(YUVFrame* frame, QuantType quant_type)
+void quant_params_init(QuantParams* quant_params, QuantType quant_type, int qp, int quality)
 {
+    quant_params->quant_type = quant_type;
+    quant_params->qp = qp;
+    quant_params->quality = quality;
+    quant_params->prepared.prepared = 0;
+
     if (quant_type == JPEG_QUANT_STANDARD) {
-        jpeg_standard_quant(frame);
+        jpeg_quant_scale_tables(quality, quant_params->luminance_table, quant_params->chrominance_table);
     }
 }
 
-void dequantize_frame(YUVFrame* frame, QuantType quant_type)
+/*  function: quantize_frame()
+    Params:
+        YUVFrame* frame           : yuv raw data frame
+        QuantParams* quant_params : 使用量化的方式和參數
+
+    Return:
+        對padded data做量化的結果
+
+    Result:
+        1. JPEG_QUANT_STANDARD : 使用quality縮放後的JPEG量化表
+        2. H264_QUANT          : 使用QP控制的整數乘法和shift
+ */
+void quantize_frame(YUVFrame* frame, QuantParams* quant_params)
 {
-    if (quant_type == JPEG_QUANT_STANDARD) {
-        jpeg_standard_dequant(frame);
+    if (quant_params->quant_type == JPEG_QUANT_STANDARD) {
+        jpeg_standard_quant(frame, quant_params);
+    } else if (quant_params->quant_type == H264_QUANT) {
+        h264_quant(frame, quant_params->qp);
+    }
+}
+
+void dequantize_frame(YUVFrame* frame, QuantParams* quant_params)
+{
+    if (quant_params->quant_type == JPEG_QUANT_STANDARD) {
+        jpeg_standard_dequant(frame, quant_params);
+    } else if (quant_params->quant_type == H264_QUANT) {
+        h264_dequant(frame, quant_params->qp);
+    }
+}
+
+
+/*  function: quantize_prepare()
+    Params:
+        QuantParams* quant_params : 使用量化的方式和參數
+
+    Return:
+        None
+
+    Result:
+        quantize_blocks()/dequantize_blocks()使用前，先準備好量化表需要的參數 (每張frame一次)
+        參數存在quant_params裡，之後只會讀取，所以準備好以後可以給多個threads共用
+ */
+void quantize_prepare(QuantParams* quant_params)
+{
+    if (quant_params->quant_type == JPEG_QUANT_STANDARD) {
+        jpeg_quant_prepare(quant_params);
+    }
+}
+
+/*  function: quantize_blocks()
+    Params:
+        int16_t* blocks           : 水平相鄰的num_blocks個blocks
+        int stride                : blocks所在buffer的width
+        int num_blocks            : block個數
+        BlockSize b_size          : 4x4或8x8 block
+        int is_chroma             : 0: Y component 1: U/V component
+        QuantParams* quant_params : 使用量化的方式和參數
+
+    Return:
+        對每個block做量化的結果
+
+    Result:
+        fused pipeline對一塊tile做量化使用，不需要整張frame
+ */
+void quantize_blocks(int16_t* blocks, int stride, int num_blocks, BlockSize b_size, int is_chroma, QuantParams* quant_params)
+{
+    if (quant_params->quant_type == JPEG_QUANT_STANDARD) {
+        jpeg_quant_blocks(blocks, stride, num_blocks, b_size, is_chroma, &quant_params->prepared);
+    } else if (quant_params->quant_type == H264_QUANT) {
+        h264_quant_blocks(blocks, stride, num_blocks, b_size, quant_params->qp);
     }
-}
\ No newline at end of file
+}
+
+void dequantize_blocks(int16_t* blocks, int stride, int num_blocks, BlockSize b_size, int is_chroma, QuantParams* quant_params)
+{
+    if (quant_params->quant_type == JPEG_QUANT_STANDARD) {
+        jpeg_dequant_blocks(blocks, stride, num_blocks, b_size, is_chroma, &quant_params->prepared);
+    } else if (quant_params->quant_type == H264_QUANT) {
+        h264_dequant_blocks(blocks, stride, num_blocks, b_size, quant_params->qp);
+    }
+}
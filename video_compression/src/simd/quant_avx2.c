@@ -0,0 +1,62 @@
+/* AVX2版本的quantization kernels (compile flags: -mavx2)
+ * 一次處理block的一個row: 8個int16擴展成一個__m256i (8個uint32) 做reciprocal乘法
+ * 反量化一次處理兩個rows
+ */
+#if defined(__x86_64__) || defined(__i386__)
+
+#include<stdint.h>
+#include<immintrin.h>
+#include"quantization/quant_simd.h"
+
+
+/* 8個uint32各自做 (x * r) >> QUANT_RECIP_BITS，乘積需要64 bits，所以偶數和奇數lanes分開乘 */
+static inline __m256i mul_recip_epu32(__m256i x, __m256i r)
+{
+    __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(x, r), QUANT_RECIP_BITS);
+    __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), _mm256_srli_epi64(r, 32));
+
+    odd = _mm256_slli_epi64(odd, 32 - QUANT_RECIP_BITS);
+    return _mm256_blend_epi32(even, odd, 0xAA);
+}
+
+static inline __m128i quant_row(__m128i coeff, const uint32_t* recip, const uint32_t* half)
+{
+    __m128i abs_coeff = _mm_abs_epi16(coeff);
+    __m256i x = _mm256_add_epi32(_mm256_cvtepu16_epi32(abs_coeff), _mm256_loadu_si256((const __m256i*)half));
+
+    x = mul_recip_epu32(x, _mm256_loadu_si256((const __m256i*)recip));
+
+    __m128i level = _mm_packus_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+    level = _mm_min_epu16(level, _mm_set1_epi16(QUANT_MAX_LEVEL));
+    return _mm_sign_epi16(level, coeff);
+}
+
+void quant_8x8_blocks_avx2(int16_t* blocks, int stride, int num_blocks, const QuantDivisors* divisors)
+{
+    for (int i = 0; i < num_blocks; i++) {
+        int16_t* block = blocks + i * 8;
+        for (int r = 0; r < 8; r++) {
+            __m128i coeff = _mm_loadu_si128((const __m128i*)(block + r * stride));
+            coeff = quant_row(coeff, divisors->reciprocal + r * 8, divisors->half + r * 8);
+            _mm_storeu_si128((__m128i*)(block + r * stride), coeff);
+        }
+    }
+}
+
+void dequant_8x8_blocks_avx2(int16_t* blocks, int stride, int num_blocks, const QuantDivisors* divisors)
+{
+    for (int i = 0; i < num_blocks; i++) {
+        int16_t* block = blocks + i * 8;
+        for (int r = 0; r < 8; r += 2) {
+            __m256i level = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(block + r * stride))),
+                                                    _mm_loadu_si128((const __m128i*)(block + (r+1) * stride)), 1);
+            __m256i step = _mm256_loadu_si256((const __m256i*)(divisors->step + r * 8));
+
+            level = _mm256_mullo_epi16(level, step);
+            _mm_storeu_si128((__m128i*)(block + r * stride), _mm256_castsi256_si128(level));
+            _mm_storeu_si128((__m128i*)(block + (r+1) * stride), _mm256_extracti128_si256(level, 1));
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,66 @@
+/* AVX-512版本的quantization kernels (compile flags: -mavx512f -mavx512bw)
+ * 一次處理block的兩個rows: 16個int16擴展成一個__m512i (16個uint32) 做reciprocal乘法
+ * 反量化一次處理四個rows
+ */
+#if defined(__x86_64__) || defined(__i386__)
+
+#include<stdint.h>
+#include<immintrin.h>
+#include"quantization/quant_simd.h"
+
+
+/* 16個uint32各自做 (x * r) >> QUANT_RECIP_BITS，乘積需要64 bits，所以偶數和奇數lanes分開乘 */
+static inline __m512i mul_recip_epu32(__m512i x, __m512i r)
+{
+    __m512i even = _mm512_srli_epi64(_mm512_mul_epu32(x, r), QUANT_RECIP_BITS);
+    __m512i odd = _mm512_mul_epu32(_mm512_srli_epi64(x, 32), _mm512_srli_epi64(r, 32));
+
+    odd = _mm512_slli_epi64(odd, 32 - QUANT_RECIP_BITS);
+    return _mm512_mask_blend_epi32(0xAAAA, even, odd);
+}
+
+void quant_8x8_blocks_avx512(int16_t* blocks, int stride, int num_blocks, const QuantDivisors* divisors)
+{
+    const __m256i max_level = _mm256_set1_epi16(QUANT_MAX_LEVEL);
+
+    for (int i = 0; i < num_blocks; i++) {
+        int16_t* block = blocks + i * 8;
+        for (int r = 0; r < 8; r += 2) {
+            __m256i coeff = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(block + r * stride))),
+                                                    _mm_loadu_si128((const __m128i*)(block + (r+1) * stride)), 1);
+            __m256i abs_coeff = _mm256_abs_epi16(coeff);
+            __m512i x = _mm512_add_epi32(_mm512_cvtepu16_epi32(abs_coeff), _mm512_loadu_si512((const void*)(divisors->half + r * 8)));
+
+            x = mul_recip_epu32(x, _mm512_loadu_si512((const void*)(divisors->reciprocal + r * 8)));
+
+            // 結果 < 2^16，直接取低16 bits
+            __m256i level = _mm256_min_epu16(_mm512_cvtepi32_epi16(x), max_level);
+            level = _mm256_sign_epi16(level, coeff);
+
+            _mm_storeu_si128((__m128i*)(block + r * stride), _mm256_castsi256_si128(level));
+            _mm_storeu_si128((__m128i*)(block + (r+1) * stride), _mm256_extracti128_si256(level, 1));
+        }
+    }
+}
+
+void dequant_8x8_blocks_avx512(int16_t* blocks, int stride, int num_blocks, const QuantDivisors* divisors)
+{
+    for (int i = 0; i < num_blocks; i++) {
+        int16_t* block = blocks + i * 8;
+        for (int r = 0; r < 8; r += 4) {
+            __m512i level = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i*)(block + r * stride)));
+            level = _mm512_inserti32x4(level, _mm_loadu_si128((const __m128i*)(block + (r+1) * stride)), 1);
+            level = _mm512_inserti32x4(level, _mm_loadu_si128((const __m128i*)(block + (r+2) * stride)), 2);
+            level = _mm512_inserti32x4(level, _mm_loadu_si128((const __m128i*)(block + (r+3) * stride)), 3);
+
+            level = _mm512_mullo_epi16(level, _mm512_loadu_si512((const void*)(divisors->step + r * 8)));
+
+            _mm_storeu_si128((__m128i*)(block + r * stride), _mm512_extracti32x4_epi32(level, 0));
+            _mm_storeu_si128((__m128i*)(block + (r+1) * stride), _mm512_extracti32x4_epi32(level, 1));
+            _mm_storeu_si128((__m128i*)(block + (r+2) * stride), _mm512_extracti32x4_epi32(level, 2));
+            _mm_storeu_si128((__m128i*)(block + (r+3) * stride), _mm512_extracti32x4_epi32(level, 3));
+        }
+    }
+}
+
+#endif
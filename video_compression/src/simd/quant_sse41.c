@@ -0,0 +1,59 @@
+/* SSE4.1版本的quantization kernels (compile flags: -msse4.1)
+ * 一次處理block的一個row (8個int16)，reciprocal乘法拆成兩個__m128i (各4個uint32)
+ */
+#if defined(__x86_64__) || defined(__i386__)
+
+#include<stdint.h>
+#include<smmintrin.h>
+#include"quantization/quant_simd.h"
+
+
+/* 4個uint32各自做 (x * r) >> QUANT_RECIP_BITS，乘積需要64 bits，所以偶數和奇數lanes分開乘 */
+static inline __m128i mul_recip_epu32(__m128i x, __m128i r)
+{
+    __m128i even = _mm_srli_epi64(_mm_mul_epu32(x, r), QUANT_RECIP_BITS);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(x, 32), _mm_srli_epi64(r, 32));
+
+    // odd乘積右移QUANT_RECIP_BITS後放到高32 bits，等於左移(32 - QUANT_RECIP_BITS)
+    odd = _mm_slli_epi64(odd, 32 - QUANT_RECIP_BITS);
+    return _mm_blend_epi16(even, odd, 0xCC);
+}
+
+static inline __m128i quant_row(__m128i coeff, const uint32_t* recip, const uint32_t* half)
+{
+    __m128i abs_coeff = _mm_abs_epi16(coeff);
+    __m128i lo = _mm_add_epi32(_mm_cvtepu16_epi32(abs_coeff), _mm_loadu_si128((const __m128i*)half));
+    __m128i hi = _mm_add_epi32(_mm_cvtepu16_epi32(_mm_srli_si128(abs_coeff, 8)), _mm_loadu_si128((const __m128i*)(half + 4)));
+
+    lo = mul_recip_epu32(lo, _mm_loadu_si128((const __m128i*)recip));
+    hi = mul_recip_epu32(hi, _mm_loadu_si128((const __m128i*)(recip + 4)));
+
+    __m128i level = _mm_min_epu16(_mm_packus_epi32(lo, hi), _mm_set1_epi16(QUANT_MAX_LEVEL));
+    return _mm_sign_epi16(level, coeff);
+}
+
+void quant_8x8_blocks_sse41(int16_t* blocks, int stride, int num_blocks, const QuantDivisors* divisors)
+{
+    for (int i = 0; i < num_blocks; i++) {
+        int16_t* block = blocks + i * 8;
+        for (int r = 0; r < 8; r++) {
+            __m128i coeff = _mm_loadu_si128((const __m128i*)(block + r * stride));
+            coeff = quant_row(coeff, divisors->reciprocal + r * 8, divisors->half + r * 8);
+            _mm_storeu_si128((__m128i*)(block + r * stride), coeff);
+        }
+    }
+}
+
+void dequant_8x8_blocks_sse41(int16_t* blocks, int stride, int num_blocks, const QuantDivisors* divisors)
+{
+    for (int i = 0; i < num_blocks; i++) {
+        int16_t* block = blocks + i * 8;
+        for (int r = 0; r < 8; r++) {
+            __m128i level = _mm_loadu_si128((const __m128i*)(block + r * stride));
+            __m128i step = _mm_loadu_si128((const __m128i*)(divisors->step + r * 8));
+            _mm_storeu_si128((__m128i*)(block + r * stride), _mm_mullo_epi16(level, step));
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,186 @@
+/* AVX2版本的transform kernels (compile flags: -mavx2)
+ * 每個__m256i放8個int32，剛好是8x8 block的一個row
+ */
+#if defined(__x86_64__) || defined(__i386__)
+
+#include<stdint.h>
+#include<immintrin.h>
+
+#define VEC             __m256i
+#define V_ADD(a, b)     _mm256_add_epi32((a), (b))
+#define V_SUB(a, b)     _mm256_sub_epi32((a), (b))
+#define V_MUL(a, b)     _mm256_mullo_epi32((a), (b))
+#define V_SET1(x)       _mm256_set1_epi32(x)
+#define V_SRAI(a, n)    _mm256_srai_epi32((a), (n))
+#define V_SLLI(a, n)    _mm256_slli_epi32((a), (n))
+
+#include"transform_simd_template.h"
+
+
+/* 8x8 int32轉置 */
+static inline void transpose_8x8(__m256i* r)
+{
+    __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+    __m256i t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+    __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+    __m256i t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+    __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+    __m256i t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+    __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+    __m256i t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+    __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+    __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+    __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+    __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+    __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+    r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+    r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+    r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+    r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+    r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+    r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+    r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+    r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+static inline void load_block(const int16_t* block, int stride, __m256i* r)
+{
+    for (int i = 0; i < 8; i++) {
+        r[i] = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(block + i * stride)));
+    }
+}
+
+/* int32轉回int16時只保留低16 bits (和scalar的(int16_t)轉型相同) */
+static inline void store_block(int16_t* block, int stride, __m256i* r)
+{
+    const __m256i mask = _mm256_set1_epi32(0xffff);
+    for (int i = 0; i < 8; i++) {
+        __m256i packed = _mm256_packus_epi32(_mm256_and_si256(r[i], mask), _mm256_setzero_si256());
+        packed = _mm256_permute4x64_epi64(packed, 0x08);
+        _mm_storeu_si128((__m128i*)(block + i * stride), _mm256_castsi256_si128(packed));
+    }
+}
+
+void fdct_8x8_blocks_avx2(int16_t* blocks, int stride, int num_blocks)
+{
+    __m256i r[8];
+
+    for (int i = 0; i < num_blocks; i++) {
+        int16_t* block = blocks + i * 8;
+
+        load_block(block, stride, r);
+
+        /* Pass 1: rows */
+        transpose_8x8(r);
+        fdct_1d(r, 1);
+
+        /* Pass 2: columns */
+        transpose_8x8(r);
+        fdct_1d(r, 2);
+
+        store_block(block, stride, r);
+    }
+}
+
+void idct_8x8_blocks_avx2(int16_t* blocks, int stride, int num_blocks)
+{
+    __m256i r[8];
+
+    for (int i = 0; i < num_blocks; i++) {
+        int16_t* block = blocks + i * 8;
+
+        load_block(block, stride, r);
+
+        /* Pass 1: columns */
+        idct_1d(r, 1);
+
+        /* Pass 2: rows */
+        transpose_8x8(r);
+        idct_1d(r, 2);
+        transpose_8x8(r);
+
+        store_block(block, stride, r);
+    }
+}
+
+void idct_8x8_low4x4_blocks_avx2(int16_t* blocks, int stride, int num_blocks)
+{
+    __m256i r[8];
+
+    for (int i = 0; i < num_blocks; i++) {
+        int16_t* block = blocks + i * 8;
+
+        load_block(block, stride, r);
+
+        /* Pass 1: columns (只有前4個係數非零) */
+        idct_1d_low4(r, 1);
+
+        /* Pass 2: rows */
+        transpose_8x8(r);
+        idct_1d_low4(r, 2);
+        transpose_8x8(r);
+
+        store_block(block, stride, r);
+    }
+}
+
+void shift_128_row_avx2(const uint8_t* src, int16_t* dst, int width)
+{
+    const __m256i offset = _mm256_set1_epi16(128);
+    int i = 0;
+
+    for (; i + 16 <= width; i += 16) {
+        __m256i pixels = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + i)));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_sub_epi16(pixels, offset));
+    }
+    for (; i < width; i++) {
+        dst[i] = (int16_t)(src[i] - 128);
+    }
+}
+
+void unshift_128_row_avx2(int16_t* data, int width)
+{
+    const __m256i offset = _mm256_set1_epi16(128);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max_value = _mm256_set1_epi16(255);
+    int i = 0;
+
+    for (; i + 16 <= width; i += 16) {
+        __m256i value = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(data + i)), offset);
+        value = _mm256_min_epi16(_mm256_max_epi16(value, zero), max_value);
+        _mm256_storeu_si256((__m256i*)(data + i), value);
+    }
+    for (; i < width; i++) {
+        int16_t value = data[i] + 128;
+        if (value < 0) value = 0;
+        else if (value > 255) value = 255;
+        data[i] = value;
+    }
+}
+
+void unshift_128_store_row_avx2(const int16_t* src, uint8_t* dst, int width)
+{
+    const __m256i offset = _mm256_set1_epi16(128);
+    int i = 0;
+
+    /* packus是以128-bit lane為單位，pack後再把64-bit順序排回來 */
+    for (; i + 32 <= width; i += 32) {
+        __m256i lo = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(src + i)), offset);
+        __m256i hi = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(src + i + 16)), offset);
+        __m256i pixels = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+        _mm256_storeu_si256((__m256i*)(dst + i), pixels);
+    }
+    for (; i < width; i++) {
+        int16_t value = src[i] + 128;
+        if (value < 0) value = 0;
+        else if (value > 255) value = 255;
+        dst[i] = (uint8_t)value;
+    }
+}
+
+#endif
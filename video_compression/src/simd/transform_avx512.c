@@ -0,0 +1,205 @@
+/* AVX-512版本的transform kernels (compile flags: -mavx512f -mavx512bw)
+ * 每個__m512i放16個int32，一次處理水平相鄰的兩個8x8 blocks:
+ *   lanes 0~7 是左邊block的一個row，lanes 8~15 是右邊block的同一個row
+ */
+#if defined(__x86_64__) || defined(__i386__)
+
+#include<stdint.h>
+#include<immintrin.h>
+
+#define VEC             __m512i
+#define V_ADD(a, b)     _mm512_add_epi32((a), (b))
+#define V_SUB(a, b)     _mm512_sub_epi32((a), (b))
+#define V_MUL(a, b)     _mm512_mullo_epi32((a), (b))
+#define V_SET1(x)       _mm512_set1_epi32(x)
+#define V_SRAI(a, n)    _mm512_srai_epi32((a), (n))
+#define V_SLLI(a, n)    _mm512_slli_epi32((a), (n))
+
+#include"transform_simd_template.h"
+
+
+/* 兩個8x8 int32 blocks各自轉置 (每個256-bit half是一個block) */
+static inline void transpose_8x8_x2(__m512i* r)
+{
+    const __m512i idx_lo = _mm512_set_epi64(13, 12, 5, 4, 9, 8, 1, 0);
+    const __m512i idx_hi = _mm512_set_epi64(15, 14, 7, 6, 11, 10, 3, 2);
+
+    __m512i t0 = _mm512_unpacklo_epi32(r[0], r[1]);
+    __m512i t1 = _mm512_unpackhi_epi32(r[0], r[1]);
+    __m512i t2 = _mm512_unpacklo_epi32(r[2], r[3]);
+    __m512i t3 = _mm512_unpackhi_epi32(r[2], r[3]);
+    __m512i t4 = _mm512_unpacklo_epi32(r[4], r[5]);
+    __m512i t5 = _mm512_unpackhi_epi32(r[4], r[5]);
+    __m512i t6 = _mm512_unpacklo_epi32(r[6], r[7]);
+    __m512i t7 = _mm512_unpackhi_epi32(r[6], r[7]);
+
+    __m512i u0 = _mm512_unpacklo_epi64(t0, t2);
+    __m512i u1 = _mm512_unpackhi_epi64(t0, t2);
+    __m512i u2 = _mm512_unpacklo_epi64(t1, t3);
+    __m512i u3 = _mm512_unpackhi_epi64(t1, t3);
+    __m512i u4 = _mm512_unpacklo_epi64(t4, t6);
+    __m512i u5 = _mm512_unpackhi_epi64(t4, t6);
+    __m512i u6 = _mm512_unpacklo_epi64(t5, t7);
+    __m512i u7 = _mm512_unpackhi_epi64(t5, t7);
+
+    r[0] = _mm512_permutex2var_epi64(u0, idx_lo, u4);
+    r[1] = _mm512_permutex2var_epi64(u1, idx_lo, u5);
+    r[2] = _mm512_permutex2var_epi64(u2, idx_lo, u6);
+    r[3] = _mm512_permutex2var_epi64(u3, idx_lo, u7);
+    r[4] = _mm512_permutex2var_epi64(u0, idx_hi, u4);
+    r[5] = _mm512_permutex2var_epi64(u1, idx_hi, u5);
+    r[6] = _mm512_permutex2var_epi64(u2, idx_hi, u6);
+    r[7] = _mm512_permutex2var_epi64(u3, idx_hi, u7);
+}
+
+static inline void load_blocks_x2(const int16_t* block, int stride, __m512i* r)
+{
+    for (int i = 0; i < 8; i++) {
+        r[i] = _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i*)(block + i * stride)));
+    }
+}
+
+/* vpmovdw只保留低16 bits (和scalar的(int16_t)轉型相同) */
+static inline void store_blocks_x2(int16_t* block, int stride, __m512i* r)
+{
+    for (int i = 0; i < 8; i++) {
+        _mm256_storeu_si256((__m256i*)(block + i * stride), _mm512_cvtepi32_epi16(r[i]));
+    }
+}
+
+void fdct_8x8_blocks_avx512(int16_t* blocks, int stride, int num_blocks)
+{
+    __m512i r[8];
+    int i = 0;
+
+    for (; i + 2 <= num_blocks; i += 2) {
+        int16_t* block = blocks + i * 8;
+
+        load_blocks_x2(block, stride, r);
+
+        /* Pass 1: rows */
+        transpose_8x8_x2(r);
+        fdct_1d(r, 1);
+
+        /* Pass 2: columns */
+        transpose_8x8_x2(r);
+        fdct_1d(r, 2);
+
+        store_blocks_x2(block, stride, r);
+    }
+
+    /* 剩下單獨一個block */
+    if (i < num_blocks) {
+        fdct_8x8_blocks_avx2(blocks + i * 8, stride, num_blocks - i);
+    }
+}
+
+void idct_8x8_blocks_avx512(int16_t* blocks, int stride, int num_blocks)
+{
+    __m512i r[8];
+    int i = 0;
+
+    for (; i + 2 <= num_blocks; i += 2) {
+        int16_t* block = blocks + i * 8;
+
+        load_blocks_x2(block, stride, r);
+
+        /* Pass 1: columns */
+        idct_1d(r, 1);
+
+        /* Pass 2: rows */
+        transpose_8x8_x2(r);
+        idct_1d(r, 2);
+        transpose_8x8_x2(r);
+
+        store_blocks_x2(block, stride, r);
+    }
+
+    /* 剩下單獨一個block */
+    if (i < num_blocks) {
+        idct_8x8_blocks_avx2(blocks + i * 8, stride, num_blocks - i);
+    }
+}
+
+void idct_8x8_low4x4_blocks_avx512(int16_t* blocks, int stride, int num_blocks)
+{
+    __m512i r[8];
+    int i = 0;
+
+    for (; i + 2 <= num_blocks; i += 2) {
+        int16_t* block = blocks + i * 8;
+
+        load_blocks_x2(block, stride, r);
+
+        /* Pass 1: columns (只有前4個係數非零) */
+        idct_1d_low4(r, 1);
+
+        /* Pass 2: rows */
+        transpose_8x8_x2(r);
+        idct_1d_low4(r, 2);
+        transpose_8x8_x2(r);
+
+        store_blocks_x2(block, stride, r);
+    }
+
+    /* 剩下單獨一個block */
+    if (i < num_blocks) {
+        idct_8x8_low4x4_blocks_avx2(blocks + i * 8, stride, num_blocks - i);
+    }
+}
+
+void shift_128_row_avx512(const uint8_t* src, int16_t* dst, int width)
+{
+    const __m512i offset = _mm512_set1_epi16(128);
+    int i = 0;
+
+    for (; i + 32 <= width; i += 32) {
+        __m512i pixels = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(src + i)));
+        _mm512_storeu_si512((void*)(dst + i), _mm512_sub_epi16(pixels, offset));
+    }
+    for (; i < width; i++) {
+        dst[i] = (int16_t)(src[i] - 128);
+    }
+}
+
+void unshift_128_row_avx512(int16_t* data, int width)
+{
+    const __m512i offset = _mm512_set1_epi16(128);
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i max_value = _mm512_set1_epi16(255);
+    int i = 0;
+
+    for (; i + 32 <= width; i += 32) {
+        __m512i value = _mm512_add_epi16(_mm512_loadu_si512((const void*)(data + i)), offset);
+        value = _mm512_min_epi16(_mm512_max_epi16(value, zero), max_value);
+        _mm512_storeu_si512((void*)(data + i), value);
+    }
+    for (; i < width; i++) {
+        int16_t value = data[i] + 128;
+        if (value < 0) value = 0;
+        else if (value > 255) value = 255;
+        data[i] = value;
+    }
+}
+
+void unshift_128_store_row_avx512(const int16_t* src, uint8_t* dst, int width)
+{
+    const __m512i offset = _mm512_set1_epi16(128);
+    const __m512i zero = _mm512_setzero_si512();
+    int i = 0;
+
+    /* 先限制下界為0，再用unsigned飽和轉成uint8 (上界255) */
+    for (; i + 32 <= width; i += 32) {
+        __m512i value = _mm512_add_epi16(_mm512_loadu_si512((const void*)(src + i)), offset);
+        value = _mm512_max_epi16(value, zero);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm512_cvtusepi16_epi8(value));
+    }
+    for (; i < width; i++) {
+        int16_t value = src[i] + 128;
+        if (value < 0) value = 0;
+        else if (value > 255) value = 255;
+        dst[i] = (uint8_t)value;
+    }
+}
+
+#endif
@@ -0,0 +1,198 @@
+/* SIMD整數fast DCT/IDCT的1-D butterfly
+ *
+ * 每個ISA的檔案先定義底下的macros，再include這個檔案:
+ *   VEC          : 存放int32 lanes的vector type
+ *   V_ADD/V_SUB  : int32加/減
+ *   V_MUL        : int32乘法 (取低32 bits)
+ *   V_SET1       : 將常數放到所有lanes
+ *   V_SRAI/V_SLLI: arithmetic right shift / left shift
+ *
+ * 運算順序和transform.c的scalar版本完全相同，每個lane各自處理一個row (或column)，
+ * 因此SIMD和scalar的結果會bit-exact
+ */
+
+#include"transform_simd.h"
+
+static inline VEC v_descale(VEC x, int n)
+{
+    return V_SRAI(V_ADD(x, V_SET1(1 << (n-1))), n);
+}
+
+/*  function: fdct_1d()
+    Params:
+        VEC* d   : 8個vectors，d[k]是第k個輸入 (每個lane是一組獨立的1-D DCT)
+        int pass : 1表示第一次 (保留PASS1_BITS)，2表示第二次 (移除PASS1_BITS和8倍scale)
+ */
+static inline void fdct_1d(VEC* d, int pass)
+{
+    VEC tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+    VEC tmp10, tmp11, tmp12, tmp13;
+    VEC z1, z2, z3, z4, z5;
+    int bits = (pass == 1) ? (CONST_BITS-PASS1_BITS) : (CONST_BITS+PASS1_BITS+3);
+
+    tmp0 = V_ADD(d[0], d[7]);
+    tmp7 = V_SUB(d[0], d[7]);
+    tmp1 = V_ADD(d[1], d[6]);
+    tmp6 = V_SUB(d[1], d[6]);
+    tmp2 = V_ADD(d[2], d[5]);
+    tmp5 = V_SUB(d[2], d[5]);
+    tmp3 = V_ADD(d[3], d[4]);
+    tmp4 = V_SUB(d[3], d[4]);
+
+    /* Even part */
+    tmp10 = V_ADD(tmp0, tmp3);
+    tmp13 = V_SUB(tmp0, tmp3);
+    tmp11 = V_ADD(tmp1, tmp2);
+    tmp12 = V_SUB(tmp1, tmp2);
+
+    if (pass == 1) {
+        d[0] = V_SLLI(V_ADD(tmp10, tmp11), PASS1_BITS);
+        d[4] = V_SLLI(V_SUB(tmp10, tmp11), PASS1_BITS);
+    } else {
+        d[0] = v_descale(V_ADD(tmp10, tmp11), PASS1_BITS+3);
+        d[4] = v_descale(V_SUB(tmp10, tmp11), PASS1_BITS+3);
+    }
+
+    z1 = V_MUL(V_ADD(tmp12, tmp13), V_SET1(FIX_0_541196100));
+    d[2] = v_descale(V_ADD(z1, V_MUL(tmp13, V_SET1(FIX_0_765366865))), bits);
+    d[6] = v_descale(V_SUB(z1, V_MUL(tmp12, V_SET1(FIX_1_847759065))), bits);
+
+    /* Odd part */
+    z1 = V_ADD(tmp4, tmp7);
+    z2 = V_ADD(tmp5, tmp6);
+    z3 = V_ADD(tmp4, tmp6);
+    z4 = V_ADD(tmp5, tmp7);
+    z5 = V_MUL(V_ADD(z3, z4), V_SET1(FIX_1_175875602));
+
+    tmp4 = V_MUL(tmp4, V_SET1(FIX_0_298631336));
+    tmp5 = V_MUL(tmp5, V_SET1(FIX_2_053119869));
+    tmp6 = V_MUL(tmp6, V_SET1(FIX_3_072711026));
+    tmp7 = V_MUL(tmp7, V_SET1(FIX_1_501321110));
+    z1 = V_MUL(z1, V_SET1(-FIX_0_899976223));
+    z2 = V_MUL(z2, V_SET1(-FIX_2_562915447));
+    z3 = V_MUL(z3, V_SET1(-FIX_1_961570560));
+    z4 = V_MUL(z4, V_SET1(-FIX_0_390180644));
+
+    z3 = V_ADD(z3, z5);
+    z4 = V_ADD(z4, z5);
+
+    d[7] = v_descale(V_ADD(V_ADD(tmp4, z1), z3), bits);
+    d[5] = v_descale(V_ADD(V_ADD(tmp5, z2), z4), bits);
+    d[3] = v_descale(V_ADD(V_ADD(tmp6, z2), z3), bits);
+    d[1] = v_descale(V_ADD(V_ADD(tmp7, z1), z4), bits);
+}
+
+/*  function: idct_1d()
+    Params:
+        VEC* d   : 8個vectors，d[k]是第k個DCT係數 (每個lane是一組獨立的1-D IDCT)
+        int pass : 1表示第一次 (保留PASS1_BITS)，2表示第二次 (移除PASS1_BITS和8倍scale)
+ */
+static inline void idct_1d(VEC* d, int pass)
+{
+    VEC tmp0, tmp1, tmp2, tmp3;
+    VEC tmp10, tmp11, tmp12, tmp13;
+    VEC z1, z2, z3, z4, z5;
+    int bits = (pass == 1) ? (CONST_BITS-PASS1_BITS) : (CONST_BITS+PASS1_BITS+3);
+
+    /* Even part */
+    z1 = V_MUL(V_ADD(d[2], d[6]), V_SET1(FIX_0_541196100));
+    tmp2 = V_SUB(z1, V_MUL(d[6], V_SET1(FIX_1_847759065)));
+    tmp3 = V_ADD(z1, V_MUL(d[2], V_SET1(FIX_0_765366865)));
+
+    tmp0 = V_SLLI(V_ADD(d[0], d[4]), CONST_BITS);
+    tmp1 = V_SLLI(V_SUB(d[0], d[4]), CONST_BITS);
+
+    tmp10 = V_ADD(tmp0, tmp3);
+    tmp13 = V_SUB(tmp0, tmp3);
+    tmp11 = V_ADD(tmp1, tmp2);
+    tmp12 = V_SUB(tmp1, tmp2);
+
+    /* Odd part */
+    tmp0 = d[7];
+    tmp1 = d[5];
+    tmp2 = d[3];
+    tmp3 = d[1];
+
+    z1 = V_ADD(tmp0, tmp3);
+    z2 = V_ADD(tmp1, tmp2);
+    z3 = V_ADD(tmp0, tmp2);
+    z4 = V_ADD(tmp1, tmp3);
+    z5 = V_MUL(V_ADD(z3, z4), V_SET1(FIX_1_175875602));
+
+    tmp0 = V_MUL(tmp0, V_SET1(FIX_0_298631336));
+    tmp1 = V_MUL(tmp1, V_SET1(FIX_2_053119869));
+    tmp2 = V_MUL(tmp2, V_SET1(FIX_3_072711026));
+    tmp3 = V_MUL(tmp3, V_SET1(FIX_1_501321110));
+    z1 = V_MUL(z1, V_SET1(-FIX_0_899976223));
+    z2 = V_MUL(z2, V_SET1(-FIX_2_562915447));
+    z3 = V_MUL(z3, V_SET1(-FIX_1_961570560));
+    z4 = V_MUL(z4, V_SET1(-FIX_0_390180644));
+
+    z3 = V_ADD(z3, z5);
+    z4 = V_ADD(z4, z5);
+
+    tmp0 = V_ADD(tmp0, V_ADD(z1, z3));
+    tmp1 = V_ADD(tmp1, V_ADD(z2, z4));
+    tmp2 = V_ADD(tmp2, V_ADD(z2, z3));
+    tmp3 = V_ADD(tmp3, V_ADD(z1, z4));
+
+    d[0] = v_descale(V_ADD(tmp10, tmp3), bits);
+    d[7] = v_descale(V_SUB(tmp10, tmp3), bits);
+    d[1] = v_descale(V_ADD(tmp11, tmp2), bits);
+    d[6] = v_descale(V_SUB(tmp11, tmp2), bits);
+    d[2] = v_descale(V_ADD(tmp12, tmp1), bits);
+    d[5] = v_descale(V_SUB(tmp12, tmp1), bits);
+    d[3] = v_descale(V_ADD(tmp13, tmp0), bits);
+    d[4] = v_descale(V_SUB(tmp13, tmp0), bits);
+}
+
+/*  function: idct_1d_low4()
+    Params:
+        VEC* d   : 8個vectors，只有d[0]~d[3]可能非零 (d[4]~d[7]不會被讀取)
+        int pass : 1表示第一次 (保留PASS1_BITS)，2表示第二次 (移除PASS1_BITS和8倍scale)
+
+    Result:
+        idct_1d()把d[4]~d[7]代入0之後的結果，和idct_int_block_8x8_low4x4()相同
+ */
+static inline void idct_1d_low4(VEC* d, int pass)
+{
+    VEC tmp0, tmp1, tmp2, tmp3;
+    VEC tmp10, tmp11, tmp12, tmp13;
+    VEC z1, z2, z3, z4, z5;
+    int bits = (pass == 1) ? (CONST_BITS-PASS1_BITS) : (CONST_BITS+PASS1_BITS+3);
+
+    /* Even part */
+    z1 = V_MUL(d[2], V_SET1(FIX_0_541196100));
+    tmp2 = z1;
+    tmp3 = V_ADD(z1, V_MUL(d[2], V_SET1(FIX_0_765366865)));
+    tmp0 = V_SLLI(d[0], CONST_BITS);
+
+    tmp10 = V_ADD(tmp0, tmp3);
+    tmp13 = V_SUB(tmp0, tmp3);
+    tmp11 = V_ADD(tmp0, tmp2);
+    tmp12 = V_SUB(tmp0, tmp2);
+
+    /* Odd part */
+    z5 = V_MUL(V_ADD(d[3], d[1]), V_SET1(FIX_1_175875602));
+
+    tmp2 = V_MUL(d[3], V_SET1(FIX_3_072711026));
+    tmp3 = V_MUL(d[1], V_SET1(FIX_1_501321110));
+    z1 = V_MUL(d[1], V_SET1(-FIX_0_899976223));
+    z2 = V_MUL(d[3], V_SET1(-FIX_2_562915447));
+    z3 = V_ADD(V_MUL(d[3], V_SET1(-FIX_1_961570560)), z5);
+    z4 = V_ADD(V_MUL(d[1], V_SET1(-FIX_0_390180644)), z5);
+
+    tmp0 = V_ADD(z1, z3);
+    tmp1 = V_ADD(z2, z4);
+    tmp2 = V_ADD(tmp2, V_ADD(z2, z3));
+    tmp3 = V_ADD(tmp3, V_ADD(z1, z4));
+
+    d[0] = v_descale(V_ADD(tmp10, tmp3), bits);
+    d[7] = v_descale(V_SUB(tmp10, tmp3), bits);
+    d[1] = v_descale(V_ADD(tmp11, tmp2), bits);
+    d[6] = v_descale(V_SUB(tmp11, tmp2), bits);
+    d[2] = v_descale(V_ADD(tmp12, tmp1), bits);
+    d[5] = v_descale(V_SUB(tmp12, tmp1), bits);
+    d[3] = v_descale(V_ADD(tmp13, tmp0), bits);
+    d[4] = v_descale(V_SUB(tmp13, tmp0), bits);
+}
@@ -0,0 +1,199 @@
+/* SSE4.1版本的transform kernels (compile flags: -msse4.1)
+ * 每個__m128i放4個int32，8x8 block的每個row分成lo (col 0~3) / hi (col 4~7) 兩半處理
+ */
+#if defined(__x86_64__) || defined(__i386__)
+
+#include<stdint.h>
+#include<smmintrin.h>
+
+#define VEC             __m128i
+#define V_ADD(a, b)     _mm_add_epi32((a), (b))
+#define V_SUB(a, b)     _mm_sub_epi32((a), (b))
+#define V_MUL(a, b)     _mm_mullo_epi32((a), (b))
+#define V_SET1(x)       _mm_set1_epi32(x)
+#define V_SRAI(a, n)    _mm_srai_epi32((a), (n))
+#define V_SLLI(a, n)    _mm_slli_epi32((a), (n))
+
+#include"transform_simd_template.h"
+
+
+/* 4x4 int32轉置 */
+static inline void transpose_4x4(__m128i* r0, __m128i* r1, __m128i* r2, __m128i* r3)
+{
+    __m128i t0 = _mm_unpacklo_epi32(*r0, *r1);
+    __m128i t1 = _mm_unpackhi_epi32(*r0, *r1);
+    __m128i t2 = _mm_unpacklo_epi32(*r2, *r3);
+    __m128i t3 = _mm_unpackhi_epi32(*r2, *r3);
+
+    *r0 = _mm_unpacklo_epi64(t0, t2);
+    *r1 = _mm_unpackhi_epi64(t0, t2);
+    *r2 = _mm_unpacklo_epi64(t1, t3);
+    *r3 = _mm_unpackhi_epi64(t1, t3);
+}
+
+/* 8x8 int32轉置: lo[r]/hi[r]是第r個row的col 0~3 / col 4~7 */
+static inline void transpose_8x8(__m128i* lo, __m128i* hi)
+{
+    __m128i a[4], b[4], c[4], d[4];
+
+    for (int i = 0; i < 4; i++) {
+        a[i] = lo[i];      // rows 0~3, cols 0~3
+        b[i] = hi[i];      // rows 0~3, cols 4~7
+        c[i] = lo[i+4];    // rows 4~7, cols 0~3
+        d[i] = hi[i+4];    // rows 4~7, cols 4~7
+    }
+    transpose_4x4(&a[0], &a[1], &a[2], &a[3]);
+    transpose_4x4(&b[0], &b[1], &b[2], &b[3]);
+    transpose_4x4(&c[0], &c[1], &c[2], &c[3]);
+    transpose_4x4(&d[0], &d[1], &d[2], &d[3]);
+
+    for (int i = 0; i < 4; i++) {
+        lo[i] = a[i];
+        hi[i] = c[i];
+        lo[i+4] = b[i];
+        hi[i+4] = d[i];
+    }
+}
+
+static inline void load_block(const int16_t* block, int stride, __m128i* lo, __m128i* hi)
+{
+    for (int r = 0; r < 8; r++) {
+        __m128i row = _mm_loadu_si128((const __m128i*)(block + r * stride));
+        lo[r] = _mm_cvtepi16_epi32(row);
+        hi[r] = _mm_cvtepi16_epi32(_mm_srli_si128(row, 8));
+    }
+}
+
+/* int32轉回int16時只保留低16 bits (和scalar的(int16_t)轉型相同) */
+static inline void store_block(int16_t* block, int stride, __m128i* lo, __m128i* hi)
+{
+    const __m128i mask = _mm_set1_epi32(0xffff);
+    for (int r = 0; r < 8; r++) {
+        __m128i row = _mm_packus_epi32(_mm_and_si128(lo[r], mask), _mm_and_si128(hi[r], mask));
+        _mm_storeu_si128((__m128i*)(block + r * stride), row);
+    }
+}
+
+void fdct_8x8_blocks_sse41(int16_t* blocks, int stride, int num_blocks)
+{
+    __m128i lo[8], hi[8];
+
+    for (int i = 0; i < num_blocks; i++) {
+        int16_t* block = blocks + i * 8;
+
+        load_block(block, stride, lo, hi);
+
+        /* Pass 1: rows (轉置後lo/hi[k]是每個row的第k個pixel) */
+        transpose_8x8(lo, hi);
+        fdct_1d(lo, 1);
+        fdct_1d(hi, 1);
+
+        /* Pass 2: columns */
+        transpose_8x8(lo, hi);
+        fdct_1d(lo, 2);
+        fdct_1d(hi, 2);
+
+        store_block(block, stride, lo, hi);
+    }
+}
+
+void idct_8x8_blocks_sse41(int16_t* blocks, int stride, int num_blocks)
+{
+    __m128i lo[8], hi[8];
+
+    for (int i = 0; i < num_blocks; i++) {
+        int16_t* block = blocks + i * 8;
+
+        load_block(block, stride, lo, hi);
+
+        /* Pass 1: columns (lo/hi[k]是每個column的第k個係數) */
+        idct_1d(lo, 1);
+        idct_1d(hi, 1);
+
+        /* Pass 2: rows */
+        transpose_8x8(lo, hi);
+        idct_1d(lo, 2);
+        idct_1d(hi, 2);
+        transpose_8x8(lo, hi);
+
+        store_block(block, stride, lo, hi);
+    }
+}
+
+/* 非零係數都在左上角4x4: 後4個column的輸入全為0，pass 1只需要處理lo */
+void idct_8x8_low4x4_blocks_sse41(int16_t* blocks, int stride, int num_blocks)
+{
+    __m128i lo[8], hi[8];
+
+    for (int i = 0; i < num_blocks; i++) {
+        int16_t* block = blocks + i * 8;
+
+        load_block(block, stride, lo, hi);
+
+        /* Pass 1: columns 0~3 */
+        idct_1d_low4(lo, 1);
+
+        /* Pass 2: rows (每個row只有前4項非零) */
+        transpose_8x8(lo, hi);
+        idct_1d_low4(lo, 2);
+        idct_1d_low4(hi, 2);
+        transpose_8x8(lo, hi);
+
+        store_block(block, stride, lo, hi);
+    }
+}
+
+void shift_128_row_sse41(const uint8_t* src, int16_t* dst, int width)
+{
+    const __m128i offset = _mm_set1_epi16(128);
+    int i = 0;
+
+    for (; i + 8 <= width; i += 8) {
+        __m128i pixels = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(src + i)));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_sub_epi16(pixels, offset));
+    }
+    for (; i < width; i++) {
+        dst[i] = (int16_t)(src[i] - 128);
+    }
+}
+
+void unshift_128_row_sse41(int16_t* data, int width)
+{
+    const __m128i offset = _mm_set1_epi16(128);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max_value = _mm_set1_epi16(255);
+    int i = 0;
+
+    for (; i + 8 <= width; i += 8) {
+        __m128i value = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(data + i)), offset);
+        value = _mm_min_epi16(_mm_max_epi16(value, zero), max_value);
+        _mm_storeu_si128((__m128i*)(data + i), value);
+    }
+    for (; i < width; i++) {
+        int16_t value = data[i] + 128;
+        if (value < 0) value = 0;
+        else if (value > 255) value = 255;
+        data[i] = value;
+    }
+}
+
+void unshift_128_store_row_sse41(const int16_t* src, uint8_t* dst, int width)
+{
+    const __m128i offset = _mm_set1_epi16(128);
+    int i = 0;
+
+    /* +128後用packus (signed int16 --> unsigned int8飽和) 同時完成clamp和轉型 */
+    for (; i + 16 <= width; i += 16) {
+        __m128i lo = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(src + i)), offset);
+        __m128i hi = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(src + i + 8)), offset);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    for (; i < width; i++) {
+        int16_t value = src[i] + 128;
+        if (value < 0) value = 0;
+        else if (value > 255) value = 255;
+        dst[i] = (uint8_t)value;
+    }
+}
+
+#endif
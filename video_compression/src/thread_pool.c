@@ -0,0 +1,195 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include"thread_pool.h"
+
+
+/*  function: thread_pool_take_job()
+    Params:
+        ThreadPool* pool : thread pool (呼叫前已經lock mutex)
+
+    Return:
+        拿到的工作index，-1表示這一批已經沒有工作
+ */
+static int thread_pool_take_job(ThreadPool* pool)
+{
+    if (pool->job == NULL || pool->next_job >= pool->jobs_num) {
+        return -1;
+    }
+    return pool->next_job++;
+}
+
+/*  function: thread_pool_finish_job()
+    Params:
+        ThreadPool* pool : thread pool (呼叫前已經lock mutex)
+
+    Result:
+        最後一個工作完成時通知thread_pool_run()的呼叫者
+ */
+static void thread_pool_finish_job(ThreadPool* pool)
+{
+    pool->pending_jobs--;
+    if (pool->pending_jobs == 0) {
+        pthread_cond_signal(&pool->done_cond);
+    }
+}
+
+/*  function: thread_pool_worker()
+    Params:
+        void* arg : ThreadPool*
+
+    Result:
+        等待工作，一次拿一個工作來做，直到pool被destroy
+ */
+static void* thread_pool_worker(void* arg)
+{
+    ThreadPool* pool = (ThreadPool*)arg;
+
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        int job_index = thread_pool_take_job(pool);
+        if (job_index < 0) {
+            if (pool->stop) break;
+            pthread_cond_wait(&pool->work_cond, &pool->mutex);
+            continue;
+        }
+
+        ThreadPoolJob job = pool->job;
+        void* job_arg = pool->arg;
+        pthread_mutex_unlock(&pool->mutex);
+
+        job(job_arg, job_index);
+
+        pthread_mutex_lock(&pool->mutex);
+        thread_pool_finish_job(pool);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+/*  function: thread_pool_create()
+    Params:
+        int threads_num : 總共使用的threads個數 (包含呼叫thread_pool_run()的thread)
+
+    Return:
+        建立好的thread pool，threads_num <= 1時回傳NULL (thread_pool_run()會直接依序執行)
+ */
+ThreadPool* thread_pool_create(int threads_num)
+{
+    if (threads_num <= 1) {
+        return NULL;
+    }
+
+    ThreadPool* pool = (ThreadPool*)calloc(1, sizeof(ThreadPool));
+    if (pool == NULL) {
+        perror("Failed to allocate memory for thread pool");
+        return NULL;
+    }
+
+    pool->workers = (pthread_t*)malloc(sizeof(pthread_t) * (threads_num - 1));
+    if (pool->workers == NULL) {
+        perror("Failed to allocate memory for thread pool workers");
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    for (int i = 0; i < threads_num - 1; i++) {
+        if (pthread_create(&pool->workers[i], NULL, thread_pool_worker, pool) != 0) {
+            /* 建立失敗時使用已經建立的workers */
+            fprintf(stderr, "Failed to create worker thread %d, use %d thread(s)\n", i, i + 1);
+            break;
+        }
+        pool->workers_num++;
+    }
+
+    return pool;
+}
+
+/*  function: thread_pool_run()
+    Params:
+        ThreadPool* pool  : thread pool (NULL時在呼叫的thread依序執行)
+        ThreadPoolJob job : 每個工作要執行的函式
+        void* arg         : 傳給job的參數
+        int jobs_num      : 工作個數
+
+    Return:
+        所有工作都完成後才回傳
+
+    Result:
+        workers和呼叫的thread一起拿工作，工作完成的順序不固定，
+        job需要把結果寫到各自的位置 (例如以job_index分開的buffer)
+        pool正在執行其他thread的工作時 (例如多張frames同時使用entropy的pool)，在呼叫的thread依序執行
+ */
+void thread_pool_run(ThreadPool* pool, ThreadPoolJob job, void* arg, int jobs_num)
+{
+    if (pool == NULL || pool->workers_num == 0 || jobs_num <= 1) {
+        for (int i = 0; i < jobs_num; i++) {
+            job(arg, i);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->job != NULL) {
+        pthread_mutex_unlock(&pool->mutex);
+        for (int i = 0; i < jobs_num; i++) {
+            job(arg, i);
+        }
+        return;
+    }
+
+    pool->job = job;
+    pool->arg = arg;
+    pool->jobs_num = jobs_num;
+    pool->next_job = 0;
+    pool->pending_jobs = jobs_num;
+    pthread_cond_broadcast(&pool->work_cond);
+
+    /* 呼叫的thread也一起做 */
+    int job_index;
+    while ((job_index = thread_pool_take_job(pool)) >= 0) {
+        pthread_mutex_unlock(&pool->mutex);
+        job(arg, job_index);
+        pthread_mutex_lock(&pool->mutex);
+        thread_pool_finish_job(pool);
+    }
+
+    while (pool->pending_jobs > 0) {
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    }
+    pool->job = NULL;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/*  function: thread_pool_destroy()
+    Params:
+        ThreadPool* pool : thread pool (可以是NULL)
+
+    Result:
+        通知workers結束，等待所有workers結束後釋放資源
+ */
+void thread_pool_destroy(ThreadPool* pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int i = 0; i < pool->workers_num; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    free(pool->workers);
+    free(pool);
+}
@@ -4,6 +4,8 @@
 #include<stdint.h>
 #include "yuv.h"
 #include"block.h"
+#include"transform.h"
+#include"transform_simd.h"
 
 
 /*  function: shift_128()
@@ -18,32 +20,98 @@
  */
 void shift_128(Component* component)
 {
-    /* 將raw data複製到padded data */
-    for (int row = 0; row < component->height; row++) {
-        for (int col = 0; col < component->width; col++) {
-            component->padded_data[row * component->padded_width + col] = component->raw_data[row * component->width + col];
+    const TransformDsp* dsp = transform_dsp_get();
+
+    for (int row = 0; row < component->padded_height; row++) {
+        int16_t* dst = component->padded_data + row * component->padded_width;
+        int col = 0;
+
+        /* 將raw data複製到padded data，同時做-128位移 */
+        if (row < component->height) {
+            dsp->shift_128_row(component->raw_data + row * component->width, dst, component->width);
+            col = component->width;
+        }
+
+        /* padding的部分當作pixel值為0，位移後為-128 */
+        for (; col < component->padded_width; col++) {
+            dst[col] = -128;
         }
     }
+}
 
-    /* 對padded data做-128位移 */
-    size_t com_size = component->padded_width * component->padded_height;
-    for (size_t i = 0; i < com_size; i++) {
-        component->padded_data[i] = (int16_t)(component->padded_data[i] - 128);
+/*  function: shift_128_tile()
+    Params:
+        Component* component : frame裡的y/u/v其中一個component
+        int row              : tile在padded data的起始row
+        int col              : tile在padded data的起始col
+        int tile_height      : tile的height
+        int tile_width       : tile的width
+        int16_t* tile        : 存放結果的buffer
+        int tile_stride      : tile buffer的width
+
+    Return:
+        從raw data讀取一塊tile，並做128-shift
+
+    Result:
+        和shift_128()相同，超出raw data的部分 (padding) 為-128
+        fused pipeline使用，不需要經過整張frame的padded data
+ */
+void shift_128_tile(Component* component, int row, int col, int tile_height, int tile_width, int16_t* tile, int tile_stride)
+{
+    const TransformDsp* dsp = transform_dsp_get();
+
+    for (int r = 0; r < tile_height; r++) {
+        int16_t* dst = tile + r * tile_stride;
+        int c = 0;
+
+        if (row + r < component->height && col < component->width) {
+            int valid = component->width - col;
+            if (valid > tile_width) valid = tile_width;
+            dsp->shift_128_row(component->raw_data + (row + r) * component->width + col, dst, valid);
+            c = valid;
+        }
+
+        for (; c < tile_width; c++) {
+            dst[c] = -128;
+        }
     }
 }
 
 void unshift_128(Component* component)
 {
-    for (int row = 0; row < component->padded_height; row++) {
-        for (int col = 0; col < component->padded_width; col++) {
-            int16_t value = component->padded_data[row * component->padded_width + col] + 128;
+    const TransformDsp* dsp = transform_dsp_get();
 
-            // 限制shift回來的值必須在[0,255]
-            if (value < 0) value = 0;
-            else if (value > 255) value = 255;
+    /* padded data是連續的記憶體，一次處理整個component (限制在[0,255]) */
+    dsp->unshift_128_row(component->padded_data, component->padded_width * component->padded_height);
+}
 
-            component->padded_data[row * component->padded_width + col] = value;
-        }
+/*  function: unshift_128_tile()
+    Params:
+        Component* component : frame裡的y/u/v其中一個component
+        int row              : tile在padded data的起始row
+        int col              : tile在padded data的起始col
+        int tile_height      : tile的height
+        int tile_width       : tile的width
+        int16_t* tile        : IDCT後的tile
+        int tile_stride      : tile buffer的width
+
+    Return:
+        將tile做+128位移並限制在[0,255]，直接寫到component的raw data (uint8)
+
+    Result:
+        只寫入raw data範圍內的pixels，padding的部分丟掉
+        fused pipeline使用，不需要經過整張frame的padded data
+ */
+void unshift_128_tile(Component* component, int row, int col, int tile_height, int tile_width, const int16_t* tile, int tile_stride)
+{
+    const TransformDsp* dsp = transform_dsp_get();
+    int valid = component->width - col;
+
+    if (valid <= 0) return;
+    if (valid > tile_width) valid = tile_width;
+
+    for (int r = 0; r < tile_height && row + r < component->height; r++) {
+        dsp->unshift_128_store_row(tile + r * tile_stride, component->raw_data + (row + r) * component->width + col, valid);
     }
 }
 
@@ -147,91 +215,645 @@ void idct_block_8x8(int16_t* block, int padded_width)
 
 }
 
-/*  function: dct_2d()
+/*  function: fdct_int_block_8x8()
     Params:
-        YUVFrame* frame : yuv frame
+        int16_t* block   : yuv padded data的一個block資料
+        int padded_width : padded data的width
 
     Return:
-        根據YUV format，對yuv的padded data的每個block各自做DCT
+        對block data做整數的separable fast DCT
 
     Result:
-        得到yuv的padded data的DCT結果
+        1. 先對每個row做1-D DCT (butterfly)，再對每個column做1-D DCT
+        2. 只使用整數乘法/加法/位移，不需要cos()和round()
+        3. 結果的scale和dct_block_8x8()相同
  */
-void dct_2d(YUVFrame* frame)
+void fdct_int_block_8x8(int16_t* block, int padded_width)
 {
-    // Y component
-    if (frame->y.block_info.b_size == BLOCK_8x8) {
-        for (int row = 0; row < frame->y.padded_height; row += 8) {
-            for (int col = 0; col < frame->y.padded_width; col += 8) {
-                dct_block_8x8(frame->y.padded_data + (row * frame->y.padded_width + col), frame->y.padded_width);
-            }
-        }
-    } else {
+    int32_t workspace[64];
+    int32_t tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+    int32_t tmp10, tmp11, tmp12, tmp13;
+    int32_t z1, z2, z3, z4, z5;
+
+    /* Pass 1: 處理row，結果放大2^PASS1_BITS倍 */
+    for (int row = 0; row < 8; row++) {
+        int16_t* in = block + row * padded_width;
+        int32_t* out = workspace + row * 8;
+
+        tmp0 = in[0] + in[7];
+        tmp7 = in[0] - in[7];
+        tmp1 = in[1] + in[6];
+        tmp6 = in[1] - in[6];
+        tmp2 = in[2] + in[5];
+        tmp5 = in[2] - in[5];
+        tmp3 = in[3] + in[4];
+        tmp4 = in[3] - in[4];
+
+        /* Even part */
+        tmp10 = tmp0 + tmp3;
+        tmp13 = tmp0 - tmp3;
+        tmp11 = tmp1 + tmp2;
+        tmp12 = tmp1 - tmp2;
+
+        out[0] = (tmp10 + tmp11) * (1 << PASS1_BITS);
+        out[4] = (tmp10 - tmp11) * (1 << PASS1_BITS);
+
+        z1 = (tmp12 + tmp13) * FIX_0_541196100;
+        out[2] = DESCALE(z1 + tmp13 * FIX_0_765366865, CONST_BITS-PASS1_BITS);
+        out[6] = DESCALE(z1 - tmp12 * FIX_1_847759065, CONST_BITS-PASS1_BITS);
+
+        /* Odd part */
+        z1 = tmp4 + tmp7;
+        z2 = tmp5 + tmp6;
+        z3 = tmp4 + tmp6;
+        z4 = tmp5 + tmp7;
+        z5 = (z3 + z4) * FIX_1_175875602;
+
+        tmp4 *= FIX_0_298631336;
+        tmp5 *= FIX_2_053119869;
+        tmp6 *= FIX_3_072711026;
+        tmp7 *= FIX_1_501321110;
+        z1 *= -FIX_0_899976223;
+        z2 *= -FIX_2_562915447;
+        z3 *= -FIX_1_961570560;
+        z4 *= -FIX_0_390180644;
+
+        z3 += z5;
+        z4 += z5;
+
+        out[7] = DESCALE(tmp4 + z1 + z3, CONST_BITS-PASS1_BITS);
+        out[5] = DESCALE(tmp5 + z2 + z4, CONST_BITS-PASS1_BITS);
+        out[3] = DESCALE(tmp6 + z2 + z3, CONST_BITS-PASS1_BITS);
+        out[1] = DESCALE(tmp7 + z1 + z4, CONST_BITS-PASS1_BITS);
+    }
 
+    /* Pass 2: 處理column，移除PASS1_BITS以及8倍的scale (2-D DCT的1/8) */
+    for (int col = 0; col < 8; col++) {
+        int32_t* in = workspace + col;
+        int16_t* out = block + col;
+
+        tmp0 = in[8*0] + in[8*7];
+        tmp7 = in[8*0] - in[8*7];
+        tmp1 = in[8*1] + in[8*6];
+        tmp6 = in[8*1] - in[8*6];
+        tmp2 = in[8*2] + in[8*5];
+        tmp5 = in[8*2] - in[8*5];
+        tmp3 = in[8*3] + in[8*4];
+        tmp4 = in[8*3] - in[8*4];
+
+        /* Even part */
+        tmp10 = tmp0 + tmp3;
+        tmp13 = tmp0 - tmp3;
+        tmp11 = tmp1 + tmp2;
+        tmp12 = tmp1 - tmp2;
+
+        out[0*padded_width] = (int16_t)DESCALE(tmp10 + tmp11, PASS1_BITS+3);
+        out[4*padded_width] = (int16_t)DESCALE(tmp10 - tmp11, PASS1_BITS+3);
+
+        z1 = (tmp12 + tmp13) * FIX_0_541196100;
+        out[2*padded_width] = (int16_t)DESCALE(z1 + tmp13 * FIX_0_765366865, CONST_BITS+PASS1_BITS+3);
+        out[6*padded_width] = (int16_t)DESCALE(z1 - tmp12 * FIX_1_847759065, CONST_BITS+PASS1_BITS+3);
+
+        /* Odd part */
+        z1 = tmp4 + tmp7;
+        z2 = tmp5 + tmp6;
+        z3 = tmp4 + tmp6;
+        z4 = tmp5 + tmp7;
+        z5 = (z3 + z4) * FIX_1_175875602;
+
+        tmp4 *= FIX_0_298631336;
+        tmp5 *= FIX_2_053119869;
+        tmp6 *= FIX_3_072711026;
+        tmp7 *= FIX_1_501321110;
+        z1 *= -FIX_0_899976223;
+        z2 *= -FIX_2_562915447;
+        z3 *= -FIX_1_961570560;
+        z4 *= -FIX_0_390180644;
+
+        z3 += z5;
+        z4 += z5;
+
+        out[7*padded_width] = (int16_t)DESCALE(tmp4 + z1 + z3, CONST_BITS+PASS1_BITS+3);
+        out[5*padded_width] = (int16_t)DESCALE(tmp5 + z2 + z4, CONST_BITS+PASS1_BITS+3);
+        out[3*padded_width] = (int16_t)DESCALE(tmp6 + z2 + z3, CONST_BITS+PASS1_BITS+3);
+        out[1*padded_width] = (int16_t)DESCALE(tmp7 + z1 + z4, CONST_BITS+PASS1_BITS+3);
     }
+}
 
-    // U component
-    if (frame->u.block_info.b_size == BLOCK_8x8) {
-        for (int row = 0; row < frame->u.padded_height; row += 8) {
-            for (int col = 0; col < frame->u.padded_width; col += 8) {
-                dct_block_8x8(frame->u.padded_data + (row * frame->u.padded_width + col), frame->u.padded_width);
-            }
-        }
-    } else {
+/*  function: idct_int_block_8x8()
+    Params:
+        int16_t* block   : yuv padded data的一個block資料 (DCT係數)
+        int padded_width : padded data的width
+
+    Return:
+        對block data做整數的separable fast IDCT
+
+    Result:
+        1. 先對每個column做1-D IDCT (butterfly)，再對每個row做1-D IDCT
+        2. 只使用整數乘法/加法/位移，結果的scale和idct_block_8x8()相同
+ */
+void idct_int_block_8x8(int16_t* block, int padded_width)
+{
+    int32_t workspace[64];
+    int32_t tmp0, tmp1, tmp2, tmp3;
+    int32_t tmp10, tmp11, tmp12, tmp13;
+    int32_t z1, z2, z3, z4, z5;
+
+    /* Pass 1: 處理column，結果放大2^PASS1_BITS倍 */
+    for (int col = 0; col < 8; col++) {
+        int16_t* in = block + col;
+        int32_t* out = workspace + col;
+
+        /* Even part */
+        z2 = in[2*padded_width];
+        z3 = in[6*padded_width];
+        z1 = (z2 + z3) * FIX_0_541196100;
+        tmp2 = z1 - z3 * FIX_1_847759065;
+        tmp3 = z1 + z2 * FIX_0_765366865;
+
+        z2 = in[0*padded_width];
+        z3 = in[4*padded_width];
+        tmp0 = (z2 + z3) * (1 << CONST_BITS);
+        tmp1 = (z2 - z3) * (1 << CONST_BITS);
+
+        tmp10 = tmp0 + tmp3;
+        tmp13 = tmp0 - tmp3;
+        tmp11 = tmp1 + tmp2;
+        tmp12 = tmp1 - tmp2;
+
+        /* Odd part */
+        tmp0 = in[7*padded_width];
+        tmp1 = in[5*padded_width];
+        tmp2 = in[3*padded_width];
+        tmp3 = in[1*padded_width];
+
+        z1 = tmp0 + tmp3;
+        z2 = tmp1 + tmp2;
+        z3 = tmp0 + tmp2;
+        z4 = tmp1 + tmp3;
+        z5 = (z3 + z4) * FIX_1_175875602;
+
+        tmp0 *= FIX_0_298631336;
+        tmp1 *= FIX_2_053119869;
+        tmp2 *= FIX_3_072711026;
+        tmp3 *= FIX_1_501321110;
+        z1 *= -FIX_0_899976223;
+        z2 *= -FIX_2_562915447;
+        z3 *= -FIX_1_961570560;
+        z4 *= -FIX_0_390180644;
+
+        z3 += z5;
+        z4 += z5;
+
+        tmp0 += z1 + z3;
+        tmp1 += z2 + z4;
+        tmp2 += z2 + z3;
+        tmp3 += z1 + z4;
+
+        out[8*0] = DESCALE(tmp10 + tmp3, CONST_BITS-PASS1_BITS);
+        out[8*7] = DESCALE(tmp10 - tmp3, CONST_BITS-PASS1_BITS);
+        out[8*1] = DESCALE(tmp11 + tmp2, CONST_BITS-PASS1_BITS);
+        out[8*6] = DESCALE(tmp11 - tmp2, CONST_BITS-PASS1_BITS);
+        out[8*2] = DESCALE(tmp12 + tmp1, CONST_BITS-PASS1_BITS);
+        out[8*5] = DESCALE(tmp12 - tmp1, CONST_BITS-PASS1_BITS);
+        out[8*3] = DESCALE(tmp13 + tmp0, CONST_BITS-PASS1_BITS);
+        out[8*4] = DESCALE(tmp13 - tmp0, CONST_BITS-PASS1_BITS);
+    }
 
+    /* Pass 2: 處理row，移除PASS1_BITS以及8倍的scale */
+    for (int row = 0; row < 8; row++) {
+        int32_t* in = workspace + row * 8;
+        int16_t* out = block + row * padded_width;
+
+        /* Even part */
+        z2 = in[2];
+        z3 = in[6];
+        z1 = (z2 + z3) * FIX_0_541196100;
+        tmp2 = z1 - z3 * FIX_1_847759065;
+        tmp3 = z1 + z2 * FIX_0_765366865;
+
+        tmp0 = (in[0] + in[4]) * (1 << CONST_BITS);
+        tmp1 = (in[0] - in[4]) * (1 << CONST_BITS);
+
+        tmp10 = tmp0 + tmp3;
+        tmp13 = tmp0 - tmp3;
+        tmp11 = tmp1 + tmp2;
+        tmp12 = tmp1 - tmp2;
+
+        /* Odd part */
+        tmp0 = in[7];
+        tmp1 = in[5];
+        tmp2 = in[3];
+        tmp3 = in[1];
+
+        z1 = tmp0 + tmp3;
+        z2 = tmp1 + tmp2;
+        z3 = tmp0 + tmp2;
+        z4 = tmp1 + tmp3;
+        z5 = (z3 + z4) * FIX_1_175875602;
+
+        tmp0 *= FIX_0_298631336;
+        tmp1 *= FIX_2_053119869;
+        tmp2 *= FIX_3_072711026;
+        tmp3 *= FIX_1_501321110;
+        z1 *= -FIX_0_899976223;
+        z2 *= -FIX_2_562915447;
+        z3 *= -FIX_1_961570560;
+        z4 *= -FIX_0_390180644;
+
+        z3 += z5;
+        z4 += z5;
+
+        tmp0 += z1 + z3;
+        tmp1 += z2 + z4;
+        tmp2 += z2 + z3;
+        tmp3 += z1 + z4;
+
+        out[0] = (int16_t)DESCALE(tmp10 + tmp3, CONST_BITS+PASS1_BITS+3);
+        out[7] = (int16_t)DESCALE(tmp10 - tmp3, CONST_BITS+PASS1_BITS+3);
+        out[1] = (int16_t)DESCALE(tmp11 + tmp2, CONST_BITS+PASS1_BITS+3);
+        out[6] = (int16_t)DESCALE(tmp11 - tmp2, CONST_BITS+PASS1_BITS+3);
+        out[2] = (int16_t)DESCALE(tmp12 + tmp1, CONST_BITS+PASS1_BITS+3);
+        out[5] = (int16_t)DESCALE(tmp12 - tmp1, CONST_BITS+PASS1_BITS+3);
+        out[3] = (int16_t)DESCALE(tmp13 + tmp0, CONST_BITS+PASS1_BITS+3);
+        out[4] = (int16_t)DESCALE(tmp13 - tmp0, CONST_BITS+PASS1_BITS+3);
     }
+}
 
-    // V component
-    if (frame->v.block_info.b_size == BLOCK_8x8) {
-        for (int row = 0; row < frame->v.padded_height; row += 8) {
-            for (int col = 0; col < frame->v.padded_width; col += 8) {
-                dct_block_8x8(frame->v.padded_data + (row * frame->v.padded_width + col), frame->v.padded_width);
-            }
+/*  function: idct_int_block_8x8_dc()
+    Params:
+        int16_t* block   : yuv padded data的一個block資料 (只有DC係數非零)
+        int padded_width : padded data的width
+
+    Return:
+        對只有DC的block做IDCT
+
+    Result:
+        AC全為0時，兩個pass的butterfly都只剩DC項，64個輸出都等於DESCALE(dc, 3)
+        結果和idct_int_block_8x8()完全相同
+ */
+void idct_int_block_8x8_dc(int16_t* block, int padded_width)
+{
+    int16_t dc = (int16_t)DESCALE((int32_t)block[0], 3);
+
+    for (int row = 0; row < 8; row++) {
+        int16_t* out = block + row * padded_width;
+        for (int col = 0; col < 8; col++) {
+            out[col] = dc;
         }
-    } else {
+    }
+}
+
+/*  function: idct_int_block_8x8_low4x4()
+    Params:
+        int16_t* block   : yuv padded data的一個block資料 (非零係數都在左上角4x4)
+        int padded_width : padded data的width
+
+    Return:
+        對只有低頻係數的block做整數IDCT
+
+    Result:
+        1. 輸入的第4~7項都是0，butterfly只需要in[0]~in[3]，乘法從12個減少為9個
+        2. pass 1只需要處理前4個column (後4個column的輸出都是0)
+        結果和idct_int_block_8x8()完全相同
+ */
+void idct_int_block_8x8_low4x4(int16_t* block, int padded_width)
+{
+    int32_t workspace[64];
+    int32_t tmp0, tmp1, tmp2, tmp3;
+    int32_t tmp10, tmp11, tmp12, tmp13;
+    int32_t z1, z2, z3, z4, z5;
+
+    /* Pass 1: 處理前4個column，結果放大2^PASS1_BITS倍 */
+    for (int col = 0; col < 4; col++) {
+        int16_t* in = block + col;
+        int32_t* out = workspace + col;
+
+        /* Even part */
+        z2 = in[2*padded_width];
+        z1 = z2 * FIX_0_541196100;
+        tmp2 = z1;
+        tmp3 = z1 + z2 * FIX_0_765366865;
+        tmp0 = in[0] * (1 << CONST_BITS);
+
+        tmp10 = tmp0 + tmp3;
+        tmp13 = tmp0 - tmp3;
+        tmp11 = tmp0 + tmp2;
+        tmp12 = tmp0 - tmp2;
+
+        /* Odd part */
+        z2 = in[3*padded_width];
+        z4 = in[1*padded_width];
+        z5 = (z2 + z4) * FIX_1_175875602;
+
+        tmp2 = z2 * FIX_3_072711026;
+        tmp3 = z4 * FIX_1_501321110;
+        z1 = z4 * -FIX_0_899976223;
+        z3 = z2 * -FIX_1_961570560 + z5;
+        z2 = z2 * -FIX_2_562915447;
+        z4 = z4 * -FIX_0_390180644 + z5;
+
+        tmp0 = z1 + z3;
+        tmp1 = z2 + z4;
+        tmp2 += z2 + z3;
+        tmp3 += z1 + z4;
+
+        out[8*0] = DESCALE(tmp10 + tmp3, CONST_BITS-PASS1_BITS);
+        out[8*7] = DESCALE(tmp10 - tmp3, CONST_BITS-PASS1_BITS);
+        out[8*1] = DESCALE(tmp11 + tmp2, CONST_BITS-PASS1_BITS);
+        out[8*6] = DESCALE(tmp11 - tmp2, CONST_BITS-PASS1_BITS);
+        out[8*2] = DESCALE(tmp12 + tmp1, CONST_BITS-PASS1_BITS);
+        out[8*5] = DESCALE(tmp12 - tmp1, CONST_BITS-PASS1_BITS);
+        out[8*3] = DESCALE(tmp13 + tmp0, CONST_BITS-PASS1_BITS);
+        out[8*4] = DESCALE(tmp13 - tmp0, CONST_BITS-PASS1_BITS);
+    }
 
+    /* Pass 2: 處理row (每個row只有前4項非零)，移除PASS1_BITS以及8倍的scale */
+    for (int row = 0; row < 8; row++) {
+        int32_t* in = workspace + row * 8;
+        int16_t* out = block + row * padded_width;
+
+        /* Even part */
+        z2 = in[2];
+        z1 = z2 * FIX_0_541196100;
+        tmp2 = z1;
+        tmp3 = z1 + z2 * FIX_0_765366865;
+        tmp0 = in[0] * (1 << CONST_BITS);
+
+        tmp10 = tmp0 + tmp3;
+        tmp13 = tmp0 - tmp3;
+        tmp11 = tmp0 + tmp2;
+        tmp12 = tmp0 - tmp2;
+
+        /* Odd part */
+        z2 = in[3];
+        z4 = in[1];
+        z5 = (z2 + z4) * FIX_1_175875602;
+
+        tmp2 = z2 * FIX_3_072711026;
+        tmp3 = z4 * FIX_1_501321110;
+        z1 = z4 * -FIX_0_899976223;
+        z3 = z2 * -FIX_1_961570560 + z5;
+        z2 = z2 * -FIX_2_562915447;
+        z4 = z4 * -FIX_0_390180644 + z5;
+
+        tmp0 = z1 + z3;
+        tmp1 = z2 + z4;
+        tmp2 += z2 + z3;
+        tmp3 += z1 + z4;
+
+        out[0] = (int16_t)DESCALE(tmp10 + tmp3, CONST_BITS+PASS1_BITS+3);
+        out[7] = (int16_t)DESCALE(tmp10 - tmp3, CONST_BITS+PASS1_BITS+3);
+        out[1] = (int16_t)DESCALE(tmp11 + tmp2, CONST_BITS+PASS1_BITS+3);
+        out[6] = (int16_t)DESCALE(tmp11 - tmp2, CONST_BITS+PASS1_BITS+3);
+        out[2] = (int16_t)DESCALE(tmp12 + tmp1, CONST_BITS+PASS1_BITS+3);
+        out[5] = (int16_t)DESCALE(tmp12 - tmp1, CONST_BITS+PASS1_BITS+3);
+        out[3] = (int16_t)DESCALE(tmp13 + tmp0, CONST_BITS+PASS1_BITS+3);
+        out[4] = (int16_t)DESCALE(tmp13 - tmp0, CONST_BITS+PASS1_BITS+3);
     }
 }
 
-void idct_2d(YUVFrame* frame)
+/*  function: dct_block_4x4()
+    Params:
+        int16_t* block   : yuv padded data的一個4x4 block資料
+        int padded_width : padded data的width
+
+    Return:
+        對block data做H.264的4x4整數core transform (W = Cf * X * Cf^T)
+
+    Result:
+        1. 只使用加法和乘2 (d03、d12可能是負數，不使用<<)
+        2. 結果沒有normalize，每個位置的scale (a^2, ab/2, b^2/4) 在quantization時補回
+ */
+void dct_block_4x4(int16_t* block, int padded_width)
 {
-    // Y component
-    if (frame->y.block_info.b_size == BLOCK_8x8) {
-        for (int row = 0; row < frame->y.padded_height; row += 8) {
-            for (int col = 0; col < frame->y.padded_width; col += 8) {
-                idct_block_8x8(frame->y.padded_data + (row * frame->y.padded_width + col), frame->y.padded_width);
-            }
+    int32_t temp[16];
+
+    /* 對每個row做1-D core transform */
+    for (int row = 0; row < 4; row++) {
+        int16_t* in = block + row * padded_width;
+        int32_t s03 = in[0] + in[3];
+        int32_t d03 = in[0] - in[3];
+        int32_t s12 = in[1] + in[2];
+        int32_t d12 = in[1] - in[2];
+
+        temp[row*4 + 0] = s03 + s12;
+        temp[row*4 + 1] = 2 * d03 + d12;
+        temp[row*4 + 2] = s03 - s12;
+        temp[row*4 + 3] = d03 - 2 * d12;
+    }
+
+    /* 對每個column做1-D core transform */
+    for (int col = 0; col < 4; col++) {
+        int32_t s03 = temp[0*4 + col] + temp[3*4 + col];
+        int32_t d03 = temp[0*4 + col] - temp[3*4 + col];
+        int32_t s12 = temp[1*4 + col] + temp[2*4 + col];
+        int32_t d12 = temp[1*4 + col] - temp[2*4 + col];
+
+        block[0*padded_width + col] = (int16_t)(s03 + s12);
+        block[1*padded_width + col] = (int16_t)(2 * d03 + d12);
+        block[2*padded_width + col] = (int16_t)(s03 - s12);
+        block[3*padded_width + col] = (int16_t)(d03 - 2 * d12);
+    }
+}
+
+/*  function: idct_block_4x4()
+    Params:
+        int16_t* block   : yuv padded data的一個4x4 block資料 (反量化後的係數，已經乘上scale*64)
+        int padded_width : padded data的width
+
+    Return:
+        對block data做H.264的4x4整數inverse core transform
+
+    Result:
+        1. 只使用加法和位移 (1/2的係數用右移1 bit)
+        2. 最後除以64並四捨五入，得到還原的pixel (128-shift後)
+ */
+void idct_block_4x4(int16_t* block, int padded_width)
+{
+    int32_t temp[16];
+
+    /* 對每個row做1-D inverse core transform */
+    for (int row = 0; row < 4; row++) {
+        int16_t* in = block + row * padded_width;
+        int32_t e = in[0] + in[2];
+        int32_t f = in[0] - in[2];
+        int32_t g = (in[1] >> 1) - in[3];
+        int32_t h = in[1] + (in[3] >> 1);
+
+        temp[row*4 + 0] = e + h;
+        temp[row*4 + 1] = f + g;
+        temp[row*4 + 2] = f - g;
+        temp[row*4 + 3] = e - h;
+    }
+
+    /* 對每個column做1-D inverse core transform，再除以64 */
+    for (int col = 0; col < 4; col++) {
+        int32_t e = temp[0*4 + col] + temp[2*4 + col];
+        int32_t f = temp[0*4 + col] - temp[2*4 + col];
+        int32_t g = (temp[1*4 + col] >> 1) - temp[3*4 + col];
+        int32_t h = temp[1*4 + col] + (temp[3*4 + col] >> 1);
+
+        block[0*padded_width + col] = (int16_t)((e + h + 32) >> 6);
+        block[1*padded_width + col] = (int16_t)((f + g + 32) >> 6);
+        block[2*padded_width + col] = (int16_t)((f - g + 32) >> 6);
+        block[3*padded_width + col] = (int16_t)((e - h + 32) >> 6);
+    }
+}
+
+/*  function: forward_transform_blocks()
+    Params:
+        int16_t* blocks              : 水平相鄰的num_blocks個blocks (已經做過128-shift)
+        int stride                   : blocks所在buffer的width
+        int num_blocks               : block個數
+        BlockSize b_size             : 4x4或8x8 block
+        TransformType transform_type : 8x8 block使用reference或是整數fast DCT
+
+    Return:
+        對每個block做DCT的結果
+
+    Result:
+        整數fast DCT一次處理所有blocks，使用CPU支援的SIMD kernel
+        4x4 block一律使用H.264的整數core transform
+        component (多次pass) 和fused pipeline (tile) 共用這個函式
+ */
+void forward_transform_blocks(int16_t* blocks, int stride, int num_blocks, BlockSize b_size, TransformType transform_type)
+{
+    if (b_size == BLOCK_4x4) {
+        for (int i = 0; i < num_blocks; i++) {
+            dct_block_4x4(blocks + i * 4, stride);
         }
+    } else if (transform_type == DCT_INT_FAST) {
+        transform_dsp_get()->fdct_8x8_blocks(blocks, stride, num_blocks);
     } else {
-
+        for (int i = 0; i < num_blocks; i++) {
+            dct_block_8x8(blocks + i * 8, stride);
+        }
     }
+}
 
-    // U component
-    if (frame->u.block_info.b_size == BLOCK_8x8) {
-        for (int row = 0; row < frame->u.padded_height; row += 8) {
-            for (int col = 0; col < frame->u.padded_width; col += 8) {
-                idct_block_8x8(frame->u.padded_data + (row * frame->u.padded_width + col), frame->u.padded_width);
-            }
+void inverse_transform_blocks(int16_t* blocks, int stride, int num_blocks, BlockSize b_size, TransformType transform_type)
+{
+    if (b_size == BLOCK_4x4) {
+        for (int i = 0; i < num_blocks; i++) {
+            idct_block_4x4(blocks + i * 4, stride);
         }
+    } else if (transform_type == DCT_INT_FAST) {
+        transform_dsp_get()->idct_8x8_blocks(blocks, stride, num_blocks);
     } else {
+        for (int i = 0; i < num_blocks; i++) {
+            idct_block_8x8(blocks + i * 8, stride);
+        }
+    }
+}
+
+/*  function: inverse_transform_sparse_blocks()
+    Params:
+        int16_t* blocks                : 水平相鄰的blocks (DCT係數)
+        int stride                     : blocks的row stride
+        int num_blocks                 : block個數
+        const BlockSparsity* sparsity  : 每個block非零係數的分布 (由entropy decoder得到)
+        BlockSize b_size               : block大小
+        TransformType transform_type   : 使用reference或是整數fast IDCT
 
+    Return:
+        對每個block做IDCT
+
+    Result:
+        整數fast IDCT的8x8 block依照sparsity選擇kernel:
+        1. BLOCK_SPARSE_DC_ONLY : 直接填DC值
+        2. BLOCK_SPARSE_LOW_4x4 : 只做左上角4x4係數的butterfly
+        3. BLOCK_SPARSE_FULL    : 完整的IDCT
+        2、3相鄰的同種blocks一起交給SIMD kernel
+        其他情況同inverse_transform_blocks()，結果完全相同
+ */
+void inverse_transform_sparse_blocks(int16_t* blocks, int stride, int num_blocks, const BlockSparsity* sparsity, BlockSize b_size, TransformType transform_type)
+{
+    if (b_size == BLOCK_4x4 || transform_type != DCT_INT_FAST) {
+        inverse_transform_blocks(blocks, stride, num_blocks, b_size, transform_type);
+        return;
     }
 
-    // V component
-    if (frame->v.block_info.b_size == BLOCK_8x8) {
-        for (int row = 0; row < frame->v.padded_height; row += 8) {
-            for (int col = 0; col < frame->v.padded_width; col += 8) {
-                idct_block_8x8(frame->v.padded_data + (row * frame->v.padded_width + col), frame->v.padded_width);
-            }
+    const TransformDsp* dsp = transform_dsp_get();
+    int i = 0;
+
+    while (i < num_blocks) {
+        if (sparsity[i] == BLOCK_SPARSE_DC_ONLY) {
+            idct_int_block_8x8_dc(blocks + i * 8, stride);
+            i++;
+            continue;
         }
-    } else {
 
+        /* 相同種類的相鄰blocks一起交給SIMD kernel */
+        int run = 1;
+        while (i + run < num_blocks && sparsity[i + run] == sparsity[i]) run++;
+
+        if (sparsity[i] == BLOCK_SPARSE_LOW_4x4) {
+            dsp->idct_8x8_low4x4_blocks(blocks + i * 8, stride, run);
+        } else {
+            dsp->idct_8x8_blocks(blocks + i * 8, stride, run);
+        }
+        i += run;
     }
 }
 
+/*  function: dct_component()
+    Params:
+        Component* comp              : frame的y/u/v其中一個component
+        TransformType transform_type : 8x8 block使用reference或是整數fast DCT
+
+    Return:
+        對component的每個block做DCT
+
+    Result:
+        一次處理一整排 (block row) 的blocks
+ */
+void dct_component(Component* comp, TransformType transform_type)
+{
+    for (int row = 0; row < comp->padded_height; row += comp->block_info.height) {
+        forward_transform_blocks(comp->padded_data + row * comp->padded_width, comp->padded_width,
+                                 comp->padded_width / comp->block_info.width, comp->block_info.b_size, transform_type);
+    }
+}
+
+void idct_component(Component* comp, TransformType transform_type)
+{
+    for (int row = 0; row < comp->padded_height; row += comp->block_info.height) {
+        inverse_transform_blocks(comp->padded_data + row * comp->padded_width, comp->padded_width,
+                                 comp->padded_width / comp->block_info.width, comp->block_info.b_size, transform_type);
+    }
+}
+
+/*  function: dct_2d()
+    Params:
+        YUVFrame* frame              : yuv frame
+        TransformType transform_type : 8x8 block使用reference或是整數fast DCT
+
+    Return:
+        根據YUV format，對yuv的padded data的每個block各自做DCT
+        4x4 block一律使用H.264的整數core transform
+
+    Result:
+        得到yuv的padded data的DCT結果
+ */
+void dct_2d(YUVFrame* frame, TransformType transform_type)
+{
+    dct_component(&frame->y, transform_type);
+    dct_component(&frame->u, transform_type);
+    dct_component(&frame->v, transform_type);
+}
+
+void idct_2d(YUVFrame* frame, TransformType transform_type)
+{
+    idct_component(&frame->y, transform_type);
+    idct_component(&frame->u, transform_type);
+    idct_component(&frame->v, transform_type);
+}
+
 /*  function: transform_frame()
     Params:
-        YUVFrame* frame : yuv raw data frame
+        YUVFrame* frame              : yuv raw data frame
+        TransformType transform_type : 使用reference或是整數fast DCT
 
     Return:
         對padded data做DCT forward結果
@@ -240,7 +862,7 @@ void idct_2d(YUVFrame* frame)
         1. 對frame的padded buffer做128-shift (不是對raw data的buffer做shift)
         2. 對shift結果做DCT
  */
-void transform_frame(YUVFrame* frame)
+void transform_frame(YUVFrame* frame, TransformType transform_type)
 {
     /* 對y/u/v的padded buffer做128-shift */
     shift_128(&frame->y);
@@ -248,15 +870,102 @@ void transform_frame(YUVFrame* frame)
     shift_128(&frame->v);
 
     /* 對shifted data做DCT forward */
-    dct_2d(frame);
+    dct_2d(frame, transform_type);
 }
 
 
-void reverse_transform_frame(YUVFrame* frame)
+void reverse_transform_frame(YUVFrame* frame, TransformType transform_type)
 {
-    idct_2d(frame);
+    idct_2d(frame, transform_type);
 
     unshift_128(&frame->y);
     unshift_128(&frame->u);
     unshift_128(&frame->v);
 }
+
+
+/*  function: transform_accuracy_report()
+    Params:
+        int num_blocks : 測試用的random block個數
+
+    Return:
+        None
+
+    Result:
+        1. 以固定seed產生random的8x8 blocks (值域和128-shift後相同: [-128,127])
+        2. 比較整數fast DCT/IDCT和reference DCT/IDCT的差異
+        3. 印出最大誤差、平均平方誤差(MSE)、以及不相同的係數比例
+        4. 確認SIMD kernels和scalar整數版本的結果相同
+ */
+void transform_accuracy_report(int num_blocks)
+{
+    int16_t ref_block[64], fast_block[64], coeff_block[64];
+    uint32_t seed = 1;
+    int fdct_max_err = 0, idct_max_err = 0;
+    long fdct_mismatch = 0, idct_mismatch = 0;
+    double fdct_sq_err = 0.0, idct_sq_err = 0.0;
+    long total = (long)num_blocks * 64;
+
+    if (num_blocks <= 0) return;
+
+    for (int b = 0; b < num_blocks; b++) {
+        /* 產生random block (LCG) */
+        for (int i = 0; i < 64; i++) {
+            seed = seed * 1103515245u + 12345u;
+            ref_block[i] = (int16_t)((seed >> 16) % 256) - 128;
+            fast_block[i] = ref_block[i];
+        }
+
+        /* Forward: 比較兩種DCT的係數 */
+        dct_block_8x8(ref_block, 8);
+        fdct_int_block_8x8(fast_block, 8);
+        for (int i = 0; i < 64; i++) {
+            int err = abs(ref_block[i] - fast_block[i]);
+            if (err > fdct_max_err) fdct_max_err = err;
+            if (err != 0) fdct_mismatch++;
+            fdct_sq_err += (double)err * err;
+        }
+
+        /* Inverse: 用同一組reference係數，比較兩種IDCT還原的pixel */
+        for (int i = 0; i < 64; i++) {
+            coeff_block[i] = ref_block[i];
+            fast_block[i] = ref_block[i];
+        }
+        idct_block_8x8(coeff_block, 8);
+        idct_int_block_8x8(fast_block, 8);
+        for (int i = 0; i < 64; i++) {
+            int err = abs(coeff_block[i] - fast_block[i]);
+            if (err > idct_max_err) idct_max_err = err;
+            if (err != 0) idct_mismatch++;
+            idct_sq_err += (double)err * err;
+        }
+    }
+
+    /* 確認目前使用的SIMD kernels和scalar整數版本bit-exact */
+    const TransformDsp* dsp = transform_dsp_get();
+    long simd_mismatch = 0;
+    seed = 1;
+    for (int b = 0; b < num_blocks; b++) {
+        for (int i = 0; i < 64; i++) {
+            seed = seed * 1103515245u + 12345u;
+            ref_block[i] = (int16_t)((seed >> 16) % 256) - 128;
+            fast_block[i] = ref_block[i];
+        }
+        fdct_int_block_8x8(ref_block, 8);
+        dsp->fdct_8x8_blocks(fast_block, 8, 1);
+        for (int i = 0; i < 64; i++) {
+            if (ref_block[i] != fast_block[i]) simd_mismatch++;
+            fast_block[i] = ref_block[i];
+        }
+        idct_int_block_8x8(ref_block, 8);
+        dsp->idct_8x8_blocks(fast_block, 8, 1);
+        for (int i = 0; i < 64; i++) {
+            if (ref_block[i] != fast_block[i]) simd_mismatch++;
+        }
+    }
+
+    printf("Transform accuracy (DCT_INT_FAST vs DCT_REFERENCE, %d random blocks)\n", num_blocks);
+    printf("  FDCT: max error=%d  MSE=%.6f  mismatch=%.4f%%\n", fdct_max_err, fdct_sq_err / total, 100.0 * fdct_mismatch / total);
+    printf("  IDCT: max error=%d  MSE=%.6f  mismatch=%.4f%%\n", idct_max_err, idct_sq_err / total, 100.0 * idct_mismatch / total);
+    printf("  %s kernels vs scalar: %ld mismatched coefficients/pixels\n", simd_level_name(dsp->level), simd_mismatch);
+}
@@ -0,0 +1,130 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include"cpu.h"
+#include"transform_simd.h"
+
+static TransformDsp transform_dsp;
+static int transform_dsp_initialized = 0;
+
+
+void fdct_8x8_blocks_scalar(int16_t* blocks, int stride, int num_blocks)
+{
+    for (int i = 0; i < num_blocks; i++) {
+        fdct_int_block_8x8(blocks + i * 8, stride);
+    }
+}
+
+void idct_8x8_blocks_scalar(int16_t* blocks, int stride, int num_blocks)
+{
+    for (int i = 0; i < num_blocks; i++) {
+        idct_int_block_8x8(blocks + i * 8, stride);
+    }
+}
+
+void idct_8x8_low4x4_blocks_scalar(int16_t* blocks, int stride, int num_blocks)
+{
+    for (int i = 0; i < num_blocks; i++) {
+        idct_int_block_8x8_low4x4(blocks + i * 8, stride);
+    }
+}
+
+void shift_128_row_scalar(const uint8_t* src, int16_t* dst, int width)
+{
+    for (int i = 0; i < width; i++) {
+        dst[i] = (int16_t)(src[i] - 128);
+    }
+}
+
+void unshift_128_row_scalar(int16_t* data, int width)
+{
+    for (int i = 0; i < width; i++) {
+        int16_t value = data[i] + 128;
+
+        // 限制shift回來的值必須在[0,255]
+        if (value < 0) value = 0;
+        else if (value > 255) value = 255;
+
+        data[i] = value;
+    }
+}
+
+void unshift_128_store_row_scalar(const int16_t* src, uint8_t* dst, int width)
+{
+    for (int i = 0; i < width; i++) {
+        int16_t value = src[i] + 128;
+
+        // 限制shift回來的值必須在[0,255]
+        if (value < 0) value = 0;
+        else if (value > 255) value = 255;
+
+        dst[i] = (uint8_t)value;
+    }
+}
+
+
+/*  function: transform_dsp_init()
+    Params:
+        SimdLevel level : 要使用的SIMD等級 (已經確認CPU支援)
+
+    Return:
+        None
+
+    Result:
+        根據SIMD等級設定transform stage使用的kernels
+        所有SIMD版本和scalar整數版本的結果完全相同 (bit-exact)
+ */
+void transform_dsp_init(SimdLevel level)
+{
+    transform_dsp.level = SIMD_SCALAR;
+    transform_dsp.fdct_8x8_blocks = fdct_8x8_blocks_scalar;
+    transform_dsp.idct_8x8_blocks = idct_8x8_blocks_scalar;
+    transform_dsp.idct_8x8_low4x4_blocks = idct_8x8_low4x4_blocks_scalar;
+    transform_dsp.shift_128_row = shift_128_row_scalar;
+    transform_dsp.unshift_128_row = unshift_128_row_scalar;
+    transform_dsp.unshift_128_store_row = unshift_128_store_row_scalar;
+
+#if defined(__x86_64__) || defined(__i386__)
+    if (level == SIMD_SSE41) {
+        transform_dsp.level = SIMD_SSE41;
+        transform_dsp.fdct_8x8_blocks = fdct_8x8_blocks_sse41;
+        transform_dsp.idct_8x8_blocks = idct_8x8_blocks_sse41;
+        transform_dsp.idct_8x8_low4x4_blocks = idct_8x8_low4x4_blocks_sse41;
+        transform_dsp.shift_128_row = shift_128_row_sse41;
+        transform_dsp.unshift_128_row = unshift_128_row_sse41;
+        transform_dsp.unshift_128_store_row = unshift_128_store_row_sse41;
+    } else if (level == SIMD_AVX2) {
+        transform_dsp.level = SIMD_AVX2;
+        transform_dsp.fdct_8x8_blocks = fdct_8x8_blocks_avx2;
+        transform_dsp.idct_8x8_blocks = idct_8x8_blocks_avx2;
+        transform_dsp.idct_8x8_low4x4_blocks = idct_8x8_low4x4_blocks_avx2;
+        transform_dsp.shift_128_row = shift_128_row_avx2;
+        transform_dsp.unshift_128_row = unshift_128_row_avx2;
+        transform_dsp.unshift_128_store_row = unshift_128_store_row_avx2;
+    } else if (level == SIMD_AVX512) {
+        transform_dsp.level = SIMD_AVX512;
+        transform_dsp.fdct_8x8_blocks = fdct_8x8_blocks_avx512;
+        transform_dsp.idct_8x8_blocks = idct_8x8_blocks_avx512;
+        transform_dsp.idct_8x8_low4x4_blocks = idct_8x8_low4x4_blocks_avx512;
+        transform_dsp.shift_128_row = shift_128_row_avx512;
+        transform_dsp.unshift_128_row = unshift_128_row_avx512;
+        transform_dsp.unshift_128_store_row = unshift_128_store_row_avx512;
+    }
+#endif
+
+    transform_dsp_initialized = 1;
+}
+
+
+/*  function: transform_dsp_get()
+    Return:
+        目前使用的transform kernels
+        如果還沒有初始化，則依照CPUID (和VC_SIMD_LEVEL環境變數) 自動選擇
+ */
+const TransformDsp* transform_dsp_get(void)
+{
+    if (!transform_dsp_initialized) {
+        transform_dsp_init(simd_resolve_level(SIMD_AUTO));
+    }
+    return &transform_dsp;
+}
@@ -0,0 +1,569 @@
+#define _GNU_SOURCE  // fopencookie()
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<pthread.h>
+#include"vcodec.h"
+#include"transform_simd.h"
+#include"quantization/quant_simd.h"
+
+/* process共用的SIMD kernels和entropy資源，由contexts的個數決定何時建立/釋放 */
+static pthread_mutex_t vcodec_runtime_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int vcodec_runtime_refs = 0;
+static int vcodec_runtime_encoders = 0;
+static EntropyType vcodec_runtime_entropy_type;
+static EntropyConfig vcodec_runtime_entropy_config;
+
+
+/*  function: vcodec_runtime_acquire()
+    Params:
+        const VCodecParams* params : context的設定
+        int encoder                : 1: encoder context 0: decoder context
+
+    Return:
+        0 : 成功
+        -1: entropy設定和正在使用的不同
+
+    Result:
+        第一個context建立時選擇SIMD kernels並建立entropy coding的資源，之後的contexts只增加reference count
+        1. entropy_type和threads (thread pool的大小) 所有contexts必須相同
+        2. huffman_optimize/restart_interval/segment_index/scan_mode決定bitstream，所有encoders必須相同；
+           沒有其他encoder時，由這個encoder設定
+ */
+static int vcodec_runtime_acquire(const VCodecParams* params, int encoder)
+{
+    extern EntropyConfig jpeg_entropy_config;
+    const EntropyConfig* config = &params->entropy_config;
+    int ret = 0;
+
+    pthread_mutex_lock(&vcodec_runtime_mutex);
+    if (vcodec_runtime_refs == 0) {
+        transform_dsp_init(simd_resolve_level(params->simd_level));
+        quant_dsp_init(transform_dsp_get()->level);
+        entropy_initialization(params->entropy_type, config);
+        vcodec_runtime_entropy_type = params->entropy_type;
+        vcodec_runtime_entropy_config = *config;
+    } else if (params->entropy_type != vcodec_runtime_entropy_type || config->threads != vcodec_runtime_entropy_config.threads) {
+        fprintf(stderr, "Entropy type/threads must be the same as the running contexts (threads: %d)\n",
+                vcodec_runtime_entropy_config.threads);
+        ret = -1;
+    }
+
+    if (ret == 0 && encoder) {
+        EntropyConfig* running = &vcodec_runtime_entropy_config;
+        if (vcodec_runtime_encoders == 0) {
+            /* 沒有encoder在使用時，由這個encoder決定bitstream的設定 */
+            running->huffman_optimize = config->huffman_optimize;
+            running->restart_interval = config->restart_interval;
+            running->segment_index = config->segment_index;
+            running->scan_mode = config->scan_mode;
+            jpeg_entropy_config = *running;
+        } else if (config->huffman_optimize != running->huffman_optimize || config->restart_interval != running->restart_interval ||
+                   config->segment_index != running->segment_index || config->scan_mode != running->scan_mode) {
+            fprintf(stderr, "Entropy config must be the same as the running encoders (huffman_optimize: %d, restart_interval: %d, "
+                    "segment_index: %d, scan_mode: %d)\n", running->huffman_optimize, running->restart_interval,
+                    running->segment_index, running->scan_mode);
+            ret = -1;
+        }
+        if (ret == 0) vcodec_runtime_encoders++;
+    }
+
+    if (ret == 0) vcodec_runtime_refs++;
+    pthread_mutex_unlock(&vcodec_runtime_mutex);
+    return ret;
+}
+
+/*  function: vcodec_runtime_release()
+    Params:
+        int encoder : 1: encoder context 0: decoder context
+
+    Result:
+        最後一個context釋放時，釋放entropy coding的資源
+ */
+static void vcodec_runtime_release(int encoder)
+{
+    pthread_mutex_lock(&vcodec_runtime_mutex);
+    if (encoder) vcodec_runtime_encoders--;
+    vcodec_runtime_refs--;
+    if (vcodec_runtime_refs == 0) {
+        entropy_destropy(vcodec_runtime_entropy_type);
+    }
+    pthread_mutex_unlock(&vcodec_runtime_mutex);
+}
+
+/*  function: vcodec_create_frame()
+    Params:
+        const VCodecParams* params : frame大小、format和block設定
+
+    Return:
+        NULL : 記憶體配置失敗
+        YUVFrame* : 64-alignment的frame (MCU需要)，block資訊已經設定好
+ */
+static YUVFrame* vcodec_create_frame(const VCodecParams* params)
+{
+    YUVFrame* frame = NULL;
+
+    if (init_yuv_frame(&frame, params->format, params->width, params->height, 64) == NULL) {
+        return NULL;
+    }
+    frame->y.block_info = params->block_info;
+    frame->u.block_info = params->block_info;
+    frame->v.block_info = params->block_info;
+    return frame;
+}
+
+/*  function: vcodec_default_params()
+    Params:
+        VCodecParams* params : 要設定的參數
+        int width            : frame的width
+        int height           : frame的height
+        YUVFormat format     : frame的yuv format
+
+    Result:
+        和configs/enc_config.txt相同的預設值: 8x8 block、DCT_INT_FAST、FUSED pipeline、quality 50、最佳化Huffman tables
+ */
+void vcodec_default_params(VCodecParams* params, int width, int height, YUVFormat format)
+{
+    memset(params, 0, sizeof(VCodecParams));
+    params->width = width;
+    params->height = height;
+    params->format = format;
+    params->block_info.b_size = BLOCK_8x8;
+    params->block_info.width = 8;
+    params->block_info.height = 8;
+    params->transform_type = DCT_INT_FAST;
+    params->pipeline_mode = PIPELINE_FUSED;
+    params->compression_type = JPEG_SEQUENTIAL;
+    params->entropy_type = HUFFMAN;
+    params->quant_type = JPEG_QUANT_STANDARD;
+    params->qp = 28;
+    params->quality = JPEG_QUALITY_DEFAULT;
+    params->entropy_config.huffman_optimize = 1;
+    params->entropy_config.restart_interval = 0;
+    params->entropy_config.threads = 1;
+    params->entropy_config.segment_index = 0;
+    params->entropy_config.scan_mode = SCAN_INTERLEAVED;
+    params->simd_level = SIMD_AUTO;
+}
+
+/*  function: vcodec_encoder_create()
+    Params:
+        const VCodecParams* params : 編碼設定
+
+    Return:
+        NULL : 參數錯誤、記憶體配置失敗或entropy設定和正在使用的contexts不同
+        VCodecEncoder* : encoder context
+
+    Result:
+        配置一張frame、bitstream pool (一張raw frame的大小) 和entropy workspace，量化表和參數在這裡準備好
+ */
+VCodecEncoder* vcodec_encoder_create(const VCodecParams* params)
+{
+    if (params->width <= 0 || params->height <= 0) {
+        fprintf(stderr, "Invalid frame size: %dx%d\n", params->width, params->height);
+        return NULL;
+    }
+
+    VCodecEncoder* encoder = (VCodecEncoder*)calloc(1, sizeof(VCodecEncoder));
+    if (encoder == NULL) {
+        perror("Allocate VCodecEncoder failed");
+        return NULL;
+    }
+    encoder->params = *params;
+
+    encoder->frame = vcodec_create_frame(params);
+    if (encoder->frame == NULL) {
+        free(encoder);
+        return NULL;
+    }
+    encoder->frame_raw[0] = encoder->frame->y.raw_data;
+    encoder->frame_raw[1] = encoder->frame->u.raw_data;
+    encoder->frame_raw[2] = encoder->frame->v.raw_data;
+
+    encoder->pool_capacity = (size_t)encoder->frame->y.width * encoder->frame->y.height +
+                             (size_t)encoder->frame->u.width * encoder->frame->u.height +
+                             (size_t)encoder->frame->v.width * encoder->frame->v.height + 4096;
+    encoder->pool = (uint8_t*)malloc(encoder->pool_capacity);
+    encoder->workspace = entropy_workspace_create(params->entropy_type);
+    if (encoder->pool == NULL || encoder->workspace == NULL) {
+        perror("Allocate bitstream pool failed");
+    }
+    if (encoder->pool == NULL || encoder->workspace == NULL || vcodec_runtime_acquire(params, 1) != 0) {
+        entropy_workspace_destroy(params->entropy_type, encoder->workspace);
+        free(encoder->pool);
+        free_yuv_frame(encoder->frame);
+        free(encoder);
+        return NULL;
+    }
+
+    quant_params_init(&encoder->quant_params, params->quant_type, params->qp, params->quality);
+    quantize_prepare(&encoder->quant_params);
+    return encoder;
+}
+
+/*  function: vcodec_encode_to()
+    Params:
+        VCodecEncoder* encoder : encoder context (frame的raw data已經設定好)
+        uint8_t* buffer        : 寫入bitstream的buffer
+        size_t capacity        : buffer的bytes
+
+    Return:
+        >= 0 : bitstream的bytes
+        -1   : fmemopen失敗或編碼失敗 (記憶體配置失敗)
+        -2   : buffer不夠
+
+    Result:
+        用fmemopen把buffer當成FILE*，和寫到檔案的bitstream完全相同
+        寫到buffer最後一個byte也當作不夠 (無法和被截斷區分)
+ */
+static long vcodec_encode_to(VCodecEncoder* encoder, uint8_t* buffer, size_t capacity)
+{
+    const VCodecParams* params = &encoder->params;
+
+    FILE* bs_fp = fmemopen(buffer, capacity, "wb");
+    if (bs_fp == NULL) {
+        perror("Failed to open bitstream buffer");
+        return -1;
+    }
+    setvbuf(bs_fp, NULL, _IONBF, 0);
+
+    int ret = encode_frame(encoder->frame, params->pipeline_mode, params->transform_type, &encoder->quant_params,
+                           params->compression_type, params->entropy_type, bs_fp, encoder->workspace);
+
+    long size = ftell(bs_fp);
+    int error = ferror(bs_fp);
+    fclose(bs_fp);
+    if (ret != 0) {
+        return -1;
+    }
+    if (error || size < 0 || (size_t)size >= capacity) {
+        return -2;
+    }
+    return size;
+}
+
+/*  function: vcodec_restore_planes()
+    Params:
+        VCodecEncoder* encoder : encoder context
+
+    Result:
+        frame的raw data指回frame自己配置的記憶體 (不再參考呼叫者的planes)
+ */
+static void vcodec_restore_planes(VCodecEncoder* encoder)
+{
+    encoder->frame->y.raw_data = encoder->frame_raw[0];
+    encoder->frame->u.raw_data = encoder->frame_raw[1];
+    encoder->frame->v.raw_data = encoder->frame_raw[2];
+}
+
+/*  function: vcodec_set_planes()
+    Params:
+        VCodecEncoder* encoder         : encoder context
+        const uint8_t* const planes[3] : y/u/v planes
+        const int strides[3]           : 每個plane一行的bytes (不小於plane的width)
+
+    Return:
+        0 : 成功
+        -1: plane是NULL或stride小於width
+
+    Result:
+        stride和width相同的plane直接使用 (不複製)，否則逐行複製到frame裡；編碼完呼叫vcodec_restore_planes()
+ */
+static int vcodec_set_planes(VCodecEncoder* encoder, const uint8_t* const planes[3], const int strides[3])
+{
+    Component* comps[3] = {&encoder->frame->y, &encoder->frame->u, &encoder->frame->v};
+
+    for (int c = 0; c < 3; c++) {
+        if (planes[c] == NULL || strides[c] < comps[c]->width) {
+            fprintf(stderr, "Invalid plane %d\n", c);
+            vcodec_restore_planes(encoder);
+            return -1;
+        }
+        if (strides[c] == comps[c]->width) {
+            comps[c]->raw_data = (uint8_t*)planes[c];  // encoder只會讀取raw data
+        } else {
+            comps[c]->raw_data = encoder->frame_raw[c];
+            for (int row = 0; row < comps[c]->height; row++) {
+                memcpy(comps[c]->raw_data + (size_t)row * comps[c]->width, planes[c] + (size_t)row * strides[c], comps[c]->width);
+            }
+        }
+    }
+    return 0;
+}
+
+/*  function: vcodec_encode_frame()
+    Params:
+        VCodecEncoder* encoder         : encoder context
+        const uint8_t* const planes[3] : y/u/v planes
+        const int strides[3]           : 每個plane一行的bytes (不小於plane的width)
+        uint8_t* out                   : 呼叫者提供的output buffer，NULL時使用encoder的pool
+        size_t out_capacity            : out的bytes
+        const uint8_t** bitstream      : 回傳bitstream的位置 (out或pool，pool在下一次編碼前有效)
+        size_t* bitstream_size         : 回傳bitstream的bytes
+
+    Return:
+        VCODEC_OK               : 成功
+        VCODEC_ERROR            : 參數錯誤、buffer開啟失敗或編碼失敗 (記憶體配置失敗)
+        VCODEC_BUFFER_TOO_SMALL : out不夠，bitstream_size是需要的bytes，bitstream指向pool裡的完整bitstream
+
+    Result:
+        1. stride和width相同的plane直接使用 (不複製)，否則逐行複製到frame裡
+        2. bitstream直接寫到out或pool，pool不夠時變成2倍後重新編碼 (只有第一次會發生)
+ */
+int vcodec_encode_frame(VCodecEncoder* encoder, const uint8_t* const planes[3], const int strides[3],
+                        uint8_t* out, size_t out_capacity, const uint8_t** bitstream, size_t* bitstream_size)
+{
+    long size;
+    int in_out = 0;  // bitstream是否已經寫在out裡
+
+    if (vcodec_set_planes(encoder, planes, strides) != 0) {
+        return VCODEC_ERROR;
+    }
+
+    if (out != NULL) {
+        size = vcodec_encode_to(encoder, out, out_capacity);
+        in_out = (size >= 0);
+    } else {
+        size = -2;
+    }
+
+    /* 沒有提供buffer，或是提供的buffer不夠時，在pool裡編碼 (得到需要的bytes) */
+    while (size == -2) {
+        size = vcodec_encode_to(encoder, encoder->pool, encoder->pool_capacity);
+        if (size != -2) break;
+
+        uint8_t* pool = (uint8_t*)realloc(encoder->pool, encoder->pool_capacity * 2);
+        if (pool == NULL) {
+            perror("Allocate bitstream pool failed");
+            size = -1;
+            break;
+        }
+        encoder->pool = pool;
+        encoder->pool_capacity *= 2;
+    }
+
+    vcodec_restore_planes(encoder);
+    if (size < 0) {
+        return VCODEC_ERROR;
+    }
+
+    *bitstream_size = (size_t)size;
+    if (in_out) {
+        *bitstream = out;
+        return VCODEC_OK;
+    }
+    *bitstream = encoder->pool;
+    return (out != NULL) ? VCODEC_BUFFER_TOO_SMALL : VCODEC_OK;
+}
+
+/* vcodec_encode_frame_stream()的FILE*寫入時呼叫的callback和已經交給callback的bytes */
+typedef struct {
+    VCodecWriteCallback write;
+    void* arg;
+    size_t written;
+}VCodecStreamSink;
+
+/*  function: vcodec_stream_write()
+    Params:
+        void* cookie    : VCodecStreamSink*
+        const char* buf : FILE*要寫出的bytes
+        size_t size     : bytes個數
+
+    Return:
+        寫出的bytes個數，callback失敗時回傳-1 (FILE*的error)
+ */
+static ssize_t vcodec_stream_write(void* cookie, const char* buf, size_t size)
+{
+    VCodecStreamSink* sink = (VCodecStreamSink*)cookie;
+
+    if (sink->write(sink->arg, (const uint8_t*)buf, size) != 0) {
+        return -1;
+    }
+    sink->written += size;
+    return (ssize_t)size;
+}
+
+/*  function: vcodec_encode_frame_stream()
+    Params:
+        VCodecEncoder* encoder         : encoder context
+        const uint8_t* const planes[3] : y/u/v planes
+        const int strides[3]           : 每個plane一行的bytes (不小於plane的width)
+        VCodecWriteCallback write      : 收到bitstream時呼叫，依照順序串起來就是完整的bitstream
+        void* arg                      : 傳給write的參數
+        size_t* bitstream_size         : 回傳bitstream的bytes
+
+    Return:
+        VCODEC_OK    : 成功
+        VCODEC_ERROR : 參數錯誤、FILE*開啟失敗、編碼失敗或write回傳失敗 (write可能已經收到一部分bitstream)
+
+    Result:
+        用fopencookie把write包成FILE*，bitstream不經過output buffer或pool
+        PIPELINE_STRIPE每個Y block row編碼完就fflush，write在下一列開始編碼前就收到這一列的bitstream；
+        其他pipeline modes整張frame的Huffman coding完成後才寫出 (依照stdio buffer的大小分成幾次呼叫)
+ */
+int vcodec_encode_frame_stream(VCodecEncoder* encoder, const uint8_t* const planes[3], const int strides[3],
+                               VCodecWriteCallback write, void* arg, size_t* bitstream_size)
+{
+    const VCodecParams* params = &encoder->params;
+    VCodecStreamSink sink = {write, arg, 0};
+    cookie_io_functions_t io = {NULL, vcodec_stream_write, NULL, NULL};
+
+    if (write == NULL) {
+        return VCODEC_ERROR;
+    }
+    if (vcodec_set_planes(encoder, planes, strides) != 0) {
+        return VCODEC_ERROR;
+    }
+
+    FILE* bs_fp = fopencookie(&sink, "wb", io);
+    if (bs_fp == NULL) {
+        perror("Failed to open bitstream stream");
+        vcodec_restore_planes(encoder);
+        return VCODEC_ERROR;
+    }
+
+    int ret = encode_frame(encoder->frame, params->pipeline_mode, params->transform_type, &encoder->quant_params,
+                           params->compression_type, params->entropy_type, bs_fp, encoder->workspace);
+
+    int error = (ret != 0) || (fflush(bs_fp) != 0) || ferror(bs_fp);
+    fclose(bs_fp);
+    vcodec_restore_planes(encoder);
+    if (error) {
+        return VCODEC_ERROR;
+    }
+
+    *bitstream_size = sink.written;
+    return VCODEC_OK;
+}
+
+/*  function: vcodec_encoder_destroy()
+    Params:
+        VCodecEncoder* encoder : encoder context
+
+    Result:
+        釋放frame、pool和entropy workspace，最後一個context時釋放entropy coding的資源
+ */
+void vcodec_encoder_destroy(VCodecEncoder* encoder)
+{
+    if (encoder == NULL) return;
+
+    entropy_workspace_destroy(encoder->params.entropy_type, encoder->workspace);
+    free_yuv_frame(encoder->frame);
+    free(encoder->pool);
+    free(encoder);
+    vcodec_runtime_release(1);
+}
+
+/*  function: vcodec_decoder_create()
+    Params:
+        const VCodecParams* params : frame大小、format、block、transform和壓縮方式 (和encoder相同)
+
+    Return:
+        NULL : 參數錯誤、記憶體配置失敗或entropy type/threads和正在使用的contexts不同
+        VCodecDecoder* : decoder context
+ */
+VCodecDecoder* vcodec_decoder_create(const VCodecParams* params)
+{
+    if (params->width <= 0 || params->height <= 0) {
+        fprintf(stderr, "Invalid frame size: %dx%d\n", params->width, params->height);
+        return NULL;
+    }
+
+    VCodecDecoder* decoder = (VCodecDecoder*)calloc(1, sizeof(VCodecDecoder));
+    if (decoder == NULL) {
+        perror("Allocate VCodecDecoder failed");
+        return NULL;
+    }
+    decoder->params = *params;
+
+    decoder->frame = vcodec_create_frame(params);
+    if (decoder->frame == NULL) {
+        free(decoder);
+        return NULL;
+    }
+    decoder->workspace = entropy_workspace_create(params->entropy_type);
+    if (decoder->workspace == NULL) {
+        free_yuv_frame(decoder->frame);
+        free(decoder);
+        return NULL;
+    }
+
+    if (vcodec_runtime_acquire(params, 0) != 0) {
+        entropy_workspace_destroy(params->entropy_type, decoder->workspace);
+        free_yuv_frame(decoder->frame);
+        free(decoder);
+        return NULL;
+    }
+
+    /* QP和量化表會在entropy decoding時從header取得 */
+    decoder->quant_params.quant_type = params->quant_type;
+    return decoder;
+}
+
+/*  function: vcodec_decode_frame()
+    Params:
+        VCodecDecoder* decoder   : decoder context
+        const uint8_t* data      : 一張frame的bitstream
+        size_t size              : bitstream的bytes
+        uint8_t* const planes[3] : 存放解碼結果的y/u/v planes
+        const int strides[3]     : 每個plane一行的bytes (不小於plane的width)
+
+    Return:
+        VCODEC_OK    : 成功
+        VCODEC_ERROR : 參數錯誤、bitstream無法讀取或解碼失敗 (header和decoder設定不同、bitstream損毀)
+
+    Result:
+        用fmemopen直接讀取memory裡的bitstream，解碼成功後才逐行複製到呼叫者的planes
+ */
+int vcodec_decode_frame(VCodecDecoder* decoder, const uint8_t* data, size_t size, uint8_t* const planes[3], const int strides[3])
+{
+    const VCodecParams* params = &decoder->params;
+    Component* comps[3] = {&decoder->frame->y, &decoder->frame->u, &decoder->frame->v};
+
+    for (int c = 0; c < 3; c++) {
+        if (planes[c] == NULL || strides[c] < comps[c]->width) {
+            fprintf(stderr, "Invalid plane %d\n", c);
+            return VCODEC_ERROR;
+        }
+    }
+    if (data == NULL || size == 0) {
+        return VCODEC_ERROR;
+    }
+
+    FILE* bs_fp = fmemopen((void*)data, size, "rb");
+    if (bs_fp == NULL) {
+        perror("Failed to open bitstream buffer");
+        return VCODEC_ERROR;
+    }
+
+    int ret = decode_frame(decoder->frame, params->pipeline_mode, params->transform_type, &decoder->quant_params,
+                           params->compression_type, params->entropy_type, bs_fp, decoder->workspace);
+    fclose(bs_fp);
+    if (ret != 0) {
+        return VCODEC_ERROR;  // planes保持呼叫前的內容
+    }
+
+    for (int c = 0; c < 3; c++) {
+        for (int row = 0; row < comps[c]->height; row++) {
+            memcpy(planes[c] + (size_t)row * strides[c], comps[c]->raw_data + (size_t)row * comps[c]->width, comps[c]->width);
+        }
+    }
+    return VCODEC_OK;
+}
+
+/*  function: vcodec_decoder_destroy()
+    Params:
+        VCodecDecoder* decoder : decoder context
+
+    Result:
+        釋放frame和entropy workspace，最後一個context時釋放entropy coding的資源
+ */
+void vcodec_decoder_destroy(VCodecDecoder* decoder)
+{
+    if (decoder == NULL) return;
+
+    entropy_workspace_destroy(decoder->params.entropy_type, decoder->workspace);
+    free_yuv_frame(decoder->frame);
+    free(decoder);
+    vcodec_runtime_release(0);
+}
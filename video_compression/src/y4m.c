@@ -0,0 +1,213 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include"y4m.h"
+
+
+/*  function: y4m_read_line()
+    Params:
+        FILE* fp   : 輸入的串流
+        char* line : 存放一行文字 (不包含'\n')
+        int size   : line的大小
+
+    Return:
+        1 : 讀到一行
+        0 : 一開始就是EOF
+        -1: 這一行太長或沒有'\n'
+ */
+static int y4m_read_line(FILE* fp, char* line, int size)
+{
+    int len = 0;
+    int c;
+
+    while ((c = fgetc(fp)) != EOF) {
+        if (c == '\n') {
+            line[len] = '\0';
+            return 1;
+        }
+        if (len == size - 1) {
+            return -1;
+        }
+        line[len++] = (char)c;
+    }
+    return (len == 0) ? 0 : -1;
+}
+
+/*  function: y4m_plane_info()
+    Params:
+        const Y4MInfo* info : frame大小和format
+        int widths[3]       : 回傳y/u/v plane的width
+        int heights[3]      : 回傳y/u/v plane的height
+
+    Result:
+        和set_yuv_frame_info()相同的u/v大小
+ */
+void y4m_plane_info(const Y4MInfo* info, int widths[3], int heights[3])
+{
+    widths[0] = info->width;
+    heights[0] = info->height;
+    for (int c = 1; c < 3; c++) {
+        widths[c] = (info->format == YUV444) ? info->width : info->width / 2;
+        heights[c] = (info->format == YUV420) ? info->height / 2 : info->height;
+    }
+}
+
+/*  function: y4m_read_header()
+    Params:
+        FILE* fp      : 輸入的串流 (例如stdin)
+        Y4MInfo* info : 回傳header裡的frame大小、format和frame rate
+
+    Return:
+        0 : 成功
+        -1: 不是YUV4MPEG2 header，或是不支援的色彩格式
+
+    Result:
+        W/H/F/C以外的參數 (interlace、aspect ratio、X) 都忽略
+        u/v有subsampling時width/height必須是偶數
+ */
+int y4m_read_header(FILE* fp, Y4MInfo* info)
+{
+    char line[Y4M_MAX_LINE];
+
+    if (y4m_read_line(fp, line, sizeof(line)) != 1 || strncmp(line, "YUV4MPEG2", 9) != 0) {
+        fprintf(stderr, "Invalid Y4M header\n");
+        return -1;
+    }
+
+    info->width = 0;
+    info->height = 0;
+    info->format = YUV420;
+    info->fps_num = 30;
+    info->fps_den = 1;
+
+    for (char* token = strtok(line + 9, " "); token != NULL; token = strtok(NULL, " ")) {
+        switch (token[0]) {
+        case 'W':
+            info->width = atoi(token + 1);
+            break;
+        case 'H':
+            info->height = atoi(token + 1);
+            break;
+        case 'F':
+            if (sscanf(token + 1, "%d:%d", &info->fps_num, &info->fps_den) != 2 || info->fps_num <= 0 || info->fps_den <= 0) {
+                info->fps_num = 30;
+                info->fps_den = 1;
+            }
+            break;
+        case 'C':
+            if (strcmp(token, "C420jpeg") == 0 || strcmp(token, "C420paldv") == 0 ||
+                strcmp(token, "C420mpeg2") == 0 || strcmp(token, "C420") == 0) {
+                info->format = YUV420;
+            } else if (strcmp(token, "C422") == 0) {
+                info->format = YUV422;
+            } else if (strcmp(token, "C444") == 0) {
+                info->format = YUV444;
+            } else {
+                fprintf(stderr, "Unsupported Y4M colorspace: %s\n", token + 1);
+                return -1;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (info->width <= 0 || info->height <= 0 || info->width > 0xffff || info->height > 0xffff ||
+        (info->format != YUV444 && info->width % 2 != 0) || (info->format == YUV420 && info->height % 2 != 0)) {
+        fprintf(stderr, "Unsupported Y4M frame size: %dx%d\n", info->width, info->height);
+        return -1;
+    }
+    return 0;
+}
+
+/*  function: y4m_read_frame()
+    Params:
+        FILE* fp                 : 輸入的串流
+        const Y4MInfo* info      : y4m_read_header()得到的資訊
+        uint8_t* const planes[3] : 存放y/u/v data (每個plane的stride就是width)
+
+    Return:
+        1 : 讀到一張frame
+        0 : 串流結束
+        -1: FRAME行錯誤或frame不完整
+ */
+int y4m_read_frame(FILE* fp, const Y4MInfo* info, uint8_t* const planes[3])
+{
+    char line[Y4M_MAX_LINE];
+    int widths[3], heights[3];
+
+    int ret = y4m_read_line(fp, line, sizeof(line));
+    if (ret == 0) {
+        return 0;
+    }
+    if (ret < 0 || strncmp(line, "FRAME", 5) != 0) {
+        fprintf(stderr, "Invalid Y4M frame header\n");
+        return -1;
+    }
+
+    y4m_plane_info(info, widths, heights);
+    for (int c = 0; c < 3; c++) {
+        size_t plane_size = (size_t)widths[c] * heights[c];
+        if (fread(planes[c], 1, plane_size, fp) != plane_size) {
+            fprintf(stderr, "Truncated Y4M frame\n");
+            return -1;
+        }
+    }
+    return 1;
+}
+
+/*  function: y4m_write_header()
+    Params:
+        FILE* fp            : 輸出的串流 (例如stdout)
+        const Y4MInfo* info : frame大小、format和frame rate
+
+    Return:
+        0 : 成功
+        -1: 寫入失敗
+ */
+int y4m_write_header(FILE* fp, const Y4MInfo* info)
+{
+    const char* colorspace = (info->format == YUV444) ? "444" : (info->format == YUV422) ? "422" : "420jpeg";
+
+    if (fprintf(fp, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C%s\n", info->width, info->height, info->fps_num, info->fps_den, colorspace) < 0) {
+        perror("Write Y4M header failed");
+        return -1;
+    }
+    return 0;
+}
+
+/*  function: y4m_write_frame()
+    Params:
+        FILE* fp                       : 輸出的串流
+        const Y4MInfo* info            : frame大小和format
+        const uint8_t* const planes[3] : y/u/v data (每個plane的stride就是width)
+
+    Return:
+        0 : 成功
+        -1: 寫入失敗
+
+    Result:
+        寫完就flush，下游可以馬上讀到這張frame
+ */
+int y4m_write_frame(FILE* fp, const Y4MInfo* info, const uint8_t* const planes[3])
+{
+    int widths[3], heights[3];
+
+    y4m_plane_info(info, widths, heights);
+    if (fputs("FRAME\n", fp) == EOF) {
+        perror("Write Y4M frame failed");
+        return -1;
+    }
+    for (int c = 0; c < 3; c++) {
+        size_t plane_size = (size_t)widths[c] * heights[c];
+        if (fwrite(planes[c], 1, plane_size, fp) != plane_size) {
+            perror("Write Y4M frame failed");
+            return -1;
+        }
+    }
+    if (fflush(fp) != 0) {
+        perror("Write Y4M frame failed");
+        return -1;
+    }
+    return 0;
+}
@@ -337,49 +337,30 @@ void save_raw_frame_to_yuv_file(const char* file, YUVFrame* frame)
     fclose(fp);
 }
 
-void save_idct_frame_to_yuv_file(const char* file, YUVFrame* frame)
-{
-    FILE* fp = fopen(file, "wb");
-    if (fp == NULL) {
-        fprintf(stderr, "Failed to save %s YUV file\n", file);
-        return;
-    }
+/*  function: copy_padded_to_raw()
+    Params:
+        YUVFrame* frame : 做完IDCT和unshift的frame (padded data的值已經在[0,255])
 
-    size_t y_size = frame->y.width * frame->y.height;
-    size_t u_size = frame->u.width * frame->u.height;
-    size_t v_size = frame->v.width * frame->v.height;
-    uint8_t* y_buffer = (uint8_t*)malloc(sizeof(uint8_t) * y_size);
-    uint8_t* u_buffer = (uint8_t*)malloc(sizeof(uint8_t) * u_size);
-    uint8_t* v_buffer = (uint8_t*)malloc(sizeof(uint8_t) * v_size);
-
-    // 將padded data轉回uint8_t buffer
-    for (int row = 0; row < frame->y.height; row++) {
-        for (int col = 0; col < frame->y.width; col++) {
-            y_buffer[row * frame->y.width + col] = (uint8_t)(frame->y.padded_data[row * frame->y.padded_width + col]);
-        }
-    }
-    for (int row = 0; row < frame->u.height; row++) {
-        for (int col = 0; col < frame->u.width; col++) {
-            u_buffer[row * frame->u.width + col] = (uint8_t)(frame->u.padded_data[row * frame->u.padded_width + col]);
-        }
-    }
-    for (int row = 0; row < frame->v.height; row++) {
-        for (int col = 0; col < frame->v.width; col++) {
-            v_buffer[row * frame->v.width + col] = (uint8_t)(frame->v.padded_data[row * frame->v.padded_width + col]);
-        }
-    }
+    Return:
+        None
 
-    if (fwrite(y_buffer, 1, y_size, fp) != y_size ||
-        fwrite(u_buffer, 1, u_size, fp) != u_size ||
-        fwrite(v_buffer, 1, v_size, fp) != v_size) {
-        perror("Write YUV padded data failed");
+    Result:
+        將y/u/v padded data的有效範圍轉成uint8，放回raw data (重複使用，不需要配置新的buffer)
+ */
+void copy_padded_to_raw(YUVFrame* frame)
+{
+    Component* comps[3] = {&frame->y, &frame->u, &frame->v};
+
+    for (int c = 0; c < 3; c++) {
+        Component* comp = comps[c];
+        for (int row = 0; row < comp->height; row++) {
+            const int16_t* src = comp->padded_data + row * comp->padded_width;
+            uint8_t* dst = comp->raw_data + row * comp->width;
+            for (int col = 0; col < comp->width; col++) {
+                dst[col] = (uint8_t)src[col];
+            }
+        }
     }
-
-    free(y_buffer);
-    free(u_buffer);
-    free(v_buffer);
-
-    fclose(fp);
 }
 
 void free_yuv_frame(YUVFrame* frame)
@@ -0,0 +1,294 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include"yuv_source.h"
+
+
+/*  function: yuv_source_reader()
+    Params:
+        void* arg : YUVSource*
+
+    Result:
+        背景的reader thread，依序讀取每張frame:
+        1. 等frame使用的slot被release
+        2. 不需要lock就可以讀取到slot裡 (slot還沒有交給其他threads)
+        3. 讀取完成後通知等待這張frame的threads
+ */
+static void* yuv_source_reader(void* arg)
+{
+    YUVSource* source = (YUVSource*)arg;
+
+    for (int frame_idx = 0; frame_idx < source->total_frames; frame_idx++) {
+        int slot = frame_idx % source->slots_num;
+        int stop;
+
+        pthread_mutex_lock(&source->mutex);
+        while (source->slot_frame[slot] != -1 && !source->stop) {
+            pthread_cond_wait(&source->cond, &source->mutex);
+        }
+        stop = source->stop;
+        pthread_mutex_unlock(&source->mutex);
+        if (stop) break;
+
+        YUVFrame* frame = read_yuv_frame_data(source->fp, source->slots[slot], source->slots[slot]->format);
+
+        pthread_mutex_lock(&source->mutex);
+        if (frame == NULL) {
+            fprintf(stderr, "Failed to read yuv frame %d\n", frame_idx);
+            source->error = 1;
+        } else {
+            source->slot_frame[slot] = frame_idx;
+        }
+        pthread_cond_broadcast(&source->cond);
+        pthread_mutex_unlock(&source->mutex);
+        if (frame == NULL) break;
+    }
+    return NULL;
+}
+
+/*  function: yuv_source_open()
+    Params:
+        const char* file       : yuv raw data的路徑
+        int width              : yuv raw data的width
+        int height             : yuv raw data的height
+        YUVFormat format       : yuv raw data的yuv format
+        int truncate_yuv_frame : 1: 只讀取前truncate_yuv_index張frames
+        int truncate_yuv_index : 讀取的frames個數
+        int alignment          : 對y/u/v做padding的alignment
+        int frames_in_flight   : 同時使用中的frames個數 (例如frame pool的threads個數)
+        InputMode input_mode   : INPUT_READ: reader thread用fread讀取 INPUT_MMAP: mmap整個檔案
+
+    Return:
+        NULL : 讀取yuv檔案失敗 或是 配置給frame的記憶體失敗
+
+        YUVSource* :
+            開始在背景讀取frames的source，用yuv_source_get_frame()依照frame index取得frame
+
+    Result:
+        1. 取代read_yuv_file()一次讀取整個影片: 只配置frames_in_flight + YUV_SOURCE_READ_AHEAD張frames，
+           記憶體和影片長度無關，讀完第一張frame就可以開始編碼
+        2. frames依序讀取，呼叫端用完frame後需要yuv_source_release_frame()，slot才能讀取後面的frame
+        3. INPUT_MMAP: 檔案mmap成唯讀，加上MADV_SEQUENTIAL/MADV_WILLNEED，由kernel做read-ahead，
+           不需要raw data buffer和fread的複製；mmap失敗時改用INPUT_READ
+ */
+YUVSource* yuv_source_open(const char* file, int width, int height, YUVFormat format,
+                           int truncate_yuv_frame, int truncate_yuv_index, int alignment, int frames_in_flight, InputMode input_mode)
+{
+    size_t frame_size, y_size, u_size, v_size;
+    long video_file_size;
+    int total_frames;
+
+    FILE* fp = fopen(file, "rb");
+    if (!fp) {
+        fprintf(stderr, "Failed to open file: %s\n", file);
+        return NULL;
+    }
+
+    // 計算每張frame的資訊
+    get_yuv_size_info(format, width, height, &frame_size, &y_size, &u_size, &v_size);
+
+    // 取得frame數量
+    fseek(fp, 0, SEEK_END);
+    video_file_size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    total_frames = video_file_size / frame_size;
+    printf("Total frames: %d   frame size: %zu bytes\n", total_frames, frame_size);
+    if (truncate_yuv_frame) {
+        printf("Truncated frame index: %d\n", truncate_yuv_index);
+        if (truncate_yuv_index < total_frames) total_frames = truncate_yuv_index;
+    }
+
+    YUVSource* source = (YUVSource*)calloc(1, sizeof(YUVSource));
+    if (source == NULL) {
+        perror("Allocate YUVSource failed");
+        fclose(fp);
+        return NULL;
+    }
+    source->fp = fp;
+    source->total_frames = total_frames;
+    source->frame_size = frame_size;
+    source->y_size = y_size;
+    source->u_size = u_size;
+    source->input_mode = input_mode;
+
+    if (input_mode == INPUT_MMAP) {
+        source->map_size = frame_size * total_frames;
+        source->map = (source->map_size > 0) ? (uint8_t*)mmap(NULL, source->map_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0) : MAP_FAILED;
+        if (source->map == MAP_FAILED) {
+            perror("mmap yuv file failed, use fread");
+            source->map = NULL;
+            source->input_mode = INPUT_READ;
+        } else {
+            madvise(source->map, source->map_size, MADV_SEQUENTIAL);
+            madvise(source->map, frame_size, MADV_WILLNEED);
+        }
+    }
+    source->slots_num = ((frames_in_flight > 1) ? frames_in_flight : 1) + YUV_SOURCE_READ_AHEAD;
+    source->slots = (YUVFrame**)calloc(source->slots_num, sizeof(YUVFrame*));
+    source->slot_frame = (int*)malloc(sizeof(int) * source->slots_num);
+    if (source->slots == NULL || source->slot_frame == NULL) {
+        perror("Allocate YUVSource slots failed");
+        free(source->slots);
+        free(source->slot_frame);
+        free(source);
+        fclose(fp);
+        return NULL;
+    }
+
+    /* ring裡的frames一開始就配置好，之後重複使用 (shift_128會完整覆寫padded data) */
+    for (int i = 0; i < source->slots_num; i++) {
+        source->slot_frame[i] = -1;
+        if (init_yuv_frame(&source->slots[i], format, width, height, alignment) == NULL) {
+            for (int j = 0; j < i; j++) {
+                free_yuv_frame(source->slots[j]);
+            }
+            if (source->map != NULL) munmap(source->map, source->map_size);
+            free(source->slots);
+            free(source->slot_frame);
+            free(source);
+            fclose(fp);
+            return NULL;
+        }
+        /* INPUT_MMAP: raw data會指到mapping，不需要自己的buffer */
+        if (source->input_mode == INPUT_MMAP) {
+            free(source->slots[i]->y.raw_data);
+            free(source->slots[i]->u.raw_data);
+            free(source->slots[i]->v.raw_data);
+            source->slots[i]->y.raw_data = NULL;
+            source->slots[i]->u.raw_data = NULL;
+            source->slots[i]->v.raw_data = NULL;
+        }
+    }
+
+    pthread_mutex_init(&source->mutex, NULL);
+    pthread_cond_init(&source->cond, NULL);
+    if (source->input_mode == INPUT_READ) {
+        if (pthread_create(&source->reader, NULL, yuv_source_reader, source) != 0) {
+            perror("Failed to create yuv reader thread");
+            yuv_source_close(source);
+            return NULL;
+        }
+        source->reader_started = 1;
+    }
+    return source;
+}
+
+/*  function: yuv_source_get_frame()
+    Params:
+        YUVSource* source : yuv_source_open()建立的source
+        int frame_idx     : 第幾張frame
+
+    Return:
+        NULL : 讀取失敗
+        YUVFrame* : 讀取完成的frame (等到reader thread讀完才會回傳)
+
+    Result:
+        frames_in_flight個threads可以同時拿不同的frames，但是拿的順序要和frame index相同
+        (frame pool依序分配frames，符合這個條件)
+        INPUT_MMAP: 等slot被release後，將slot的raw data指到mapping裡的frame，並對後面的frames做MADV_WILLNEED
+ */
+YUVFrame* yuv_source_get_frame(YUVSource* source, int frame_idx)
+{
+    int slot = frame_idx % source->slots_num;
+    YUVFrame* frame = NULL;
+
+    if (frame_idx < 0 || frame_idx >= source->total_frames) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&source->mutex);
+    if (source->input_mode == INPUT_MMAP) {
+        while (source->slot_frame[slot] != -1) {
+            pthread_cond_wait(&source->cond, &source->mutex);
+        }
+        frame = source->slots[slot];
+        frame->y.raw_data = source->map + source->frame_size * frame_idx;
+        frame->u.raw_data = frame->y.raw_data + source->y_size;
+        frame->v.raw_data = frame->u.raw_data + source->u_size;
+        source->slot_frame[slot] = frame_idx;
+        pthread_mutex_unlock(&source->mutex);
+
+        /* 讓kernel預先讀取後面的frames (madvise的起始位置要align到page) */
+        if (frame_idx + 1 < source->total_frames) {
+            int ahead = source->total_frames - (frame_idx + 1);
+            size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+            size_t start, end;
+
+            if (ahead > YUV_SOURCE_READ_AHEAD) ahead = YUV_SOURCE_READ_AHEAD;
+            start = source->frame_size * (frame_idx + 1);
+            end = start + source->frame_size * ahead;
+            start &= ~(page_size - 1);
+            madvise(source->map + start, end - start, MADV_WILLNEED);
+        }
+        return frame;
+    }
+
+    while (source->slot_frame[slot] != frame_idx && !source->error) {
+        pthread_cond_wait(&source->cond, &source->mutex);
+    }
+    if (source->slot_frame[slot] == frame_idx) {
+        frame = source->slots[slot];
+    }
+    pthread_mutex_unlock(&source->mutex);
+    return frame;
+}
+
+/*  function: yuv_source_release_frame()
+    Params:
+        YUVSource* source : yuv_source_open()建立的source
+        int frame_idx     : 已經用完的frame
+
+    Result:
+        frame的slot可以讓reader thread讀取後面的frame
+ */
+void yuv_source_release_frame(YUVSource* source, int frame_idx)
+{
+    int slot = frame_idx % source->slots_num;
+
+    pthread_mutex_lock(&source->mutex);
+    if (source->slot_frame[slot] == frame_idx) {
+        source->slot_frame[slot] = -1;
+        pthread_cond_broadcast(&source->cond);
+    }
+    pthread_mutex_unlock(&source->mutex);
+}
+
+/*  function: yuv_source_close()
+    Params:
+        YUVSource* source : yuv_source_open()建立的source
+
+    Result:
+        結束reader thread，釋放ring裡的frames和檔案
+ */
+void yuv_source_close(YUVSource* source)
+{
+    if (source == NULL) return;
+
+    pthread_mutex_lock(&source->mutex);
+    source->stop = 1;
+    pthread_cond_broadcast(&source->cond);
+    pthread_mutex_unlock(&source->mutex);
+    if (source->reader_started) {
+        pthread_join(source->reader, NULL);
+    }
+
+    for (int i = 0; i < source->slots_num; i++) {
+        /* INPUT_MMAP: raw data指到mapping，不能free */
+        if (source->input_mode == INPUT_MMAP) {
+            source->slots[i]->y.raw_data = NULL;
+            source->slots[i]->u.raw_data = NULL;
+            source->slots[i]->v.raw_data = NULL;
+        }
+        free_yuv_frame(source->slots[i]);
+    }
+    if (source->map != NULL) {
+        munmap(source->map, source->map_size);
+    }
+    pthread_mutex_destroy(&source->mutex);
+    pthread_cond_destroy(&source->cond);
+    free(source->slots);
+    free(source->slot_frame);
+    fclose(source->fp);
+    free(source);
+}
@@ -0,0 +1,373 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<math.h>
+#include"vcodec.h"
+#include"entropy/algorithms/huffman.h"
+#include"quantization/h264/quant_h264.h"
+
+/* libvcodec的round-trip測試，以及損毀bitstream/錯誤參數的error paths
+ *   執行: make test (失敗時印出檔案/行數，回傳非0)
+ */
+
+/* YUV420的chroma padded width也是64的倍數: width不是128的倍數時，chroma blocks和MCU的對應不一致
+ * (目前的限制，最後一列chroma blocks不會被編碼)，測試使用可以正確編碼的大小 */
+#define TEST_WIDTH   128
+#define TEST_HEIGHT  64
+
+/* bitstream header的位置 (見jpeg_encode_header())
+ *   w(2) h(2) format(1) y/u/v block info(9) quant type(1) QP(1)
+ *   JPEG_QUANT_STANDARD: Y/UV量化表(各64)，接著compression type(1) entropy type(1) Huffman最佳化flag(1)
+ *   最佳化時接著Y DC table的bits(16)
+ */
+#define HEADER_QP_OFFSET             15
+#define HEADER_QUANT_TABLE_OFFSET    16
+#define HEADER_HUFFMAN_FLAG_OFFSET   (HEADER_QUANT_TABLE_OFFSET + 128 + 2)
+#define HEADER_HUFFMAN_BITS_OFFSET   (HEADER_HUFFMAN_FLAG_OFFSET + 1)
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "[FAIL] %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+/* 一張YUV420的測試frame和解碼用的planes */
+typedef struct {
+    uint8_t y[TEST_WIDTH * TEST_HEIGHT];
+    uint8_t u[(TEST_WIDTH / 2) * (TEST_HEIGHT / 2)];
+    uint8_t v[(TEST_WIDTH / 2) * (TEST_HEIGHT / 2)];
+    const uint8_t* planes[3];
+    uint8_t* out_planes[3];
+    int strides[3];
+}TestFrame;
+
+/*  function: test_frame_init()
+    Params:
+        TestFrame* frame : 要設定的frame
+        int noise        : 0: 平滑的漸層加上一些texture 1: 高頻的pattern (係數多，encoder會使用最佳化的Huffman tables)
+ */
+static void test_frame_init(TestFrame* frame, int noise)
+{
+    for (int row = 0; row < TEST_HEIGHT; row++) {
+        for (int col = 0; col < TEST_WIDTH; col++) {
+            int i = row * TEST_WIDTH + col;
+            frame->y[i] = noise ? (uint8_t)(i * 7) : (uint8_t)(row * 3 + col * 2 + ((row / 8 + col / 8) % 2) * 16);
+        }
+    }
+    for (int row = 0; row < TEST_HEIGHT / 2; row++) {
+        for (int col = 0; col < TEST_WIDTH / 2; col++) {
+            frame->u[row * (TEST_WIDTH / 2) + col] = (uint8_t)(96 + col + row);
+            frame->v[row * (TEST_WIDTH / 2) + col] = (uint8_t)(160 - col - row / 2);
+        }
+    }
+    frame->planes[0] = frame->y;
+    frame->planes[1] = frame->u;
+    frame->planes[2] = frame->v;
+    frame->strides[0] = TEST_WIDTH;
+    frame->strides[1] = TEST_WIDTH / 2;
+    frame->strides[2] = TEST_WIDTH / 2;
+}
+
+static double test_psnr(const uint8_t* a, const uint8_t* b, int size)
+{
+    double mse = 0.0;
+
+    for (int i = 0; i < size; i++) {
+        mse += (double)(a[i] - b[i]) * (a[i] - b[i]);
+    }
+    mse /= size;
+    return (mse == 0.0) ? 99.0 : 10.0 * log10(255.0 * 255.0 / mse);
+}
+
+/*  function: test_encode()
+    Params:
+        const VCodecParams* params : 編碼設定
+        const TestFrame* frame     : 輸入的frame
+        size_t* size               : 回傳bitstream的bytes
+
+    Return:
+        NULL : 編碼失敗
+        uint8_t* : 複製出來的bitstream (由呼叫者free，可以任意修改)
+ */
+static uint8_t* test_encode(const VCodecParams* params, const TestFrame* frame, size_t* size)
+{
+    const uint8_t* bitstream;
+    uint8_t* copy = NULL;
+
+    VCodecEncoder* encoder = vcodec_encoder_create(params);
+    if (encoder == NULL) return NULL;
+
+    if (vcodec_encode_frame(encoder, frame->planes, frame->strides, NULL, 0, &bitstream, size) == VCODEC_OK) {
+        copy = (uint8_t*)malloc(*size);
+        if (copy != NULL) memcpy(copy, bitstream, *size);
+    }
+    vcodec_encoder_destroy(encoder);
+    return copy;
+}
+
+/*  function: test_decode()
+    Params:
+        const VCodecParams* params : 解碼設定
+        const uint8_t* data        : bitstream
+        size_t size                : bitstream的bytes
+        TestFrame* out             : 解碼結果 (y/u/v)
+
+    Return:
+        vcodec_decode_frame()的回傳值，decoder建立失敗時是VCODEC_ERROR
+ */
+static int test_decode(const VCodecParams* params, const uint8_t* data, size_t size, TestFrame* out)
+{
+    out->out_planes[0] = out->y;
+    out->out_planes[1] = out->u;
+    out->out_planes[2] = out->v;
+
+    VCodecDecoder* decoder = vcodec_decoder_create(params);
+    if (decoder == NULL) return VCODEC_ERROR;
+
+    int ret = vcodec_decode_frame(decoder, data, size, out->out_planes, out->strides);
+    vcodec_decoder_destroy(decoder);
+    return ret;
+}
+
+/* 修改bitstream的一個byte後解碼，回傳vcodec_decode_frame()的結果 */
+static int test_decode_corrupted(const VCodecParams* params, const TestFrame* frame, size_t offset, uint8_t value)
+{
+    TestFrame out;
+    size_t size;
+    int ret = VCODEC_ERROR;
+
+    test_frame_init(&out, 0);
+    uint8_t* bitstream = test_encode(params, frame, &size);
+    CHECK(bitstream != NULL && offset < size);
+    if (bitstream != NULL && offset < size) {
+        bitstream[offset] = value;
+        ret = test_decode(params, bitstream, size, &out);
+    }
+    free(bitstream);
+    return ret;
+}
+
+static void test_round_trip(const TestFrame* frame, QuantType quant_type, PipelineMode pipeline_mode)
+{
+    VCodecParams params;
+    TestFrame out;
+    size_t size;
+
+    vcodec_default_params(&params, TEST_WIDTH, TEST_HEIGHT, YUV420);
+    params.quant_type = quant_type;
+    params.pipeline_mode = pipeline_mode;
+    test_frame_init(&out, 0);
+    memset(out.y, 0, sizeof(out.y));
+
+    uint8_t* bitstream = test_encode(&params, frame, &size);
+    CHECK(bitstream != NULL);
+    if (bitstream == NULL) return;
+
+    CHECK(test_decode(&params, bitstream, size, &out) == VCODEC_OK);
+    CHECK(test_psnr(frame->y, out.y, sizeof(out.y)) > 30.0);
+    CHECK(test_psnr(frame->u, out.u, sizeof(out.u)) > 30.0);
+    CHECK(test_psnr(frame->v, out.v, sizeof(out.v)) > 30.0);
+    free(bitstream);
+}
+
+/* out不夠時回傳VCODEC_BUFFER_TOO_SMALL，bitstream指向pool裡完整的bitstream */
+static void test_buffer_too_small(const TestFrame* frame)
+{
+    VCodecParams params;
+    uint8_t small[16];
+    const uint8_t* bitstream;
+    size_t size = 0, expected_size;
+    TestFrame out;
+
+    vcodec_default_params(&params, TEST_WIDTH, TEST_HEIGHT, YUV420);
+    uint8_t* expected = test_encode(&params, frame, &expected_size);
+    CHECK(expected != NULL);
+
+    VCodecEncoder* encoder = vcodec_encoder_create(&params);
+    CHECK(encoder != NULL);
+    if (encoder == NULL || expected == NULL) {
+        free(expected);
+        return;
+    }
+    CHECK(vcodec_encode_frame(encoder, frame->planes, frame->strides, small, sizeof(small), &bitstream, &size) == VCODEC_BUFFER_TOO_SMALL);
+    CHECK(bitstream == encoder->pool);
+    CHECK(size == expected_size && memcmp(bitstream, expected, size) == 0);
+
+    test_frame_init(&out, 0);
+    CHECK(test_decode(&params, bitstream, size, &out) == VCODEC_OK);
+    vcodec_encoder_destroy(encoder);
+    free(expected);
+}
+
+static int test_write_fail(void* arg, const uint8_t* data, size_t size)
+{
+    (void)arg; (void)data; (void)size;
+    return -1;
+}
+
+/* write callback失敗時回傳VCODEC_ERROR，encoder之後還可以繼續使用 */
+static void test_stream_write_failure(const TestFrame* frame)
+{
+    VCodecParams params;
+    const uint8_t* bitstream;
+    size_t size;
+
+    vcodec_default_params(&params, TEST_WIDTH, TEST_HEIGHT, YUV420);
+    VCodecEncoder* encoder = vcodec_encoder_create(&params);
+    CHECK(encoder != NULL);
+    if (encoder == NULL) return;
+
+    CHECK(vcodec_encode_frame_stream(encoder, frame->planes, frame->strides, test_write_fail, NULL, &size) == VCODEC_ERROR);
+    CHECK(vcodec_encode_frame_stream(encoder, frame->planes, frame->strides, NULL, NULL, &size) == VCODEC_ERROR);
+    CHECK(vcodec_encode_frame(encoder, frame->planes, frame->strides, NULL, 0, &bitstream, &size) == VCODEC_OK);
+    vcodec_encoder_destroy(encoder);
+}
+
+/* 參數錯誤和entropy設定與正在使用的encoders不同時，建立context回傳NULL */
+static void test_invalid_params(void)
+{
+    VCodecParams params, other;
+
+    vcodec_default_params(&params, 0, TEST_HEIGHT, YUV420);
+    CHECK(vcodec_encoder_create(&params) == NULL);
+    CHECK(vcodec_decoder_create(&params) == NULL);
+
+    vcodec_default_params(&params, TEST_WIDTH, TEST_HEIGHT, YUV420);
+    other = params;
+    other.entropy_config.huffman_optimize = 0;
+
+    VCodecEncoder* encoder = vcodec_encoder_create(&params);
+    CHECK(encoder != NULL);
+    VCodecEncoder* mismatch = vcodec_encoder_create(&other);
+    CHECK(mismatch == NULL);
+    vcodec_encoder_destroy(mismatch);
+    vcodec_encoder_destroy(encoder);
+
+    /* 沒有其他encoder時可以使用不同的設定 */
+    encoder = vcodec_encoder_create(&other);
+    CHECK(encoder != NULL);
+    vcodec_encoder_destroy(encoder);
+}
+
+/* header損毀 (量化表step為0、QP超出範圍、Huffman table不合法) 時回傳VCODEC_ERROR，planes不變 */
+static void test_corrupt_header(const TestFrame* frame)
+{
+    VCodecParams params;
+
+    vcodec_default_params(&params, TEST_WIDTH, TEST_HEIGHT, YUV420);
+    CHECK(test_decode_corrupted(&params, frame, HEADER_QUANT_TABLE_OFFSET, 0) == VCODEC_ERROR);
+    CHECK(test_decode_corrupted(&params, frame, HEADER_QUANT_TABLE_OFFSET + 64 + 63, 0) == VCODEC_ERROR);
+
+    params.quant_type = H264_QUANT;
+    CHECK(test_decode_corrupted(&params, frame, HEADER_QP_OFFSET, H264_QP_MAX + 1) == VCODEC_ERROR);
+    CHECK(test_decode_corrupted(&params, frame, HEADER_QP_OFFSET, 255) == VCODEC_ERROR);
+    CHECK(test_decode_corrupted(&params, frame, HEADER_QP_OFFSET, H264_QP_MAX) == VCODEC_OK);
+
+    /* decoder設定和header不同 */
+    TestFrame out;
+    size_t size;
+    test_frame_init(&out, 0);
+    uint8_t* bitstream = test_encode(&params, frame, &size);
+    CHECK(bitstream != NULL);
+    if (bitstream != NULL) {
+        params.quant_type = JPEG_QUANT_STANDARD;
+        memset(out.y, 0x5a, sizeof(out.y));
+        CHECK(test_decode(&params, bitstream, size, &out) == VCODEC_ERROR);
+        CHECK(out.y[0] == 0x5a && out.y[sizeof(out.y) - 1] == 0x5a);
+        free(bitstream);
+    }
+}
+
+/* header裡最佳化的Huffman tables損毀 */
+static void test_corrupt_huffman_tables(const TestFrame* frame)
+{
+    VCodecParams params;
+    size_t size;
+
+    vcodec_default_params(&params, TEST_WIDTH, TEST_HEIGHT, YUV420);
+    uint8_t* bitstream = test_encode(&params, frame, &size);
+    CHECK(bitstream != NULL && bitstream[HEADER_HUFFMAN_FLAG_OFFSET] == 1);
+    free(bitstream);
+
+    /* 長度1有2個codewords: codeword "1"是全部是1的codeword */
+    CHECK(test_decode_corrupted(&params, frame, HEADER_HUFFMAN_BITS_OFFSET, 2) == VCODEC_ERROR);
+    CHECK(test_decode_corrupted(&params, frame, HEADER_HUFFMAN_FLAG_OFFSET, 2) == VCODEC_ERROR);
+}
+
+/* 截斷或不是bitstream的資料 */
+static void test_truncated_bitstream(const TestFrame* frame)
+{
+    VCodecParams params;
+    TestFrame out;
+    size_t size;
+    uint8_t junk[256];
+
+    vcodec_default_params(&params, TEST_WIDTH, TEST_HEIGHT, YUV420);
+    test_frame_init(&out, 0);
+    uint8_t* bitstream = test_encode(&params, frame, &size);
+    CHECK(bitstream != NULL);
+    if (bitstream != NULL) {
+        CHECK(test_decode(&params, bitstream, HEADER_QUANT_TABLE_OFFSET + 10, &out) == VCODEC_ERROR);
+        CHECK(test_decode(&params, bitstream, 0, &out) == VCODEC_ERROR);
+        CHECK(test_decode(&params, NULL, size, &out) == VCODEC_ERROR);
+        free(bitstream);
+    }
+
+    for (int i = 0; i < (int)sizeof(junk); i++) {
+        junk[i] = (uint8_t)(i * 37 + 11);
+    }
+    CHECK(test_decode(&params, junk, sizeof(junk), &out) == VCODEC_ERROR);
+}
+
+/* huffman_spec_is_valid(): codeword的空間剛好用完 (最後一個codeword全部是1) 時不合法 */
+static void test_huffman_spec(void)
+{
+    Huffman_Spec spec;
+
+    memset(&spec, 0, sizeof(spec));
+    for (int i = 0; i < HUFFMAN_MAX_CODE_LENGTH - 1; i++) {
+        spec.bits[i] = 1;
+    }
+    spec.bits[HUFFMAN_MAX_CODE_LENGTH - 1] = 2;
+    for (int i = 0; i < 17; i++) {
+        spec.hufval[i] = (uint8_t)i;
+    }
+    CHECK(huffman_spec_is_valid(&spec, 255) == 0);
+
+    spec.bits[HUFFMAN_MAX_CODE_LENGTH - 1] = 1;
+    CHECK(huffman_spec_is_valid(&spec, 255) == 1);
+    spec.hufval[0] = 16;
+    CHECK(huffman_spec_is_valid(&spec, 15) == 0);
+
+    memset(&spec, 0, sizeof(spec));
+    CHECK(huffman_spec_is_valid(&spec, 255) == 0);
+}
+
+int main(void)
+{
+    TestFrame frame, noise;
+
+    test_frame_init(&frame, 0);
+    test_frame_init(&noise, 1);
+
+    test_round_trip(&frame, JPEG_QUANT_STANDARD, PIPELINE_FUSED);
+    test_round_trip(&frame, JPEG_QUANT_STANDARD, PIPELINE_MULTI_PASS);
+    test_round_trip(&frame, H264_QUANT, PIPELINE_FUSED);
+    test_buffer_too_small(&frame);
+    test_stream_write_failure(&frame);
+    test_invalid_params();
+    test_corrupt_header(&frame);
+    test_corrupt_huffman_tables(&noise);
+    test_truncated_bitstream(&frame);
+    test_huffman_spec();
+
+    if (failures != 0) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All tests passed\n");
+    return 0;
+}